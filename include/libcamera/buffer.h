@@ -60,8 +60,9 @@ public:
 
 	int copyFrom(const FrameBuffer *src);
 private:
-	friend class Request; /* Needed to update request_. */
+	friend class Request; /* Needed to update request_ and metadata_. */
 	friend class V4L2VideoDevice; /* Needed to update metadata_. */
+	friend class PipelineHandler; /* Needed to update metadata_. */
 
 	std::vector<Plane> planes_;
 
@@ -98,6 +98,9 @@ public:
 	int start();
 	int stop();
 
+	int pause();
+	int resume();
+
 private:
 	Camera(PipelineHandler *pipe, const std::string &name,
 	       const std::set<Stream *> &streams);
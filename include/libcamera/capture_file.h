@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * capture_file.h - Raw capture container file
+ */
+#ifndef __LIBCAMERA_CAPTURE_FILE_H__
+#define __LIBCAMERA_CAPTURE_FILE_H__
+
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <libcamera/buffer.h>
+#include <libcamera/controls.h>
+#include <libcamera/geometry.h>
+#include <libcamera/pixelformats.h>
+#include <libcamera/span.h>
+#include <libcamera/stream.h>
+
+namespace libcamera {
+
+struct CaptureFileFrame {
+	unsigned int stream;
+	unsigned int sequence;
+	uint64_t timestamp;
+	PixelFormat pixelFormat;
+	Size size;
+	unsigned int stride;
+	std::vector<Span<const uint8_t>> planes;
+	Span<const uint8_t> metadata;
+};
+
+class CaptureFileReader
+{
+public:
+	CaptureFileReader();
+	~CaptureFileReader();
+
+	CaptureFileReader(const CaptureFileReader &) = delete;
+	CaptureFileReader &operator=(const CaptureFileReader &) = delete;
+
+	int open(const std::string &fileName);
+	void close();
+	bool isOpen() const;
+
+	const std::vector<CaptureFileFrame> &frames() const;
+	ControlList metadata(const CaptureFileFrame &frame);
+
+private:
+	class Private;
+	std::unique_ptr<Private> p_;
+};
+
+class CaptureFileWriter
+{
+public:
+	CaptureFileWriter();
+	~CaptureFileWriter();
+
+	CaptureFileWriter(const CaptureFileWriter &) = delete;
+	CaptureFileWriter &operator=(const CaptureFileWriter &) = delete;
+
+	int open(const std::string &fileName);
+	int close();
+	bool isOpen() const;
+
+	int write(unsigned int stream, const StreamConfiguration &config,
+		  const FrameMetadata &metadata,
+		  const std::vector<Span<const uint8_t>> &planes,
+		  const ControlList &controls);
+
+private:
+	class Private;
+	std::unique_ptr<Private> p_;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_CAPTURE_FILE_H__ */
@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * capture_file_format.h - Raw capture container file format
+ */
+#ifndef __LIBCAMERA_CAPTURE_FILE_FORMAT_H__
+#define __LIBCAMERA_CAPTURE_FILE_FORMAT_H__
+
+#include <stdint.h>
+
+namespace libcamera {
+
+#define CAPTURE_FILE_MAGIC		0x4643434c	/* "LCCF" */
+#define CAPTURE_FILE_FRAME_MAGIC	0x5246434c	/* "LCFR" */
+#define CAPTURE_FILE_VERSION		1
+#define CAPTURE_FILE_MAX_PLANES		4
+#define CAPTURE_FILE_ALIGN		4096
+
+struct capture_file_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t num_frames;
+	uint32_t reserved;
+	uint64_t index_offset;
+};
+
+struct capture_file_plane {
+	uint64_t offset;
+	uint32_t size;
+	uint32_t reserved;
+};
+
+struct capture_file_frame {
+	uint32_t magic;
+	uint32_t stream;
+	uint32_t sequence;
+	uint32_t num_planes;
+	uint64_t timestamp;
+	uint32_t pixel_format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t stride;
+	uint64_t modifier;
+	uint64_t metadata_offset;
+	uint32_t metadata_size;
+	uint32_t reserved;
+	struct capture_file_plane planes[CAPTURE_FILE_MAX_PLANES];
+	uint64_t next_offset;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_CAPTURE_FILE_FORMAT_H__ */
@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Raspberry Pi (Trading) Ltd.
+ *
+ * delayed_controls.h - Helper to deal with controls that take effect with a delay
+ */
+#ifndef __LIBCAMERA_DELAYED_CONTROLS_H__
+#define __LIBCAMERA_DELAYED_CONTROLS_H__
+
+#include <array>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include <libcamera/controls.h>
+
+namespace libcamera {
+
+class V4L2Device;
+
+class DelayedControls
+{
+public:
+	DelayedControls(V4L2Device *device,
+			const std::unordered_map<uint32_t, unsigned int> &delays);
+
+	void reset();
+
+	bool push(const ControlList &controls);
+	ControlList get(uint32_t sequence);
+
+	void applyControls(uint32_t sequence);
+
+private:
+	/* The ring size must be a power of 2. */
+	static constexpr unsigned int ringSize = 16;
+
+	class Info : public ControlValue
+	{
+	public:
+		Info()
+			: updated(false)
+		{
+		}
+
+		Info(const ControlValue &v)
+			: ControlValue(v), updated(true)
+		{
+		}
+
+		bool updated;
+	};
+
+	class ControlRingBuffer : public std::array<Info, ringSize>
+	{
+	public:
+		Info &operator[](unsigned int index)
+		{
+			return std::array<Info, ringSize>::operator[](index & (ringSize - 1));
+		}
+
+		const Info &operator[](unsigned int index) const
+		{
+			return std::array<Info, ringSize>::operator[](index & (ringSize - 1));
+		}
+	};
+
+	struct DelayedControl {
+		const ControlId *id;
+		unsigned int delay;
+		ControlRingBuffer values;
+	};
+
+	DelayedControl *find(unsigned int id);
+
+	V4L2Device *device_;
+	std::vector<DelayedControl> controls_;
+	unsigned int maxDelay_;
+
+	bool running_;
+	uint32_t firstSequence_;
+
+	uint32_t queueCount_;
+	uint32_t writeCount_;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_DELAYED_CONTROLS_H__ */
@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * device_cache.h - Persistent cache of device information
+ */
+#ifndef __LIBCAMERA_DEVICE_CACHE_H__
+#define __LIBCAMERA_DEVICE_CACHE_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <libcamera/span.h>
+
+namespace libcamera {
+
+class DeviceCache
+{
+public:
+	DeviceCache(const std::string &directory);
+
+	static DeviceCache *instance();
+	static const std::string &systemKey();
+
+	bool isEnabled() const { return !directory_.empty(); }
+
+	std::vector<uint8_t> load(const std::string &key) const;
+	int store(const std::string &key, Span<const uint8_t> data) const;
+
+private:
+	std::string fileName(const std::string &key) const;
+
+	std::string directory_;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_DEVICE_CACHE_H__ */
@@ -27,6 +27,9 @@ public:
 	std::unique_ptr<IPAProxy> createIPA(PipelineHandler *pipe,
 					    uint32_t maxVersion,
 					    uint32_t minVersion);
+	std::unique_ptr<IPAProxy> createIPA(const char *pipelineName,
+					    uint32_t maxVersion,
+					    uint32_t minVersion);
 
 private:
 	std::vector<IPAModule *> modules_;
@@ -41,6 +41,7 @@ public:
 	const std::string deviceNode() const { return deviceNode_; }
 	const std::string model() const { return model_; }
 	unsigned int version() const { return version_; }
+	const std::string &cacheKey() const { return cacheKey_; }
 
 	const std::vector<MediaEntity *> &entities() const { return entities_; }
 	MediaEntity *getEntityByName(const std::string &name) const;
@@ -62,6 +63,7 @@ private:
 	std::string deviceNode_;
 	std::string model_;
 	unsigned int version_;
+	std::string cacheKey_;
 
 	int fd_;
 	bool valid_;
@@ -29,6 +29,7 @@ class CameraManager;
 class DeviceEnumerator;
 class DeviceMatch;
 class FrameBuffer;
+struct FrameMetadata;
 class MediaDevice;
 class PipelineHandler;
 class Request;
@@ -37,7 +38,7 @@ class CameraData
 {
 public:
 	explicit CameraData(PipelineHandler *pipe)
-		: pipe_(pipe)
+		: pipe_(pipe), paused_(false)
 	{
 	}
 	virtual ~CameraData() {}
@@ -45,6 +46,8 @@ public:
 	Camera *camera_;
 	PipelineHandler *pipe_;
 	std::list<Request *> queuedRequests_;
+	std::list<Request *> heldRequests_;
+	bool paused_;
 	ControlInfoMap controlInfo_;
 	ControlList properties_;
 	std::unique_ptr<IPAProxy> ipa_;
@@ -83,10 +86,16 @@ public:
 
 	int queueRequest(Camera *camera, Request *request);
 
+	int pause(Camera *camera);
+	void resume(Camera *camera);
+	void cancelHeldRequests(Camera *camera);
+
 	bool completeBuffer(Camera *camera, Request *request,
 			    FrameBuffer *buffer);
 	void completeRequest(Camera *camera, Request *request);
 
+	static FrameMetadata &bufferMetadata(FrameBuffer *buffer);
+
 	const char *name() const { return name_; }
 
 protected:
@@ -96,11 +105,16 @@ protected:
 
 	virtual int queueRequestDevice(Camera *camera, Request *request) = 0;
 
+	virtual int pauseDevice(Camera *camera);
+	virtual void resumeDevice(Camera *camera);
+
 	CameraData *cameraData(const Camera *camera);
 
 	CameraManager *manager_;
 
 private:
+	void cancelRequest(Camera *camera, Request *request);
+
 	void mediaDeviceDisconnected(MediaDevice *media);
 	virtual void disconnect();
 
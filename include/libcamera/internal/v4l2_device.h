@@ -13,11 +13,15 @@
 
 #include <linux/videodev2.h>
 
+#include <libcamera/signal.h>
+
 #include "libcamera/internal/log.h"
 #include "libcamera/internal/v4l2_controls.h"
 
 namespace libcamera {
 
+class EventNotifier;
+
 class V4L2Device : protected Loggable
 {
 public:
@@ -31,6 +35,9 @@ public:
 
 	const std::string &deviceNode() const { return deviceNode_; }
 
+	int setFrameStartEnabled(bool enable);
+	Signal<uint32_t> frameStart;
+
 protected:
 	V4L2Device(const std::string &deviceNode);
 	~V4L2Device();
@@ -48,11 +55,16 @@ private:
 			    const struct v4l2_ext_control *v4l2Ctrls,
 			    unsigned int count);
 
+	void eventAvailable(EventNotifier *notifier);
+
 	std::map<unsigned int, struct v4l2_query_ext_ctrl> controlInfo_;
 	std::vector<std::unique_ptr<V4L2ControlId>> controlIds_;
 	ControlInfoMap controls_;
 	std::string deviceNode_;
 	int fd_;
+
+	EventNotifier *fdEventNotifier_;
+	bool frameStartEnabled_;
 };
 
 } /* namespace libcamera */
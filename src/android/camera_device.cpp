@@ -8,6 +8,12 @@
 #include "camera_device.h"
 #include "camera_ops.h"
 
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <time.h>
+
 #include <libcamera/controls.h>
 #include <libcamera/property_ids.h>
 
@@ -20,6 +26,28 @@ using namespace libcamera;
 
 LOG_DECLARE_CATEGORY(HAL);
 
+namespace {
+
+/*
+ * Encoding is parallelised across captures, two workers are enough to keep
+ * up with the shot-to-shot rate of still captures.
+ */
+constexpr unsigned int MaxJpegWorkers = 2;
+
+/*
+ * Capacity of the result metadata buffers.
+ *
+ * \todo Keep this in sync with the entries set by getResultMetadata().
+ * Currently: 12 entries, 40 bytes
+ */
+constexpr size_t ResultEntryCapacity = 15;
+constexpr size_t ResultDataCapacity = 50;
+
+/* Number of result metadata buffers kept for reuse. */
+constexpr unsigned int MaxPooledResultMetadata = 4;
+
+} /* namespace */
+
 /*
  * \struct Camera3RequestDescriptor
  *
@@ -53,7 +81,8 @@ CameraDevice::Camera3RequestDescriptor::~Camera3RequestDescriptor()
  */
 
 CameraDevice::CameraDevice(unsigned int id, const std::shared_ptr<Camera> &camera)
-	: running_(false), camera_(camera), staticMetadata_(nullptr)
+	: running_(false), camera_(camera), jpegStream_(nullptr),
+	  staticMetadata_(nullptr)
 {
 	camera_->requestCompleted.connect(this, &CameraDevice::requestComplete);
 }
@@ -94,9 +123,14 @@ int CameraDevice::open(const hw_module_t *hardwareModule)
 void CameraDevice::close()
 {
 	camera_->stop();
+
+	/* Wait for the pending JPEG captures before freeing their buffers. */
+	releaseJpegStream();
+
 	camera_->release();
 
 	running_ = false;
+	bufferCache_.clear();
 }
 
 void CameraDevice::setCallbacks(const camera3_callback_ops_t *callbacks)
@@ -122,9 +156,9 @@ const camera_metadata_t *CameraDevice::getStaticMetadata()
 
 	/*
 	 * \todo Keep this in sync with the actual number of entries.
-	 * Currently: 50 entries, 666 bytes
+	 * Currently: 51 entries, 682 bytes
 	 */
-	staticMetadata_ = new CameraMetadata(50, 700);
+	staticMetadata_ = new CameraMetadata(51, 700);
 	if (!staticMetadata_->isValid()) {
 		LOG(HAL, Error) << "Failed to allocate static metadata";
 		delete staticMetadata_;
@@ -244,6 +278,7 @@ const camera_metadata_t *CameraDevice::getStaticMetadata()
 	/* JPEG static metadata. */
 	std::vector<int32_t> availableThumbnailSizes = {
 		0, 0,
+		160, 120,
 	};
 	staticMetadata_->addEntry(ANDROID_JPEG_AVAILABLE_THUMBNAIL_SIZES,
 				  availableThumbnailSizes.data(),
@@ -402,6 +437,25 @@ const camera_metadata_t *CameraDevice::getStaticMetadata()
 				  availableStreamConfigurations.data(),
 				  availableStreamConfigurations.size());
 
+	/*
+	 * The uncompressed NV12 size of the largest BLOB stream bounds the
+	 * JPEG data. Add room for the EXIF segment and the blob trailer.
+	 */
+	uint32_t maxJpegPixels = 0;
+	for (unsigned int i = 0; i < availableStreamConfigurations.size(); i += 4) {
+		if (availableStreamConfigurations[i] !=
+		    ANDROID_SCALER_AVAILABLE_FORMATS_BLOB)
+			continue;
+
+		maxJpegPixels = std::max(maxJpegPixels,
+					 availableStreamConfigurations[i + 1] *
+					 availableStreamConfigurations[i + 2]);
+	}
+
+	int32_t maxJpegSize = maxJpegPixels * 3 / 2 + 65536
+			    + sizeof(camera3_jpeg_blob_t);
+	staticMetadata_->addEntry(ANDROID_JPEG_MAX_SIZE, &maxJpegSize, 1);
+
 	std::vector<int64_t> availableStallDurations = {
 		ANDROID_SCALER_AVAILABLE_FORMATS_BLOB, 2560, 1920, 33333333,
 	};
@@ -460,6 +514,7 @@ const camera_metadata_t *CameraDevice::getStaticMetadata()
 		ANDROID_CONTROL_AWB_LOCK_AVAILABLE,
 		ANDROID_CONTROL_AVAILABLE_MODES,
 		ANDROID_JPEG_AVAILABLE_THUMBNAIL_SIZES,
+		ANDROID_JPEG_MAX_SIZE,
 		ANDROID_SENSOR_INFO_PIXEL_ARRAY_SIZE,
 		ANDROID_SENSOR_INFO_ACTIVE_ARRAY_SIZE,
 		ANDROID_SENSOR_INFO_SENSITIVITY_RANGE,
@@ -650,6 +705,17 @@ const camera_metadata_t *CameraDevice::constructDefaultRequestSettings(int type)
  */
 int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 {
+	/*
+	 * Stop the camera and complete the pending JPEG captures, the buffers
+	 * of the previous configuration are about to be released.
+	 */
+	if (running_) {
+		camera_->stop();
+		running_ = false;
+	}
+
+	releaseJpegStream();
+
 	for (unsigned int i = 0; i < stream_list->num_streams; ++i) {
 		camera3_stream_t *stream = stream_list->streams[i];
 
@@ -660,24 +726,53 @@ int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 			       << ", format: " << utils::hex(stream->format);
 	}
 
-	/* Hardcode viewfinder role, collecting sizes from the stream config. */
-	if (stream_list->num_streams != 1) {
-		LOG(HAL, Error) << "Only one stream supported";
+	/*
+	 * Map each Android stream to a libcamera stream, picking the role from
+	 * the stream format and usage.
+	 */
+	StreamRoles roles;
+	unsigned int numJpegStreams = 0;
+	for (unsigned int i = 0; i < stream_list->num_streams; ++i) {
+		camera3_stream_t *camera3Stream = stream_list->streams[i];
+
+		if (camera3Stream->stream_type != CAMERA3_STREAM_OUTPUT) {
+			LOG(HAL, Error) << "Only output streams are supported";
+			return -EINVAL;
+		}
+
+		if (camera3Stream->format == HAL_PIXEL_FORMAT_BLOB) {
+			roles.push_back(StreamRole::StillCapture);
+			numJpegStreams++;
+		} else if (camera3Stream->usage & GRALLOC_USAGE_HW_VIDEO_ENCODER) {
+			roles.push_back(StreamRole::VideoRecording);
+		} else {
+			roles.push_back(StreamRole::Viewfinder);
+		}
+	}
+
+	if (numJpegStreams > 1) {
+		LOG(HAL, Error) << "Only one BLOB stream is supported";
 		return -EINVAL;
 	}
 
-	StreamRoles roles = { StreamRole::Viewfinder };
 	config_ = camera_->generateConfiguration(roles);
-	if (!config_ || config_->empty()) {
-		LOG(HAL, Error) << "Failed to generate camera configuration";
+	if (!config_ || config_->size() != stream_list->num_streams) {
+		LOG(HAL, Error) << "Failed to generate camera configuration for "
+				<< stream_list->num_streams << " streams";
+		config_.reset();
 		return -EINVAL;
 	}
 
-	/* Only one stream is supported. */
-	camera3_stream_t *camera3Stream = stream_list->streams[0];
-	StreamConfiguration *streamConfiguration = &config_->at(0);
-	streamConfiguration->size.width = camera3Stream->width;
-	streamConfiguration->size.height = camera3Stream->height;
+	for (unsigned int i = 0; i < stream_list->num_streams; ++i) {
+		camera3_stream_t *camera3Stream = stream_list->streams[i];
+		StreamConfiguration *streamConfiguration = &config_->at(i);
+		streamConfiguration->size.width = camera3Stream->width;
+		streamConfiguration->size.height = camera3Stream->height;
+
+		/* BLOB streams are captured in NV12 and encoded by the HAL. */
+		if (camera3Stream->format == HAL_PIXEL_FORMAT_BLOB)
+			streamConfiguration->pixelFormat = PixelFormat(DRM_FORMAT_NV12);
+	}
 
 	/*
 	 * \todo We'll need to translate from Android defined pixel format codes
@@ -689,17 +784,31 @@ int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 	case CameraConfiguration::Valid:
 		break;
 	case CameraConfiguration::Adjusted:
-		LOG(HAL, Info) << "Camera configuration adjusted";
-		config_.reset();
-		return -EINVAL;
+		/*
+		 * The pipeline handler may capture the JPEG source in another
+		 * YUV format, accept any format the encoder supports as long
+		 * as the sizes haven't been changed.
+		 */
+		for (unsigned int i = 0; i < stream_list->num_streams; ++i) {
+			camera3_stream_t *camera3Stream = stream_list->streams[i];
+			const StreamConfiguration &streamConfiguration = config_->at(i);
+			Size size(camera3Stream->width, camera3Stream->height);
+
+			if (streamConfiguration.size != size ||
+			    (camera3Stream->format == HAL_PIXEL_FORMAT_BLOB &&
+			     !JpegEncoder::isSupported(streamConfiguration.pixelFormat))) {
+				LOG(HAL, Info) << "Camera configuration adjusted";
+				config_.reset();
+				return -EINVAL;
+			}
+		}
+		break;
 	case CameraConfiguration::Invalid:
 		LOG(HAL, Info) << "Camera configuration invalid";
 		config_.reset();
 		return -EINVAL;
 	}
 
-	camera3Stream->max_buffers = streamConfiguration->bufferCount;
-
 	/*
 	 * Once the CameraConfiguration has been adjusted/validated
 	 * it can be applied to the camera.
@@ -711,17 +820,246 @@ int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 		return ret;
 	}
 
+	/*
+	 * Store the libcamera stream in the HAL private field of the Android
+	 * stream, to look it up when processing capture requests.
+	 */
+	for (unsigned int i = 0; i < stream_list->num_streams; ++i) {
+		camera3_stream_t *camera3Stream = stream_list->streams[i];
+		const StreamConfiguration &streamConfiguration = config_->at(i);
+
+		camera3Stream->max_buffers = streamConfiguration.bufferCount;
+		camera3Stream->priv = streamConfiguration.stream();
+
+		if (camera3Stream->format != HAL_PIXEL_FORMAT_BLOB)
+			continue;
+
+		ret = configureJpegStream(camera3Stream, streamConfiguration);
+		if (ret) {
+			releaseJpegStream();
+			return ret;
+		}
+	}
+
+	/* Buffers of the previous configuration will not be used anymore. */
+	bufferCache_.clear();
+
 	return 0;
 }
 
-int CameraDevice::processCaptureRequest(camera3_capture_request_t *camera3Request)
+/*
+ * Allocate and map the source buffers of the BLOB stream, in which libcamera
+ * captures the images to be encoded to JPEG, and start the encoding workers.
+ */
+int CameraDevice::configureJpegStream(camera3_stream_t *camera3Stream,
+				      const StreamConfiguration &streamConfiguration)
+{
+	Stream *stream = streamConfiguration.stream();
+	const PixelFormat &format = streamConfiguration.pixelFormat;
+	const Size &size = streamConfiguration.size;
+	bool packed = format == PixelFormat(DRM_FORMAT_YUYV);
+
+	unsigned int stride = streamConfiguration.stride;
+	if (!stride)
+		stride = packed ? size.width * 2 : size.width;
+
+	allocator_ = std::make_unique<FrameBufferAllocator>(camera_);
+	int ret = allocator_->allocate(stream);
+	if (ret < 0) {
+		LOG(HAL, Error) << "Failed to allocate JPEG source buffers";
+		return ret;
+	}
+
+	for (const std::unique_ptr<FrameBuffer> &buffer : allocator_->buffers(stream)) {
+		std::vector<const uint8_t *> planes;
+
+		for (const FrameBuffer::Plane &plane : buffer->planes()) {
+			void *address = mmap(nullptr, plane.length, PROT_READ,
+					     MAP_SHARED, plane.fd.fd(), 0);
+			if (address == MAP_FAILED) {
+				ret = -errno;
+				LOG(HAL, Error) << "Failed to map JPEG source buffer: "
+						<< strerror(-ret);
+				return ret;
+			}
+
+			jpegMappings_.emplace_back(address, plane.length);
+			planes.push_back(static_cast<const uint8_t *>(address));
+		}
+
+		/*
+		 * The chroma plane of semi-planar formats follows the luma
+		 * plane when the buffer has a single plane.
+		 */
+		size_t lumaSize = stride * size.height;
+		if (!packed && planes.size() == 1 &&
+		    buffer->planes()[0].length < lumaSize * 3 / 2) {
+			LOG(HAL, Error) << "JPEG source buffer too small";
+			return -EINVAL;
+		}
+
+		JpegEncoder::Image &image = jpegSources_[buffer.get()];
+		image.format = format;
+		image.size = size;
+		image.planes[0] = planes[0];
+		image.planes[1] = planes.size() > 1 ? planes[1] : planes[0] + lumaSize;
+		image.strides[0] = stride;
+		image.strides[1] = stride;
+
+		freeJpegSources_.push_back(buffer.get());
+	}
+
+	unsigned int numWorkers = std::thread::hardware_concurrency();
+	numWorkers = std::min(std::max(numWorkers, 1U), MaxJpegWorkers);
+
+	jpegWorkers_ = std::make_unique<JpegWorkerPool>(numWorkers);
+	jpegWorkers_->jobDone.connect(this, &CameraDevice::jpegDone);
+	jpegStream_ = camera3Stream;
+	camera3Stream->max_buffers = freeJpegSources_.size();
+
+	LOG(HAL, Debug)
+		<< "Encoding JPEG from " << format.toString() << " with "
+		<< numWorkers << " workers and "
+		<< freeJpegSources_.size() << " source buffers";
+
+	return 0;
+}
+
+/*
+ * Wait for all JPEG captures to complete, and release the resources of the
+ * BLOB stream.
+ */
+void CameraDevice::releaseJpegStream()
 {
-	StreamConfiguration *streamConfiguration = &config_->at(0);
-	Stream *stream = streamConfiguration->stream();
+	jpegWorkers_.reset();
 
-	if (camera3Request->num_output_buffers != 1) {
-		LOG(HAL, Error) << "Invalid number of output buffers: "
-				<< camera3Request->num_output_buffers;
+	for (const auto &mapping : jpegMappings_)
+		munmap(mapping.first, mapping.second);
+
+	jpegMappings_.clear();
+	jpegSources_.clear();
+	freeJpegSources_.clear();
+	allocator_.reset();
+	jpegStream_ = nullptr;
+}
+
+/*
+ * Retrieve a free JPEG source buffer, or return nullptr if they are all in use.
+ * The BLOB stream max_buffers is set to the number of source buffers, and a
+ * source buffer is released before its BLOB buffer is returned to the
+ * framework, a source buffer is thus always available to a well-behaved
+ * framework.
+ */
+FrameBuffer *CameraDevice::acquireJpegSource()
+{
+	MutexLocker locker(jpegMutex_);
+	if (freeJpegSources_.empty()) {
+		LOG(HAL, Error) << "No JPEG source buffer available";
+		return nullptr;
+	}
+
+	FrameBuffer *buffer = freeJpegSources_.back();
+	freeJpegSources_.pop_back();
+
+	return buffer;
+}
+
+void CameraDevice::releaseJpegSource(FrameBuffer *buffer)
+{
+	MutexLocker locker(jpegMutex_);
+	freeJpegSources_.push_back(buffer);
+}
+
+/*
+ * Update the JPEG settings from the capture request settings. Requests without
+ * settings reuse the settings of the previous request.
+ */
+void CameraDevice::readJpegSettings(const camera_metadata_t *settings)
+{
+	camera_metadata_ro_entry_t entry;
+
+	if (!find_camera_metadata_ro_entry(settings, ANDROID_JPEG_QUALITY, &entry) &&
+	    entry.count == 1)
+		jpegSettings_.quality = entry.data.u8[0];
+
+	if (!find_camera_metadata_ro_entry(settings, ANDROID_JPEG_THUMBNAIL_QUALITY, &entry) &&
+	    entry.count == 1)
+		jpegSettings_.thumbnailQuality = entry.data.u8[0];
+
+	if (!find_camera_metadata_ro_entry(settings, ANDROID_JPEG_THUMBNAIL_SIZE, &entry) &&
+	    entry.count == 2)
+		jpegSettings_.thumbnailSize = Size(entry.data.i32[0],
+						   entry.data.i32[1]);
+
+	if (!find_camera_metadata_ro_entry(settings, ANDROID_JPEG_ORIENTATION, &entry) &&
+	    entry.count == 1)
+		jpegSettings_.orientation = entry.data.i32[0];
+}
+
+/*
+ * Retrieve the FrameBuffer wrapping the dmabufs of an Android buffer handle.
+ *
+ * FrameBuffer instances are cached by handle, and live until the streams are
+ * reconfigured or the camera closed. Reusing them keeps the file descriptors
+ * of the FrameBuffer planes stable, which lets pipeline handlers map each
+ * buffer to the same V4L2 buffer instead of importing the dmabufs again for
+ * every request.
+ */
+FrameBuffer *CameraDevice::getFrameBuffer(buffer_handle_t camera3Handle)
+{
+	unsigned int numFds = std::min(camera3Handle->numFds, 3);
+	if (!numFds)
+		return nullptr;
+
+	/*
+	 * Handles may be freed and their memory reused for new handles.
+	 * Identify the buffer by its file descriptors and the inode of the
+	 * first dmabuf to avoid using a stale entry.
+	 */
+	struct stat statbuf;
+	if (fstat(camera3Handle->data[0], &statbuf) < 0)
+		return nullptr;
+
+	auto it = bufferCache_.find(camera3Handle);
+	if (it != bufferCache_.end()) {
+		CachedBuffer &cached = it->second;
+		bool match = cached.ino == statbuf.st_ino &&
+			     cached.fds.size() == numFds;
+		for (unsigned int i = 0; match && i < numFds; i++)
+			match = cached.fds[i] == camera3Handle->data[i];
+
+		if (match)
+			return cached.buffer.get();
+
+		bufferCache_.erase(it);
+	}
+
+	std::vector<int> fds(camera3Handle->data, camera3Handle->data + numFds);
+	std::vector<FrameBuffer::Plane> planes;
+	for (int fd : fds) {
+		FrameBuffer::Plane plane;
+		plane.fd = FileDescriptor(fd);
+		/*
+		 * Setting length to zero here is OK as the length is only used
+		 * to map the memory of the plane. Libcamera do not need to poke
+		 * at the memory content queued by the HAL.
+		 */
+		plane.length = 0;
+		planes.push_back(std::move(plane));
+	}
+
+	CachedBuffer &cached = bufferCache_[camera3Handle];
+	cached.fds = std::move(fds);
+	cached.ino = statbuf.st_ino;
+	cached.buffer = std::make_unique<FrameBuffer>(std::move(planes));
+
+	return cached.buffer.get();
+}
+
+int CameraDevice::processCaptureRequest(camera3_capture_request_t *camera3Request)
+{
+	if (!camera3Request->num_output_buffers) {
+		LOG(HAL, Error) << "No output buffers provided";
 		return -EINVAL;
 	}
 
@@ -736,6 +1074,9 @@ int CameraDevice::processCaptureRequest(camera3_capture_request_t *camera3Reques
 		running_ = true;
 	}
 
+	if (camera3Request->settings)
+		readJpegSettings(camera3Request->settings);
+
 	/*
 	 * Queue a request for the Camera with the provided dmabuf file
 	 * descriptors.
@@ -751,51 +1092,57 @@ int CameraDevice::processCaptureRequest(camera3_capture_request_t *camera3Reques
 	Camera3RequestDescriptor *descriptor =
 		new Camera3RequestDescriptor(camera3Request->frame_number,
 					     camera3Request->num_output_buffers);
+	descriptor->jpegSettings = jpegSettings_;
+
+	Request *request =
+		camera_->createRequest(reinterpret_cast<uint64_t>(descriptor));
+
+	FrameBuffer *jpegSource = nullptr;
+	int ret = 0;
+
 	for (unsigned int i = 0; i < descriptor->numBuffers; ++i) {
 		/*
 		 * Keep track of which stream the request belongs to and store
 		 * the native buffer handles.
-		 *
-		 * \todo Currently we only support one capture buffer. Copy
-		 * all of them to be ready once we'll support more.
 		 */
 		descriptor->buffers[i].stream = camera3Buffers[i].stream;
 		descriptor->buffers[i].buffer = camera3Buffers[i].buffer;
-	}
-
-	/*
-	 * Create a libcamera buffer using the dmabuf descriptors of the first
-	 * and (currently) only supported request buffer.
-	 */
-	const buffer_handle_t camera3Handle = *camera3Buffers[0].buffer;
 
-	std::vector<FrameBuffer::Plane> planes;
-	for (int i = 0; i < 3; i++) {
-		FrameBuffer::Plane plane;
-		plane.fd = FileDescriptor(camera3Handle->data[i]);
 		/*
-		 * Setting length to zero here is OK as the length is only used
-		 * to map the memory of the plane. Libcamera do not need to poke
-		 * at the memory content queued by the HAL.
+		 * BLOB buffers are filled by the JPEG encoder, capture to a
+		 * source buffer instead.
 		 */
-		plane.length = 0;
-		planes.push_back(std::move(plane));
-	}
+		Stream *stream = static_cast<Stream *>(camera3Buffers[i].stream->priv);
+		FrameBuffer *buffer;
+		if (camera3Buffers[i].stream == jpegStream_ && !jpegSource) {
+			jpegSource = acquireJpegSource();
+			buffer = jpegSource;
+		} else {
+			buffer = getFrameBuffer(*camera3Buffers[i].buffer);
+		}
 
-	FrameBuffer *buffer = new FrameBuffer(std::move(planes));
-	if (!buffer) {
-		LOG(HAL, Error) << "Failed to create buffer";
-		delete descriptor;
-		return -ENOMEM;
+		if (!stream || !buffer) {
+			LOG(HAL, Error) << "Invalid output buffer " << i;
+			ret = -EINVAL;
+			break;
+		}
+
+		ret = request->addBuffer(stream, buffer);
+		if (ret) {
+			LOG(HAL, Error) << "Failed to add output buffer " << i;
+			break;
+		}
 	}
 
-	Request *request =
-		camera_->createRequest(reinterpret_cast<uint64_t>(descriptor));
-	request->addBuffer(stream, buffer);
+	if (!ret) {
+		ret = camera_->queueRequest(request);
+		if (ret)
+			LOG(HAL, Error) << "Failed to queue request";
+	}
 
-	int ret = camera_->queueRequest(request);
 	if (ret) {
-		LOG(HAL, Error) << "Failed to queue request";
+		if (jpegSource)
+			releaseJpegSource(jpegSource);
 		delete request;
 		delete descriptor;
 		return ret;
@@ -821,46 +1168,121 @@ void CameraDevice::requestComplete(Request *request)
 	Camera3RequestDescriptor *descriptor =
 		reinterpret_cast<Camera3RequestDescriptor *>(request->cookie());
 
-	camera3_capture_result_t captureResult = {};
-	captureResult.frame_number = descriptor->frameNumber;
-	captureResult.num_output_buffers = descriptor->numBuffers;
+	/*
+	 * Generate the result metadata first, the whole request is failed if
+	 * it can't be produced.
+	 */
+	if (status == CAMERA3_BUFFER_STATUS_OK) {
+		resultMetadata = getResultMetadata(descriptor->frameNumber,
+						   buffer->metadata().timestamp);
+		if (!resultMetadata)
+			status = CAMERA3_BUFFER_STATUS_ERROR;
+	}
+
+	/*
+	 * Return all buffers but the BLOB buffers, which are returned by the
+	 * JPEG workers once encoded. Failed BLOB buffers go through the workers
+	 * too, to be returned in order with the BLOB buffers of previous
+	 * requests still being encoded.
+	 */
+	std::vector<camera3_stream_buffer_t> resultBuffers;
+	std::vector<std::unique_ptr<JpegJob>> jpegJobs;
+
 	for (unsigned int i = 0; i < descriptor->numBuffers; ++i) {
-		/*
-		 * \todo Currently we only support one capture buffer. Prepare
-		 * all of them to be ready once we'll support more.
-		 */
-		descriptor->buffers[i].acquire_fence = -1;
-		descriptor->buffers[i].release_fence = -1;
-		descriptor->buffers[i].status = status;
+		camera3_stream_buffer_t &camera3Buffer = descriptor->buffers[i];
+		Stream *stream = static_cast<Stream *>(camera3Buffer.stream->priv);
+		FrameBuffer *streamBuffer = request->findBuffer(stream);
+
+		camera3Buffer.acquire_fence = -1;
+		camera3Buffer.release_fence = -1;
+		camera3Buffer.status = status;
+
+		if (!streamBuffer ||
+		    streamBuffer->metadata().status != FrameMetadata::FrameSuccess)
+			camera3Buffer.status = CAMERA3_BUFFER_STATUS_ERROR;
+
+		if (camera3Buffer.stream != jpegStream_) {
+			resultBuffers.push_back(camera3Buffer);
+			continue;
+		}
+
+		std::unique_ptr<JpegJob> job = std::make_unique<JpegJob>();
+		job->frameNumber = descriptor->frameNumber;
+		job->camera3Buffer = camera3Buffer;
+		job->source = streamBuffer;
+		job->requestError = status != CAMERA3_BUFFER_STATUS_OK;
+
+		if (camera3Buffer.status == CAMERA3_BUFFER_STATUS_OK) {
+			job->image = jpegSources_[streamBuffer];
+			job->settings = descriptor->jpegSettings;
+			job->make = "libcamera";
+			job->model = camera_->name();
+			job->timestamp = time(nullptr);
+			job->status = 0;
+		} else {
+			job->status = -EIO;
+		}
+
+		jpegJobs.push_back(std::move(job));
 	}
-	captureResult.output_buffers =
-		const_cast<const camera3_stream_buffer_t *>(descriptor->buffers);
+
+	camera3_capture_result_t captureResult = {};
+	captureResult.frame_number = descriptor->frameNumber;
+	captureResult.num_output_buffers = resultBuffers.size();
+	captureResult.output_buffers = resultBuffers.data();
 
 	if (status == CAMERA3_BUFFER_STATUS_OK) {
 		notifyShutter(descriptor->frameNumber,
 			      buffer->metadata().timestamp);
 
 		captureResult.partial_result = 1;
-		resultMetadata = getResultMetadata(descriptor->frameNumber,
-						   buffer->metadata().timestamp);
 		captureResult.result = resultMetadata->get();
-	}
-
-	if (status == CAMERA3_BUFFER_STATUS_ERROR || !captureResult.result) {
-		/* \todo Improve error handling. In case we notify an error
-		 * because the metadata generation fails, a shutter event has
-		 * already been notified for this frame number before the error
-		 * is here signalled. Make sure the error path plays well with
-		 * the camera stack state machine.
-		 */
+	} else {
 		notifyError(descriptor->frameNumber,
-			    descriptor->buffers[0].stream);
+			    descriptor->buffers[0].stream,
+			    CAMERA3_MSG_ERROR_REQUEST);
 	}
 
 	callbacks_->process_capture_result(callbacks_, &captureResult);
 
+	/* The framework has copied the metadata, recycle the buffer. */
+	if (resultMetadata)
+		releaseResultMetadata(std::move(resultMetadata));
+
+	/*
+	 * Queue the JPEG jobs after sending the shutter notification and the
+	 * result metadata, which must precede the BLOB buffers.
+	 */
+	for (std::unique_ptr<JpegJob> &job : jpegJobs)
+		jpegWorkers_->queue(std::move(job));
+
 	delete descriptor;
-	delete buffer;
+}
+
+/*
+ * Return the BLOB buffer of a JPEG job to the framework. This is called from
+ * the JPEG worker threads, in the order the jobs have been queued.
+ */
+void CameraDevice::jpegDone(JpegJob *job)
+{
+	camera3_stream_buffer_t camera3Buffer = job->camera3Buffer;
+	camera3Buffer.status = job->status ? CAMERA3_BUFFER_STATUS_ERROR
+					   : CAMERA3_BUFFER_STATUS_OK;
+
+	if (job->source)
+		releaseJpegSource(job->source);
+
+	/* Failed requests have already been reported as a whole. */
+	if (job->status && !job->requestError)
+		notifyError(job->frameNumber, camera3Buffer.stream,
+			    CAMERA3_MSG_ERROR_BUFFER);
+
+	camera3_capture_result_t captureResult = {};
+	captureResult.frame_number = job->frameNumber;
+	captureResult.num_output_buffers = 1;
+	captureResult.output_buffers = &camera3Buffer;
+
+	callbacks_->process_capture_result(callbacks_, &captureResult);
 }
 
 void CameraDevice::notifyShutter(uint32_t frameNumber, uint64_t timestamp)
@@ -874,32 +1296,42 @@ void CameraDevice::notifyShutter(uint32_t frameNumber, uint64_t timestamp)
 	callbacks_->notify(callbacks_, &notify);
 }
 
-void CameraDevice::notifyError(uint32_t frameNumber, camera3_stream_t *stream)
+void CameraDevice::notifyError(uint32_t frameNumber, camera3_stream_t *stream,
+			       camera3_error_msg_code code)
 {
 	camera3_notify_msg_t notify = {};
 
 	notify.type = CAMERA3_MSG_ERROR;
 	notify.message.error.error_stream = stream;
 	notify.message.error.frame_number = frameNumber;
-	notify.message.error.error_code = CAMERA3_MSG_ERROR_REQUEST;
+	notify.message.error.error_code = code;
 
 	callbacks_->notify(callbacks_, &notify);
 }
 
 /*
  * Produce a set of fixed result metadata.
+ *
+ * The metadata buffer is taken from the pool of buffers recycled by
+ * releaseResultMetadata(), and only allocated when the pool is empty, to
+ * avoid allocating memory for every completed request. This is only called
+ * from requestComplete(), the pool thus needs no locking.
  */
 std::unique_ptr<CameraMetadata> CameraDevice::getResultMetadata(int frame_number,
 								int64_t timestamp)
 {
-	/*
-	 * \todo Keep this in sync with the actual number of entries.
-	 * Currently: 12 entries, 36 bytes
-	 */
-	std::unique_ptr<CameraMetadata> resultMetadata =
-		std::make_unique<CameraMetadata>(15, 50);
+	std::unique_ptr<CameraMetadata> resultMetadata;
+	if (!resultMetadataPool_.empty()) {
+		resultMetadata = std::move(resultMetadataPool_.back());
+		resultMetadataPool_.pop_back();
+		resultMetadata->clear();
+	} else {
+		resultMetadata = std::make_unique<CameraMetadata>(ResultEntryCapacity,
+								  ResultDataCapacity);
+	}
+
 	if (!resultMetadata->isValid()) {
-		LOG(HAL, Error) << "Failed to allocate static metadata";
+		LOG(HAL, Error) << "Failed to allocate result metadata";
 		return nullptr;
 	}
 
@@ -957,3 +1389,15 @@ std::unique_ptr<CameraMetadata> CameraDevice::getResultMetadata(int frame_number
 
 	return resultMetadata;
 }
+
+/*
+ * Return a result metadata buffer to the pool once the framework has copied
+ * its content.
+ */
+void CameraDevice::releaseResultMetadata(std::unique_ptr<CameraMetadata> metadata)
+{
+	if (resultMetadataPool_.size() >= MaxPooledResultMetadata)
+		return;
+
+	resultMetadataPool_.push_back(std::move(metadata));
+}
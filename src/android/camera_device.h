@@ -7,16 +7,24 @@
 #ifndef __ANDROID_CAMERA_DEVICE_H__
 #define __ANDROID_CAMERA_DEVICE_H__
 
+#include <map>
 #include <memory>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
 
 #include <hardware/camera3.h>
 
 #include <libcamera/buffer.h>
 #include <libcamera/camera.h>
+#include <libcamera/framebuffer_allocator.h>
 #include <libcamera/request.h>
 #include <libcamera/stream.h>
 
 #include "libcamera/internal/message.h"
+#include "libcamera/internal/thread.h"
+
+#include "jpeg_worker_pool.h"
 
 class CameraMetadata;
 
@@ -48,12 +56,29 @@ private:
 		uint32_t frameNumber;
 		uint32_t numBuffers;
 		camera3_stream_buffer_t *buffers;
+		JpegSettings jpegSettings;
+	};
+
+	struct CachedBuffer {
+		std::vector<int> fds;
+		ino_t ino;
+		std::unique_ptr<libcamera::FrameBuffer> buffer;
 	};
 
+	libcamera::FrameBuffer *getFrameBuffer(buffer_handle_t camera3Handle);
+	int configureJpegStream(camera3_stream_t *camera3Stream,
+				const libcamera::StreamConfiguration &streamConfiguration);
+	void releaseJpegStream();
+	libcamera::FrameBuffer *acquireJpegSource();
+	void releaseJpegSource(libcamera::FrameBuffer *buffer);
+	void readJpegSettings(const camera_metadata_t *settings);
+	void jpegDone(JpegJob *job);
 	void notifyShutter(uint32_t frameNumber, uint64_t timestamp);
-	void notifyError(uint32_t frameNumber, camera3_stream_t *stream);
+	void notifyError(uint32_t frameNumber, camera3_stream_t *stream,
+			 camera3_error_msg_code code);
 	std::unique_ptr<CameraMetadata> getResultMetadata(int frame_number,
 							  int64_t timestamp);
+	void releaseResultMetadata(std::unique_ptr<CameraMetadata> metadata);
 
 	unsigned int id_;
 	camera3_device_t camera3Device_;
@@ -61,9 +86,25 @@ private:
 	bool running_;
 	std::shared_ptr<libcamera::Camera> camera_;
 	std::unique_ptr<libcamera::CameraConfiguration> config_;
+	std::map<buffer_handle_t, CachedBuffer> bufferCache_;
+
+	/*
+	 * BLOB streams are captured in YUV to HAL-allocated source buffers,
+	 * and encoded to JPEG by the worker pool.
+	 */
+	camera3_stream_t *jpegStream_;
+	std::unique_ptr<libcamera::FrameBufferAllocator> allocator_;
+	std::map<libcamera::FrameBuffer *, JpegEncoder::Image> jpegSources_;
+	std::vector<std::pair<void *, size_t>> jpegMappings_;
+	std::unique_ptr<JpegWorkerPool> jpegWorkers_;
+	JpegSettings jpegSettings_;
+
+	libcamera::Mutex jpegMutex_;
+	std::vector<libcamera::FrameBuffer *> freeJpegSources_;
 
 	CameraMetadata *staticMetadata_;
 	std::map<unsigned int, CameraMetadata *> requestTemplates_;
+	std::vector<std::unique_ptr<CameraMetadata>> resultMetadataPool_;
 	const camera3_callback_ops_t *callbacks_;
 };
 
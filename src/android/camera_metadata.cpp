@@ -46,6 +46,20 @@ bool CameraMetadata::addEntry(uint32_t tag, const void *data, size_t count)
 	return false;
 }
 
+/*
+ * Remove all entries, keeping the buffer and its capacity for reuse.
+ */
+void CameraMetadata::clear()
+{
+	if (!metadata_)
+		return;
+
+	place_camera_metadata(metadata_, get_camera_metadata_size(metadata_),
+			      get_camera_metadata_entry_capacity(metadata_),
+			      get_camera_metadata_data_capacity(metadata_));
+	valid_ = true;
+}
+
 camera_metadata_t *CameraMetadata::get()
 {
 	return valid_ ? metadata_ : nullptr;
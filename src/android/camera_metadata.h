@@ -19,6 +19,7 @@ public:
 
 	bool isValid() { return valid_; }
 	bool addEntry(uint32_t tag, const void *data, size_t data_count);
+	void clear();
 
 	camera_metadata_t *get();
 
@@ -0,0 +1,261 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * exif.cpp - EXIF metadata generator for JPEG images
+ */
+
+#include "exif.h"
+
+#include "libcamera/internal/log.h"
+
+using namespace libcamera;
+
+LOG_DECLARE_CATEGORY(HAL);
+
+namespace {
+
+enum ExifTag : uint16_t {
+	TagCompression = 0x0103,
+	TagMake = 0x010f,
+	TagModel = 0x0110,
+	TagOrientation = 0x0112,
+	TagDateTime = 0x0132,
+	TagJpegInterchangeFormat = 0x0201,
+	TagJpegInterchangeFormatLength = 0x0202,
+	TagExifIfdPointer = 0x8769,
+	TagExifVersion = 0x9000,
+	TagDateTimeOriginal = 0x9003,
+	TagColorSpace = 0xa001,
+	TagPixelXDimension = 0xa002,
+	TagPixelYDimension = 0xa003,
+};
+
+enum ExifType : uint16_t {
+	TypeAscii = 2,
+	TypeShort = 3,
+	TypeLong = 4,
+	TypeUndefined = 7,
+};
+
+/* The APP1 marker payload is limited to 64kB minus the length field. */
+constexpr size_t MaxExifSize = 65533;
+
+const uint8_t exifHeader[] = { 'E', 'x', 'i', 'f', 0, 0 };
+
+struct IfdEntry {
+	uint16_t tag;
+	uint16_t type;
+	uint32_t count;
+	std::vector<uint8_t> data;
+};
+
+/* All values are stored in little endian order, as declared in the header. */
+void put16(std::vector<uint8_t> &buffer, uint16_t value)
+{
+	buffer.push_back(value & 0xff);
+	buffer.push_back(value >> 8);
+}
+
+void put32(std::vector<uint8_t> &buffer, uint32_t value)
+{
+	put16(buffer, value & 0xffff);
+	put16(buffer, value >> 16);
+}
+
+IfdEntry shortEntry(uint16_t tag, uint16_t value)
+{
+	IfdEntry entry{ tag, TypeShort, 1, {} };
+	put16(entry.data, value);
+	return entry;
+}
+
+IfdEntry longEntry(uint16_t tag, uint32_t value)
+{
+	IfdEntry entry{ tag, TypeLong, 1, {} };
+	put32(entry.data, value);
+	return entry;
+}
+
+IfdEntry asciiEntry(uint16_t tag, const std::string &value)
+{
+	IfdEntry entry{ tag, TypeAscii, static_cast<uint32_t>(value.size() + 1), {} };
+	entry.data.assign(value.begin(), value.end());
+	entry.data.push_back('\0');
+	return entry;
+}
+
+IfdEntry undefinedEntry(uint16_t tag, const std::string &value)
+{
+	IfdEntry entry{ tag, TypeUndefined, static_cast<uint32_t>(value.size()), {} };
+	entry.data.assign(value.begin(), value.end());
+	return entry;
+}
+
+/*
+ * An IFD is made of an entry count, the entries, the offset of the next IFD,
+ * and the values that don't fit in the 4 bytes of the entries, aligned to
+ * 2 bytes.
+ */
+size_t ifdSize(const std::vector<IfdEntry> &entries)
+{
+	size_t size = 2 + entries.size() * 12 + 4;
+	for (const IfdEntry &entry : entries) {
+		if (entry.data.size() > 4)
+			size += (entry.data.size() + 1) & ~1;
+	}
+
+	return size;
+}
+
+void writeIfd(std::vector<uint8_t> &tiff, const std::vector<IfdEntry> &entries,
+	      uint32_t next)
+{
+	uint32_t dataOffset = tiff.size() + 2 + entries.size() * 12 + 4;
+
+	put16(tiff, entries.size());
+
+	for (const IfdEntry &entry : entries) {
+		put16(tiff, entry.tag);
+		put16(tiff, entry.type);
+		put32(tiff, entry.count);
+
+		if (entry.data.size() > 4) {
+			put32(tiff, dataOffset);
+			dataOffset += (entry.data.size() + 1) & ~1;
+		} else {
+			tiff.insert(tiff.end(), entry.data.begin(), entry.data.end());
+			tiff.resize(tiff.size() + 4 - entry.data.size());
+		}
+	}
+
+	put32(tiff, next);
+
+	for (const IfdEntry &entry : entries) {
+		if (entry.data.size() <= 4)
+			continue;
+
+		tiff.insert(tiff.end(), entry.data.begin(), entry.data.end());
+		if (entry.data.size() & 1)
+			tiff.push_back(0);
+	}
+}
+
+} /* namespace */
+
+/*
+ * \class Exif
+ * \brief Generate the EXIF APP1 segment of a JPEG image
+ *
+ * The generated data contains the primary image IFD with the camera make,
+ * model, orientation and capture time, an EXIF IFD with the image dimensions,
+ * and, when a thumbnail is set, a second IFD pointing to the JPEG-compressed
+ * thumbnail.
+ */
+
+Exif::Exif()
+	: orientation_(1), timestamp_(0)
+{
+}
+
+/*
+ * Set the orientation of the image as a clockwise rotation in degrees, as
+ * specified by ANDROID_JPEG_ORIENTATION. The rotation is stored as the EXIF
+ * orientation tag value that tells viewers how to display the image upright.
+ */
+void Exif::setOrientation(int orientation)
+{
+	switch (orientation) {
+	case 0:
+	default:
+		orientation_ = 1;
+		break;
+	case 90:
+		orientation_ = 6;
+		break;
+	case 180:
+		orientation_ = 3;
+		break;
+	case 270:
+		orientation_ = 8;
+		break;
+	}
+}
+
+void Exif::setThumbnail(std::vector<uint8_t> thumbnail)
+{
+	thumbnail_ = std::move(thumbnail);
+}
+
+/*
+ * Generate the APP1 segment payload, starting with the EXIF identifier code.
+ * The thumbnail is dropped if it doesn't fit in the segment.
+ */
+std::vector<uint8_t> Exif::generate() const
+{
+	std::vector<uint8_t> tiff = generateTiff(!thumbnail_.empty());
+	if (sizeof(exifHeader) + tiff.size() > MaxExifSize) {
+		LOG(HAL, Warning)
+			<< "Thumbnail too large (" << thumbnail_.size()
+			<< " bytes), dropping it";
+		tiff = generateTiff(false);
+	}
+
+	std::vector<uint8_t> exif(exifHeader, exifHeader + sizeof(exifHeader));
+	exif.insert(exif.end(), tiff.begin(), tiff.end());
+
+	return exif;
+}
+
+std::vector<uint8_t> Exif::generateTiff(bool withThumbnail) const
+{
+	char dateTime[20] = {};
+	struct tm tm;
+	if (localtime_r(&timestamp_, &tm))
+		strftime(dateTime, sizeof(dateTime), "%Y:%m:%d %H:%M:%S", &tm);
+
+	/* Entries of each IFD must be sorted by tag. */
+	std::vector<IfdEntry> ifd0 = {
+		asciiEntry(TagMake, make_),
+		asciiEntry(TagModel, model_),
+		shortEntry(TagOrientation, orientation_),
+		asciiEntry(TagDateTime, dateTime),
+		longEntry(TagExifIfdPointer, 0),
+	};
+
+	std::vector<IfdEntry> exifIfd = {
+		undefinedEntry(TagExifVersion, "0220"),
+		asciiEntry(TagDateTimeOriginal, dateTime),
+		shortEntry(TagColorSpace, 1),
+		longEntry(TagPixelXDimension, size_.width),
+		longEntry(TagPixelYDimension, size_.height),
+	};
+
+	std::vector<IfdEntry> ifd1 = {
+		shortEntry(TagCompression, 6),
+		longEntry(TagJpegInterchangeFormat, 0),
+		longEntry(TagJpegInterchangeFormatLength, thumbnail_.size()),
+	};
+
+	/* Compute the offsets of the IFDs from the start of the TIFF header. */
+	uint32_t ifd0Offset = 8;
+	uint32_t exifOffset = ifd0Offset + ifdSize(ifd0);
+	uint32_t ifd1Offset = exifOffset + ifdSize(exifIfd);
+	uint32_t thumbnailOffset = ifd1Offset + ifdSize(ifd1);
+
+	ifd0.back() = longEntry(TagExifIfdPointer, exifOffset);
+	ifd1[1] = longEntry(TagJpegInterchangeFormat, thumbnailOffset);
+
+	std::vector<uint8_t> tiff = { 'I', 'I', 0x2a, 0x00 };
+	put32(tiff, ifd0Offset);
+
+	writeIfd(tiff, ifd0, withThumbnail ? ifd1Offset : 0);
+	writeIfd(tiff, exifIfd, 0);
+
+	if (withThumbnail) {
+		writeIfd(tiff, ifd1, 0);
+		tiff.insert(tiff.end(), thumbnail_.begin(), thumbnail_.end());
+	}
+
+	return tiff;
+}
@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * exif.h - EXIF metadata generator for JPEG images
+ */
+#ifndef __ANDROID_EXIF_H__
+#define __ANDROID_EXIF_H__
+
+#include <stdint.h>
+#include <string>
+#include <time.h>
+#include <vector>
+
+#include <libcamera/geometry.h>
+
+class Exif
+{
+public:
+	Exif();
+
+	void setMake(const std::string &make) { make_ = make; }
+	void setModel(const std::string &model) { model_ = model; }
+	void setOrientation(int orientation);
+	void setSize(const libcamera::Size &size) { size_ = size; }
+	void setTimestamp(time_t timestamp) { timestamp_ = timestamp; }
+	void setThumbnail(std::vector<uint8_t> thumbnail);
+
+	std::vector<uint8_t> generate() const;
+
+private:
+	std::vector<uint8_t> generateTiff(bool withThumbnail) const;
+
+	std::string make_;
+	std::string model_;
+	uint16_t orientation_;
+	libcamera::Size size_;
+	time_t timestamp_;
+	std::vector<uint8_t> thumbnail_;
+};
+
+#endif /* __ANDROID_EXIF_H__ */
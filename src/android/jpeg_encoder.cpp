@@ -0,0 +1,236 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * jpeg_encoder.cpp - JPEG encoder for YUV images, based on libjpeg
+ */
+
+#include "jpeg_encoder.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+
+#include <jerror.h>
+
+#include "libcamera/internal/log.h"
+
+using namespace libcamera;
+
+LOG_DECLARE_CATEGORY(HAL);
+
+/*
+ * \class JpegEncoder
+ * \brief Compress NV12, NV21 and YUYV images to JPEG
+ *
+ * The encoder feeds the image to libjpeg in raw data mode: the luma and chroma
+ * samples are handed over as they are stored in memory, without any colour
+ * conversion or resampling, leaving only the DCT, quantization and entropy
+ * coding to libjpeg, which libjpeg-turbo accelerates with SIMD instructions.
+ * NV12 and NV21 images are encoded as 4:2:0 and YUYV images as 4:2:2.
+ *
+ * An encoder instance isn't thread-safe, but different instances can be used
+ * concurrently.
+ */
+
+JpegEncoder::JpegEncoder()
+	: lumaWidth_(0), chromaWidth_(0)
+{
+	compress_.err = jpeg_std_error(&error_.pub);
+	jpeg_create_compress(&compress_);
+
+	error_.pub.error_exit = &JpegEncoder::errorExit;
+
+	destination_.pub.init_destination = &JpegEncoder::initDestination;
+	destination_.pub.empty_output_buffer = &JpegEncoder::emptyOutputBuffer;
+	destination_.pub.term_destination = &JpegEncoder::termDestination;
+	compress_.dest = &destination_.pub;
+}
+
+JpegEncoder::~JpegEncoder()
+{
+	jpeg_destroy_compress(&compress_);
+}
+
+bool JpegEncoder::isSupported(const PixelFormat &format)
+{
+	switch (format.fourcc()) {
+	case DRM_FORMAT_NV12:
+	case DRM_FORMAT_NV21:
+	case DRM_FORMAT_YUYV:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Encode the \a image to \a destination with the given \a quality (1 to 100),
+ * and insert the \a exif data, if any, in an APP1 marker.
+ *
+ * Return the size of the JPEG data on success, -ENOSPC if it doesn't fit in
+ * \a destination, or another negative error code otherwise.
+ */
+int JpegEncoder::encode(const Image &image, Span<uint8_t> destination,
+			int quality, Span<const uint8_t> exif)
+{
+	if (!isSupported(image.format) || !image.size.width ||
+	    !image.size.height) {
+		LOG(HAL, Error) << "Unsupported image for JPEG encoding";
+		return -EINVAL;
+	}
+
+	const bool packed = image.format == PixelFormat(DRM_FORMAT_YUYV);
+	const unsigned int vSubsampling = packed ? 1 : 2;
+	const unsigned int lumaRows = DCTSIZE * vSubsampling;
+
+	/*
+	 * Allocate row buffers padded to the MCU width. Only the rows of one
+	 * iMCU are stored, the image is converted as it gets compressed.
+	 */
+	lumaWidth_ = (image.size.width + 15) & ~15;
+	chromaWidth_ = lumaWidth_ / 2;
+	rows_.resize(lumaRows * lumaWidth_ + 2 * DCTSIZE * chromaWidth_);
+
+	uint8_t *row = rows_.data();
+	for (unsigned int i = 0; i < lumaRows; ++i, row += lumaWidth_)
+		lumaRows_[i] = row;
+	for (unsigned int i = 0; i < DCTSIZE; ++i, row += chromaWidth_)
+		cbRows_[i] = row;
+	for (unsigned int i = 0; i < DCTSIZE; ++i, row += chromaWidth_)
+		crRows_[i] = row;
+
+	destination_.buffer = destination;
+	destination_.overflow = false;
+
+	if (setjmp(error_.escape)) {
+		jpeg_abort_compress(&compress_);
+		return destination_.overflow ? -ENOSPC : -EINVAL;
+	}
+
+	compress_.image_width = image.size.width;
+	compress_.image_height = image.size.height;
+	compress_.input_components = 3;
+	compress_.in_color_space = JCS_YCbCr;
+
+	jpeg_set_defaults(&compress_);
+	jpeg_set_quality(&compress_, quality, TRUE);
+
+	compress_.raw_data_in = TRUE;
+	compress_.comp_info[0].h_samp_factor = 2;
+	compress_.comp_info[0].v_samp_factor = vSubsampling;
+	compress_.comp_info[1].h_samp_factor = 1;
+	compress_.comp_info[1].v_samp_factor = 1;
+	compress_.comp_info[2].h_samp_factor = 1;
+	compress_.comp_info[2].v_samp_factor = 1;
+
+	/* EXIF and JFIF are mutually exclusive. */
+	compress_.write_JFIF_header = exif.empty();
+
+	jpeg_start_compress(&compress_, TRUE);
+
+	if (!exif.empty())
+		jpeg_write_marker(&compress_, JPEG_APP0 + 1, exif.data(),
+				  exif.size());
+
+	JSAMPARRAY planes[3] = { lumaRows_, cbRows_, crRows_ };
+
+	while (compress_.next_scanline < compress_.image_height) {
+		fillRows(image, compress_.next_scanline, lumaRows);
+		jpeg_write_raw_data(&compress_, planes, lumaRows);
+	}
+
+	jpeg_finish_compress(&compress_);
+
+	return destination.size() - destination_.pub.free_in_buffer;
+}
+
+/*
+ * Convert the luma and chroma rows of the iMCU starting at \a row to planar
+ * rows. Rows and columns past the end of the image replicate the last ones.
+ */
+void JpegEncoder::fillRows(const Image &image, unsigned int row,
+			   unsigned int lumaRows)
+{
+	const unsigned int width = image.size.width;
+	const unsigned int height = image.size.height;
+	const unsigned int chromaSamples = (width + 1) / 2;
+	const bool packed = image.format == PixelFormat(DRM_FORMAT_YUYV);
+	const unsigned int vSubsampling = packed ? 1 : 2;
+	const unsigned int chromaHeight = (height + vSubsampling - 1) / vSubsampling;
+
+	for (unsigned int i = 0; i < lumaRows; ++i) {
+		unsigned int y = std::min(row + i, height - 1);
+		const uint8_t *src = image.planes[0] + y * image.strides[0];
+		uint8_t *dst = lumaRows_[i];
+
+		if (packed) {
+			for (unsigned int x = 0; x < width; ++x)
+				dst[x] = src[x * 2];
+		} else {
+			memcpy(dst, src, width);
+		}
+
+		memset(dst + width, dst[width - 1], lumaWidth_ - width);
+	}
+
+	for (unsigned int i = 0; i < DCTSIZE; ++i) {
+		unsigned int y = std::min(row / vSubsampling + i, chromaHeight - 1);
+		uint8_t *cb = cbRows_[i];
+		uint8_t *cr = crRows_[i];
+
+		if (packed) {
+			const uint8_t *src = image.planes[0] + y * image.strides[0];
+			for (unsigned int x = 0; x < chromaSamples; ++x) {
+				cb[x] = src[x * 4 + 1];
+				cr[x] = src[x * 4 + 3];
+			}
+		} else {
+			const uint8_t *src = image.planes[1] + y * image.strides[1];
+			unsigned int cbOffset = image.format == PixelFormat(DRM_FORMAT_NV21) ? 1 : 0;
+			for (unsigned int x = 0; x < chromaSamples; ++x) {
+				cb[x] = src[x * 2 + cbOffset];
+				cr[x] = src[x * 2 + 1 - cbOffset];
+			}
+		}
+
+		memset(cb + chromaSamples, cb[chromaSamples - 1],
+		       chromaWidth_ - chromaSamples);
+		memset(cr + chromaSamples, cr[chromaSamples - 1],
+		       chromaWidth_ - chromaSamples);
+	}
+}
+
+void JpegEncoder::errorExit(j_common_ptr cinfo)
+{
+	ErrorManager *error = reinterpret_cast<ErrorManager *>(cinfo->err);
+
+	char message[JMSG_LENGTH_MAX];
+	(*cinfo->err->format_message)(cinfo, message);
+	LOG(HAL, Error) << "JPEG compression failed: " << message;
+
+	longjmp(error->escape, 1);
+}
+
+void JpegEncoder::initDestination(j_compress_ptr cinfo)
+{
+	Destination *dest = reinterpret_cast<Destination *>(cinfo->dest);
+
+	dest->pub.next_output_byte = dest->buffer.data();
+	dest->pub.free_in_buffer = dest->buffer.size();
+}
+
+boolean JpegEncoder::emptyOutputBuffer(j_compress_ptr cinfo)
+{
+	Destination *dest = reinterpret_cast<Destination *>(cinfo->dest);
+
+	/* The destination buffer can't grow, abort compression. */
+	dest->overflow = true;
+	ERREXIT(cinfo, JERR_BUFFER_SIZE);
+
+	return FALSE;
+}
+
+void JpegEncoder::termDestination(j_compress_ptr cinfo)
+{
+}
@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * jpeg_encoder.h - JPEG encoder for YUV images, based on libjpeg
+ */
+#ifndef __ANDROID_JPEG_ENCODER_H__
+#define __ANDROID_JPEG_ENCODER_H__
+
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include <jpeglib.h>
+
+#include <libcamera/geometry.h>
+#include <libcamera/pixelformats.h>
+#include <libcamera/span.h>
+
+class JpegEncoder
+{
+public:
+	struct Image {
+		libcamera::PixelFormat format;
+		libcamera::Size size;
+		const uint8_t *planes[2];
+		unsigned int strides[2];
+	};
+
+	JpegEncoder();
+	~JpegEncoder();
+
+	JpegEncoder(const JpegEncoder &) = delete;
+	JpegEncoder &operator=(const JpegEncoder &) = delete;
+
+	static bool isSupported(const libcamera::PixelFormat &format);
+
+	int encode(const Image &image, libcamera::Span<uint8_t> destination,
+		   int quality, libcamera::Span<const uint8_t> exif = {});
+
+private:
+	struct ErrorManager {
+		struct jpeg_error_mgr pub;
+		jmp_buf escape;
+	};
+
+	struct Destination {
+		struct jpeg_destination_mgr pub;
+		libcamera::Span<uint8_t> buffer;
+		bool overflow;
+	};
+
+	static void errorExit(j_common_ptr cinfo);
+	static void initDestination(j_compress_ptr cinfo);
+	static boolean emptyOutputBuffer(j_compress_ptr cinfo);
+	static void termDestination(j_compress_ptr cinfo);
+
+	void fillRows(const Image &image, unsigned int row,
+		      unsigned int lumaRows);
+
+	struct jpeg_compress_struct compress_;
+	ErrorManager error_;
+	Destination destination_;
+
+	unsigned int lumaWidth_;
+	unsigned int chromaWidth_;
+	std::vector<uint8_t> rows_;
+	JSAMPROW lumaRows_[16];
+	JSAMPROW cbRows_[8];
+	JSAMPROW crRows_[8];
+};
+
+#endif /* __ANDROID_JPEG_ENCODER_H__ */
@@ -0,0 +1,294 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * jpeg_worker_pool.cpp - Pool of threads encoding JPEG captures
+ */
+
+#include "jpeg_worker_pool.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "libcamera/internal/log.h"
+
+#include "exif.h"
+
+using namespace libcamera;
+
+LOG_DECLARE_CATEGORY(HAL);
+
+/*
+ * \struct JpegJob
+ * \brief A capture to be encoded to JPEG into an Android BLOB buffer
+ *
+ * The source image is described by the image field, and stays valid until
+ * the job is signalled as done through JpegWorkerPool::jobDone. The caller
+ * sets the status to 0 for the capture to be encoded, or to a negative error
+ * code if the capture failed, in which case the job is only signalled as
+ * done, in order with the other jobs. The worker sets the status to 0 if the
+ * JPEG data has been written to the BLOB buffer, or to a negative error code
+ * otherwise. The requestError field tells whether the whole request failed.
+ */
+
+/*
+ * \class JpegWorkerPool
+ * \brief Encode JPEG captures on dedicated threads
+ *
+ * Encoding a full resolution capture takes longer than a frame interval on
+ * most platforms. Doing so in the camera manager thread would delay the
+ * completion of all the other requests. The worker pool instead encodes jobs
+ * in the background, on a fixed number of threads, each owning its own
+ * JpegEncoder.
+ *
+ * Jobs are signalled as done in the order they have been queued, as required
+ * by the camera3 API for the buffers of a stream, even when a later job
+ * completes first. The number of jobs in flight isn't limited by the pool,
+ * callers shall bound it, typically by the number of source buffers.
+ */
+
+JpegWorkerPool::JpegWorkerPool(unsigned int numWorkers)
+	: stopping_(false)
+{
+	for (unsigned int i = 0; i < numWorkers; ++i)
+		threads_.emplace_back(&JpegWorkerPool::run, this);
+}
+
+/*
+ * Destroying the pool waits for all queued jobs to be encoded and signalled
+ * as done.
+ */
+JpegWorkerPool::~JpegWorkerPool()
+{
+	{
+		MutexLocker locker(queueMutex_);
+		stopping_ = true;
+	}
+
+	queueCondition_.notify_all();
+
+	for (std::thread &thread : threads_)
+		thread.join();
+}
+
+/*
+ * Queue a job for encoding. The jobDone signal is emitted from a worker thread
+ * once the job has completed. Jobs for failed captures are signalled as soon
+ * as all previous jobs have been, from the calling thread if they already
+ * have.
+ */
+void JpegWorkerPool::queue(std::unique_ptr<JpegJob> job)
+{
+	JpegJob *pending = job.get();
+	bool failed = job->status != 0;
+
+	{
+		MutexLocker locker(completionMutex_);
+		inFlight_.emplace_back(std::move(job), false);
+	}
+
+	/* Failed captures have nothing to encode, only signal them in order. */
+	if (failed) {
+		complete(pending);
+		return;
+	}
+
+	{
+		MutexLocker locker(queueMutex_);
+		pending_.push(pending);
+	}
+
+	queueCondition_.notify_one();
+}
+
+/*
+ * Wait until all queued jobs have been signalled as done.
+ */
+void JpegWorkerPool::flush()
+{
+	MutexLocker locker(completionMutex_);
+	idleCondition_.wait(locker, [&] { return inFlight_.empty(); });
+}
+
+void JpegWorkerPool::run()
+{
+	JpegEncoder encoder;
+
+	while (true) {
+		JpegJob *job;
+
+		{
+			MutexLocker locker(queueMutex_);
+			queueCondition_.wait(locker, [&] {
+				return stopping_ || !pending_.empty();
+			});
+
+			if (pending_.empty())
+				return;
+
+			job = pending_.front();
+			pending_.pop();
+		}
+
+		job->status = encode(&encoder, job);
+		complete(job);
+	}
+}
+
+int JpegWorkerPool::encode(JpegEncoder *encoder, JpegJob *job)
+{
+	/*
+	 * The size of BLOB buffers is set by the framework from the
+	 * ANDROID_JPEG_MAX_SIZE static metadata, retrieve it from the dmabuf.
+	 */
+	const native_handle_t *handle = *job->camera3Buffer.buffer;
+	int fd = handle->data[0];
+
+	off_t size = lseek(fd, 0, SEEK_END);
+	if (size < 0) {
+		int ret = -errno;
+		LOG(HAL, Error) << "Failed to get JPEG buffer size: "
+				<< strerror(-ret);
+		return ret;
+	}
+
+	if (static_cast<size_t>(size) <= sizeof(camera3_jpeg_blob_t)) {
+		LOG(HAL, Error) << "JPEG buffer too small";
+		return -ENOSPC;
+	}
+
+	void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			 fd, 0);
+	if (map == MAP_FAILED) {
+		int ret = -errno;
+		LOG(HAL, Error) << "Failed to map JPEG buffer: "
+				<< strerror(-ret);
+		return ret;
+	}
+
+	Exif exif;
+	exif.setMake(job->make);
+	exif.setModel(job->model);
+	exif.setOrientation(job->settings.orientation);
+	exif.setSize(job->image.size);
+	exif.setTimestamp(job->timestamp);
+	exif.setThumbnail(thumbnail(encoder, *job));
+
+	std::vector<uint8_t> exifData = exif.generate();
+
+	/* The JPEG data is followed by a camera3_jpeg_blob_t at the end. */
+	uint8_t *data = static_cast<uint8_t *>(map);
+	size_t blobOffset = size - sizeof(camera3_jpeg_blob_t);
+
+	int ret = encoder->encode(job->image, { data, blobOffset },
+				  job->settings.quality, exifData);
+	if (ret >= 0) {
+		camera3_jpeg_blob_t *blob =
+			reinterpret_cast<camera3_jpeg_blob_t *>(data + blobOffset);
+		blob->jpeg_blob_id = CAMERA3_JPEG_BLOB_ID;
+		blob->jpeg_size = ret;
+		ret = 0;
+	}
+
+	munmap(map, size);
+
+	return ret;
+}
+
+/*
+ * Generate the JPEG thumbnail of the job image. The image is downscaled to an
+ * NV12 thumbnail with nearest-neighbour sampling, which is enough for the
+ * small sizes thumbnails have.
+ */
+std::vector<uint8_t> JpegWorkerPool::thumbnail(JpegEncoder *encoder,
+					       const JpegJob &job)
+{
+	const JpegEncoder::Image &image = job.image;
+	const unsigned int width = job.settings.thumbnailSize.width & ~1;
+	const unsigned int height = job.settings.thumbnailSize.height & ~1;
+
+	if (!width || !height)
+		return {};
+
+	const bool packed = image.format == PixelFormat(DRM_FORMAT_YUYV);
+	const unsigned int cbOffset = image.format == PixelFormat(DRM_FORMAT_NV21) ? 1 : 0;
+
+	std::vector<uint8_t> scaled(width * height * 3 / 2);
+	uint8_t *luma = scaled.data();
+	uint8_t *chroma = scaled.data() + width * height;
+
+	for (unsigned int y = 0; y < height; ++y) {
+		unsigned int sy = y * image.size.height / height;
+		const uint8_t *src = image.planes[0] + sy * image.strides[0];
+
+		for (unsigned int x = 0; x < width; ++x) {
+			unsigned int sx = x * image.size.width / width;
+			*luma++ = packed ? src[sx * 2] : src[sx];
+		}
+	}
+
+	for (unsigned int y = 0; y < height; y += 2) {
+		unsigned int sy = y * image.size.height / height;
+		const uint8_t *src = packed
+				   ? image.planes[0] + sy * image.strides[0]
+				   : image.planes[1] + sy / 2 * image.strides[1];
+
+		for (unsigned int x = 0; x < width; x += 2) {
+			unsigned int sx = (x * image.size.width / width) & ~1;
+			if (packed) {
+				*chroma++ = src[sx * 2 + 1];
+				*chroma++ = src[sx * 2 + 3];
+			} else {
+				*chroma++ = src[sx + cbOffset];
+				*chroma++ = src[sx + 1 - cbOffset];
+			}
+		}
+	}
+
+	JpegEncoder::Image thumbnailImage;
+	thumbnailImage.format = PixelFormat(DRM_FORMAT_NV12);
+	thumbnailImage.size = { width, height };
+	thumbnailImage.planes[0] = scaled.data();
+	thumbnailImage.planes[1] = scaled.data() + width * height;
+	thumbnailImage.strides[0] = width;
+	thumbnailImage.strides[1] = width;
+
+	/* Leave room for the headers of very small thumbnails. */
+	std::vector<uint8_t> thumbnail(scaled.size() + 1024);
+	int ret = encoder->encode(thumbnailImage, thumbnail,
+				  job.settings.thumbnailQuality);
+	if (ret < 0) {
+		LOG(HAL, Warning) << "Failed to encode thumbnail";
+		return {};
+	}
+
+	thumbnail.resize(ret);
+	return thumbnail;
+}
+
+void JpegWorkerPool::complete(JpegJob *job)
+{
+	MutexLocker locker(completionMutex_);
+
+	for (auto &entry : inFlight_) {
+		if (entry.first.get() == job) {
+			entry.second = true;
+			break;
+		}
+	}
+
+	/*
+	 * Signal completed jobs in order, with the lock held to prevent
+	 * another worker from signalling later jobs concurrently.
+	 */
+	while (!inFlight_.empty() && inFlight_.front().second) {
+		std::unique_ptr<JpegJob> done = std::move(inFlight_.front().first);
+		inFlight_.pop_front();
+		jobDone.emit(done.get());
+	}
+
+	if (inFlight_.empty())
+		idleCondition_.notify_all();
+}
@@ -0,0 +1,87 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * jpeg_worker_pool.h - Pool of threads encoding JPEG captures
+ */
+#ifndef __ANDROID_JPEG_WORKER_POOL_H__
+#define __ANDROID_JPEG_WORKER_POOL_H__
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <queue>
+#include <string>
+#include <thread>
+#include <time.h>
+#include <utility>
+#include <vector>
+
+#include <hardware/camera3.h>
+
+#include <libcamera/buffer.h>
+#include <libcamera/geometry.h>
+#include <libcamera/signal.h>
+
+#include "libcamera/internal/thread.h"
+
+#include "jpeg_encoder.h"
+
+struct JpegSettings {
+	JpegSettings()
+		: quality(95), thumbnailQuality(90), orientation(0)
+	{
+	}
+
+	int quality;
+	int thumbnailQuality;
+	libcamera::Size thumbnailSize;
+	int orientation;
+};
+
+struct JpegJob {
+	/* Input, filled by the caller. */
+	uint32_t frameNumber;
+	camera3_stream_buffer_t camera3Buffer;
+	libcamera::FrameBuffer *source;
+	JpegEncoder::Image image;
+	JpegSettings settings;
+	std::string make;
+	std::string model;
+	time_t timestamp;
+	bool requestError;
+
+	/* Input and output, see the JpegJob documentation. */
+	int status;
+};
+
+class JpegWorkerPool
+{
+public:
+	JpegWorkerPool(unsigned int numWorkers);
+	~JpegWorkerPool();
+
+	void queue(std::unique_ptr<JpegJob> job);
+	void flush();
+
+	libcamera::Signal<JpegJob *> jobDone;
+
+private:
+	void run();
+	int encode(JpegEncoder *encoder, JpegJob *job);
+	std::vector<uint8_t> thumbnail(JpegEncoder *encoder, const JpegJob &job);
+	void complete(JpegJob *job);
+
+	std::vector<std::thread> threads_;
+
+	libcamera::Mutex queueMutex_;
+	std::condition_variable queueCondition_;
+	std::queue<JpegJob *> pending_;
+	bool stopping_;
+
+	libcamera::Mutex completionMutex_;
+	std::condition_variable idleCondition_;
+	std::deque<std::pair<std::unique_ptr<JpegJob>, bool>> inFlight_;
+};
+
+#endif /* __ANDROID_JPEG_WORKER_POOL_H__ */
@@ -10,6 +10,7 @@
 #include <iostream>
 #include <limits.h>
 #include <sstream>
+#include <sys/mman.h>
 
 #include "capture.h"
 #include "main.h"
@@ -37,9 +38,11 @@ int Capture::run(EventLoop *loop, const OptionsParser::Options &options)
 	}
 
 	streamName_.clear();
+	streamIndex_.clear();
 	for (unsigned int index = 0; index < config_->size(); ++index) {
 		StreamConfiguration &cfg = config_->at(index);
 		streamName_[cfg.stream()] = "stream" + std::to_string(index);
+		streamIndex_[cfg.stream()] = index;
 	}
 
 	camera_->requestCompleted.connect(this, &Capture::requestComplete);
@@ -51,6 +54,17 @@ int Capture::run(EventLoop *loop, const OptionsParser::Options &options)
 			writer_ = new BufferWriter();
 	}
 
+	if (options.isSet(OptRecord)) {
+		recorder_ = std::make_unique<CaptureFileWriter>();
+		ret = recorder_->open(options[OptRecord]);
+		if (ret < 0) {
+			std::cerr << "Failed to open capture file" << std::endl;
+			recorder_.reset();
+			delete writer_;
+			writer_ = nullptr;
+			return ret;
+		}
+	}
 
 	FrameBufferAllocator *allocator = new FrameBufferAllocator(camera_);
 
@@ -61,6 +75,12 @@ int Capture::run(EventLoop *loop, const OptionsParser::Options &options)
 		writer_ = nullptr;
 	}
 
+	if (recorder_) {
+		recorder_->close();
+		recorder_.reset();
+		unmapBuffers();
+	}
+
 	delete allocator;
 
 	return ret;
@@ -111,6 +131,8 @@ int Capture::capture(EventLoop *loop, FrameBufferAllocator *allocator)
 
 			if (writer_)
 				writer_->mapBuffer(buffer.get());
+			if (recorder_)
+				mapBuffer(buffer.get());
 		}
 
 		requests.push_back(request);
@@ -179,6 +201,9 @@ void Capture::requestComplete(Request *request)
 
 		if (writer_)
 			writer_->write(buffer, name);
+
+		if (recorder_)
+			record(stream, buffer, request->metadata());
 	}
 
 	std::cout << info.str() << std::endl;
@@ -202,3 +227,54 @@ void Capture::requestComplete(Request *request)
 
 	camera_->queueRequest(request);
 }
+
+void Capture::mapBuffer(FrameBuffer *buffer)
+{
+	std::vector<Span<uint8_t>> &planes = mappedBuffers_[buffer];
+
+	for (const FrameBuffer::Plane &plane : buffer->planes()) {
+		void *memory = mmap(NULL, plane.length, PROT_READ, MAP_SHARED,
+				    plane.fd.fd(), 0);
+		if (memory == MAP_FAILED) {
+			std::cerr << "Failed to map buffer" << std::endl;
+			memory = nullptr;
+		}
+
+		planes.emplace_back(static_cast<uint8_t *>(memory),
+				    memory ? plane.length : 0);
+	}
+}
+
+void Capture::unmapBuffers()
+{
+	for (auto &iter : mappedBuffers_) {
+		for (const Span<uint8_t> &plane : iter.second) {
+			if (plane.data())
+				munmap(plane.data(), plane.size());
+		}
+	}
+
+	mappedBuffers_.clear();
+}
+
+void Capture::record(Stream *stream, FrameBuffer *buffer,
+		     const ControlList &metadata)
+{
+	const std::vector<Span<uint8_t>> &mapped = mappedBuffers_[buffer];
+	const FrameMetadata &frame = buffer->metadata();
+	std::vector<Span<const uint8_t>> planes;
+
+	for (unsigned int i = 0; i < mapped.size(); ++i) {
+		size_t size = mapped[i].size();
+		if (i < frame.planes.size() && frame.planes[i].bytesused)
+			size = std::min<size_t>(size, frame.planes[i].bytesused);
+
+		planes.emplace_back(mapped[i].data(), size);
+	}
+
+	int ret = recorder_->write(streamIndex_[stream],
+				   stream->configuration(), frame, planes,
+				   metadata);
+	if (ret < 0)
+		std::cerr << "Failed to record frame" << std::endl;
+}
@@ -8,12 +8,16 @@
 #define __CAM_CAPTURE_H__
 
 #include <chrono>
+#include <map>
 #include <memory>
+#include <vector>
 
 #include <libcamera/buffer.h>
 #include <libcamera/camera.h>
+#include <libcamera/capture_file.h>
 #include <libcamera/framebuffer_allocator.h>
 #include <libcamera/request.h>
+#include <libcamera/span.h>
 #include <libcamera/stream.h>
 
 #include "buffer_writer.h"
@@ -33,11 +37,20 @@ private:
 
 	void requestComplete(libcamera::Request *request);
 
+	void mapBuffer(libcamera::FrameBuffer *buffer);
+	void unmapBuffers();
+	void record(libcamera::Stream *stream, libcamera::FrameBuffer *buffer,
+		    const libcamera::ControlList &metadata);
+
 	std::shared_ptr<libcamera::Camera> camera_;
 	libcamera::CameraConfiguration *config_;
 
 	std::map<libcamera::Stream *, std::string> streamName_;
 	BufferWriter *writer_;
+	std::unique_ptr<libcamera::CaptureFileWriter> recorder_;
+	std::map<libcamera::Stream *, unsigned int> streamIndex_;
+	std::map<const libcamera::FrameBuffer *,
+		 std::vector<libcamera::Span<uint8_t>>> mappedBuffers_;
 	std::chrono::steady_clock::time_point last_;
 };
 
@@ -168,6 +168,9 @@ int CamApp::parseOptions(int argc, char *argv[])
 			 "The first '#' character in the file name is expanded to the stream name and frame sequence number.\n"
 			 "The default file name is 'frame-#.bin'.",
 			 "file", ArgumentOptional, "filename");
+	parser.addOption(OptRecord, OptionString,
+			 "Record captured frames and their metadata to a capture file",
+			 "record", ArgumentRequired, "filename");
 	parser.addOption(OptStream, &streamKeyValue,
 			 "Set configuration of a camera stream", "stream", true);
 	parser.addOption(OptHelp, OptionNone, "Display this help message",
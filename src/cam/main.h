@@ -15,6 +15,7 @@ enum {
 	OptInfo = 'I',
 	OptList = 'l',
 	OptListProperties = 'p',
+	OptRecord = 'R',
 	OptStream = 's',
 	OptListControls = 256,
 };
@@ -8,6 +8,10 @@
 
 #include "gstlibcamerapool.h"
 
+#include <vector>
+
+#include <libcamera/buffer.h>
+#include <libcamera/file_descriptor.h>
 #include <libcamera/stream.h>
 
 #include "gstlibcamera-utils.h"
@@ -26,11 +30,88 @@ struct _GstLibcameraPool {
 
 	GstAtomicQueue *queue;
 	GstLibcameraAllocator *allocator;
+	GstBufferPool *downstream_pool;
 	Stream *stream;
 };
 
 G_DEFINE_TYPE(GstLibcameraPool, gst_libcamera_pool, GST_TYPE_BUFFER_POOL);
 
+/* The downstream buffer imported in one of our buffers. */
+G_DEFINE_QUARK(GstLibcameraImportedBuffer, gst_libcamera_imported_buffer);
+/* The FrameBuffer wrapping the dmabufs of a downstream memory. */
+G_DEFINE_QUARK(GstLibcameraImportedFrame, gst_libcamera_imported_frame);
+
+static void
+gst_libcamera_pool_free_frame_buffer(gpointer data)
+{
+	delete static_cast<FrameBuffer *>(data);
+}
+
+/*
+ * Retrieve the FrameBuffer wrapping the dmabuf of a downstream buffer,
+ * creating it the first time the memory is seen. The FrameBuffer is attached
+ * to the first memory of the buffer and shares its lifetime. This keeps the
+ * file descriptors stable when the same memory is imported again, which the
+ * V4L2 buffer cache relies on to avoid remapping buffers.
+ */
+static FrameBuffer *
+gst_libcamera_pool_import_frame_buffer(GstBuffer *buffer)
+{
+	if (!gst_buffer_n_memory(buffer))
+		return nullptr;
+
+	GstMemory *first = gst_buffer_peek_memory(buffer, 0);
+	auto *fb = static_cast<FrameBuffer *>(gst_mini_object_get_qdata(GST_MINI_OBJECT(first),
+									 gst_libcamera_imported_frame_quark()));
+	if (fb)
+		return fb;
+
+	/*
+	 * The buffer has been checked to consist of a single dmabuf, import it
+	 * as a single plane. FrameBuffer planes have no offset into the dmabuf.
+	 */
+	if (!gst_is_dmabuf_memory(first) || first->offset)
+		return nullptr;
+
+	FrameBuffer::Plane plane;
+	plane.fd = FileDescriptor(gst_dmabuf_memory_get_fd(first));
+	plane.length = gst_buffer_get_size(buffer);
+
+	fb = new FrameBuffer({ plane });
+	gst_mini_object_set_qdata(GST_MINI_OBJECT(first),
+				  gst_libcamera_imported_frame_quark(), fb,
+				  gst_libcamera_pool_free_frame_buffer);
+
+	return fb;
+}
+
+static bool
+gst_libcamera_pool_import_buffer(GstLibcameraPool *self, GstBuffer *buffer)
+{
+	GstBufferPoolAcquireParams params = {};
+	GstBuffer *imported;
+
+	params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+	if (gst_buffer_pool_acquire_buffer(self->downstream_pool, &imported,
+					   &params) != GST_FLOW_OK)
+		return false;
+
+	if (!gst_libcamera_pool_import_frame_buffer(imported)) {
+		gst_buffer_unref(imported);
+		return false;
+	}
+
+	for (guint i = 0; i < gst_buffer_n_memory(imported); i++)
+		gst_buffer_append_memory(buffer, gst_buffer_get_memory(imported, i));
+
+	/* Hold the downstream buffer until our buffer is returned. */
+	gst_mini_object_set_qdata(GST_MINI_OBJECT(buffer),
+				  gst_libcamera_imported_buffer_quark(), imported,
+				  (GDestroyNotify)gst_buffer_unref);
+
+	return true;
+}
+
 static GstFlowReturn
 gst_libcamera_pool_acquire_buffer(GstBufferPool *pool, GstBuffer **buffer,
 				  GstBufferPoolAcquireParams *params)
@@ -40,8 +121,17 @@ gst_libcamera_pool_acquire_buffer(GstBufferPool *pool, GstBuffer **buffer,
 	if (!buf)
 		return GST_FLOW_ERROR;
 
-	if (!gst_libcamera_allocator_prepare_buffer(self->allocator, self->stream, buf))
+	bool prepared;
+	if (self->downstream_pool)
+		prepared = gst_libcamera_pool_import_buffer(self, buf);
+	else
+		prepared = gst_libcamera_allocator_prepare_buffer(self->allocator,
+								  self->stream, buf);
+
+	if (!prepared) {
+		gst_atomic_queue_push(self->queue, buf);
 		return GST_FLOW_ERROR;
+	}
 
 	*buffer = buf;
 	return GST_FLOW_OK;
@@ -54,6 +144,9 @@ gst_libcamera_pool_reset_buffer(GstBufferPool *pool, GstBuffer *buffer)
 
 	/* Clears all the memories and only pool the GstBuffer objects */
 	gst_buffer_remove_all_memory(buffer);
+	gst_mini_object_set_qdata(GST_MINI_OBJECT(buffer),
+				  gst_libcamera_imported_buffer_quark(),
+				  nullptr, nullptr);
 	klass->reset_buffer(pool, buffer);
 	GST_BUFFER_FLAGS(buffer) = 0;
 }
@@ -86,7 +179,12 @@ gst_libcamera_pool_finalize(GObject *object)
 		gst_buffer_unref(buf);
 
 	gst_atomic_queue_unref(self->queue);
-	g_object_unref(self->allocator);
+	g_clear_object(&self->allocator);
+
+	if (self->downstream_pool) {
+		gst_buffer_pool_set_active(self->downstream_pool, FALSE);
+		gst_object_unref(self->downstream_pool);
+	}
 
 	G_OBJECT_CLASS(gst_libcamera_pool_parent_class)->finalize(object);
 }
@@ -126,12 +224,40 @@ gst_libcamera_pool_new(GstLibcameraAllocator *allocator, Stream *stream)
 	return pool;
 }
 
+/*
+ * Create a pool whose buffers wrap the dmabufs of buffers acquired from the
+ * configured and active \a downstream_pool. The downstream pool is deactivated
+ * when the returned pool is finalized.
+ */
+GstLibcameraPool *
+gst_libcamera_pool_new_import(GstBufferPool *downstream_pool, Stream *stream,
+			      gsize size)
+{
+	auto *pool = GST_LIBCAMERA_POOL(g_object_new(GST_TYPE_LIBCAMERA_POOL, nullptr));
+
+	pool->downstream_pool = GST_BUFFER_POOL(gst_object_ref(downstream_pool));
+	pool->stream = stream;
+
+	for (gsize i = 0; i < size; i++) {
+		GstBuffer *buffer = gst_buffer_new();
+		gst_atomic_queue_push(pool->queue, buffer);
+	}
+
+	return pool;
+}
+
 Stream *
 gst_libcamera_pool_get_stream(GstLibcameraPool *self)
 {
 	return self->stream;
 }
 
+bool
+gst_libcamera_pool_is_empty(GstLibcameraPool *self)
+{
+	return gst_atomic_queue_length(self->queue) == 0;
+}
+
 Stream *
 gst_libcamera_buffer_get_stream(GstBuffer *buffer)
 {
@@ -143,5 +269,10 @@ FrameBuffer *
 gst_libcamera_buffer_get_frame_buffer(GstBuffer *buffer)
 {
 	GstMemory *mem = gst_buffer_peek_memory(buffer, 0);
+	auto *fb = static_cast<FrameBuffer *>(gst_mini_object_get_qdata(GST_MINI_OBJECT(mem),
+									 gst_libcamera_imported_frame_quark()));
+	if (fb)
+		return fb;
+
 	return gst_libcamera_memory_get_frame_buffer(mem);
 }
@@ -24,8 +24,14 @@ G_DECLARE_FINAL_TYPE(GstLibcameraPool, gst_libcamera_pool, GST_LIBCAMERA, POOL,
 GstLibcameraPool *gst_libcamera_pool_new(GstLibcameraAllocator *allocator,
 					 libcamera::Stream *stream);
 
+GstLibcameraPool *gst_libcamera_pool_new_import(GstBufferPool *downstream_pool,
+						libcamera::Stream *stream,
+						gsize size);
+
 libcamera::Stream *gst_libcamera_pool_get_stream(GstLibcameraPool *self);
 
+bool gst_libcamera_pool_is_empty(GstLibcameraPool *self);
+
 libcamera::Stream *gst_libcamera_buffer_get_stream(GstBuffer *buffer);
 
 libcamera::FrameBuffer *gst_libcamera_buffer_get_frame_buffer(GstBuffer *buffer);
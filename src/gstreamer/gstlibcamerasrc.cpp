@@ -17,12 +17,10 @@
  *    + Evaluate if a single streaming thread is fine
  *  - Add application driven request (snapshot)
  *  - Add framerate control
- *  - Add buffer importation support
  *
  *  Requires new libcamera API:
  *  - Add framerate negotiation support
  *  - Add colorimetry support
- *  - Add timestamp support
  *  - Use unique names to select the camera devices
  *  - Add GstVideoMeta support (strides and offsets)
  *
@@ -34,6 +32,7 @@
 #include "gstlibcamerasrc.h"
 
 #include <queue>
+#include <time.h>
 #include <vector>
 
 #include <gst/base/base.h>
@@ -52,9 +51,12 @@ GST_DEBUG_CATEGORY_STATIC(source_debug);
 #define GST_CAT_DEFAULT source_debug
 
 struct RequestWrap {
-	RequestWrap(Request *request);
+	RequestWrap();
 	~RequestWrap();
 
+	void setRequest(Request *request);
+	void releaseBuffers();
+
 	void attachBuffer(GstBuffer *buffer);
 	GstBuffer *detachBuffer(Stream *stream);
 
@@ -63,16 +65,33 @@ struct RequestWrap {
 	std::map<Stream *, GstBuffer *> buffers_;
 };
 
-RequestWrap::RequestWrap(Request *request)
-	: request_(request)
+RequestWrap::RequestWrap()
+	: request_(nullptr)
 {
 }
 
 RequestWrap::~RequestWrap()
+{
+	releaseBuffers();
+}
+
+void RequestWrap::setRequest(Request *request)
+{
+	request_ = request;
+}
+
+/*
+ * Drop the buffers still attached to the wrap, returning them to their pool.
+ * The map entries are kept, so that reusing the wrap for the same streams
+ * doesn't allocate memory.
+ */
+void RequestWrap::releaseBuffers()
 {
 	for (std::pair<Stream *const, GstBuffer *> &item : buffers_) {
-		if (item.second)
+		if (item.second) {
 			gst_buffer_unref(item.second);
+			item.second = nullptr;
+		}
 	}
 }
 
@@ -85,7 +104,8 @@ void RequestWrap::attachBuffer(GstBuffer *buffer)
 
 	auto item = buffers_.find(stream);
 	if (item != buffers_.end()) {
-		gst_buffer_unref(item->second);
+		if (item->second)
+			gst_buffer_unref(item->second);
 		item->second = buffer;
 	} else {
 		buffers_[stream] = buffer;
@@ -114,10 +134,37 @@ struct GstLibcameraSrcState {
 	std::unique_ptr<CameraConfiguration> config_;
 	std::vector<GstPad *> srcpads_;
 	std::queue<std::unique_ptr<RequestWrap>> requests_;
+	std::vector<std::unique_ptr<RequestWrap>> freeWraps_;
+
+	/*
+	 * The streaming task has been woken up to push completed buffers and
+	 * hasn't paused since.
+	 */
+	bool wakeupPending_;
+
+	/* Clock correlation and latency tracking, see updateClock(). */
+	GstClock *clock_;
+	bool clockIsMonotonic_;
+	GstClockTimeDiff clockOffset_;
+	guint64 lastTimestamp_;
+	GstClockTime frameInterval_;
+	GstClockTime latency_;
+	bool latencyChanged_;
+
+	std::unique_ptr<RequestWrap> getWrap();
+	void recycleWrap(std::unique_ptr<RequestWrap> wrap);
+
+	void resetClock();
+	void updateClock(GstClock *clock, guint64 timestamp);
 
 	void requestCompleted(Request *request);
 };
 
+typedef enum {
+	GST_LIBCAMERA_IO_MODE_MMAP,
+	GST_LIBCAMERA_IO_MODE_DMABUF_IMPORT,
+} GstLibcameraIOMode;
+
 struct _GstLibcameraSrc {
 	GstElement parent;
 
@@ -125,6 +172,7 @@ struct _GstLibcameraSrc {
 	GstTask *task;
 
 	gchar *camera_name;
+	GstLibcameraIOMode io_mode;
 
 	GstLibcameraSrcState *state;
 	GstLibcameraAllocator *allocator;
@@ -133,7 +181,8 @@ struct _GstLibcameraSrc {
 
 enum {
 	PROP_0,
-	PROP_CAMERA_NAME
+	PROP_CAMERA_NAME,
+	PROP_IO_MODE,
 };
 
 G_DEFINE_TYPE_WITH_CODE(GstLibcameraSrc, gst_libcamera_src, GST_TYPE_ELEMENT,
@@ -152,6 +201,131 @@ GstStaticPadTemplate request_src_template = {
 	"src_%s", GST_PAD_SRC, GST_PAD_REQUEST, TEMPLATE_CAPS
 };
 
+static GType
+gst_libcamera_io_mode_get_type(void)
+{
+	static gsize type = 0;
+	static const GEnumValue values[] = {
+		{ GST_LIBCAMERA_IO_MODE_MMAP, "Allocate buffers with libcamera", "mmap" },
+		{ GST_LIBCAMERA_IO_MODE_DMABUF_IMPORT, "Import dmabufs from downstream", "dmabuf-import" },
+		{ 0, NULL, NULL }
+	};
+
+	if (g_once_init_enter(&type)) {
+		GType enum_type = g_enum_register_static("GstLibcameraIOMode", values);
+		g_once_init_leave(&type, enum_type);
+	}
+
+	return type;
+}
+
+/* Must be called with the src object lock held. */
+std::unique_ptr<RequestWrap>
+GstLibcameraSrcState::getWrap()
+{
+	if (freeWraps_.empty())
+		return std::make_unique<RequestWrap>();
+
+	std::unique_ptr<RequestWrap> wrap = std::move(freeWraps_.back());
+	freeWraps_.pop_back();
+	return wrap;
+}
+
+/* Must be called with the src object lock held. */
+void
+GstLibcameraSrcState::recycleWrap(std::unique_ptr<RequestWrap> wrap)
+{
+	wrap->releaseBuffers();
+	wrap->setRequest(nullptr);
+	freeWraps_.push_back(std::move(wrap));
+}
+
+/* Must be called with the src object lock held. */
+void
+GstLibcameraSrcState::resetClock()
+{
+	clock_ = nullptr;
+	clockIsMonotonic_ = false;
+	clockOffset_ = 0;
+	lastTimestamp_ = 0;
+	frameInterval_ = 0;
+	latency_ = 0;
+	latencyChanged_ = false;
+}
+
+/*
+ * Update the correlation between the clock of libcamera timestamps, which is
+ * CLOCK_MONOTONIC, and the element clock, as well as the latency estimate,
+ * for a frame captured at \a timestamp. Must be called with the src object
+ * lock held.
+ */
+void
+GstLibcameraSrcState::updateClock(GstClock *clock, guint64 timestamp)
+{
+	struct timespec ts;
+
+	if (clock != clock_) {
+		resetClock();
+		clock_ = clock;
+
+		/*
+		 * The default system clock runs on CLOCK_MONOTONIC, the offset
+		 * is then zero and doesn't need to be measured.
+		 */
+		if (GST_IS_SYSTEM_CLOCK(clock)) {
+			GstClockType type;
+			g_object_get(clock, "clock-type", &type, nullptr);
+			clockIsMonotonic_ = type == GST_CLOCK_TYPE_MONOTONIC;
+		}
+	}
+
+	/*
+	 * Sample both clocks back to back, and smooth the offset to filter out
+	 * the jitter caused by preemption between the two reads, while still
+	 * tracking the drift between the clocks.
+	 */
+	GstClockTime gst_now = gst_clock_get_time(clock);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	GstClockTime sys_now = GST_TIMESPEC_TO_TIME(ts);
+
+	if (!clockIsMonotonic_) {
+		GstClockTimeDiff offset = GST_CLOCK_DIFF(sys_now, gst_now);
+		if (!lastTimestamp_)
+			clockOffset_ = offset;
+		else
+			clockOffset_ += (offset - clockOffset_) / 16;
+	}
+
+	/*
+	 * Report the latency as a whole number of frame intervals, computed
+	 * from the number of frames the pipeline holds between capture and
+	 * completion. This keeps the latency stable across frames, and only
+	 * notifies downstream when the pipeline depth changes.
+	 */
+	if (lastTimestamp_ && timestamp > lastTimestamp_) {
+		GstClockTime interval = timestamp - lastTimestamp_;
+		if (!frameInterval_)
+			frameInterval_ = interval;
+		else
+			frameInterval_ = (frameInterval_ * 15 + interval) / 16;
+	}
+	lastTimestamp_ = timestamp;
+
+	if (frameInterval_ && sys_now > timestamp) {
+		guint64 depth = (sys_now - timestamp + frameInterval_ - 1) / frameInterval_;
+		GstClockTime latency = depth * frameInterval_;
+
+		/* Ignore variations within half a frame to avoid flapping. */
+		GstClockTimeDiff diff = GST_CLOCK_DIFF(latency_, latency);
+		if (ABS(diff) > static_cast<GstClockTimeDiff>(frameInterval_ / 2)) {
+			latency_ = latency;
+			latencyChanged_ = true;
+			for (GstPad *srcpad : srcpads_)
+				gst_libcamera_pad_set_latency(srcpad, latency_);
+		}
+	}
+}
+
 void
 GstLibcameraSrcState::requestCompleted(Request *request)
 {
@@ -166,9 +340,13 @@ GstLibcameraSrcState::requestCompleted(Request *request)
 
 	if ((request->status() == Request::RequestCancelled)) {
 		GST_DEBUG_OBJECT(src_, "Request was cancelled");
+		recycleWrap(std::move(wrap));
 		return;
 	}
 
+	GstClock *clock = GST_ELEMENT_CLOCK(src_);
+	bool clock_updated = false;
+
 	GstBuffer *buffer;
 	for (GstPad *srcpad : srcpads_) {
 		Stream *stream = gst_libcamera_pad_get_stream(srcpad);
@@ -176,16 +354,23 @@ GstLibcameraSrcState::requestCompleted(Request *request)
 
 		FrameBuffer *fb = gst_libcamera_buffer_get_frame_buffer(buffer);
 
-		if (GST_ELEMENT_CLOCK(src_)) {
+		if (clock) {
+			/* All buffers of a request are captured together. */
+			if (!clock_updated) {
+				updateClock(clock, fb->metadata().timestamp);
+				clock_updated = true;
+			}
+
+			/*
+			 * Deduced from:
+			 * timestamp + clockOffset_ == gst_time
+			 * pts == gst_time - gst_base_time
+			 */
 			GstClockTime gst_base_time = GST_ELEMENT(src_)->base_time;
-			GstClockTime gst_now = gst_clock_get_time(GST_ELEMENT_CLOCK(src_));
-			/* \todo Need to expose which reference clock the timestamp relates to. */
-			GstClockTime sys_now = g_get_monotonic_time() * 1000;
-
-			/* Deduced from: sys_now - sys_base_time == gst_now - gst_base_time */
-			GstClockTime sys_base_time = sys_now - (gst_now - gst_base_time);
-			GST_BUFFER_PTS(buffer) = fb->metadata().timestamp - sys_base_time;
-			gst_libcamera_pad_set_latency(srcpad, sys_now - fb->metadata().timestamp);
+			GstClockTimeDiff pts = static_cast<GstClockTimeDiff>(fb->metadata().timestamp)
+					     + clockOffset_
+					     - static_cast<GstClockTimeDiff>(gst_base_time);
+			GST_BUFFER_PTS(buffer) = pts > 0 ? pts : 0;
 		} else {
 			GST_BUFFER_PTS(buffer) = 0;
 		}
@@ -196,7 +381,16 @@ GstLibcameraSrcState::requestCompleted(Request *request)
 		gst_libcamera_pad_queue_buffer(srcpad, buffer);
 	}
 
-	gst_libcamera_resume_task(this->src_->task);
+	recycleWrap(std::move(wrap));
+
+	/*
+	 * Wake the task up once per batch of completed requests. Requests that
+	 * complete before the task pauses again are pushed in the same run.
+	 */
+	if (!wakeupPending_) {
+		wakeupPending_ = true;
+		gst_libcamera_resume_task(this->src_->task);
+	}
 }
 
 static bool
@@ -266,41 +460,95 @@ gst_libcamera_src_task_run(gpointer user_data)
 	GstLibcameraSrc *self = GST_LIBCAMERA_SRC(user_data);
 	GstLibcameraSrcState *state = self->state;
 
-	Request *request = state->cam_->createRequest();
-	auto wrap = std::make_unique<RequestWrap>(request);
-	for (GstPad *srcpad : state->srcpads_) {
-		GstLibcameraPool *pool = gst_libcamera_pad_get_pool(srcpad);
-		GstBuffer *buffer;
-		GstFlowReturn ret;
+	/*
+	 * Queue requests ahead for as long as all the pools have buffers
+	 * available, to keep the camera pipeline full without waking up the
+	 * task for every frame. Only the streaming thread acquires buffers,
+	 * the pools can thus not run dry between the check and the
+	 * acquisition.
+	 */
+	for (;;) {
+		bool ready = true;
+		for (GstPad *srcpad : state->srcpads_) {
+			GstLibcameraPool *pool = gst_libcamera_pad_get_pool(srcpad);
+			if (gst_libcamera_pool_is_empty(pool)) {
+				ready = false;
+				break;
+			}
+		}
 
-		ret = gst_buffer_pool_acquire_buffer(GST_BUFFER_POOL(pool),
-						     &buffer, nullptr);
-		if (ret != GST_FLOW_OK) {
-			/*
-			 * RequestWrap does not take ownership, and we won't be
-			 * queueing this one due to lack of buffers.
-			 */
-			delete request;
-			request = nullptr;
+		if (!ready)
 			break;
+
+		std::unique_ptr<RequestWrap> wrap;
+		{
+			GLibLocker lock(GST_OBJECT(self));
+			wrap = state->getWrap();
 		}
 
-		wrap->attachBuffer(buffer);
-	}
+		Request *request = state->cam_->createRequest();
+		wrap->setRequest(request);
+
+		for (GstPad *srcpad : state->srcpads_) {
+			GstLibcameraPool *pool = gst_libcamera_pad_get_pool(srcpad);
+			GstBuffer *buffer;
+			GstFlowReturn ret;
+
+			ret = gst_buffer_pool_acquire_buffer(GST_BUFFER_POOL(pool),
+							     &buffer, nullptr);
+			if (ret != GST_FLOW_OK) {
+				/*
+				 * RequestWrap does not take ownership, and we
+				 * won't be queueing this one due to lack of
+				 * buffers.
+				 */
+				delete request;
+				request = nullptr;
+				break;
+			}
+
+			wrap->attachBuffer(buffer);
+		}
 
-	if (request) {
 		GLibLocker lock(GST_OBJECT(self));
+
+		if (!request) {
+			state->recycleWrap(std::move(wrap));
+			break;
+		}
+
 		GST_TRACE_OBJECT(self, "Requesting buffers");
 		state->cam_->queueRequest(request);
 		state->requests_.push(std::move(wrap));
 	}
 
+	bool latency_changed;
+	{
+		GLibLocker lock(GST_OBJECT(self));
+		latency_changed = state->latencyChanged_;
+		state->latencyChanged_ = false;
+	}
+
+	if (latency_changed)
+		gst_element_post_message(GST_ELEMENT(self),
+					 gst_message_new_latency(GST_OBJECT(self)));
+
+	/*
+	 * Push all the buffers that have completed since the last iteration in
+	 * one go, interleaving the pads to keep the streams in sync.
+	 */
 	GstFlowReturn ret = GST_FLOW_OK;
 	gst_flow_combiner_reset(self->flow_combiner);
-	for (GstPad *srcpad : state->srcpads_) {
-		ret = gst_libcamera_pad_push_pending(srcpad);
-		ret = gst_flow_combiner_update_pad_flow(self->flow_combiner,
-							srcpad, ret);
+	for (bool pending = true; pending && ret == GST_FLOW_OK;) {
+		pending = false;
+
+		for (GstPad *srcpad : state->srcpads_) {
+			ret = gst_libcamera_pad_push_pending(srcpad);
+			ret = gst_flow_combiner_update_pad_flow(self->flow_combiner,
+								srcpad, ret);
+			if (gst_libcamera_pad_has_pending(srcpad))
+				pending = true;
+		}
 	}
 
 	{
@@ -332,9 +580,181 @@ gst_libcamera_src_task_run(gpointer user_data)
 			}
 		}
 
-		if (do_pause)
+		if (do_pause) {
+			state->wakeupPending_ = false;
 			gst_task_pause(self->task);
+		}
+	}
+}
+
+/*
+ * Check that downstream buffers consist of a single dmabuf, possibly split in
+ * contiguous memories. Buffers are imported with one FrameBuffer plane, as
+ * separate dmabufs per plane can only be used with video devices that
+ * implement the multi-planar API, which libcamera doesn't expose.
+ */
+static bool
+gst_libcamera_src_check_dmabuf(GstPad *srcpad, GstBuffer *buffer)
+{
+	guint n_memory = gst_buffer_n_memory(buffer);
+	gint fd = -1;
+	gsize offset = 0;
+
+	if (!n_memory)
+		return false;
+
+	for (guint i = 0; i < n_memory; i++) {
+		GstMemory *mem = gst_buffer_peek_memory(buffer, i);
+
+		if (!gst_is_dmabuf_memory(mem)) {
+			GST_WARNING_OBJECT(srcpad, "Downstream pool doesn't provide dmabufs");
+			return false;
+		}
+
+		if (i == 0)
+			fd = gst_dmabuf_memory_get_fd(mem);
+
+		if (gst_dmabuf_memory_get_fd(mem) != fd || mem->offset != offset) {
+			GST_WARNING_OBJECT(srcpad, "Downstream buffers span multiple dmabufs");
+			return false;
+		}
+
+		offset += mem->size;
+	}
+
+	return true;
+}
+
+/*
+ * Check that downstream buffers are laid out as libcamera fills them. Plane
+ * strides are derived from the stream stride, and planes follow each other in
+ * the buffer. Downstream describes its layout with a GstVideoMeta, or uses the
+ * default layout for the caps otherwise.
+ */
+static bool
+gst_libcamera_src_check_layout(GstPad *srcpad, GstBuffer *buffer,
+			       const GstVideoInfo &info,
+			       const StreamConfiguration &stream_cfg)
+{
+	guint n_planes = GST_VIDEO_INFO_N_PLANES(&info);
+	gint stride = GST_VIDEO_INFO_PLANE_STRIDE(&info, 0);
+
+	const GstVideoMeta *meta = gst_buffer_get_video_meta(buffer);
+	if (meta && meta->n_planes != n_planes) {
+		GST_WARNING_OBJECT(srcpad, "Downstream buffers have %u planes, %u expected",
+				   meta->n_planes, n_planes);
+		return false;
+	}
+
+	gsize offset = 0;
+	for (guint i = 0; i < n_planes; i++) {
+		gint plane_stride = GST_VIDEO_INFO_PLANE_STRIDE(&info, i) *
+				    static_cast<gint>(stream_cfg.stride) / stride;
+
+		if (i > 0) {
+			gsize lines = (GST_VIDEO_INFO_PLANE_OFFSET(&info, i) -
+				       GST_VIDEO_INFO_PLANE_OFFSET(&info, i - 1)) /
+				      GST_VIDEO_INFO_PLANE_STRIDE(&info, i - 1);
+			offset += lines * (GST_VIDEO_INFO_PLANE_STRIDE(&info, i - 1) *
+					   stream_cfg.stride / stride);
+		}
+
+		gint actual_stride = meta ? meta->stride[i]
+					  : GST_VIDEO_INFO_PLANE_STRIDE(&info, i);
+		gsize actual_offset = meta ? meta->offset[i]
+					   : GST_VIDEO_INFO_PLANE_OFFSET(&info, i);
+
+		if (actual_stride != plane_stride || actual_offset != offset) {
+			GST_WARNING_OBJECT(srcpad,
+					   "Downstream plane %u layout (stride %d, offset %"
+					   G_GSIZE_FORMAT ") doesn't match the stream (stride %d, offset %"
+					   G_GSIZE_FORMAT ")", i, actual_stride, actual_offset,
+					   plane_stride, offset);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Retrieve a buffer pool from downstream to import dmabufs from, through an
+ * allocation query. The pool is configured for the stream and activated.
+ * Return nullptr if downstream can't provide dmabufs suitable for the
+ * stream, with the stride and plane layout of the stream configuration, in
+ * which case buffers shall be allocated by libcamera.
+ */
+static GstBufferPool *
+gst_libcamera_src_get_import_pool(GstLibcameraSrc *self, GstPad *srcpad,
+				  const StreamConfiguration &stream_cfg)
+{
+	g_autoptr(GstCaps) caps = gst_libcamera_stream_configuration_to_caps(stream_cfg);
+	g_autoptr(GstQuery) query = gst_query_new_allocation(caps, TRUE);
+	GstBufferPool *pool = nullptr;
+	guint size, min, max;
+
+	if (!gst_pad_peer_query(srcpad, query) ||
+	    !gst_query_get_n_allocation_pools(query)) {
+		GST_WARNING_OBJECT(srcpad, "Downstream proposed no buffer pool");
+		return nullptr;
 	}
+
+	gst_query_parse_nth_allocation_pool(query, 0, &pool, &size, &min, &max);
+	if (!pool) {
+		GST_WARNING_OBJECT(srcpad, "Downstream proposed no buffer pool");
+		return nullptr;
+	}
+
+	if (max && max < stream_cfg.bufferCount) {
+		GST_WARNING_OBJECT(srcpad, "Downstream pool is limited to %u buffers, %u needed",
+				   max, stream_cfg.bufferCount);
+		gst_object_unref(pool);
+		return nullptr;
+	}
+
+	GstVideoInfo info;
+	bool raw = gst_video_info_from_caps(&info, caps);
+	if (raw)
+		size = MAX(size, info.size);
+
+	/*
+	 * Size the pool to the number of buffers the camera uses, to keep a
+	 * steady set of dmabufs cycling through the V4L2 buffer cache.
+	 */
+	GstStructure *config = gst_buffer_pool_get_config(pool);
+	gst_buffer_pool_config_set_params(config, caps, size,
+					  stream_cfg.bufferCount,
+					  stream_cfg.bufferCount);
+	if (!gst_buffer_pool_set_config(pool, config) ||
+	    !gst_buffer_pool_set_active(pool, TRUE)) {
+		GST_WARNING_OBJECT(srcpad, "Failed to configure downstream pool");
+		gst_object_unref(pool);
+		return nullptr;
+	}
+
+	/*
+	 * Only dmabufs can be imported, and they must be laid out as the
+	 * stream, check what the pool produces.
+	 */
+	GstBuffer *buffer;
+	bool dmabuf = false;
+	bool layout = false;
+	if (gst_buffer_pool_acquire_buffer(pool, &buffer, nullptr) == GST_FLOW_OK) {
+		dmabuf = gst_libcamera_src_check_dmabuf(srcpad, buffer);
+		layout = !raw || gst_libcamera_src_check_layout(srcpad, buffer,
+								info, stream_cfg);
+		gst_buffer_unref(buffer);
+	}
+
+	if (!dmabuf || !layout) {
+		gst_buffer_pool_set_active(pool, FALSE);
+		gst_object_unref(pool);
+		return nullptr;
+	}
+
+	GST_DEBUG_OBJECT(srcpad, "Importing buffers from %" GST_PTR_FORMAT, pool);
+
+	return pool;
 }
 
 static void
@@ -424,26 +844,69 @@ gst_libcamera_src_task_enter(GstTask *task, GThread *thread, gpointer user_data)
 		return;
 	}
 
-	self->allocator = gst_libcamera_allocator_new(state->cam_);
-	if (!self->allocator) {
-		GST_ELEMENT_ERROR(self, RESOURCE, NO_SPACE_LEFT,
-				  ("Failed to allocate memory"),
-				  ("gst_libcamera_allocator_new() failed."));
-		gst_task_stop(task);
-		return;
-	}
+	/*
+	 * In dmabuf-import mode, use the buffers provided by downstream when
+	 * possible, and fall back to allocating buffers otherwise.
+	 */
+	{
+		std::vector<GstBufferPool *> import_pools(state->srcpads_.size(), nullptr);
+		std::vector<Stream *> alloc_streams;
+		for (gsize i = 0; i < state->srcpads_.size(); i++) {
+			const StreamConfiguration &stream_cfg = state->config_->at(i);
+
+			if (self->io_mode == GST_LIBCAMERA_IO_MODE_DMABUF_IMPORT)
+				import_pools[i] = gst_libcamera_src_get_import_pool(self,
+										    state->srcpads_[i],
+										    stream_cfg);
+
+			if (!import_pools[i])
+				alloc_streams.push_back(stream_cfg.stream());
+		}
 
-	self->flow_combiner = gst_flow_combiner_new();
-	for (gsize i = 0; i < state->srcpads_.size(); i++) {
-		GstPad *srcpad = state->srcpads_[i];
-		const StreamConfiguration &stream_cfg = state->config_->at(i);
-		GstLibcameraPool *pool = gst_libcamera_pool_new(self->allocator,
-								stream_cfg.stream());
-		g_signal_connect_swapped(pool, "buffer-notify",
-					 G_CALLBACK(gst_libcamera_resume_task), task);
+		self->allocator = gst_libcamera_allocator_new(state->cam_, alloc_streams);
+		if (!self->allocator) {
+			for (GstBufferPool *import_pool : import_pools) {
+				if (import_pool) {
+					gst_buffer_pool_set_active(import_pool, FALSE);
+					gst_object_unref(import_pool);
+				}
+			}
+
+			GST_ELEMENT_ERROR(self, RESOURCE, NO_SPACE_LEFT,
+					  ("Failed to allocate memory"),
+					  ("gst_libcamera_allocator_new() failed."));
+			gst_task_stop(task);
+			return;
+		}
+
+		self->flow_combiner = gst_flow_combiner_new();
+		for (gsize i = 0; i < state->srcpads_.size(); i++) {
+			GstPad *srcpad = state->srcpads_[i];
+			const StreamConfiguration &stream_cfg = state->config_->at(i);
+			GstLibcameraPool *pool;
+
+			if (import_pools[i]) {
+				pool = gst_libcamera_pool_new_import(import_pools[i],
+								     stream_cfg.stream(),
+								     stream_cfg.bufferCount);
+				gst_object_unref(import_pools[i]);
+			} else {
+				pool = gst_libcamera_pool_new(self->allocator,
+							      stream_cfg.stream());
+			}
+
+			g_signal_connect_swapped(pool, "buffer-notify",
+						 G_CALLBACK(gst_libcamera_resume_task), task);
 
-		gst_libcamera_pad_set_pool(srcpad, pool);
-		gst_flow_combiner_add_pad(self->flow_combiner, srcpad);
+			gst_libcamera_pad_set_pool(srcpad, pool);
+			gst_flow_combiner_add_pad(self->flow_combiner, srcpad);
+		}
+	}
+
+	{
+		GLibLocker lock(GST_OBJECT(self));
+		state->resetClock();
+		state->wakeupPending_ = false;
 	}
 
 	ret = state->cam_->start();
@@ -476,6 +939,11 @@ gst_libcamera_src_task_leave(GstTask *task, GThread *thread, gpointer user_data)
 
 	state->cam_->stop();
 
+	{
+		GLibLocker lock(GST_OBJECT(self));
+		state->freeWraps_.clear();
+	}
+
 	for (GstPad *srcpad : state->srcpads_)
 		gst_libcamera_pad_set_pool(srcpad, nullptr);
 
@@ -516,6 +984,9 @@ gst_libcamera_src_set_property(GObject *object, guint prop_id,
 		g_free(self->camera_name);
 		self->camera_name = g_value_dup_string(value);
 		break;
+	case PROP_IO_MODE:
+		self->io_mode = (GstLibcameraIOMode)g_value_get_enum(value);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
@@ -533,6 +1004,9 @@ gst_libcamera_src_get_property(GObject *object, guint prop_id, GValue *value,
 	case PROP_CAMERA_NAME:
 		g_value_set_string(value, self->camera_name);
 		break;
+	case PROP_IO_MODE:
+		g_value_set_enum(value, self->io_mode);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
@@ -651,4 +1125,13 @@ gst_libcamera_src_class_init(GstLibcameraSrcClass *klass)
 							     | G_PARAM_READWRITE
 							     | G_PARAM_STATIC_STRINGS));
 	g_object_class_install_property(object_class, PROP_CAMERA_NAME, spec);
+
+	spec = g_param_spec_enum("io-mode", "IO Mode",
+				 "How buffers are allocated", gst_libcamera_io_mode_get_type(),
+				 GST_LIBCAMERA_IO_MODE_MMAP,
+				 (GParamFlags)(GST_PARAM_MUTABLE_READY
+					       | G_PARAM_CONSTRUCT
+					       | G_PARAM_READWRITE
+					       | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(object_class, PROP_IO_MODE, spec);
 }
@@ -44,6 +44,10 @@ public:
 	{
 		return controller_->GetGlobalMetadata();
 	}
+	std::chrono::steady_clock::duration GetFrameInterval() const
+	{
+		return controller_->GetFrameInterval();
+	}
 
 private:
 	Controller *controller_;
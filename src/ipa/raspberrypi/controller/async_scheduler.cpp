@@ -0,0 +1,159 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2020, Raspberry Pi (Trading) Limited
+ *
+ * async_scheduler.cpp - shared scheduler for asynchronous algorithm jobs
+ */
+
+#include <algorithm>
+
+#include "logging.hpp"
+
+#include "async_scheduler.hpp"
+
+using namespace RPi;
+
+// Two threads are plenty even for several cameras, as each algorithm only
+// restarts its calculation every few frames.
+#define NUM_THREADS 2
+
+std::shared_ptr<AsyncScheduler> AsyncScheduler::Get()
+{
+	static std::mutex mutex;
+	static std::weak_ptr<AsyncScheduler> instance;
+	std::lock_guard<std::mutex> lock(mutex);
+	std::shared_ptr<AsyncScheduler> scheduler = instance.lock();
+	if (!scheduler) {
+		scheduler = std::make_shared<AsyncScheduler>(NUM_THREADS);
+		instance = scheduler;
+	}
+	return scheduler;
+}
+
+AsyncScheduler::AsyncScheduler(unsigned int num_threads)
+	: abort_(false)
+{
+	for (unsigned int i = 0; i < num_threads; i++)
+		threads_.emplace_back(std::bind(&AsyncScheduler::workerFunc, this));
+}
+
+AsyncScheduler::~AsyncScheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		abort_ = true;
+		job_signal_.notify_all();
+	}
+	for (auto &thread : threads_)
+		thread.join();
+}
+
+AsyncScheduler::Stats AsyncScheduler::GetStats(std::string const &name) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto it = stats_.find(name);
+	return it != stats_.end() ? it->second : Stats();
+}
+
+void AsyncScheduler::submit(AsyncJob *job, Clock::time_point deadline)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	job->state_ = AsyncJob::State::Queued;
+	job->submitted_ = Clock::now();
+	job->deadline_ = deadline;
+	queue_.push_back(job);
+	job_signal_.notify_one();
+}
+
+void AsyncScheduler::remove(AsyncJob *job, std::unique_lock<std::mutex> &lock)
+{
+	// Take the job out of the queue, or wait for it to finish if it's
+	// already running.
+	if (job->state_ == AsyncJob::State::Queued)
+		queue_.erase(std::find(queue_.begin(), queue_.end(), job));
+	done_signal_.wait(lock, [&] {
+		return job->state_ != AsyncJob::State::Running;
+	});
+	job->state_ = AsyncJob::State::Idle;
+}
+
+void AsyncScheduler::workerFunc()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true) {
+		job_signal_.wait(lock, [&] {
+			return !queue_.empty() || abort_;
+		});
+		if (abort_)
+			break;
+		auto next = std::min_element(
+			queue_.begin(), queue_.end(),
+			[](AsyncJob const *a, AsyncJob const *b) {
+				if (a->priority_ != b->priority_)
+					return a->priority_ > b->priority_;
+				return a->deadline_ < b->deadline_;
+			});
+		AsyncJob *job = *next;
+		queue_.erase(next);
+		job->state_ = AsyncJob::State::Running;
+		Clock::time_point start = Clock::now();
+
+		lock.unlock();
+		job->func_();
+		lock.lock();
+
+		Clock::time_point end = Clock::now();
+		Stats &stats = stats_[job->name_];
+		Clock::duration latency = start - job->submitted_;
+		stats.count++;
+		stats.total_latency += latency;
+		stats.max_latency = std::max(stats.max_latency, latency);
+		stats.total_run_time += end - start;
+		if (end > job->deadline_)
+			stats.deadline_misses++;
+		RPI_LOG(job->name_ << " latency "
+			<< std::chrono::duration_cast<std::chrono::microseconds>(latency).count()
+			<< "us run time "
+			<< std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()
+			<< "us" << (end > job->deadline_ ? " (late)" : ""));
+
+		job->state_ = AsyncJob::State::Finished;
+		done_signal_.notify_all();
+	}
+}
+
+AsyncJob::AsyncJob(std::string const &name, int priority,
+		   std::function<void()> const &func)
+	: scheduler_(AsyncScheduler::Get()), name_(name), priority_(priority),
+	  func_(func), state_(State::Idle)
+{
+}
+
+AsyncJob::~AsyncJob()
+{
+	std::unique_lock<std::mutex> lock(scheduler_->mutex_);
+	scheduler_->remove(this, lock);
+}
+
+void AsyncJob::Start(AsyncScheduler::Clock::time_point deadline)
+{
+	scheduler_->submit(this, deadline);
+}
+
+bool AsyncJob::Started() const
+{
+	std::lock_guard<std::mutex> lock(scheduler_->mutex_);
+	return state_ != State::Idle;
+}
+
+bool AsyncJob::Finished() const
+{
+	std::lock_guard<std::mutex> lock(scheduler_->mutex_);
+	return state_ == State::Finished;
+}
+
+void AsyncJob::Reset()
+{
+	std::lock_guard<std::mutex> lock(scheduler_->mutex_);
+	state_ = State::Idle;
+}
@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2020, Raspberry Pi (Trading) Limited
+ *
+ * async_scheduler.hpp - shared scheduler for asynchronous algorithm jobs
+ */
+#pragma once
+
+// Some control algorithms (such as AWB and ALSC) do their heavy lifting
+// asynchronously, restarting the calculation every few frames and picking
+// up the results once they're ready. Rather than each of them running its
+// own thread, per camera, they all submit their work to a single small pool
+// of worker threads shared by every Controller in the process.
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace RPi {
+
+class AsyncJob;
+
+class AsyncScheduler
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+	struct Stats {
+		Stats()
+			: count(0), total_latency(0), max_latency(0),
+			  total_run_time(0), deadline_misses(0)
+		{
+		}
+		unsigned int count; // number of jobs completed
+		Clock::duration total_latency; // from submission to starting
+		Clock::duration max_latency;
+		Clock::duration total_run_time;
+		unsigned int deadline_misses; // jobs finished after their deadline
+	};
+	// The scheduler is created along with the first job that needs it, and
+	// goes away (stopping its threads) with the last.
+	static std::shared_ptr<AsyncScheduler> Get();
+	AsyncScheduler(unsigned int num_threads);
+	~AsyncScheduler();
+	// Return the accumulated statistics for jobs of the given name.
+	Stats GetStats(std::string const &name) const;
+
+private:
+	friend class AsyncJob;
+	void submit(AsyncJob *job, Clock::time_point deadline);
+	void remove(AsyncJob *job, std::unique_lock<std::mutex> &lock);
+	void workerFunc();
+	mutable std::mutex mutex_;
+	// condvar for the workers to wait on for jobs
+	std::condition_variable job_signal_;
+	// condvar for waiting on running jobs to finish
+	std::condition_variable done_signal_;
+	bool abort_;
+	std::vector<AsyncJob *> queue_;
+	std::vector<std::thread> threads_;
+	std::map<std::string, Stats> stats_;
+};
+
+// An AsyncJob is owned by the algorithm, and runs the same function each
+// time it is started. Jobs of higher priority run first, and amongst jobs of
+// the same priority, those with the earliest deadline.
+
+class AsyncJob
+{
+public:
+	AsyncJob(std::string const &name, int priority,
+		 std::function<void()> const &func);
+	~AsyncJob();
+	// Queue the job to run; it should ideally be finished by the deadline.
+	void Start(AsyncScheduler::Clock::time_point deadline);
+	// The job counts as started until it is Reset(), even once finished.
+	bool Started() const;
+	bool Finished() const;
+	// Call once the results of a finished job have been collected.
+	void Reset();
+
+private:
+	friend class AsyncScheduler;
+	enum class State { Idle, Queued, Running, Finished };
+	std::shared_ptr<AsyncScheduler> scheduler_;
+	std::string name_;
+	int priority_;
+	std::function<void()> func_;
+	// The following are protected by the scheduler's mutex:
+	State state_;
+	AsyncScheduler::Clock::time_point submitted_;
+	AsyncScheduler::Clock::time_point deadline_;
+};
+
+} // namespace RPi
@@ -7,17 +7,20 @@
 
 #include "algorithm.hpp"
 #include "controller.hpp"
+#include "tuning_file.hpp"
 
-#include <boost/property_tree/json_parser.hpp>
 #include <boost/property_tree/ptree.hpp>
 
 using namespace RPi;
 
+// Assumed until we have seen some frames.
+#define DEFAULT_FRAME_INTERVAL std::chrono::milliseconds(33)
+
 Controller::Controller()
-	: switch_mode_called_(false) {}
+	: switch_mode_called_(false), frame_interval_(DEFAULT_FRAME_INTERVAL) {}
 
 Controller::Controller(char const *json_filename)
-	: switch_mode_called_(false)
+	: switch_mode_called_(false), frame_interval_(DEFAULT_FRAME_INTERVAL)
 {
 	Read(json_filename);
 	Initialise();
@@ -29,7 +32,7 @@ void Controller::Read(char const *filename)
 {
 	RPI_LOG("Controller starting");
 	boost::property_tree::ptree root;
-	boost::property_tree::read_json(filename, root);
+	ReadTuningFile(filename, root);
 	for (auto const &key_and_value : root) {
 		Algorithm *algo = CreateAlgorithm(key_and_value.first.c_str());
 		if (algo) {
@@ -62,6 +65,8 @@ void Controller::SwitchMode(CameraMode const &camera_mode)
 	for (auto &algo : algorithms_)
 		algo->SwitchMode(camera_mode);
 	switch_mode_called_ = true;
+	// Don't count any gap in streaming as a frame interval.
+	last_process_time_ = std::chrono::steady_clock::time_point();
 	RPI_LOG("Controller finished");
 }
 
@@ -79,6 +84,23 @@ void Controller::Process(StatisticsPtr stats, Metadata *image_metadata)
 {
 	RPI_LOG("Controller::Process starting");
 	assert(switch_mode_called_);
+	// Keep a smoothed estimate of the frame interval, which the algorithms
+	// use to set the deadlines for their asynchronous calculations.
+	auto now = std::chrono::steady_clock::now();
+	if (last_process_time_ != std::chrono::steady_clock::time_point())
+		frame_interval_ =
+			(frame_interval_ * 7 + (now - last_process_time_)) / 8;
+	last_process_time_ = now;
+	// Build the histogram once here for all the algorithms that want it.
+	{
+		std::lock_guard<Metadata> lock(*image_metadata);
+		Histogram *histogram = image_metadata->GetLocked<Histogram>();
+		if (!histogram) {
+			image_metadata->SetLocked(Histogram());
+			histogram = image_metadata->GetLocked<Histogram>();
+		}
+		histogram->Set(stats->hist[0].g_hist, NUM_HISTOGRAM_BINS);
+	}
 	for (auto &algo : algorithms_)
 		if (!algo->IsPaused())
 			algo->Process(stats, image_metadata);
@@ -90,6 +112,23 @@ Metadata &Controller::GetGlobalMetadata()
 	return global_metadata_;
 }
 
+std::chrono::steady_clock::duration Controller::GetFrameInterval() const
+{
+	return frame_interval_;
+}
+
+std::map<std::string, AsyncScheduler::Stats> Controller::GetAsyncStats() const
+{
+	std::map<std::string, AsyncScheduler::Stats> stats;
+	std::shared_ptr<AsyncScheduler> scheduler = AsyncScheduler::Get();
+	for (auto &algo : algorithms_) {
+		AsyncScheduler::Stats algo_stats = scheduler->GetStats(algo->Name());
+		if (algo_stats.count)
+			stats[algo->Name()] = algo_stats;
+	}
+	return stats;
+}
+
 Algorithm *Controller::GetAlgorithm(std::string const &name) const
 {
 	// The passed name must be the entire algorithm name, or must match the
@@ -10,11 +10,14 @@
 // "control algorithms" (such as AWB etc.) and for running them all in a
 // convenient manner.
 
+#include <chrono>
+#include <map>
 #include <vector>
 #include <string>
 
 #include <linux/bcm2835-isp.h>
 
+#include "async_scheduler.hpp"
 #include "camera_mode.h"
 #include "device_status.h"
 #include "metadata.hpp"
@@ -44,11 +47,19 @@ public:
 	void Process(StatisticsPtr stats, Metadata *image_metadata);
 	Metadata &GetGlobalMetadata();
 	Algorithm *GetAlgorithm(std::string const &name) const;
+	// Estimated time between frames, as seen by the Process method.
+	std::chrono::steady_clock::duration GetFrameInterval() const;
+	// Statistics of the asynchronous jobs run by our algorithms, by
+	// algorithm name. The scheduler is shared, so these accumulate over
+	// all the cameras in the process.
+	std::map<std::string, AsyncScheduler::Stats> GetAsyncStats() const;
 
 protected:
 	Metadata global_metadata_;
 	std::vector<AlgorithmPtr> algorithms_;
 	bool switch_mode_called_;
+	std::chrono::steady_clock::time_point last_process_time_;
+	std::chrono::steady_clock::duration frame_interval_;
 };
 
 } // namespace RPi
@@ -45,6 +45,17 @@ double Histogram::Quantile(double q, int first, int last) const
 	return first + frac;
 }
 
+void Histogram::Quantiles(double const *q, double *bins, unsigned int num) const
+{
+	int first = 0;
+	for (unsigned int i = 0; i < num; i++) {
+		if (i && q[i] < q[i - 1])
+			first = 0;
+		bins[i] = Quantile(q[i], first);
+		first = (int)bins[i];
+	}
+}
+
 double Histogram::InterQuantileMean(double q_lo, double q_hi) const
 {
 	assert(q_hi > q_lo);
@@ -18,14 +18,22 @@ namespace RPi {
 class Histogram
 {
 public:
+	Histogram() : cumulative_(1, 0) {}
 	template<typename T> Histogram(T *histogram, int num)
+	{
+		Set(histogram, num);
+	}
+	// (Re)build the histogram, reusing any storage it already has.
+	template<typename T> void Set(T *histogram, int num)
 	{
 		assert(num);
-		cumulative_.reserve(num + 1);
-		cumulative_.push_back(0);
-		for (int i = 0; i < num; i++)
-			cumulative_.push_back(cumulative_.back() +
-					      histogram[i]);
+		cumulative_.resize(num + 1);
+		uint64_t sum = 0;
+		cumulative_[0] = 0;
+		for (int i = 0; i < num; i++) {
+			sum += histogram[i];
+			cumulative_[i + 1] = sum;
+		}
 	}
 	uint32_t Bins() const { return cumulative_.size() - 1; }
 	uint64_t Total() const { return cumulative_[cumulative_.size() - 1]; }
@@ -34,6 +42,9 @@ public:
 	// Return the (fractional) bin of the point q (0 <= q <= 1) through the
 	// histogram. Optionally provide limits to help.
 	double Quantile(double q, int first = -1, int last = -1) const;
+	// Find a number of quantiles in one go. Listing them in increasing
+	// order is best, as each search then starts where the last one ended.
+	void Quantiles(double const *q, double *bins, unsigned int num) const;
 	// Return the average histogram bin value between the two quantiles.
 	double InterQuantileMean(double q_lo, double q_hi) const;
 
@@ -8,41 +8,130 @@
 
 // A simple class for carrying arbitrary metadata, for example about an image.
 
+#include <string.h>
+
 #include <string>
 #include <mutex>
 #include <map>
 #include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 #include <boost/any.hpp>
 
+#include "agc_status.h"
+#include "alsc_status.h"
+#include "awb_status.h"
+#include "black_level_status.h"
+#include "ccm_status.h"
+#include "contrast_status.h"
+#include "device_status.h"
+#include "dpc_status.h"
+#include "focus_status.h"
+#include "geq_status.h"
+#include "histogram.hpp"
+#include "lux_status.h"
+#include "noise_status.h"
+#include "sdn_status.h"
+#include "sharpen_status.h"
+
 namespace RPi {
 
+// The status structures that the algorithms exchange every frame (and the
+// histogram of the frame's statistics) are registered here with their tag.
+// Each of them gets a fixed, typed slot in the Metadata, so that the typed
+// accessors below involve no string comparisons, no memory allocation and no
+// any_cast. Anything else still goes into a string-keyed map.
+
+template<typename T> struct MetadataTag {
+	static constexpr bool registered = false;
+	static const char *name() { return nullptr; }
+};
+
+#define RPI_METADATA_TAG(type, tag)                        \
+	template<> struct MetadataTag<type> {              \
+		static constexpr bool registered = true;   \
+		static const char *name() { return tag; }  \
+	}
+
+RPI_METADATA_TAG(AgcStatus, "agc.status");
+RPI_METADATA_TAG(AlscStatus, "alsc.status");
+RPI_METADATA_TAG(AwbStatus, "awb.status");
+RPI_METADATA_TAG(BlackLevelStatus, "black_level.status");
+RPI_METADATA_TAG(CcmStatus, "ccm.status");
+RPI_METADATA_TAG(ContrastStatus, "contrast.status");
+RPI_METADATA_TAG(DeviceStatus, "device.status");
+RPI_METADATA_TAG(DpcStatus, "dpc.status");
+RPI_METADATA_TAG(FocusStatus, "focus.status");
+RPI_METADATA_TAG(GeqStatus, "geq.status");
+RPI_METADATA_TAG(Histogram, "histogram");
+RPI_METADATA_TAG(LuxStatus, "lux.status");
+RPI_METADATA_TAG(NoiseStatus, "noise.status");
+RPI_METADATA_TAG(SdnStatus, "sdn.status");
+RPI_METADATA_TAG(SharpenStatus, "sharpen.status");
+
+#undef RPI_METADATA_TAG
+
 class Metadata
 {
 public:
+	// Typed accessors, for registered status structures only.
+	template<typename T> void Set(T const &value)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		SetLocked(value);
+	}
+	template<typename T> int Get(T &value) const
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		Slot<T> const &slot = std::get<Slot<T>>(slots_);
+		if (!slot.valid)
+			return -1;
+		value = slot.value;
+		return 0;
+	}
+	template<typename T> T *GetLocked()
+	{
+		// As with the string version below, you should be holding the
+		// lock to use this.
+		Slot<T> &slot = std::get<Slot<T>>(slots_);
+		return slot.valid ? &slot.value : nullptr;
+	}
+	template<typename T> void SetLocked(T const &value)
+	{
+		Slot<T> &slot = std::get<Slot<T>>(slots_);
+		slot.value = value;
+		slot.valid = true;
+	}
+
+	// String-keyed accessors. Registered tags used with their own type are
+	// redirected to the typed slots, everything else lives in the map.
 	template<typename T> void Set(std::string const &tag, T const &value)
 	{
 		std::lock_guard<std::mutex> lock(mutex_);
-		data_[tag] = value;
+		SetLocked(tag, value);
 	}
 	template<typename T> int Get(std::string const &tag, T &value) const
 	{
 		std::lock_guard<std::mutex> lock(mutex_);
-		auto it = data_.find(tag);
-		if (it == data_.end())
+		T const *ptr = const_cast<Metadata *>(this)->GetLocked<T>(tag);
+		if (!ptr)
 			return -1;
-		value = boost::any_cast<T>(it->second);
+		value = *ptr;
 		return 0;
 	}
 	void Clear()
 	{
 		std::lock_guard<std::mutex> lock(mutex_);
+		clearSlots(std::make_index_sequence<NumSlots>());
 		data_.clear();
 	}
 	Metadata &operator=(Metadata const &other)
 	{
 		std::lock_guard<std::mutex> lock(mutex_);
 		std::lock_guard<std::mutex> other_lock(other.mutex_);
+		copySlots(other, std::make_index_sequence<NumSlots>());
 		data_ = other.data_;
 		return *this;
 	}
@@ -50,6 +139,8 @@ public:
 	{
 		// This allows in-place access to the Metadata contents,
 		// for which you should be holding the lock.
+		if (isSlot<T>(tag))
+			return typedSlot<T>(IsRegistered<T>());
 		auto it = data_.find(tag);
 		if (it == data_.end())
 			return nullptr;
@@ -59,7 +150,10 @@ public:
 	void SetLocked(std::string const &tag, T const &value)
 	{
 		// Use this only if you're holding the lock yourself.
-		data_[tag] = value;
+		if (isSlot<T>(tag))
+			setTypedSlot(value, IsRegistered<T>());
+		else
+			data_[tag] = value;
 	}
 	// Note: use of (lowercase) lock and unlock means you can create scoped
 	// locks with the standard lock classes.
@@ -68,7 +162,65 @@ public:
 	void unlock() { mutex_.unlock(); }
 
 private:
+	template<typename T> struct Slot {
+		bool valid = false;
+		T value;
+	};
+
+	typedef std::tuple<Slot<AgcStatus>, Slot<AlscStatus>, Slot<AwbStatus>,
+			   Slot<BlackLevelStatus>, Slot<CcmStatus>,
+			   Slot<ContrastStatus>, Slot<DeviceStatus>,
+			   Slot<DpcStatus>, Slot<FocusStatus>, Slot<GeqStatus>,
+			   Slot<Histogram>, Slot<LuxStatus>, Slot<NoiseStatus>,
+			   Slot<SdnStatus>, Slot<SharpenStatus>>
+		Slots;
+	static constexpr size_t NumSlots = std::tuple_size<Slots>::value;
+
+	template<typename T>
+	using IsRegistered =
+		std::integral_constant<bool, MetadataTag<T>::registered>;
+
+	template<typename T> T *typedSlot(std::true_type)
+	{
+		return GetLocked<T>();
+	}
+	template<typename T> T *typedSlot(std::false_type) { return nullptr; }
+	template<typename T> void setTypedSlot(T const &value, std::true_type)
+	{
+		SetLocked(value);
+	}
+	template<typename T> void setTypedSlot(T const &, std::false_type) {}
+
+	template<typename T> static bool isSlot(std::string const &tag)
+	{
+		return MetadataTag<T>::registered &&
+		       !strcmp(tag.c_str(), MetadataTag<T>::name());
+	}
+	template<size_t... I> void clearSlots(std::index_sequence<I...>)
+	{
+		// (Expands into one statement per slot.)
+		int dummy[] = { (std::get<I>(slots_).valid = false, 0)... };
+		(void)dummy;
+	}
+	template<size_t... I>
+	void copySlots(Metadata const &other, std::index_sequence<I...>)
+	{
+		// Only copy the slots that are in use, the larger status
+		// structures run to several kilobytes.
+		int dummy[] = { (copySlot(std::get<I>(slots_),
+					  std::get<I>(other.slots_)), 0)... };
+		(void)dummy;
+	}
+	template<typename T>
+	static void copySlot(Slot<T> &dst, Slot<T> const &src)
+	{
+		dst.valid = src.valid;
+		if (src.valid)
+			dst.value = src.value;
+	}
+
 	mutable std::mutex mutex_;
+	Slots slots_;
 	std::map<std::string, boost::any> data_;
 };
 
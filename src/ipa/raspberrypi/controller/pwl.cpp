@@ -66,6 +66,13 @@ double Pwl::Eval(double x, int *span_ptr, bool update_span) const
 		       (points_[span + 1].x - points_[span].x);
 }
 
+void Pwl::Eval(double const *x, double *y, unsigned int num) const
+{
+	int span = -1;
+	for (unsigned int i = 0; i < num; i++)
+		y[i] = Eval(x[i], &span);
+}
+
 int Pwl::findSpan(double x, int span) const
 {
 	// Pwls are generally small, so linear search may well be faster than
@@ -119,6 +126,7 @@ Pwl Pwl::Compose(Pwl const &other, const double eps) const
 	double this_x = points_[0].x, this_y = points_[0].y;
 	int this_span = 0, other_span = other.findSpan(this_y, 0);
 	Pwl result({ { this_x, other.Eval(this_y, &other_span, false) } });
+	result.points_.reserve(points_.size() + other.points_.size());
 	while (this_span != (int)points_.size() - 1) {
 		double dx = points_[this_span + 1].x - points_[this_span].x,
 		       dy = points_[this_span + 1].y - points_[this_span].y;
@@ -153,43 +161,6 @@ Pwl Pwl::Compose(Pwl const &other, const double eps) const
 	return result;
 }
 
-void Pwl::Map(std::function<void(double x, double y)> f) const
-{
-	for (auto &pt : points_)
-		f(pt.x, pt.y);
-}
-
-void Pwl::Map2(Pwl const &pwl0, Pwl const &pwl1,
-	       std::function<void(double x, double y0, double y1)> f)
-{
-	int span0 = 0, span1 = 0;
-	double x = std::min(pwl0.points_[0].x, pwl1.points_[0].x);
-	f(x, pwl0.Eval(x, &span0, false), pwl1.Eval(x, &span1, false));
-	while (span0 < (int)pwl0.points_.size() - 1 ||
-	       span1 < (int)pwl1.points_.size() - 1) {
-		if (span0 == (int)pwl0.points_.size() - 1)
-			x = pwl1.points_[++span1].x;
-		else if (span1 == (int)pwl1.points_.size() - 1)
-			x = pwl0.points_[++span0].x;
-		else if (pwl0.points_[span0 + 1].x > pwl1.points_[span1 + 1].x)
-			x = pwl1.points_[++span1].x;
-		else
-			x = pwl0.points_[++span0].x;
-		f(x, pwl0.Eval(x, &span0, false), pwl1.Eval(x, &span1, false));
-	}
-}
-
-Pwl Pwl::Combine(Pwl const &pwl0, Pwl const &pwl1,
-		 std::function<double(double x, double y0, double y1)> f,
-		 const double eps)
-{
-	Pwl result;
-	Map2(pwl0, pwl1, [&](double x, double y0, double y1) {
-		result.Append(x, f(x, y0, y1), eps);
-	});
-	return result;
-}
-
 void Pwl::MatchDomain(Interval const &domain, bool clip, const double eps)
 {
 	int span = 0;
@@ -7,6 +7,8 @@
 #pragma once
 
 #include <math.h>
+
+#include <algorithm>
 #include <vector>
 
 #include <boost/property_tree/ptree.hpp>
@@ -67,6 +69,9 @@ public:
 	// -1.
 	double Eval(double x, int *span_ptr = nullptr,
 		    bool update_span = true) const;
+	// Evaluate Pwl at num points in one go. Each search for the span starts
+	// from the previous one, so this is quickest when x is increasing.
+	void Eval(double const *x, double *y, unsigned int num) const;
 	// Find perpendicular closest to xy, starting from span+1 so you can
 	// call it repeatedly to check for multiple closest points (set span to
 	// -1 on the first call). Also returns "pseudo" perpendiculars; see
@@ -83,17 +88,48 @@ public:
 	// Compose two Pwls together, doing "this" first and "other" after.
 	Pwl Compose(Pwl const &other, const double eps = 1e-6) const;
 	// Apply function to (x,y) values at every control point.
-	void Map(std::function<void(double x, double y)> f) const;
+	template<typename F> void Map(F &&f) const
+	{
+		for (auto &pt : points_)
+			f(pt.x, pt.y);
+	}
 	// Apply function to (x, y0, y1) values wherever either Pwl has a
 	// control point.
-	static void Map2(Pwl const &pwl0, Pwl const &pwl1,
-			 std::function<void(double x, double y0, double y1)> f);
+	template<typename F>
+	static void Map2(Pwl const &pwl0, Pwl const &pwl1, F &&f)
+	{
+		int span0 = 0, span1 = 0;
+		double x = std::min(pwl0.points_[0].x, pwl1.points_[0].x);
+		f(x, pwl0.Eval(x, &span0, false), pwl1.Eval(x, &span1, false));
+		while (span0 < (int)pwl0.points_.size() - 1 ||
+		       span1 < (int)pwl1.points_.size() - 1) {
+			if (span0 == (int)pwl0.points_.size() - 1)
+				x = pwl1.points_[++span1].x;
+			else if (span1 == (int)pwl1.points_.size() - 1)
+				x = pwl0.points_[++span0].x;
+			else if (pwl0.points_[span0 + 1].x >
+				 pwl1.points_[span1 + 1].x)
+				x = pwl1.points_[++span1].x;
+			else
+				x = pwl0.points_[++span0].x;
+			f(x, pwl0.Eval(x, &span0, false),
+			  pwl1.Eval(x, &span1, false));
+		}
+	}
 	// Combine two Pwls, meaning we create a new Pwl where the y values are
 	// given by running f wherever either has a knot.
-	static Pwl
-	Combine(Pwl const &pwl0, Pwl const &pwl1,
-		std::function<double(double x, double y0, double y1)> f,
-		const double eps = 1e-6);
+	template<typename F>
+	static Pwl Combine(Pwl const &pwl0, Pwl const &pwl1, F &&f,
+			   const double eps = 1e-6)
+	{
+		Pwl result;
+		result.points_.reserve(pwl0.points_.size() +
+				       pwl1.points_.size());
+		Map2(pwl0, pwl1, [&](double x, double y0, double y1) {
+			result.Append(x, f(x, y0, y1), eps);
+		});
+		return result;
+	}
 	// Make "this" match (at least) the given domain. Any extension my be
 	// clipped or linear.
 	void MatchDomain(Interval const &domain, bool clip = true,
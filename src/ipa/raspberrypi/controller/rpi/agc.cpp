@@ -234,7 +234,7 @@ void Agc::Prepare(Metadata *image_metadata)
 	if (status_.total_exposure_value) {
 		// Process has run, so we have meaningful values.
 		DeviceStatus device_status;
-		if (image_metadata->Get("device.status", device_status) == 0) {
+		if (image_metadata->Get(device_status) == 0) {
 			double actual_exposure = device_status.shutter_speed *
 						 device_status.analogue_gain;
 			if (actual_exposure) {
@@ -279,7 +279,7 @@ void Agc::Prepare(Metadata *image_metadata)
 			RPI_LOG(Name() << ": no device metadata");
 		status.locked = lock_count_ >= MAX_LOCK_COUNT;
 		//printf("%s\n", status.locked ? "+++++++++" : "-");
-		image_metadata->Set("agc.status", status);
+		image_metadata->Set(status);
 	}
 }
 
@@ -373,13 +373,13 @@ void Agc::fetchCurrentExposure(Metadata *image_metadata)
 {
 	std::unique_lock<Metadata> lock(*image_metadata);
 	DeviceStatus *device_status =
-		image_metadata->GetLocked<DeviceStatus>("device.status");
+		image_metadata->GetLocked<DeviceStatus>();
 	if (!device_status)
 		throw std::runtime_error("Agc: no device metadata");
 	current_.shutter = device_status->shutter_speed;
 	current_.analogue_gain = device_status->analogue_gain;
 	AgcStatus *agc_status =
-		image_metadata->GetLocked<AgcStatus>("agc.status");
+		image_metadata->GetLocked<AgcStatus>();
 	current_.total_exposure = agc_status ? agc_status->total_exposure_value : 0;
 	current_.total_exposure_no_dg = current_.shutter * current_.analogue_gain;
 }
@@ -390,7 +390,7 @@ static double compute_initial_Y(bcm2835_isp_stats *stats, Metadata *image_metada
 	bcm2835_isp_stats_region *regions = stats->agc_stats;
 	struct AwbStatus awb;
 	awb.gain_r = awb.gain_g = awb.gain_b = 1.0; // in case no metadata
-	if (image_metadata->Get("awb.status", awb) != 0)
+	if (image_metadata->Get(awb) != 0)
 		RPI_WARN("Agc: no AWB status found");
 	double Y_sum = 0, weight_sum = 0;
 	for (int i = 0; i < AGC_STATS_SIZE; i++) {
@@ -414,7 +414,7 @@ static double compute_initial_Y(bcm2835_isp_stats *stats, Metadata *image_metada
 
 #define EV_GAIN_Y_TARGET_LIMIT 0.9
 
-static double constraint_compute_gain(AgcConstraint &c, Histogram &h,
+static double constraint_compute_gain(AgcConstraint &c, Histogram const &h,
 				      double lux, double ev_gain,
 				      double &target_Y)
 {
@@ -429,9 +429,12 @@ void Agc::computeGain(bcm2835_isp_stats *statistics, Metadata *image_metadata,
 {
 	struct LuxStatus lux = {};
 	lux.lux = 400; // default lux level to 400 in case no metadata found
-	if (image_metadata->Get("lux.status", lux) != 0)
+	if (image_metadata->Get(lux) != 0)
 		RPI_WARN("Agc: no lux level found");
-	Histogram h(statistics->hist[0].g_hist, NUM_HISTOGRAM_BINS);
+	// The Controller leaves us the histogram in the metadata, though if it
+	// isn't there we can always make our own.
+	if (image_metadata->Get(histogram_) != 0)
+		histogram_.Set(statistics->hist[0].g_hist, NUM_HISTOGRAM_BINS);
 	double ev_gain = status_.ev * config_.base_ev;
 	// The initial gain and target_Y come from some of the regions. After
 	// that we consider the histogram constraints.
@@ -446,7 +449,7 @@ void Agc::computeGain(bcm2835_isp_stats *statistics, Metadata *image_metadata,
 	for (auto &c : *constraint_mode_) {
 		double new_target_Y;
 		double new_gain =
-			constraint_compute_gain(c, h, lux.lux, ev_gain,
+			constraint_compute_gain(c, histogram_, lux.lux, ev_gain,
 						new_target_Y);
 		RPI_LOG("Constraint has target_Y "
 			<< new_target_Y << " giving gain " << new_gain);
@@ -491,7 +494,7 @@ bool Agc::applyDigitalGain(Metadata *image_metadata, double gain,
 	// I think this pipeline subtracts black level and rescales before we
 	// get the stats, so no need to worry about it.
 	struct AwbStatus awb;
-	if (image_metadata->Get("awb.status", awb) == 0) {
+	if (image_metadata->Get(awb) == 0) {
 		double min_gain = std::min(awb.gain_r,
 					   std::min(awb.gain_g, awb.gain_b));
 		dg *= std::max(1.0, 1.0 / min_gain);
@@ -627,7 +630,7 @@ void Agc::writeAndFinish(Metadata *image_metadata, bool desaturate)
 	}
 	// Write to metadata as well, in case anyone wants to update the camera
 	// immediately.
-	image_metadata->Set("agc.status", status_);
+	image_metadata->Set(status_);
 	RPI_LOG("Output written, total exposure requested is "
 		<< filtered_.total_exposure);
 	RPI_LOG("Camera exposure update: shutter time " << filtered_.shutter <<
@@ -10,6 +10,7 @@
 #include <mutex>
 
 #include "../agc_algorithm.hpp"
+#include "../histogram.hpp"
 #include "../agc_status.h"
 #include "../pwl.hpp"
 
@@ -80,6 +81,7 @@ public:
 
 private:
 	AgcConfig config_;
+	Histogram histogram_;
 	void housekeepConfig();
 	void fetchCurrentExposure(Metadata *image_metadata);
 	void computeGain(bcm2835_isp_stats *statistics, Metadata *image_metadata,
@@ -6,12 +6,9 @@
  */
 #pragma once
 
-#include <mutex>
-#include <condition_variable>
-#include <thread>
-
 #include "../algorithm.hpp"
 #include "../alsc_status.h"
+#include "../async_scheduler.hpp"
 
 namespace RPi {
 
@@ -60,25 +57,10 @@ private:
 	AlscConfig config_;
 	bool first_time_;
 	std::atomic<CameraMode> camera_mode_;
-	std::thread async_thread_;
-	void asyncFunc(); // asynchronous thread function
-	std::mutex mutex_;
 	CameraMode async_camera_mode_;
-	// condvar for async thread to wait on
-	std::condition_variable async_signal_;
-	// condvar for synchronous thread to wait on
-	std::condition_variable sync_signal_;
-	// for sync thread to check  if async thread finished (requires mutex)
-	bool async_finished_;
-	// for async thread to check if it's been told to run (requires mutex)
-	bool async_start_;
-	// for async thread to check if it's been told to quit (requires mutex)
-	bool async_abort_;
 
 	// The following are only for the synchronous thread to use:
-	// for sync thread to note its has asked async thread to run
-	bool async_started_;
-	// counts up to frame_period before restarting the async thread
+	// counts up to frame_period before restarting the async job
 	int frame_phase_;
 	// counts up to startup_frames
 	int frame_count_;
@@ -86,10 +68,10 @@ private:
 	int frame_count2_;
 	double sync_results_[3][ALSC_CELLS_Y][ALSC_CELLS_X];
 	double prev_sync_results_[3][ALSC_CELLS_Y][ALSC_CELLS_X];
-	// The following are for the asynchronous thread to use, though the main
-	// thread can set/reset them if the async thread is known to be idle:
+	// The following are for the asynchronous job to use, though the main
+	// thread can set/reset them if the job is known to be idle:
 	void restartAsync(StatisticsPtr &stats, Metadata *image_metadata);
-	// copy out the results from the async thread so that it can be restarted
+	// copy out the results from the async job so that it can be restarted
 	void fetchAsyncResults();
 	double ct_;
 	bcm2835_isp_stats_region statistics_[ALSC_CELLS_Y * ALSC_CELLS_X];
@@ -99,6 +81,9 @@ private:
 	void doAlsc();
 	double lambda_r_[ALSC_CELLS_X * ALSC_CELLS_Y];
 	double lambda_b_[ALSC_CELLS_X * ALSC_CELLS_Y];
+	// declared last so that a job still in flight is finished with before
+	// anything it uses is destroyed
+	AsyncJob async_job_;
 };
 
 } // namespace RPi
@@ -0,0 +1,155 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2019, Raspberry Pi (Trading) Limited
+ *
+ * alsc_solver.cpp - ALSC (auto lens shading correction) adaptive solver
+ */
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <math.h>
+
+#include "../logging.hpp"
+#include "alsc_solver.hpp"
+
+using namespace RPi;
+
+static const int X = ALSC_CELLS_X;
+static const int Y = ALSC_CELLS_Y;
+static const int XY = X * Y;
+
+// Compute weight out of 1.0 which reflects how similar we wish to make the
+// colours of these two regions.
+static double compute_weight(double C_i, double C_j, double sigma)
+{
+	if (C_i == ALSC_INSUFFICIENT_DATA || C_j == ALSC_INSUFFICIENT_DATA)
+		return 0;
+	double diff = (C_i - C_j) / sigma;
+	return exp(-diff * diff / 2);
+}
+
+void RPi::alsc_compute_W(double const C[XY], double sigma, double W[XY][4])
+{
+	for (int i = 0; i < XY; i++) {
+		// Start with neighbour above and go clockwise.
+		W[i][0] = i >= X ? compute_weight(C[i], C[i - X], sigma) : 0;
+		W[i][1] = i % X < X - 1 ? compute_weight(C[i], C[i + 1], sigma)
+					: 0;
+		W[i][2] =
+			i < XY - X ? compute_weight(C[i], C[i + X], sigma) : 0;
+		W[i][3] = i % X ? compute_weight(C[i], C[i - 1], sigma) : 0;
+	}
+}
+
+// Compute M, the large but sparse matrix such that M * lambdas = 0.
+static void construct_M(double const C[XY], double const W[XY][4],
+			double M[XY][4])
+{
+	double epsilon = 0.001;
+	for (int i = 0; i < XY; i++) {
+		// Note how, if C[i] == ALSC_INSUFFICIENT_DATA, the weights will
+		// all be zero so the equation is still set up correctly.
+		int m = !!(i >= X) + !!(i % X < X - 1) + !!(i < XY - X) +
+			!!(i % X); // total number of neighbours
+		// we'll divide the diagonal out straight away
+		double diagonal =
+			(epsilon + W[i][0] + W[i][1] + W[i][2] + W[i][3]) *
+			C[i];
+		M[i][0] = i >= X ? (W[i][0] * C[i - X] + epsilon / m * C[i]) /
+					   diagonal
+				 : 0;
+		M[i][1] = i % X < X - 1
+				  ? (W[i][1] * C[i + 1] + epsilon / m * C[i]) /
+					    diagonal
+				  : 0;
+		M[i][2] = i < XY - X
+				  ? (W[i][2] * C[i + X] + epsilon / m * C[i]) /
+					    diagonal
+				  : 0;
+		M[i][3] = i % X ? (W[i][3] * C[i - 1] + epsilon / m * C[i]) /
+					  diagonal
+				: 0;
+	}
+}
+
+// The iterations run in single precision on a copy of the lambdas padded with
+// a border of zeroes, so that every cell has four neighbours and the loops
+// need no edge tests (the matrix coefficients for the missing neighbours are
+// zero anyway). The cells are visited in red-black order: all those where
+// x + y is even, then all the others. Each half-sweep then reads only values
+// from the other colour, which leaves no dependencies between the updates
+// in a row for the compiler to worry about when vectorising.
+static const int PX = X + 2;
+static const int PXY = PX * (Y + 2);
+
+static void pad_M(double const M[XY][4], float padded_M[4][PXY])
+{
+	for (int k = 0; k < 4; k++)
+		for (int i = 0; i < PXY; i++)
+			padded_M[k][i] = 0;
+	for (int y = 0; y < Y; y++)
+		for (int x = 0; x < X; x++)
+			for (int k = 0; k < 4; k++)
+				padded_M[k][(y + 1) * PX + x + 1] =
+					M[y * X + x][k];
+}
+
+// Update the cells of one colour with over-relaxation, returning the largest
+// change made.
+static float red_black_SOR(float const M[4][PXY], float omega,
+			   float lambda[PXY], int colour)
+{
+	float max_diff = 0;
+	for (int y = 0; y < Y; y++) {
+		int offset = (y + 1) * PX + 1;
+		float const *__restrict above = M[0] + offset;
+		float const *__restrict right = M[1] + offset;
+		float const *__restrict below = M[2] + offset;
+		float const *__restrict left = M[3] + offset;
+		float *row = lambda + offset;
+		for (int x = (y + colour) & 1; x < X; x += 2) {
+			float l = above[x] * row[x - PX] +
+				  right[x] * row[x + 1] +
+				  below[x] * row[x + PX] +
+				  left[x] * row[x - 1];
+			float diff = (l - row[x]) * omega;
+			row[x] += diff;
+			max_diff = std::max(max_diff, std::abs(diff));
+		}
+	}
+	return max_diff;
+}
+
+void RPi::alsc_run_matrix_iterations(double const C[XY], double lambda[XY],
+				     double const W[XY][4], double omega,
+				     int n_iter, double threshold)
+{
+	double M[XY][4];
+	construct_M(C, W, M);
+	float padded_M[4][PXY];
+	pad_M(M, padded_M);
+	float padded_lambda[PXY] = {};
+	for (int y = 0; y < Y; y++)
+		for (int x = 0; x < X; x++)
+			padded_lambda[(y + 1) * PX + x + 1] = lambda[y * X + x];
+	float last_max_diff = std::numeric_limits<float>::max();
+	for (int i = 0; i < n_iter; i++) {
+		float max_diff =
+			std::max(red_black_SOR(padded_M, omega, padded_lambda, 0),
+				 red_black_SOR(padded_M, omega, padded_lambda, 1));
+		if (max_diff < threshold) {
+			RPI_LOG("Stop after " << i + 1 << " iterations");
+			break;
+		}
+		// this happens very occasionally (so make a note), though
+		// doesn't seem to matter
+		if (max_diff > last_max_diff)
+			RPI_LOG("Iteration " << i << ": max_diff gone up "
+					     << last_max_diff << " to "
+					     << max_diff);
+		last_max_diff = max_diff;
+	}
+	for (int y = 0; y < Y; y++)
+		for (int x = 0; x < X; x++)
+			lambda[y * X + x] = padded_lambda[(y + 1) * PX + x + 1];
+}
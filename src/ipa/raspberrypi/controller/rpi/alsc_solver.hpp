@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2019, Raspberry Pi (Trading) Limited
+ *
+ * alsc_solver.hpp - ALSC (auto lens shading correction) adaptive solver
+ */
+#pragma once
+
+#include "../alsc_status.h"
+
+// Value of the colour statistics of zones that hold too few pixels to be
+// used.
+#define ALSC_INSUFFICIENT_DATA -1.0
+
+namespace RPi {
+
+// Compute the weights which reflect how similar we wish to make the colours
+// C of each zone and of its four neighbours, above and then clockwise.
+void alsc_compute_W(double const C[ALSC_CELLS_X * ALSC_CELLS_Y], double sigma,
+		    double W[ALSC_CELLS_X * ALSC_CELLS_Y][4]);
+
+// Iteratively refine the lambdas, starting from the values passed in, so as
+// to smooth out the colours C with the weights W. Iterations stop when the
+// largest change falls below threshold, or after n_iter of them. The
+// lambdas are not normalised.
+void alsc_run_matrix_iterations(double const C[ALSC_CELLS_X * ALSC_CELLS_Y],
+				double lambda[ALSC_CELLS_X * ALSC_CELLS_Y],
+				double const W[ALSC_CELLS_X * ALSC_CELLS_Y][4],
+				double omega, int n_iter, double threshold);
+
+} // namespace RPi
@@ -53,6 +53,24 @@ static void read_ct_curve(Pwl &ct_r, Pwl &ct_b,
 			"AwbConfig: insufficient points in CT curve");
 }
 
+static void prepare_coarse_search(AwbMode &mode, AwbConfig const &config)
+{
+	int span_r = 0, span_b = 0;
+	double t = mode.ct_lo;
+	mode.coarse_ct.clear();
+	mode.coarse_gain_r.clear();
+	mode.coarse_gain_b.clear();
+	while (true) {
+		mode.coarse_ct.push_back(t);
+		mode.coarse_gain_r.push_back(1 / config.ct_r.Eval(t, &span_r));
+		mode.coarse_gain_b.push_back(1 / config.ct_b.Eval(t, &span_b));
+		if (t == mode.ct_hi)
+			break;
+		// for even steps along the r/b curve scale them by the current t
+		t = std::min(t + t / 10 * config.coarse_step, mode.ct_hi);
+	}
+}
+
 void AwbConfig::Read(boost::property_tree::ptree const &params)
 {
 	RPI_LOG("AwbConfig");
@@ -112,26 +130,23 @@ void AwbConfig::Read(boost::property_tree::ptree const &params)
 	if (bayes == false)
 		sensitivity_r = sensitivity_b =
 			1.0; // nor do sensitivities make any sense
+	else
+		for (auto &m : modes)
+			prepare_coarse_search(m.second, *this);
 }
 
+// ALSC uses the AWB results, so give AWB priority over it.
+#define ASYNC_PRIORITY 1
+
 Awb::Awb(Controller *controller)
-	: AwbAlgorithm(controller)
+	: AwbAlgorithm(controller),
+	  async_job_(NAME, ASYNC_PRIORITY, std::bind(&Awb::doAwb, this))
 {
-	async_abort_ = async_start_ = async_started_ = async_finished_ = false;
 	mode_ = nullptr;
 	manual_r_ = manual_b_ = 0.0;
-	async_thread_ = std::thread(std::bind(&Awb::asyncFunc, this));
 }
 
-Awb::~Awb()
-{
-	{
-		std::lock_guard<std::mutex> lock(mutex_);
-		async_abort_ = true;
-		async_signal_.notify_one();
-	}
-	async_thread_.join();
-}
+Awb::~Awb() {}
 
 char const *Awb::Name() const
 {
@@ -182,16 +197,15 @@ void Awb::SetManualGains(double manual_r, double manual_b)
 void Awb::fetchAsyncResults()
 {
 	RPI_LOG("Fetch AWB results");
-	async_finished_ = false;
-	async_started_ = false;
+	async_job_.Reset();
 	sync_results_ = async_results_;
 }
 
 void Awb::restartAsync(StatisticsPtr &stats, std::string const &mode_name,
 		       double lux)
 {
-	RPI_LOG("Starting AWB thread");
-	// this makes a new reference which belongs to the asynchronous thread
+	RPI_LOG("Starting AWB job");
+	// this makes a new reference which belongs to the asynchronous job
 	statistics_ = stats;
 	// store the mode as it could technically change
 	auto m = config_.modes.find(mode_name);
@@ -200,12 +214,12 @@ void Awb::restartAsync(StatisticsPtr &stats, std::string const &mode_name,
 			: (mode_ == nullptr ? config_.default_mode : mode_);
 	lux_ = lux;
 	frame_phase_ = 0;
-	async_start_ = true;
-	async_started_ = true;
 	size_t len = mode_name.copy(async_results_.mode,
 				    sizeof(async_results_.mode) - 1);
 	async_results_.mode[len] = '\0';
-	async_signal_.notify_one();
+	// We'd like the results by the time we next want to restart.
+	async_job_.Start(std::chrono::steady_clock::now() +
+			 GetFrameInterval() * config_.frame_period);
 }
 
 void Awb::Prepare(Metadata *image_metadata)
@@ -216,12 +230,9 @@ void Awb::Prepare(Metadata *image_metadata)
 			       ? 1.0
 			       : config_.speed;
 	RPI_LOG("Awb: frame_count " << frame_count_ << " speed " << speed);
-	{
-		std::unique_lock<std::mutex> lock(mutex_);
-		if (async_started_ && async_finished_) {
-			RPI_LOG("AWB thread finished");
-			fetchAsyncResults();
-		}
+	if (async_job_.Finished()) {
+		RPI_LOG("AWB job finished");
+		fetchAsyncResults();
 	}
 	// Finally apply IIR filter to results and put into metadata.
 	memcpy(prev_sync_results_.mode, sync_results_.mode,
@@ -235,7 +246,7 @@ void Awb::Prepare(Metadata *image_metadata)
 				    (1.0 - speed) * prev_sync_results_.gain_g;
 	prev_sync_results_.gain_b = speed * sync_results_.gain_b +
 				    (1.0 - speed) * prev_sync_results_.gain_b;
-	image_metadata->Set("awb.status", prev_sync_results_);
+	image_metadata->Set(prev_sync_results_);
 	RPI_LOG("Using AWB gains r " << prev_sync_results_.gain_r << " g "
 				     << prev_sync_results_.gain_g << " b "
 				     << prev_sync_results_.gain_b);
@@ -243,7 +254,7 @@ void Awb::Prepare(Metadata *image_metadata)
 
 void Awb::Process(StatisticsPtr &stats, Metadata *image_metadata)
 {
-	// Count frames since we last poked the async thread.
+	// Count frames since we last poked the async job.
 	if (frame_phase_ < (int)config_.frame_period)
 		frame_phase_++;
 	if (frame_count2_ < (int)config_.startup_frames)
@@ -259,39 +270,17 @@ void Awb::Process(StatisticsPtr &stats, Metadata *image_metadata)
 		}
 		struct LuxStatus lux_status = {};
 		lux_status.lux = 400; // in case no metadata
-		if (image_metadata->Get("lux.status", lux_status) != 0)
+		if (image_metadata->Get(lux_status) != 0)
 			RPI_LOG("No lux metadata found");
 		RPI_LOG("Awb lux value is " << lux_status.lux);
 
-		std::unique_lock<std::mutex> lock(mutex_);
-		if (async_started_ == false) {
-			RPI_LOG("AWB thread starting");
+		if (!async_job_.Started()) {
+			RPI_LOG("AWB job starting");
 			restartAsync(stats, mode_name, lux_status.lux);
 		}
 	}
 }
 
-void Awb::asyncFunc()
-{
-	while (true) {
-		{
-			std::unique_lock<std::mutex> lock(mutex_);
-			async_signal_.wait(lock, [&] {
-				return async_start_ || async_abort_;
-			});
-			async_start_ = false;
-			if (async_abort_)
-				break;
-		}
-		doAwb();
-		{
-			std::lock_guard<std::mutex> lock(mutex_);
-			async_finished_ = true;
-			sync_signal_.notify_one();
-		}
-	}
-}
-
 static void generate_stats(std::vector<Awb::RGB> &zones,
 			   bcm2835_isp_stats_region *stats, double min_pixels,
 			   double min_G)
@@ -327,20 +316,28 @@ void Awb::prepareStats()
 			zone.B *= config_.sensitivity_b;
 }
 
-double Awb::computeDelta2Sum(double gain_r, double gain_b)
+void Awb::computeDelta2Sums(double const *__restrict gain_r,
+			    double const *__restrict gain_b,
+			    double *__restrict delta2_sums, unsigned int count)
 {
 	// Compute the sum of the squared colour error (non-greyness) as it
-	// appears in the log likelihood equation.
-	double delta2_sum = 0;
-	for (auto &z : zones_) {
-		double delta_r = gain_r * z.R - 1 - config_.whitepoint_r;
-		double delta_b = gain_b * z.B - 1 - config_.whitepoint_b;
-		double delta2 = delta_r * delta_r + delta_b * delta_b;
-		//RPI_LOG("delta_r " << delta_r << " delta_b " << delta_b << " delta2 " << delta2);
-		delta2 = std::min(delta2, config_.delta_limit);
-		delta2_sum += delta2;
+	// appears in the log likelihood equation, for a whole batch of
+	// candidate gains. The inner loop runs across the candidates, each of
+	// which has its own sum, so it can be vectorised without reordering any
+	// of the additions.
+	double const delta_limit = config_.delta_limit;
+	double const whitepoint_r = config_.whitepoint_r;
+	double const whitepoint_b = config_.whitepoint_b;
+	std::fill(delta2_sums, delta2_sums + count, 0.0);
+	for (size_t z = 0; z < zones_r_.size(); z++) {
+		double const R = zones_r_[z], B = zones_b_[z];
+		for (unsigned int i = 0; i < count; i++) {
+			double delta_r = gain_r[i] * R - 1 - whitepoint_r;
+			double delta_b = gain_b[i] * B - 1 - whitepoint_b;
+			double delta2 = delta_r * delta_r + delta_b * delta_b;
+			delta2_sums[i] += std::min(delta2, delta_limit);
+		}
 	}
-	return delta2_sum;
 }
 
 Pwl Awb::interpolatePrior()
@@ -388,31 +385,30 @@ double Awb::coarseSearch(Pwl const &prior)
 {
 	points_.clear(); // assume doesn't deallocate memory
 	size_t best_point = 0;
-	double t = mode_->ct_lo;
-	int span_r = 0, span_b = 0;
-	// Step down the CT curve evaluating log likelihood.
-	while (true) {
-		double r = config_.ct_r.Eval(t, &span_r);
-		double b = config_.ct_b.Eval(t, &span_b);
-		double gain_r = 1 / r, gain_b = 1 / b;
-		double delta2_sum = computeDelta2Sum(gain_r, gain_b);
+	// The steps down the CT curve are always the same for a given mode, so
+	// we only need to evaluate the log likelihood at each of them.
+	std::vector<double> const &coarse_ct = mode_->coarse_ct;
+	delta2_sums_.resize(coarse_ct.size());
+	computeDelta2Sums(mode_->coarse_gain_r.data(),
+			  mode_->coarse_gain_b.data(), delta2_sums_.data(),
+			  coarse_ct.size());
+	int span = -1;
+	for (size_t i = 0; i < coarse_ct.size(); i++) {
+		double t = coarse_ct[i];
 		double prior_log_likelihood =
-			prior.Eval(prior.Domain().Clip(t));
-		double final_log_likelihood = delta2_sum - prior_log_likelihood;
-		RPI_LOG("t: " << t << " gain_r " << gain_r << " gain_b "
-			      << gain_b << " delta2_sum " << delta2_sum
-			      << " prior " << prior_log_likelihood << " final "
+			prior.Eval(prior.Domain().Clip(t), &span);
+		double final_log_likelihood =
+			delta2_sums_[i] - prior_log_likelihood;
+		RPI_LOG("t: " << t << " gain_r " << mode_->coarse_gain_r[i]
+			      << " gain_b " << mode_->coarse_gain_b[i]
+			      << " delta2_sum " << delta2_sums_[i] << " prior "
+			      << prior_log_likelihood << " final "
 			      << final_log_likelihood);
 		points_.push_back(Pwl::Point(t, final_log_likelihood));
 		if (points_.back().y < points_[best_point].y)
 			best_point = points_.size() - 1;
-		if (t == mode_->ct_hi)
-			break;
-		// for even steps along the r/b curve scale them by the current t
-		t = std::min(t + t / 10 * config_.coarse_step,
-			     mode_->ct_hi);
 	}
-	t = points_[best_point].x;
+	double t = points_[best_point].x;
 	RPI_LOG("Coarse search found CT " << t);
 	// We have the best point of the search, but refine it with a quadratic
 	// interpolation around its neighbours.
@@ -434,7 +430,8 @@ void Awb::fineSearch(double &t, double &r, double &b, Pwl const &prior)
 	config_.ct_r.Eval(t, &span_r);
 	config_.ct_b.Eval(t, &span_b);
 	double step = t / 10 * config_.coarse_step * 0.1;
-	int nsteps = 5;
+	const int NUM_CURVE_STEPS = 5;
+	int nsteps = NUM_CURVE_STEPS;
 	double r_diff = config_.ct_r.Eval(t + nsteps * step, &span_r) -
 			config_.ct_r.Eval(t - nsteps * step, &span_r);
 	double b_diff = config_.ct_b.Eval(t + nsteps * step, &span_b) -
@@ -445,7 +442,6 @@ void Awb::fineSearch(double &t, double &r, double &b, Pwl const &prior)
 	// unit vector orthogonal to the b vs. r function (pointing outwards
 	// with r and b increasing)
 	transverse = transverse / transverse.Len();
-	double best_log_likelihood = 0, best_t = 0, best_r = 0, best_b = 0;
 	double transverse_range =
 		config_.transverse_neg + config_.transverse_pos;
 	const int MAX_NUM_DELTAS = 12;
@@ -455,44 +451,65 @@ void Awb::fineSearch(double &t, double &r, double &b, Pwl const &prior)
 		     (num_deltas > MAX_NUM_DELTAS ? MAX_NUM_DELTAS : num_deltas);
 	// Step down CT curve. March a bit further if the transverse range is
 	// large.
+	const int MAX_NUM_STEPS = 2 * (NUM_CURVE_STEPS + MAX_NUM_DELTAS) + 1;
 	nsteps += num_deltas;
-	for (int i = -nsteps; i <= nsteps; i++) {
-		double t_test = t + i * step;
-		double prior_log_likelihood =
+	int num_steps = 2 * nsteps + 1;
+	double offsets[MAX_NUM_DELTAS];
+	for (int j = 0; j < num_deltas; j++)
+		offsets[j] = -config_.transverse_neg +
+			     (transverse_range * j) / (num_deltas - 1);
+	// Lay out all the measurements transversely *off* the CT curve first,
+	// so that they can be evaluated in a single batch.
+	double prior_log_likelihood[MAX_NUM_STEPS];
+	Pwl::Point rb_curve[MAX_NUM_STEPS];
+	double gain_r[MAX_NUM_STEPS * MAX_NUM_DELTAS];
+	double gain_b[MAX_NUM_STEPS * MAX_NUM_DELTAS];
+	double delta2_sum[MAX_NUM_STEPS * MAX_NUM_DELTAS];
+	for (int i = 0; i < num_steps; i++) {
+		double t_test = t + (i - nsteps) * step;
+		prior_log_likelihood[i] =
 			prior.Eval(prior.Domain().Clip(t_test));
-		double r_curve = config_.ct_r.Eval(t_test, &span_r);
-		double b_curve = config_.ct_b.Eval(t_test, &span_b);
+		rb_curve[i] = Pwl::Point(config_.ct_r.Eval(t_test, &span_r),
+					 config_.ct_b.Eval(t_test, &span_b));
+		for (int j = 0; j < num_deltas; j++) {
+			Pwl::Point rb_test = rb_curve[i] + transverse * offsets[j];
+			gain_r[i * num_deltas + j] = 1 / rb_test.x;
+			gain_b[i * num_deltas + j] = 1 / rb_test.y;
+		}
+	}
+	computeDelta2Sums(gain_r, gain_b, delta2_sum, num_steps * num_deltas);
+	// Now, for each CT, do a quadratic interpolation across the points we
+	// measured for the best result.
+	Pwl::Point rb_best[MAX_NUM_STEPS];
+	for (int i = 0; i < num_steps; i++) {
 		// x will be distance off the curve, y the log likelihood there
 		Pwl::Point points[MAX_NUM_DELTAS];
 		int best_point = 0;
-		// Take some measurements transversely *off* the CT curve.
 		for (int j = 0; j < num_deltas; j++) {
-			points[j].x = -config_.transverse_neg +
-				      (transverse_range * j) / (num_deltas - 1);
-			Pwl::Point rb_test = Pwl::Point(r_curve, b_curve) +
-					     transverse * points[j].x;
-			double r_test = rb_test.x, b_test = rb_test.y;
-			double gain_r = 1 / r_test, gain_b = 1 / b_test;
-			double delta2_sum = computeDelta2Sum(gain_r, gain_b);
-			points[j].y = delta2_sum - prior_log_likelihood;
-			RPI_LOG("At t " << t_test << " r " << r_test << " b "
-					<< b_test << ": " << points[j].y);
+			points[j].x = offsets[j];
+			points[j].y = delta2_sum[i * num_deltas + j] -
+				      prior_log_likelihood[i];
+			RPI_LOG("At t " << t + (i - nsteps) * step << ": "
+					<< points[j].y);
 			if (points[j].y < points[best_point].y)
 				best_point = j;
 		}
-		// We have NUM_DELTAS points transversely across the CT curve,
-		// now let's do a quadratic interpolation for the best result.
 		best_point = std::max(1, std::min(best_point, num_deltas - 2));
-		Pwl::Point rb_test =
-			Pwl::Point(r_curve, b_curve) +
-			transverse *
-				interpolate_quadatric(points[best_point - 1],
-						      points[best_point],
-						      points[best_point + 1]);
-		double r_test = rb_test.x, b_test = rb_test.y;
-		double gain_r = 1 / r_test, gain_b = 1 / b_test;
-		double delta2_sum = computeDelta2Sum(gain_r, gain_b);
-		double final_log_likelihood = delta2_sum - prior_log_likelihood;
+		rb_best[i] = rb_curve[i] +
+			     transverse *
+				     interpolate_quadatric(points[best_point - 1],
+							   points[best_point],
+							   points[best_point + 1]);
+		gain_r[i] = 1 / rb_best[i].x;
+		gain_b[i] = 1 / rb_best[i].y;
+	}
+	computeDelta2Sums(gain_r, gain_b, delta2_sum, num_steps);
+	double best_log_likelihood = 0, best_t = 0, best_r = 0, best_b = 0;
+	for (int i = 0; i < num_steps; i++) {
+		double t_test = t + (i - nsteps) * step;
+		double r_test = rb_best[i].x, b_test = rb_best[i].y;
+		double final_log_likelihood =
+			delta2_sum[i] - prior_log_likelihood[i];
 		RPI_LOG("Finally "
 			<< t_test << " r " << r_test << " b " << b_test << ": "
 			<< final_log_likelihood
@@ -510,8 +527,13 @@ void Awb::awbBayes()
 {
 	// May as well divide out G to save computeDelta2Sum from doing it over
 	// and over.
-	for (auto &z : zones_)
+	zones_r_.clear();
+	zones_b_.clear();
+	for (auto &z : zones_) {
 		z.R = z.R / (z.G + 1), z.B = z.B / (z.G + 1);
+		zones_r_.push_back(z.R);
+		zones_b_.push_back(z.B);
+	}
 	// Get the current prior, and scale according to how many zones are
 	// valid... not entirely sure about this.
 	Pwl prior = interpolatePrior();
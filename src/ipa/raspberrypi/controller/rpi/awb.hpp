@@ -7,9 +7,8 @@
 #pragma once
 
 #include <mutex>
-#include <condition_variable>
-#include <thread>
 
+#include "../async_scheduler.hpp"
 #include "../awb_algorithm.hpp"
 #include "../pwl.hpp"
 #include "../awb_status.h"
@@ -22,6 +21,11 @@ struct AwbMode {
 	void Read(boost::property_tree::ptree const &params);
 	double ct_lo; // low CT value for search
 	double ct_hi; // high CT value for search
+	// The CT values visited by the coarse search, and the gains that put
+	// each of them on the CT curve, worked out once when the tuning is read.
+	std::vector<double> coarse_ct;
+	std::vector<double> coarse_gain_r;
+	std::vector<double> coarse_gain_b;
 };
 
 struct AwbPrior {
@@ -107,24 +111,9 @@ public:
 private:
 	// configuration is read-only, and available to both threads
 	AwbConfig config_;
-	std::thread async_thread_;
-	void asyncFunc(); // asynchronous thread function
-	std::mutex mutex_;
-	// condvar for async thread to wait on
-	std::condition_variable async_signal_;
-	// condvar for synchronous thread to wait on
-	std::condition_variable sync_signal_;
-	// for sync thread to check  if async thread finished (requires mutex)
-	bool async_finished_;
-	// for async thread to check if it's been told to run (requires mutex)
-	bool async_start_;
-	// for async thread to check if it's been told to quit (requires mutex)
-	bool async_abort_;
 
 	// The following are only for the synchronous thread to use:
-	// for sync thread to note its has asked async thread to run
-	bool async_started_;
-	// counts up to frame_period before restarting the async thread
+	// counts up to frame_period before restarting the async job
 	int frame_phase_;
 	int frame_count_; // counts up to startup_frames
 	int frame_count2_; // counts up to startup_frames for Process method
@@ -132,11 +121,11 @@ private:
 	AwbStatus prev_sync_results_;
 	std::string mode_name_;
 	std::mutex settings_mutex_;
-	// The following are for the asynchronous thread to use, though the main
-	// thread can set/reset them if the async thread is known to be idle:
+	// The following are for the asynchronous job to use, though the main
+	// thread can set/reset them if the job is known to be idle:
 	void restartAsync(StatisticsPtr &stats, std::string const &mode_name,
 			  double lux);
-	// copy out the results from the async thread so that it can be restarted
+	// copy out the results from the async job so that it can be restarted
 	void fetchAsyncResults();
 	StatisticsPtr statistics_;
 	AwbMode *mode_;
@@ -146,16 +135,25 @@ private:
 	void awbBayes();
 	void awbGrey();
 	void prepareStats();
-	double computeDelta2Sum(double gain_r, double gain_b);
+	void computeDelta2Sums(double const *__restrict gain_r,
+			       double const *__restrict gain_b,
+			       double *__restrict delta2_sums, unsigned int count);
 	Pwl interpolatePrior();
 	double coarseSearch(Pwl const &prior);
 	void fineSearch(double &t, double &r, double &b, Pwl const &prior);
 	std::vector<RGB> zones_;
+	// R/G and B/G of the valid zones, laid out for computeDelta2Sums
+	std::vector<double> zones_r_;
+	std::vector<double> zones_b_;
+	std::vector<double> delta2_sums_;
 	std::vector<Pwl::Point> points_;
 	// manual r setting
 	double manual_r_;
 	// manual b setting
 	double manual_b_;
+	// declared last so that a job still in flight is finished with before
+	// anything it uses is destroyed
+	AsyncJob async_job_;
 };
 
 static inline Awb::RGB operator+(Awb::RGB const &a, Awb::RGB const &b)
@@ -45,7 +45,7 @@ void BlackLevel::Prepare(Metadata *image_metadata)
 	status.black_level_r = black_level_r_;
 	status.black_level_g = black_level_g_;
 	status.black_level_b = black_level_b_;
-	image_metadata->Set("black_level.status", status);
+	image_metadata->Set(status);
 }
 
 // Register algorithm with the system.
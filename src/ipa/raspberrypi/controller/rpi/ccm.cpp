@@ -80,9 +80,9 @@ void Ccm::SetSaturation(double saturation)
 void Ccm::Initialise() {}
 
 template<typename T>
-static bool get_locked(Metadata *metadata, std::string const &tag, T &value)
+static bool get_locked(Metadata *metadata, T &value)
 {
-	T *ptr = metadata->GetLocked<T>(tag);
+	T *ptr = metadata->GetLocked<T>();
 	if (ptr == nullptr)
 		return false;
 	value = *ptr;
@@ -125,8 +125,8 @@ void Ccm::Prepare(Metadata *image_metadata)
 	{
 		// grab mutex just once to get everything
 		std::lock_guard<Metadata> lock(*image_metadata);
-		awb_ok = get_locked(image_metadata, "awb.status", awb);
-		lux_ok = get_locked(image_metadata, "lux.status", lux);
+		awb_ok = get_locked(image_metadata, awb);
+		lux_ok = get_locked(image_metadata, lux);
 	}
 	if (!awb_ok)
 		RPI_WARN("Ccm: no colour temperature found");
@@ -151,7 +151,7 @@ void Ccm::Prepare(Metadata *image_metadata)
 			<< " " << ccm_status.matrix[5] << "     "
 			<< ccm_status.matrix[6] << " " << ccm_status.matrix[7]
 			<< " " << ccm_status.matrix[8]);
-	image_metadata->Set("ccm.status", ccm_status);
+	image_metadata->Set(ccm_status);
 }
 
 // Register algorithm with the system.
@@ -63,12 +63,15 @@ static void fill_in_status(ContrastStatus &status, double brightness,
 {
 	status.brightness = brightness;
 	status.contrast = contrast;
+	double x[CONTRAST_NUM_POINTS - 1], y[CONTRAST_NUM_POINTS - 1];
+	for (int i = 0; i < CONTRAST_NUM_POINTS - 1; i++)
+		x[i] = i < 16 ? i * 1024
+			      : (i < 24 ? (i - 16) * 2048 + 16384
+					: (i - 24) * 4096 + 32768);
+	gamma_curve.Eval(x, y, CONTRAST_NUM_POINTS - 1);
 	for (int i = 0; i < CONTRAST_NUM_POINTS - 1; i++) {
-		int x = i < 16 ? i * 1024
-			       : (i < 24 ? (i - 16) * 2048 + 16384
-					 : (i - 24) * 4096 + 32768);
-		status.points[i].x = x;
-		status.points[i].y = std::min(65535.0, gamma_curve.Eval(x));
+		status.points[i].x = x[i];
+		status.points[i].y = std::min(65535.0, y[i]);
 	}
 	status.points[CONTRAST_NUM_POINTS - 1].x = 65535;
 	status.points[CONTRAST_NUM_POINTS - 1].y = 65535;
@@ -84,7 +87,7 @@ void Contrast::Initialise()
 void Contrast::Prepare(Metadata *image_metadata)
 {
 	std::unique_lock<std::mutex> lock(mutex_);
-	image_metadata->Set("contrast.status", status_);
+	image_metadata->Set(status_);
 }
 
 Pwl compute_stretch_curve(Histogram const &histogram,
@@ -92,10 +95,12 @@ Pwl compute_stretch_curve(Histogram const &histogram,
 {
 	Pwl enhance;
 	enhance.Append(0, 0);
+	double q[3] = { config.lo_histogram, 0.5, config.hi_histogram };
+	double bins[3];
+	histogram.Quantiles(q, bins, 3);
 	// If the start of the histogram is rather empty, try to pull it down a
 	// bit.
-	double hist_lo = histogram.Quantile(config.lo_histogram) *
-			 (65536 / NUM_HISTOGRAM_BINS);
+	double hist_lo = bins[0] * (65536 / NUM_HISTOGRAM_BINS);
 	double level_lo = config.lo_level * 65536;
 	RPI_LOG("Move histogram point " << hist_lo << " to " << level_lo);
 	hist_lo = std::max(
@@ -105,13 +110,12 @@ Pwl compute_stretch_curve(Histogram const &histogram,
 	enhance.Append(hist_lo, level_lo);
 	// Keep the mid-point (median) in the same place, though, to limit the
 	// apparent amount of global brightness shift.
-	double mid = histogram.Quantile(0.5) * (65536 / NUM_HISTOGRAM_BINS);
+	double mid = bins[1] * (65536 / NUM_HISTOGRAM_BINS);
 	enhance.Append(mid, mid);
 
 	// If the top to the histogram is empty, try to pull the pixel values
 	// there up.
-	double hist_hi = histogram.Quantile(config.hi_histogram) *
-			 (65536 / NUM_HISTOGRAM_BINS);
+	double hist_hi = bins[2] * (65536 / NUM_HISTOGRAM_BINS);
 	double level_hi = config.hi_level * 65536;
 	RPI_LOG("Move histogram point " << hist_hi << " to " << level_hi);
 	hist_hi = std::min(
@@ -139,16 +143,16 @@ Pwl apply_manual_contrast(Pwl const &gamma_curve, double brightness,
 
 void Contrast::Process(StatisticsPtr &stats, Metadata *image_metadata)
 {
-	(void)image_metadata;
 	double brightness = brightness_, contrast = contrast_;
-	Histogram histogram(stats->hist[0].g_hist, NUM_HISTOGRAM_BINS);
+	if (image_metadata->Get(histogram_) != 0)
+		histogram_.Set(stats->hist[0].g_hist, NUM_HISTOGRAM_BINS);
 	// We look at the histogram and adjust the gamma curve in the following
 	// ways: 1. Adjust the gamma curve so as to pull the start of the
 	// histogram down, and possibly push the end up.
 	Pwl gamma_curve = config_.gamma_curve;
 	if (config_.ce_enable) {
 		if (config_.lo_max != 0 || config_.hi_max != 0)
-			gamma_curve = compute_stretch_curve(histogram, config_)
+			gamma_curve = compute_stretch_curve(histogram_, config_)
 					      .Compose(gamma_curve);
 		// We could apply other adjustments (e.g. partial equalisation)
 		// based on the histogram...?
@@ -10,6 +10,7 @@
 #include <mutex>
 
 #include "../contrast_algorithm.hpp"
+#include "../histogram.hpp"
 #include "../pwl.hpp"
 
 namespace RPi {
@@ -45,6 +46,7 @@ private:
 	std::atomic<double> brightness_;
 	std::atomic<double> contrast_;
 	ContrastStatus status_;
+	Histogram histogram_;
 	std::mutex mutex_;
 };
 
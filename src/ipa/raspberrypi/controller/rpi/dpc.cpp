@@ -38,7 +38,7 @@ void Dpc::Prepare(Metadata *image_metadata)
 	// Should we vary this with lux level or analogue gain? TBD.
 	dpc_status.strength = config_.strength;
 	RPI_LOG("Dpc: strength " << dpc_status.strength);
-	image_metadata->Set("dpc.status", dpc_status);
+	image_metadata->Set(dpc_status);
 }
 
 // Register algorithm with the system.
@@ -39,7 +39,7 @@ void Focus::Process(StatisticsPtr &stats, Metadata *image_metadata)
 	for (i = 0; i < FOCUS_REGIONS; i++)
 		status.focus_measures[i] = stats->focus_stats[i].contrast_val[1][1] / 1000;
 	status.num = i;
-	image_metadata->Set("focus.status", status);
+	image_metadata->Set(status);
 	if (print_) {
 		uint32_t value = (status.focus_measures[5] + status.focus_measures[6]) / 10;
 		RPI_LOG("Focus contrast measure: " << value);
@@ -46,7 +46,7 @@ void Lux::Read(boost::property_tree::ptree const &params)
 void Lux::Prepare(Metadata *image_metadata)
 {
 	std::unique_lock<std::mutex> lock(mutex_);
-	image_metadata->Set("lux.status", status_);
+	image_metadata->Set(status_);
 }
 
 void Lux::Process(StatisticsPtr &stats, Metadata *image_metadata)
@@ -58,7 +58,7 @@ void Lux::Process(StatisticsPtr &stats, Metadata *image_metadata)
 		  .lens_position = 0.0,
 		  .aperture = 0.0,
 		  .flash_intensity = 0.0 };
-	if (image_metadata->Get("device.status", device_status) == 0) {
+	if (image_metadata->Get(device_status) == 0) {
 		double current_gain = device_status.analogue_gain;
 		double current_shutter_speed = device_status.shutter_speed;
 		double current_aperture = device_status.aperture;
@@ -91,7 +91,7 @@ void Lux::Process(StatisticsPtr &stats, Metadata *image_metadata)
 		}
 		// Overwrite the metadata here as well, so that downstream
 		// algorithms get the latest value.
-		image_metadata->Set("lux.status", status);
+		image_metadata->Set(status);
 	} else
 		RPI_WARN(Name() << ": no device metadata");
 }
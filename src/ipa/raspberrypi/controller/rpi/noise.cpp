@@ -45,7 +45,7 @@ void Noise::Prepare(Metadata *image_metadata)
 {
 	struct DeviceStatus device_status;
 	device_status.analogue_gain = 1.0; // keep compiler calm
-	if (image_metadata->Get("device.status", device_status) == 0) {
+	if (image_metadata->Get(device_status) == 0) {
 		// There is a slight question as to exactly how the noise
 		// profile, specifically the constant part of it, scales. For
 		// now we assume it all scales the same, and we'll revisit this
@@ -56,7 +56,7 @@ void Noise::Prepare(Metadata *image_metadata)
 		struct NoiseStatus status;
 		status.noise_constant = reference_constant_ * factor;
 		status.noise_slope = reference_slope_ * factor;
-		image_metadata->Set("noise.status", status);
+		image_metadata->Set(status);
 		RPI_LOG(Name() << ": constant " << status.noise_constant
 			       << " slope " << status.noise_slope);
 	} else
@@ -39,7 +39,7 @@ void Sdn::Prepare(Metadata *image_metadata)
 {
 	struct NoiseStatus noise_status = {};
 	noise_status.noise_slope = 3.0; // in case no metadata
-	if (image_metadata->Get("noise.status", noise_status) != 0)
+	if (image_metadata->Get(noise_status) != 0)
 		RPI_WARN("Sdn: no noise profile found");
 	RPI_LOG("Noise profile: constant " << noise_status.noise_constant
 					   << " slope "
@@ -48,7 +48,7 @@ void Sdn::Prepare(Metadata *image_metadata)
 	status.noise_constant = noise_status.noise_constant * deviation_;
 	status.noise_slope = noise_status.noise_slope * deviation_;
 	status.strength = strength_;
-	image_metadata->Set("sdn.status", status);
+	image_metadata->Set(status);
 	RPI_LOG("Sdn: programmed constant " << status.noise_constant
 					    << " slope " << status.noise_slope
 					    << " strength "
@@ -49,7 +49,7 @@ void Sharpen::Prepare(Metadata *image_metadata)
 	status.threshold = threshold_ * mode_factor;
 	status.strength = strength_ / mode_factor;
 	status.limit = limit_ / mode_factor;
-	image_metadata->Set("sharpen.status", status);
+	image_metadata->Set(status);
 }
 
 // Register algorithm with the system.
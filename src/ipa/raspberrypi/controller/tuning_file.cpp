@@ -0,0 +1,297 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2020, Raspberry Pi (Trading) Limited
+ *
+ * tuning_file.cpp - loading and caching of tuning files
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+
+#include <boost/property_tree/json_parser.hpp>
+
+#include "logging.hpp"
+
+#include "tuning_file.hpp"
+
+using namespace RPi;
+
+// The binary file starts with this header, followed by the root node. Each
+// node is its data (a 32-bit length and the bytes), then the number of
+// children, then for each child its key (also length and bytes) and its node,
+// recursively. Everything is in the machine's native byte order, which the
+// byte_order field lets us check.
+
+#define TUNING_MAGIC "RPiTune"
+#define TUNING_VERSION 1
+#define TUNING_BYTE_ORDER 0x01020304
+#define MAX_DEPTH 64
+
+struct TuningHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint64_t source_hash;
+	uint64_t size; // of everything after the header
+};
+
+// Environment variable giving the cache directory. The cache is disabled
+// when it isn't set.
+#define CACHE_DIR_ENV "LIBCAMERA_RPI_TUNING_CACHE"
+
+static uint64_t hash_contents(std::string const &contents)
+{
+	// 64-bit FNV-1a.
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (unsigned char c : contents) {
+		hash ^= c;
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static void read_file(char const *filename, std::string &contents)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file)
+		throw boost::property_tree::json_parser_error(
+			"cannot open file", filename, 0);
+	std::ostringstream stream;
+	stream << file.rdbuf();
+	contents = stream.str();
+}
+
+static void parse_json(char const *filename, std::string const &contents,
+		       boost::property_tree::ptree &root)
+{
+	std::istringstream stream(contents);
+	try {
+		boost::property_tree::read_json(stream, root);
+	} catch (boost::property_tree::json_parser_error &e) {
+		// Report the error against the file rather than the stream.
+		throw boost::property_tree::json_parser_error(
+			e.message(), filename, e.line());
+	}
+}
+
+static std::string cache_directory()
+{
+	char const *dir = getenv(CACHE_DIR_ENV);
+	if (!dir || !*dir)
+		return "";
+	// Failures will show up when we try to write the cache file.
+	mkdir(dir, 0755);
+	return dir;
+}
+
+static std::string cache_filename(char const *filename)
+{
+	std::string dir = cache_directory();
+	if (dir.empty())
+		return "";
+	// Keep one cache file per tuning file name. Its contents record the
+	// hash of the JSON they were made from, so an edited (or different)
+	// JSON file of the same name simply replaces it.
+	char const *name = strrchr(filename, '/');
+	name = name ? name + 1 : filename;
+	return dir + "/" + name + ".bin";
+}
+
+namespace {
+
+class Reader
+{
+public:
+	Reader(uint8_t const *data, size_t size)
+		: ptr_(data), end_(data + size)
+	{
+	}
+	bool ReadNode(boost::property_tree::ptree &node, unsigned int depth)
+	{
+		if (depth > MAX_DEPTH || !readString(data_))
+			return false;
+		node.data() = data_;
+		uint32_t num_children;
+		if (!readU32(num_children))
+			return false;
+		for (uint32_t i = 0; i < num_children; i++) {
+			if (!readString(key_))
+				return false;
+			// Build each child in place rather than copying
+			// subtrees around.
+			auto it = node.push_back(
+				std::make_pair(key_, boost::property_tree::ptree()));
+			if (!ReadNode(it->second, depth + 1))
+				return false;
+		}
+		return true;
+	}
+	bool AtEnd() const { return ptr_ == end_; }
+
+private:
+	bool readU32(uint32_t &value)
+	{
+		if (end_ - ptr_ < (ptrdiff_t)sizeof(value))
+			return false;
+		memcpy(&value, ptr_, sizeof(value));
+		ptr_ += sizeof(value);
+		return true;
+	}
+	bool readString(std::string &str)
+	{
+		uint32_t len;
+		if (!readU32(len) || (size_t)(end_ - ptr_) < len)
+			return false;
+		str.assign(reinterpret_cast<char const *>(ptr_), len);
+		ptr_ += len;
+		return true;
+	}
+	uint8_t const *ptr_;
+	uint8_t const *end_;
+	// Scratch strings, to save reallocating them for every node.
+	std::string data_;
+	std::string key_;
+};
+
+} // namespace
+
+static void write_u32(std::string &out, uint32_t value)
+{
+	out.append(reinterpret_cast<char const *>(&value), sizeof(value));
+}
+
+static void write_string(std::string &out, std::string const &str)
+{
+	write_u32(out, str.size());
+	out.append(str);
+}
+
+static void write_node(std::string &out, boost::property_tree::ptree const &node)
+{
+	write_string(out, node.data());
+	write_u32(out, node.size());
+	for (auto const &key_and_value : node) {
+		write_string(out, key_and_value.first);
+		write_node(out, key_and_value.second);
+	}
+}
+
+void RPi::ReadJsonTuningFile(char const *filename,
+			     boost::property_tree::ptree &root, uint64_t *hash)
+{
+	std::string contents;
+	read_file(filename, contents);
+	if (hash)
+		*hash = hash_contents(contents);
+	parse_json(filename, contents, root);
+}
+
+bool RPi::ReadBinaryTuningFile(char const *filename,
+			       boost::property_tree::ptree &root,
+			       uint64_t const *expected_hash)
+{
+	int fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(TuningHeader)) {
+		close(fd);
+		return false;
+	}
+	void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return false;
+
+	TuningHeader header;
+	memcpy(&header, map, sizeof(header));
+	bool ok = !memcmp(header.magic, TUNING_MAGIC, sizeof(header.magic)) &&
+		  header.version == TUNING_VERSION &&
+		  header.byte_order == TUNING_BYTE_ORDER &&
+		  header.size == (uint64_t)st.st_size - sizeof(header) &&
+		  (!expected_hash || header.source_hash == *expected_hash);
+	if (ok) {
+		Reader reader(static_cast<uint8_t const *>(map) + sizeof(header),
+			      header.size);
+		root.clear();
+		ok = reader.ReadNode(root, 0) && reader.AtEnd();
+		if (!ok) {
+			RPI_WARN("Malformed tuning file " << filename);
+			root.clear();
+		}
+	}
+	munmap(map, st.st_size);
+	return ok;
+}
+
+bool RPi::WriteBinaryTuningFile(char const *filename,
+				boost::property_tree::ptree const &root,
+				uint64_t source_hash)
+{
+	TuningHeader header = {};
+	memcpy(header.magic, TUNING_MAGIC, sizeof(header.magic));
+	header.version = TUNING_VERSION;
+	header.byte_order = TUNING_BYTE_ORDER;
+	header.source_hash = source_hash;
+	std::string out(reinterpret_cast<char const *>(&header), sizeof(header));
+	write_node(out, root);
+	uint64_t size = out.size() - sizeof(header);
+	memcpy(&out[offsetof(TuningHeader, size)], &size, sizeof(size));
+
+	// Write to a temporary file and rename it over the target.
+	std::string tmp_name = std::string(filename) + ".XXXXXX";
+	int fd = mkstemp(&tmp_name[0]);
+	if (fd < 0)
+		return false;
+	size_t written = 0;
+	while (written < out.size()) {
+		ssize_t ret = write(fd, out.data() + written,
+				    out.size() - written);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			break;
+		written += ret;
+	}
+	bool ok = written == out.size();
+	ok = !close(fd) && ok;
+	if (ok)
+		ok = !chmod(tmp_name.c_str(), 0644) &&
+		     !rename(tmp_name.c_str(), filename);
+	if (!ok)
+		unlink(tmp_name.c_str());
+	return ok;
+}
+
+void RPi::ReadTuningFile(char const *filename, boost::property_tree::ptree &root)
+{
+	// Files that are already in binary form are used directly.
+	if (ReadBinaryTuningFile(filename, root)) {
+		RPI_LOG("Read binary tuning file " << filename);
+		return;
+	}
+
+	std::string contents;
+	read_file(filename, contents);
+	uint64_t hash = hash_contents(contents);
+	std::string cache = cache_filename(filename);
+	if (!cache.empty() && ReadBinaryTuningFile(cache.c_str(), root, &hash)) {
+		RPI_LOG("Read " << filename << " from cache " << cache);
+		return;
+	}
+
+	parse_json(filename, contents, root);
+	// Failing to write the cache costs us nothing but the next startup.
+	if (!cache.empty() && !WriteBinaryTuningFile(cache.c_str(), root, hash))
+		RPI_LOG("Unable to write tuning cache " << cache);
+}
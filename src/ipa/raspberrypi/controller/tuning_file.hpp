@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2020, Raspberry Pi (Trading) Limited
+ *
+ * tuning_file.hpp - loading and caching of tuning files
+ */
+#pragma once
+
+// Tuning files are written in JSON, but parsing them is a noticeable part of
+// the time it takes to open a camera. They can instead be converted into a
+// compact binary form that is simply mapped and walked to rebuild the same
+// property tree. When given a JSON file, we can cache its binary form (tagged
+// with a hash of the JSON) so that only the first load has to parse it. The
+// cache is opt-in, in the directory named by the LIBCAMERA_RPI_TUNING_CACHE
+// environment variable.
+
+#include <stdint.h>
+
+#include <string>
+
+#include <boost/property_tree/ptree.hpp>
+
+namespace RPi {
+
+// Load a tuning file, in either format, into the property tree, using (and
+// updating) the cache for JSON files when it is enabled. Throws on failure
+// just as the JSON parser does.
+void ReadTuningFile(char const *filename, boost::property_tree::ptree &root);
+
+// Parse a JSON tuning file without going through the cache.
+void ReadJsonTuningFile(char const *filename, boost::property_tree::ptree &root,
+			uint64_t *hash = nullptr);
+
+// Read a binary tuning file. If expected_hash is given, the file must have
+// been made from JSON with that hash. Returns false if the file is missing,
+// stale or malformed.
+bool ReadBinaryTuningFile(char const *filename,
+			  boost::property_tree::ptree &root,
+			  uint64_t const *expected_hash = nullptr);
+
+// Write the property tree as a binary tuning file, returning false on failure.
+// The file is replaced atomically so that concurrent readers never see it
+// half-written.
+bool WriteBinaryTuningFile(char const *filename,
+			   boost::property_tree::ptree const &root,
+			   uint64_t source_hash);
+
+} // namespace RPi
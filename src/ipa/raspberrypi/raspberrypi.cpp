@@ -73,7 +73,7 @@ public:
 
 	int init(const IPASettings &settings) override;
 	int start() override { return 0; }
-	void stop() override {}
+	void stop() override;
 
 	void configure(const CameraSensorInfo &sensorInfo,
 		       const std::map<unsigned int, IPAStream> &streamConfig,
@@ -139,6 +139,27 @@ private:
 	void *lsTable_;
 };
 
+void IPARPi::stop()
+{
+	using std::chrono::duration_cast;
+	using std::chrono::microseconds;
+
+	/* Report how the asynchronous algorithms kept up with the frames. */
+	for (auto const &it : controller_.GetAsyncStats()) {
+		const RPi::AsyncScheduler::Stats &stats = it.second;
+
+		LOG(IPARPI, Info)
+			<< it.first << ": " << stats.count << " jobs, latency "
+			<< duration_cast<microseconds>(stats.total_latency).count() / stats.count
+			<< "us average, "
+			<< duration_cast<microseconds>(stats.max_latency).count()
+			<< "us max, run time "
+			<< duration_cast<microseconds>(stats.total_run_time).count() / stats.count
+			<< "us average, " << stats.deadline_misses
+			<< " deadlines missed";
+	}
+}
+
 int IPARPi::init(const IPASettings &settings)
 {
 	tuningFile_ = settings.configurationFile;
@@ -373,28 +394,28 @@ void IPARPi::reportMetadata()
 	 * buffer, where an application could query it.
 	 */
 
-	DeviceStatus *deviceStatus = rpiMetadata_.GetLocked<DeviceStatus>("device.status");
+	DeviceStatus *deviceStatus = rpiMetadata_.GetLocked<DeviceStatus>();
 	if (deviceStatus) {
 		libcameraMetadata_.set(controls::ExposureTime, deviceStatus->shutter_speed);
 		libcameraMetadata_.set(controls::AnalogueGain, deviceStatus->analogue_gain);
 	}
 
-	AgcStatus *agcStatus = rpiMetadata_.GetLocked<AgcStatus>("agc.status");
+	AgcStatus *agcStatus = rpiMetadata_.GetLocked<AgcStatus>();
 	if (agcStatus)
 		libcameraMetadata_.set(controls::AeLocked, agcStatus->locked);
 
-	LuxStatus *luxStatus = rpiMetadata_.GetLocked<LuxStatus>("lux.status");
+	LuxStatus *luxStatus = rpiMetadata_.GetLocked<LuxStatus>();
 	if (luxStatus)
 		libcameraMetadata_.set(controls::Lux, luxStatus->lux);
 
-	AwbStatus *awbStatus = rpiMetadata_.GetLocked<AwbStatus>("awb.status");
+	AwbStatus *awbStatus = rpiMetadata_.GetLocked<AwbStatus>();
 	if (awbStatus) {
 		libcameraMetadata_.set(controls::ColourGains, { static_cast<float>(awbStatus->gain_r),
 								static_cast<float>(awbStatus->gain_b) });
 		libcameraMetadata_.set(controls::ColourTemperature, awbStatus->temperature_K);
 	}
 
-	BlackLevelStatus *blackLevelStatus = rpiMetadata_.GetLocked<BlackLevelStatus>("black_level.status");
+	BlackLevelStatus *blackLevelStatus = rpiMetadata_.GetLocked<BlackLevelStatus>();
 	if (blackLevelStatus)
 		libcameraMetadata_.set(controls::SensorBlackLevels,
 				       { static_cast<int32_t>(blackLevelStatus->black_level_r),
@@ -660,49 +681,49 @@ void IPARPi::prepareISP(unsigned int bufferId)
 		ControlList ctrls(isp_ctrls_);
 
 		rpiMetadata_.Clear();
-		rpiMetadata_.Set("device.status", deviceStatus);
+		rpiMetadata_.Set(deviceStatus);
 		controller_.Prepare(&rpiMetadata_);
 
 		/* Lock the metadata buffer to avoid constant locks/unlocks. */
 		std::unique_lock<RPi::Metadata> lock(rpiMetadata_);
 
-		AwbStatus *awbStatus = rpiMetadata_.GetLocked<AwbStatus>("awb.status");
+		AwbStatus *awbStatus = rpiMetadata_.GetLocked<AwbStatus>();
 		if (awbStatus)
 			applyAWB(awbStatus, ctrls);
 
-		CcmStatus *ccmStatus = rpiMetadata_.GetLocked<CcmStatus>("ccm.status");
+		CcmStatus *ccmStatus = rpiMetadata_.GetLocked<CcmStatus>();
 		if (ccmStatus)
 			applyCCM(ccmStatus, ctrls);
 
-		AgcStatus *dgStatus = rpiMetadata_.GetLocked<AgcStatus>("agc.status");
+		AgcStatus *dgStatus = rpiMetadata_.GetLocked<AgcStatus>();
 		if (dgStatus)
 			applyDG(dgStatus, ctrls);
 
-		AlscStatus *lsStatus = rpiMetadata_.GetLocked<AlscStatus>("alsc.status");
+		AlscStatus *lsStatus = rpiMetadata_.GetLocked<AlscStatus>();
 		if (lsStatus)
 			applyLS(lsStatus, ctrls);
 
-		ContrastStatus *contrastStatus = rpiMetadata_.GetLocked<ContrastStatus>("contrast.status");
+		ContrastStatus *contrastStatus = rpiMetadata_.GetLocked<ContrastStatus>();
 		if (contrastStatus)
 			applyGamma(contrastStatus, ctrls);
 
-		BlackLevelStatus *blackLevelStatus = rpiMetadata_.GetLocked<BlackLevelStatus>("black_level.status");
+		BlackLevelStatus *blackLevelStatus = rpiMetadata_.GetLocked<BlackLevelStatus>();
 		if (blackLevelStatus)
 			applyBlackLevel(blackLevelStatus, ctrls);
 
-		GeqStatus *geqStatus = rpiMetadata_.GetLocked<GeqStatus>("geq.status");
+		GeqStatus *geqStatus = rpiMetadata_.GetLocked<GeqStatus>();
 		if (geqStatus)
 			applyGEQ(geqStatus, ctrls);
 
-		SdnStatus *denoiseStatus = rpiMetadata_.GetLocked<SdnStatus>("sdn.status");
+		SdnStatus *denoiseStatus = rpiMetadata_.GetLocked<SdnStatus>();
 		if (denoiseStatus)
 			applyDenoise(denoiseStatus, ctrls);
 
-		SharpenStatus *sharpenStatus = rpiMetadata_.GetLocked<SharpenStatus>("sharpen.status");
+		SharpenStatus *sharpenStatus = rpiMetadata_.GetLocked<SharpenStatus>();
 		if (sharpenStatus)
 			applySharpen(sharpenStatus, ctrls);
 
-		DpcStatus *dpcStatus = rpiMetadata_.GetLocked<DpcStatus>("dpc.status");
+		DpcStatus *dpcStatus = rpiMetadata_.GetLocked<DpcStatus>();
 		if (dpcStatus)
 			applyDPC(dpcStatus, ctrls);
 
@@ -763,7 +784,7 @@ void IPARPi::processStats(unsigned int bufferId)
 	controller_.Process(statistics, &rpiMetadata_);
 
 	struct AgcStatus agcStatus;
-	if (rpiMetadata_.Get("agc.status", agcStatus) == 0)
+	if (rpiMetadata_.Get(agcStatus) == 0)
 		applyAGC(&agcStatus);
 }
 
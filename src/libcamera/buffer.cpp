@@ -85,10 +85,12 @@ LOG_DEFINE_CATEGORY(Buffer)
  * \var FrameMetadata::timestamp
  * \brief Time when the frame was captured
  *
- * The timestamp is expressed as a number of nanoseconds relative to the system
- * clock since an unspecified time point.
+ * The timestamp is expressed as a number of nanoseconds on the CLOCK_MONOTONIC
+ * system clock, as returned by clock_gettime(). Applications can correlate it
+ * with other clocks by sampling CLOCK_MONOTONIC and their clock together.
  *
- * \todo Be more precise on what timestamps refer to.
+ * \todo Be more precise on which point of the frame capture the timestamp
+ * refers to.
  */
 
 /**
@@ -263,6 +263,7 @@ public:
 		CameraAcquired,
 		CameraConfigured,
 		CameraRunning,
+		CameraPaused,
 	};
 
 	Private(PipelineHandler *pipe, const std::string &name,
@@ -274,6 +275,7 @@ public:
 			    bool allowDisconnected = false) const;
 
 	void disconnect();
+	State state() const { return state_.load(std::memory_order_acquire); }
 	void setState(State state);
 
 	std::shared_ptr<PipelineHandler> pipe_;
@@ -304,6 +306,7 @@ static const char *const camera_state_names[] = {
 	"Acquired",
 	"Configured",
 	"Running",
+	"Paused",
 };
 
 int Camera::Private::isAccessAllowed(State state, bool allowDisconnected) const
@@ -348,11 +351,11 @@ int Camera::Private::isAccessAllowed(State low, State high,
 void Camera::Private::disconnect()
 {
 	/*
-	 * If the camera was running when the hardware was removed force the
-	 * state to Configured state to allow applications to free resources
-	 * and call release() before deleting the camera.
+	 * If the camera was running or paused when the hardware was removed
+	 * force the state to Configured state to allow applications to free
+	 * resources and call release() before deleting the camera.
 	 */
-	if (state_.load(std::memory_order_acquire) == Private::CameraRunning)
+	if (state_.load(std::memory_order_acquire) >= Private::CameraRunning)
 		state_.store(Private::CameraConfigured, std::memory_order_release);
 
 	disconnected_ = true;
@@ -410,6 +413,7 @@ void Camera::Private::setState(State state)
  *   node [shape = circle ]; Acquired;
  *   node [shape = circle ]; Configured;
  *   node [shape = circle ]; Running;
+ *   node [shape = circle ]; Paused;
  *
  *   Available -> Available [label = "release()"];
  *   Available -> Acquired [label = "acquire()"];
@@ -423,6 +427,11 @@ void Camera::Private::setState(State state)
  *
  *   Running -> Configured [label = "stop()"];
  *   Running -> Running [label = "createRequest(), queueRequest()"];
+ *   Running -> Paused [label = "pause()"];
+ *
+ *   Paused -> Configured [label = "stop()"];
+ *   Paused -> Paused [label = "createRequest(), queueRequest()"];
+ *   Paused -> Running [label = "resume()"];
  * }
  * \enddot
  *
@@ -444,7 +453,12 @@ void Camera::Private::setState(State state)
  * \subsubsection Running
  * The camera is running and ready to process requests queued by the
  * application. The camera remains in this state until it is stopped and moved
- * to the Configured state.
+ * to the Configured state, or paused and moved to the Paused state.
+ *
+ * \subsubsection Paused
+ * The camera is streaming but doesn't process new requests. Requests queued by
+ * the application are held until the camera is resumed and moves back to the
+ * Running state, or cancelled if it is stopped.
  */
 
 /**
@@ -690,7 +704,7 @@ const std::set<Stream *> &Camera::streams() const
 std::unique_ptr<CameraConfiguration> Camera::generateConfiguration(const StreamRoles &roles)
 {
 	int ret = p_->isAccessAllowed(Private::CameraAvailable,
-				      Private::CameraRunning);
+				      Private::CameraPaused);
 	if (ret < 0)
 		return nullptr;
 
@@ -806,14 +820,15 @@ int Camera::configure(CameraConfiguration *config)
  * responsible for either queueing the request or deleting it.
  *
  * \context This function is \threadsafe. It may only be called when the camera
- * is in the Configured or Running state as defined in \ref camera_operation.
+ * is in the Configured, Running or Paused state as defined in
+ * \ref camera_operation.
  *
  * \return A pointer to the newly created request, or nullptr on error
  */
 Request *Camera::createRequest(uint64_t cookie)
 {
 	int ret = p_->isAccessAllowed(Private::CameraConfigured,
-				      Private::CameraRunning);
+				      Private::CameraPaused);
 	if (ret < 0)
 		return nullptr;
 
@@ -837,7 +852,7 @@ Request *Camera::createRequest(uint64_t cookie)
  * automatically after it completes.
  *
  * \context This function is \threadsafe. It may only be called when the camera
- * is in the Running state as defined in \ref camera_operation.
+ * is in the Running or Paused state as defined in \ref camera_operation.
  *
  * \return 0 on success or a negative error code otherwise
  * \retval -ENODEV The camera has been disconnected from the system
@@ -847,7 +862,8 @@ Request *Camera::createRequest(uint64_t cookie)
  */
 int Camera::queueRequest(Request *request)
 {
-	int ret = p_->isAccessAllowed(Private::CameraRunning);
+	int ret = p_->isAccessAllowed(Private::CameraRunning,
+				      Private::CameraPaused);
 	if (ret < 0)
 		return ret;
 
@@ -916,8 +932,9 @@ int Camera::start()
  * requests are cancelled and complete synchronously in an error state.
  *
  * \context This function may only be called when the camera is in the Running
- * state as defined in \ref camera_operation, and shall be synchronized by the
- * caller with other functions that affect the camera state.
+ * or Paused state as defined in \ref camera_operation, and shall be
+ * synchronized by the caller with other functions that affect the camera
+ * state.
  *
  * \return 0 on success or a negative error code otherwise
  * \retval -ENODEV The camera has been disconnected from the system
@@ -925,17 +942,97 @@ int Camera::start()
  */
 int Camera::stop()
 {
-	int ret = p_->isAccessAllowed(Private::CameraRunning);
+	int ret = p_->isAccessAllowed(Private::CameraRunning,
+				      Private::CameraPaused);
 	if (ret < 0)
 		return ret;
 
 	LOG(Camera, Debug) << "Stopping capture";
 
+	bool paused = p_->state() == Private::CameraPaused;
+
 	p_->setState(Private::CameraConfigured);
 
 	p_->pipe_->invokeMethod(&PipelineHandler::stop, ConnectionTypeBlocking,
 				this);
 
+	/* Requests held while paused have never reached the device. */
+	if (paused)
+		p_->pipe_->invokeMethod(&PipelineHandler::cancelHeldRequests,
+					ConnectionTypeBlocking, this);
+
+	return 0;
+}
+
+/**
+ * \brief Pause capture from the camera
+ *
+ * This method pauses the capture session without stopping the device. The
+ * requests already queued to the device complete normally, while the requests
+ * queued from now on are held until the camera is resumed with resume(). As
+ * buffers stay allocated, the device keeps streaming and image processing
+ * algorithms keep running, resuming is much faster than restarting the camera
+ * with start().
+ *
+ * The camera can be stopped with stop() while paused, in which case the held
+ * requests are cancelled.
+ *
+ * Pausing is optional and not supported by all pipeline handlers.
+ *
+ * \context This function may only be called when the camera is in the Running
+ * state as defined in \ref camera_operation, and shall be synchronized by the
+ * caller with other functions that affect the camera state.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENODEV The camera has been disconnected from the system
+ * \retval -EACCES The camera is not running so can't be paused
+ * \retval -ENOTSUP The camera doesn't support pausing
+ */
+int Camera::pause()
+{
+	int ret = p_->isAccessAllowed(Private::CameraRunning);
+	if (ret < 0)
+		return ret;
+
+	LOG(Camera, Debug) << "Pausing capture";
+
+	ret = p_->pipe_->invokeMethod(&PipelineHandler::pause,
+				      ConnectionTypeBlocking, this);
+	if (ret)
+		return ret;
+
+	p_->setState(Private::CameraPaused);
+
+	return 0;
+}
+
+/**
+ * \brief Resume capture from the camera
+ *
+ * This method resumes a capture session paused with pause(). The requests held
+ * while the camera was paused are queued to the device in submission order.
+ *
+ * \context This function may only be called when the camera is in the Paused
+ * state as defined in \ref camera_operation, and shall be synchronized by the
+ * caller with other functions that affect the camera state.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENODEV The camera has been disconnected from the system
+ * \retval -EACCES The camera is not paused so can't be resumed
+ */
+int Camera::resume()
+{
+	int ret = p_->isAccessAllowed(Private::CameraPaused);
+	if (ret < 0)
+		return ret;
+
+	LOG(Camera, Debug) << "Resuming capture";
+
+	p_->setState(Private::CameraRunning);
+
+	p_->pipe_->invokeMethod(&PipelineHandler::resume, ConnectionTypeBlocking,
+				this);
+
 	return 0;
 }
 
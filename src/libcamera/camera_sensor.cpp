@@ -16,7 +16,10 @@
 
 #include <libcamera/property_ids.h>
 
+#include "libcamera/internal/byte_stream_buffer.h"
+#include "libcamera/internal/device_cache.h"
 #include "libcamera/internal/formats.h"
+#include "libcamera/internal/media_device.h"
 #include "libcamera/internal/utils.h"
 #include "libcamera/internal/v4l2_subdevice.h"
 
@@ -244,7 +247,7 @@ int CameraSensor::init()
 	properties_.set(properties::Rotation, propertyValue);
 
 	/* Enumerate, sort and cache media bus codes and sizes. */
-	formats_ = subdev_->formats(pad_);
+	formats_ = enumerateFormats();
 	if (formats_.isEmpty()) {
 		LOG(CameraSensor, Error) << "No image format found";
 		return -EINVAL;
@@ -274,6 +277,102 @@ int CameraSensor::init()
 	return 0;
 }
 
+namespace {
+
+/*
+ * Parse formats stored in the DeviceCache by CameraSensor::enumerateFormats(),
+ * returning an empty ImageFormats if the data is malformed.
+ */
+ImageFormats parseFormats(const std::vector<uint8_t> &data)
+{
+	ByteStreamBuffer buffer(data.data(), data.size());
+	ImageFormats formats;
+
+	const uint32_t *count = buffer.read<uint32_t>();
+	for (uint32_t i = 0; count && i < *count; ++i) {
+		const uint32_t *code = buffer.read<uint32_t>();
+		const uint32_t *numSizes = buffer.read<uint32_t>();
+		if (!code || !numSizes)
+			return {};
+
+		const uint32_t *values =
+			buffer.read<uint32_t>(static_cast<size_t>(*numSizes) * 6);
+		if (!values)
+			return {};
+
+		std::vector<SizeRange> sizes;
+		for (uint32_t j = 0; j < *numSizes; ++j, values += 6)
+			sizes.emplace_back(Size{ values[0], values[1] },
+					   Size{ values[2], values[3] },
+					   values[4], values[5]);
+
+		if (formats.addFormat(*code, sizes))
+			return {};
+	}
+
+	if (!count || buffer.offset() != buffer.size())
+		return {};
+
+	return formats;
+}
+
+} /* namespace */
+
+/**
+ * \brief Enumerate the media bus formats supported by the sensor
+ *
+ * Enumerating the formats of a sensor takes one ioctl per media bus code and
+ * frame size. As they don't change for a given sensor and driver, the result
+ * is stored in the DeviceCache, when enabled, and retrieved from there on
+ * subsequent calls.
+ *
+ * \return The formats supported by the sensor, empty on error
+ */
+ImageFormats CameraSensor::enumerateFormats()
+{
+	DeviceCache *cache = DeviceCache::instance();
+	std::string key;
+
+	if (cache->isEnabled()) {
+		key = entity_->device()->cacheKey() + "\nsensor formats\n" +
+		      entity_->name() + "\n" + std::to_string(pad_);
+
+		std::vector<uint8_t> data = cache->load(key);
+		if (!data.empty()) {
+			ImageFormats formats = parseFormats(data);
+			if (!formats.isEmpty()) {
+				LOG(CameraSensor, Debug)
+					<< "Using cached formats for "
+					<< entity_->name();
+				return formats;
+			}
+		}
+	}
+
+	ImageFormats formats = subdev_->formats(pad_);
+	if (!cache->isEnabled() || formats.isEmpty())
+		return formats;
+
+	std::vector<uint32_t> data;
+	data.push_back(formats.data().size());
+	for (const auto &format : formats.data()) {
+		data.push_back(format.first);
+		data.push_back(format.second.size());
+		for (const SizeRange &range : format.second) {
+			data.insert(data.end(), {
+				range.min.width, range.min.height,
+				range.max.width, range.max.height,
+				range.hStep, range.vStep
+			});
+		}
+	}
+
+	cache->store(key, { reinterpret_cast<const uint8_t *>(data.data()),
+			    data.size() * sizeof(uint32_t) });
+
+	return formats;
+}
+
 /**
  * \fn CameraSensor::model()
  * \brief Retrieve the sensor model name
@@ -438,6 +537,16 @@ ControlList CameraSensor::getControls(const std::vector<uint32_t> &ids)
 	return subdev_->getControls(ids);
 }
 
+/**
+ * \fn CameraSensor::device()
+ * \brief Retrieve the camera sensor V4L2 subdevice
+ *
+ * This is meant for helpers that operate on the V4L2 device directly, such as
+ * DelayedControls. Other users should go through the CameraSensor methods.
+ *
+ * \return The camera sensor V4L2 subdevice
+ */
+
 /**
  * \fn CameraSensor::properties()
  * \brief Retrieve the camera sensor properties
@@ -0,0 +1,679 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * capture_file.cpp - Raw capture container file
+ */
+
+#include <libcamera/capture_file.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "libcamera/internal/byte_stream_buffer.h"
+#include "libcamera/internal/capture_file_format.h"
+#include "libcamera/internal/control_serializer.h"
+#include "libcamera/internal/file.h"
+#include "libcamera/internal/log.h"
+
+/**
+ * \file capture_file.h
+ * \brief Raw capture container file reader and writer
+ */
+
+/**
+ * \file capture_file_format.h
+ * \brief Raw capture container file format
+ *
+ * The capture file format stores a sequence of frames captured from one or
+ * more streams, along with their metadata, in a single file. It is designed to
+ * be written in an append-only fashion at capture time, and to be memory-mapped
+ * and randomly accessed when read.
+ *
+ * A capture file starts with a capture_file_header. Frames follow, each of
+ * them stored as a capture_file_frame record immediately followed by the
+ * serialized frame metadata, and by the frame planes. Frame records and plane
+ * data are all aligned to CAPTURE_FILE_ALIGN bytes, allowing readers to map
+ * individual planes without copying them.
+ *
+ * When the file is closed, a copy of all the frame records is appended to the
+ * end of the file to form the index, and the header is updated with the index
+ * location. Files that haven't been closed properly (for instance when the
+ * capture process crashed) have no index, and readers can then rebuild it by
+ * following the chain of frame records through their next_offset field.
+ *
+ * All fields are stored in the host byte order.
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(CaptureFile)
+
+/**
+ * \def CAPTURE_FILE_MAGIC
+ * \brief Magic number identifying a capture file header
+ */
+
+/**
+ * \def CAPTURE_FILE_FRAME_MAGIC
+ * \brief Magic number identifying a capture file frame record
+ */
+
+/**
+ * \def CAPTURE_FILE_VERSION
+ * \brief The capture file format version
+ */
+
+/**
+ * \def CAPTURE_FILE_MAX_PLANES
+ * \brief The maximum number of planes per frame
+ */
+
+/**
+ * \def CAPTURE_FILE_ALIGN
+ * \brief Alignment of the frame records and plane data within the file
+ */
+
+/**
+ * \struct capture_file_header
+ * \brief Capture file header
+ *
+ * \var capture_file_header::magic
+ * \brief The CAPTURE_FILE_MAGIC magic number
+ *
+ * \var capture_file_header::version
+ * \brief The file format version, set to CAPTURE_FILE_VERSION
+ *
+ * \var capture_file_header::num_frames
+ * \brief The number of frames in the index
+ *
+ * \var capture_file_header::reserved
+ * \brief Reserved for future use
+ *
+ * \var capture_file_header::index_offset
+ * \brief The offset of the index from the beginning of the file, or 0 if the
+ * file has no index
+ */
+
+/**
+ * \struct capture_file_plane
+ * \brief Location of a frame plane within the capture file
+ *
+ * \var capture_file_plane::offset
+ * \brief The offset of the plane data from the beginning of the file
+ *
+ * \var capture_file_plane::size
+ * \brief The size of the plane data in bytes
+ *
+ * \var capture_file_plane::reserved
+ * \brief Reserved for future use
+ */
+
+/**
+ * \struct capture_file_frame
+ * \brief Capture file frame record and index entry
+ *
+ * \var capture_file_frame::magic
+ * \brief The CAPTURE_FILE_FRAME_MAGIC magic number
+ *
+ * \var capture_file_frame::stream
+ * \brief The index of the stream the frame has been captured from
+ *
+ * \var capture_file_frame::sequence
+ * \brief The frame sequence number
+ *
+ * \var capture_file_frame::num_planes
+ * \brief The number of valid entries in the planes array
+ *
+ * \var capture_file_frame::timestamp
+ * \brief The frame timestamp, as reported in FrameMetadata::timestamp
+ *
+ * \var capture_file_frame::pixel_format
+ * \brief The frame pixel format FourCC
+ *
+ * \var capture_file_frame::width
+ * \brief The frame width in pixels
+ *
+ * \var capture_file_frame::height
+ * \brief The frame height in pixels
+ *
+ * \var capture_file_frame::stride
+ * \brief The frame line stride in bytes
+ *
+ * \var capture_file_frame::modifier
+ * \brief The frame pixel format modifier
+ *
+ * \var capture_file_frame::metadata_offset
+ * \brief The offset of the serialized metadata from the beginning of the file
+ *
+ * \var capture_file_frame::metadata_size
+ * \brief The size of the serialized metadata in bytes
+ *
+ * \var capture_file_frame::reserved
+ * \brief Reserved for future use
+ *
+ * \var capture_file_frame::planes
+ * \brief The location of the frame planes
+ *
+ * \var capture_file_frame::next_offset
+ * \brief The offset of the next frame record from the beginning of the file
+ */
+
+namespace {
+
+const uint8_t zeroPadding[CAPTURE_FILE_ALIGN] = {};
+
+off_t alignOffset(off_t offset)
+{
+	return (offset + CAPTURE_FILE_ALIGN - 1) & ~(CAPTURE_FILE_ALIGN - 1);
+}
+
+} /* namespace */
+
+class CaptureFileWriter::Private
+{
+public:
+	Private()
+		: fd_(-1), offset_(0)
+	{
+	}
+
+	int fd_;
+	off_t offset_;
+
+	ControlSerializer serializer_;
+	std::vector<uint8_t> record_;
+	std::vector<struct capture_file_frame> index_;
+};
+
+/**
+ * \class CaptureFileWriter
+ * \brief Write frames to a capture file
+ *
+ * The CaptureFileWriter creates a capture file and appends frames to it. Each
+ * frame is written with a single system call, and the index is written when
+ * the file is closed.
+ */
+
+/**
+ * \brief Construct a CaptureFileWriter
+ */
+CaptureFileWriter::CaptureFileWriter()
+	: p_(new Private())
+{
+}
+
+/**
+ * \brief Destroy the CaptureFileWriter, closing the file if it is open
+ */
+CaptureFileWriter::~CaptureFileWriter()
+{
+	close();
+}
+
+/**
+ * \brief Create a capture file
+ * \param[in] fileName The name of the file
+ *
+ * The file is created if it doesn't exist, and truncated otherwise.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int CaptureFileWriter::open(const std::string &fileName)
+{
+	if (isOpen()) {
+		LOG(CaptureFile, Error) << "Capture file already open";
+		return -EBUSY;
+	}
+
+	p_->fd_ = ::open(fileName.c_str(),
+			 O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC,
+			 S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (p_->fd_ < 0) {
+		int ret = -errno;
+		LOG(CaptureFile, Error)
+			<< "Failed to create " << fileName << ": "
+			<< strerror(-ret);
+		return ret;
+	}
+
+	struct capture_file_header header = {};
+	header.magic = CAPTURE_FILE_MAGIC;
+	header.version = CAPTURE_FILE_VERSION;
+
+	if (::write(p_->fd_, &header, sizeof(header)) != sizeof(header)) {
+		int ret = -errno;
+		LOG(CaptureFile, Error)
+			<< "Failed to write header: " << strerror(-ret);
+		::close(p_->fd_);
+		p_->fd_ = -1;
+		return ret;
+	}
+
+	p_->offset_ = alignOffset(sizeof(header));
+	p_->index_.clear();
+	p_->serializer_.reset();
+
+	return 0;
+}
+
+/**
+ * \brief Write the index and close the capture file
+ *
+ * If the file isn't open this function performs no operation.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int CaptureFileWriter::close()
+{
+	if (!isOpen())
+		return 0;
+
+	int ret = 0;
+	size_t indexSize = p_->index_.size() * sizeof(p_->index_[0]);
+
+	if (pwrite(p_->fd_, p_->index_.data(), indexSize, p_->offset_) !=
+	    static_cast<ssize_t>(indexSize)) {
+		ret = -errno;
+		LOG(CaptureFile, Error)
+			<< "Failed to write index: " << strerror(-ret);
+	} else {
+		struct capture_file_header header = {};
+		header.magic = CAPTURE_FILE_MAGIC;
+		header.version = CAPTURE_FILE_VERSION;
+		header.num_frames = p_->index_.size();
+		header.index_offset = p_->offset_;
+
+		if (pwrite(p_->fd_, &header, sizeof(header), 0) != sizeof(header)) {
+			ret = -errno;
+			LOG(CaptureFile, Error)
+				<< "Failed to write header: " << strerror(-ret);
+		}
+	}
+
+	::close(p_->fd_);
+	p_->fd_ = -1;
+	p_->index_.clear();
+
+	return ret;
+}
+
+/**
+ * \brief Check if the capture file is open
+ * \return True if the file is open, false otherwise
+ */
+bool CaptureFileWriter::isOpen() const
+{
+	return p_->fd_ != -1;
+}
+
+/**
+ * \brief Append a frame to the capture file
+ * \param[in] stream The index of the stream the frame belongs to
+ * \param[in] config The configuration of the stream
+ * \param[in] metadata The frame metadata
+ * \param[in] planes The frame planes data
+ * \param[in] controls The request metadata associated with the frame
+ *
+ * The \a planes data is written to the file as-is, callers should trim the
+ * planes to their FrameMetadata::Plane::bytesused value if desired. The
+ * request metadata is stored in the ControlSerializer format.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int CaptureFileWriter::write(unsigned int stream,
+			     const StreamConfiguration &config,
+			     const FrameMetadata &metadata,
+			     const std::vector<Span<const uint8_t>> &planes,
+			     const ControlList &controls)
+{
+	if (!isOpen())
+		return -EBADF;
+
+	if (planes.size() > CAPTURE_FILE_MAX_PLANES) {
+		LOG(CaptureFile, Error)
+			<< "Too many planes (" << planes.size() << ")";
+		return -EINVAL;
+	}
+
+	/* Serialize the frame record and the metadata. */
+	size_t metadataSize = ControlSerializer::binarySize(controls);
+	p_->record_.resize(sizeof(struct capture_file_frame) + metadataSize);
+
+	uint8_t *record = p_->record_.data();
+	ByteStreamBuffer buffer(record + sizeof(struct capture_file_frame),
+				metadataSize);
+	int ret = p_->serializer_.serialize(controls, buffer);
+	if (ret < 0) {
+		LOG(CaptureFile, Error) << "Failed to serialize metadata";
+		return ret;
+	}
+
+	struct capture_file_frame *frame =
+		reinterpret_cast<struct capture_file_frame *>(record);
+	memset(frame, 0, sizeof(*frame));
+
+	frame->magic = CAPTURE_FILE_FRAME_MAGIC;
+	frame->stream = stream;
+	frame->sequence = metadata.sequence;
+	frame->num_planes = planes.size();
+	frame->timestamp = metadata.timestamp;
+	frame->pixel_format = config.pixelFormat.fourcc();
+	frame->width = config.size.width;
+	frame->height = config.size.height;
+	frame->stride = config.stride;
+	frame->modifier = config.pixelFormat.modifier();
+	frame->metadata_offset = p_->offset_ + sizeof(*frame);
+	frame->metadata_size = metadataSize;
+
+	/*
+	 * Lay out the record and the planes, and gather them in a single I/O
+	 * vector, padding each of them to the file alignment.
+	 */
+	struct iovec iov[CAPTURE_FILE_MAX_PLANES * 2 + 2];
+	unsigned int iovcnt = 0;
+	off_t offset = p_->offset_;
+
+	auto append = [&](const void *data, size_t size) {
+		iov[iovcnt].iov_base = const_cast<void *>(data);
+		iov[iovcnt].iov_len = size;
+		iovcnt++;
+
+		off_t end = offset + size;
+		offset = alignOffset(end);
+		if (offset != end) {
+			iov[iovcnt].iov_base = const_cast<uint8_t *>(zeroPadding);
+			iov[iovcnt].iov_len = offset - end;
+			iovcnt++;
+		}
+	};
+
+	append(p_->record_.data(), p_->record_.size());
+
+	for (unsigned int i = 0; i < planes.size(); ++i) {
+		frame->planes[i].offset = offset;
+		frame->planes[i].size = planes[i].size();
+		append(planes[i].data(), planes[i].size());
+	}
+
+	frame->next_offset = offset;
+
+	ssize_t size = offset - p_->offset_;
+	ssize_t written = pwritev(p_->fd_, iov, iovcnt, p_->offset_);
+	if (written != size) {
+		ret = written < 0 ? -errno : -ENOSPC;
+		LOG(CaptureFile, Error)
+			<< "Failed to write frame: " << strerror(-ret);
+		return ret;
+	}
+
+	p_->index_.push_back(*frame);
+	p_->offset_ = offset;
+
+	return 0;
+}
+
+/**
+ * \struct CaptureFileFrame
+ * \brief A frame stored in a capture file
+ *
+ * The plane and metadata spans reference the memory-mapped capture file, and
+ * stay valid until the CaptureFileReader is closed.
+ *
+ * \var CaptureFileFrame::stream
+ * \brief The index of the stream the frame has been captured from
+ *
+ * \var CaptureFileFrame::sequence
+ * \brief The frame sequence number
+ *
+ * \var CaptureFileFrame::timestamp
+ * \brief The frame timestamp
+ *
+ * \var CaptureFileFrame::pixelFormat
+ * \brief The frame pixel format
+ *
+ * \var CaptureFileFrame::size
+ * \brief The frame size
+ *
+ * \var CaptureFileFrame::stride
+ * \brief The frame line stride in bytes
+ *
+ * \var CaptureFileFrame::planes
+ * \brief The frame planes data
+ *
+ * \var CaptureFileFrame::metadata
+ * \brief The serialized request metadata, see CaptureFileReader::metadata()
+ */
+
+class CaptureFileReader::Private
+{
+public:
+	int readIndex(const struct capture_file_header *header);
+	int scanFrames();
+	int addFrame(const struct capture_file_frame *record);
+
+	File file_;
+	Span<const uint8_t> data_;
+
+	ControlSerializer serializer_;
+	std::vector<CaptureFileFrame> frames_;
+};
+
+/**
+ * \class CaptureFileReader
+ * \brief Read frames from a capture file
+ *
+ * The CaptureFileReader memory-maps a capture file and gives random access to
+ * all the frames it contains through frames(). The index is read from the file
+ * if present, or rebuilt by walking through the frame records otherwise.
+ */
+
+/**
+ * \brief Construct a CaptureFileReader
+ */
+CaptureFileReader::CaptureFileReader()
+	: p_(new Private())
+{
+}
+
+/**
+ * \brief Destroy the CaptureFileReader, closing the file if it is open
+ */
+CaptureFileReader::~CaptureFileReader()
+{
+	close();
+}
+
+/**
+ * \brief Open and map a capture file
+ * \param[in] fileName The name of the file
+ * \return 0 on success or a negative error code otherwise
+ */
+int CaptureFileReader::open(const std::string &fileName)
+{
+	if (isOpen()) {
+		LOG(CaptureFile, Error) << "Capture file already open";
+		return -EBUSY;
+	}
+
+	File &file = p_->file_;
+	file.setFileName(fileName);
+	if (!file.open(File::ReadOnly)) {
+		LOG(CaptureFile, Error)
+			<< "Failed to open " << fileName << ": "
+			<< strerror(-file.error());
+		return file.error();
+	}
+
+	Span<uint8_t> data = file.map();
+	file.close();
+
+	if (data.size() < sizeof(struct capture_file_header)) {
+		LOG(CaptureFile, Error) << "Invalid capture file " << fileName;
+		close();
+		return -EINVAL;
+	}
+
+	p_->data_ = data;
+
+	const struct capture_file_header *header =
+		reinterpret_cast<const struct capture_file_header *>(data.data());
+	if (header->magic != CAPTURE_FILE_MAGIC ||
+	    header->version != CAPTURE_FILE_VERSION) {
+		LOG(CaptureFile, Error)
+			<< "Unsupported capture file " << fileName;
+		close();
+		return -EINVAL;
+	}
+
+	int ret;
+	if (header->index_offset) {
+		ret = p_->readIndex(header);
+	} else {
+		LOG(CaptureFile, Warning)
+			<< "Capture file " << fileName
+			<< " has no index, scanning frames";
+		ret = p_->scanFrames();
+	}
+
+	if (ret < 0) {
+		close();
+		return ret;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Close the capture file
+ *
+ * All CaptureFileFrame instances retrieved from the reader are invalidated.
+ */
+void CaptureFileReader::close()
+{
+	p_->frames_.clear();
+	p_->data_ = {};
+	p_->file_.setFileName({});
+	p_->serializer_.reset();
+}
+
+/**
+ * \brief Check if the capture file is open
+ * \return True if the file is open, false otherwise
+ */
+bool CaptureFileReader::isOpen() const
+{
+	return !p_->data_.empty();
+}
+
+/**
+ * \brief Retrieve all the frames stored in the capture file
+ * \return The frames, in the order they have been written
+ */
+const std::vector<CaptureFileFrame> &CaptureFileReader::frames() const
+{
+	return p_->frames_;
+}
+
+/**
+ * \brief Deserialize the request metadata of a frame
+ * \param[in] frame The frame
+ * \return The request metadata
+ */
+ControlList CaptureFileReader::metadata(const CaptureFileFrame &frame)
+{
+	ByteStreamBuffer buffer(frame.metadata.data(), frame.metadata.size());
+	return p_->serializer_.deserialize<ControlList>(buffer);
+}
+
+int CaptureFileReader::Private::readIndex(const struct capture_file_header *header)
+{
+	size_t indexSize = header->num_frames * sizeof(struct capture_file_frame);
+	if (header->index_offset > data_.size() ||
+	    indexSize > data_.size() - header->index_offset) {
+		LOG(CaptureFile, Error) << "Invalid capture file index";
+		return -EINVAL;
+	}
+
+	const struct capture_file_frame *index =
+		reinterpret_cast<const struct capture_file_frame *>(
+			data_.data() + header->index_offset);
+
+	frames_.reserve(header->num_frames);
+
+	for (unsigned int i = 0; i < header->num_frames; ++i) {
+		int ret = addFrame(&index[i]);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+int CaptureFileReader::Private::scanFrames()
+{
+	uint64_t offset = alignOffset(sizeof(struct capture_file_header));
+
+	while (offset + sizeof(struct capture_file_frame) <= data_.size()) {
+		const struct capture_file_frame *record =
+			reinterpret_cast<const struct capture_file_frame *>(
+				data_.data() + offset);
+
+		/* Stop at the first truncated or invalid record. */
+		if (record->magic != CAPTURE_FILE_FRAME_MAGIC ||
+		    record->next_offset <= offset ||
+		    record->next_offset > data_.size())
+			break;
+
+		if (addFrame(record) < 0)
+			break;
+
+		offset = record->next_offset;
+	}
+
+	return 0;
+}
+
+int CaptureFileReader::Private::addFrame(const struct capture_file_frame *record)
+{
+	if (record->magic != CAPTURE_FILE_FRAME_MAGIC ||
+	    record->num_planes > CAPTURE_FILE_MAX_PLANES ||
+	    record->metadata_offset > data_.size() ||
+	    record->metadata_size > data_.size() - record->metadata_offset) {
+		LOG(CaptureFile, Error) << "Invalid frame record";
+		return -EINVAL;
+	}
+
+	CaptureFileFrame frame;
+	frame.stream = record->stream;
+	frame.sequence = record->sequence;
+	frame.timestamp = record->timestamp;
+	frame.pixelFormat = PixelFormat(record->pixel_format, record->modifier);
+	frame.size = Size(record->width, record->height);
+	frame.stride = record->stride;
+	frame.metadata = { data_.data() + record->metadata_offset,
+			   record->metadata_size };
+
+	for (unsigned int i = 0; i < record->num_planes; ++i) {
+		const struct capture_file_plane &plane = record->planes[i];
+
+		if (plane.offset > data_.size() ||
+		    plane.size > data_.size() - plane.offset) {
+			LOG(CaptureFile, Error) << "Invalid frame plane";
+			return -EINVAL;
+		}
+
+		frame.planes.emplace_back(data_.data() + plane.offset,
+					  plane.size);
+	}
+
+	frames_.push_back(std::move(frame));
+
+	return 0;
+}
+
+} /* namespace libcamera */
@@ -0,0 +1,313 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Raspberry Pi (Trading) Ltd.
+ *
+ * delayed_controls.cpp - Helper to deal with controls that take effect with a delay
+ */
+
+#include "libcamera/internal/delayed_controls.h"
+
+#include <algorithm>
+
+#include <libcamera/controls.h>
+
+#include "libcamera/internal/log.h"
+#include "libcamera/internal/utils.h"
+#include "libcamera/internal/v4l2_device.h"
+
+/**
+ * \file delayed_controls.h
+ * \brief Helper to deal with controls that take effect with a delay
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(DelayedControls)
+
+/**
+ * \class DelayedControls
+ * \brief Helper to deal with controls that take effect with a delay
+ *
+ * Some sensor controls take effect with a delay as the sensor needs time to
+ * adjust, for example exposure and analog gain. This is a helper class to deal
+ * with such controls and the intended users are pipeline handlers.
+ *
+ * The idea is to extend the concept of the buffer depth of a pipeline the
+ * application needs to maintain to also cover controls. Just as with buffer
+ * depth if the application keeps the number of requests queued above the
+ * control depth the controls are guaranteed to take effect for the correct
+ * request. The control depth is determined by the control with the greatest
+ * delay.
+ *
+ * Controls are queued with push(), one ControlList per frame. At each frame
+ * start, signalled to applyControls(), every control is written to the device
+ * early enough for all the controls of a given push() to take effect on the
+ * same frame, regardless of their individual delays. The values in effect for
+ * any frame can later be retrieved with get().
+ *
+ * The history of control values is kept in a fixed-size ring per control, so
+ * no memory is allocated as frames go by. The class is meant to be used from
+ * the pipeline handler thread only and performs no locking.
+ *
+ * \context This class is \threadbound.
+ */
+
+/**
+ * \brief Construct a DelayedControls instance
+ * \param[in] device The V4L2 device the controls have to be applied to
+ * \param[in] delays Map of the numerical V4L2 control ids to their associated
+ * delays (in frames)
+ *
+ * Only controls specified in \a delays are handled. If it's desired to mix
+ * delayed controls and controls that take effect immediately the immediate
+ * controls must be listed in the \a delays map with a delay value of 0.
+ * Controls that the \a device doesn't expose are ignored. Delays must be
+ * smaller than the 16 frames of history kept for each control, and larger
+ * delays are clamped.
+ */
+DelayedControls::DelayedControls(V4L2Device *device,
+				 const std::unordered_map<uint32_t, unsigned int> &delays)
+	: device_(device), maxDelay_(0)
+{
+	const ControlInfoMap &controls = device_->controls();
+
+	/*
+	 * Create a map of control ids to delays for controls exposed by the
+	 * device.
+	 */
+	for (auto const &delay : delays) {
+		auto it = controls.find(delay.first);
+		if (it == controls.end()) {
+			LOG(DelayedControls, Warning)
+				<< "Delay request for control id "
+				<< utils::hex(delay.first)
+				<< " but control is not exposed by device "
+				<< device_->deviceNode();
+			continue;
+		}
+
+		const ControlId *id = it->first;
+		unsigned int value = delay.second;
+
+		if (value >= ringSize) {
+			LOG(DelayedControls, Error)
+				<< "Delay of " << value << " for " << id->name()
+				<< " is too large, clamping to " << ringSize - 1;
+			value = ringSize - 1;
+		}
+
+		controls_.push_back({ id, value, {} });
+
+		LOG(DelayedControls, Debug)
+			<< "Set a delay of " << value << " for " << id->name();
+
+		maxDelay_ = std::max(maxDelay_, value);
+	}
+
+	reset();
+}
+
+/**
+ * \brief Reset state machine
+ *
+ * Resets the state machine to a starting position based on control values
+ * retrieved from the device. The values are taken to be in effect for all the
+ * frames up to the control depth. This shall be called before the device
+ * starts streaming, after any controls that must be in effect from the first
+ * frame have been written to the device directly.
+ */
+void DelayedControls::reset()
+{
+	running_ = false;
+	firstSequence_ = 0;
+	queueCount_ = 1;
+	writeCount_ = 1;
+
+	/* Retrieve the control values as reported by the device. */
+	std::vector<uint32_t> ids;
+	for (const DelayedControl &ctrl : controls_)
+		ids.push_back(ctrl.id->id());
+
+	ControlList values = device_->getControls(ids);
+
+	/* Seed the control queue with them. */
+	for (DelayedControl &ctrl : controls_) {
+		ctrl.values = {};
+		if (!values.contains(ctrl.id->id()))
+			continue;
+
+		/* They're already on the device, don't write them again. */
+		Info &info = ctrl.values[0];
+		info = values.get(ctrl.id->id());
+		info.updated = false;
+	}
+}
+
+/**
+ * \brief Push a set of controls on the queue
+ * \param[in] controls List of controls to add to the device queue
+ *
+ * Push a set of controls to the control queue. This increases the control
+ * queue depth by one. Controls not in the list keep the value they had in the
+ * previous frame.
+ *
+ * \return True if \a controls are accepted, or false if any of them isn't
+ * handled by this instance or the queue is full, in which case none of them
+ * are queued
+ */
+bool DelayedControls::push(const ControlList &controls)
+{
+	for (const auto &control : controls) {
+		if (!find(control.first)) {
+			LOG(DelayedControls, Warning)
+				<< "Control " << utils::hex(control.first)
+				<< " has no delay";
+			return false;
+		}
+	}
+
+	/*
+	 * Don't overwrite values that haven't been written to the device yet,
+	 * or that get() may still need to report.
+	 */
+	if (queueCount_ - writeCount_ + maxDelay_ >= ringSize) {
+		LOG(DelayedControls, Error) << "Control queue is full";
+		return false;
+	}
+
+	/* Copy state from previous frame, and update with the new controls. */
+	for (DelayedControl &ctrl : controls_) {
+		Info &info = ctrl.values[queueCount_];
+		info = ctrl.values[queueCount_ - 1];
+		info.updated = false;
+	}
+
+	for (const auto &control : controls) {
+		DelayedControl *ctrl = find(control.first);
+		ctrl->values[queueCount_] = Info(control.second);
+
+		LOG(DelayedControls, Debug)
+			<< "Queuing " << ctrl->id->name()
+			<< " to " << control.second.toString()
+			<< " at index " << queueCount_;
+	}
+
+	queueCount_++;
+
+	return true;
+}
+
+/**
+ * \brief Read back controls in effect at a sequence number
+ * \param[in] sequence The sequence number to get controls for
+ *
+ * Read back what controls were in effect at a specific sequence number. The
+ * history is a ring buffer of 16 entries where new and old values coexist.
+ * It's the caller's responsibility to not read too old sequence numbers that
+ * have been pushed out of the history.
+ *
+ * Historic values are evicted by pushing new values onto the queue using
+ * push(). The max history from the current sequence number that yields valid
+ * values is thus 16 minus the number of controls pushed.
+ *
+ * \return The controls at \a sequence number
+ */
+ControlList DelayedControls::get(uint32_t sequence)
+{
+	unsigned int index = 0;
+	if (running_) {
+		uint32_t adjustedSeq = sequence - firstSequence_ + 1;
+		index = std::max<int>(0, adjustedSeq - maxDelay_);
+	}
+
+	ControlList out(device_->controls());
+	for (const DelayedControl &ctrl : controls_) {
+		const Info &info = ctrl.values[index];
+		out.set(ctrl.id->id(), info);
+
+		LOG(DelayedControls, Debug)
+			<< "Reading " << ctrl.id->name()
+			<< " to " << info.toString()
+			<< " at index " << index;
+	}
+
+	return out;
+}
+
+/**
+ * \brief Inform DelayedControls of the start of a new frame
+ * \param[in] sequence Sequence number of the frame that started
+ *
+ * Inform the state machine that a new frame has started and of its sequence
+ * number. Any user of these helpers is responsible to inform the helper about
+ * the start of any frame. This can be connected with ease to the start of an
+ * exposure (SOE) V4L2 event, through V4L2Device::frameStart.
+ *
+ * If no controls have been pushed for the frame, the values of the previous
+ * frame are carried over.
+ */
+void DelayedControls::applyControls(uint32_t sequence)
+{
+	LOG(DelayedControls, Debug) << "frame " << sequence << " started";
+
+	if (!running_) {
+		firstSequence_ = sequence;
+		running_ = true;
+	}
+
+	while (writeCount_ >= queueCount_) {
+		LOG(DelayedControls, Debug)
+			<< "Queue is empty, auto queue no-op.";
+		if (!push(ControlList(device_->controls()))) {
+			LOG(DelayedControls, Error)
+				<< "Failed to queue controls for frame "
+				<< sequence;
+			return;
+		}
+	}
+
+	/*
+	 * Create control list peeking ahead in the value queue to ensure
+	 * values are set in time to satisfy the sensor delay.
+	 */
+	ControlList out(device_->controls());
+	for (DelayedControl &ctrl : controls_) {
+		unsigned int delayDiff = maxDelay_ - ctrl.delay;
+		if (writeCount_ < delayDiff)
+			continue;
+
+		Info &info = ctrl.values[writeCount_ - delayDiff];
+		if (!info.updated)
+			continue;
+
+		out.set(ctrl.id->id(), info);
+		info.updated = false;
+
+		LOG(DelayedControls, Debug)
+			<< "Setting " << ctrl.id->name()
+			<< " to " << info.toString()
+			<< " at index " << writeCount_ - delayDiff;
+	}
+
+	writeCount_++;
+
+	if (out.empty())
+		return;
+
+	int ret = device_->setControls(&out);
+	if (ret)
+		LOG(DelayedControls, Error)
+			<< "Failed to set controls: " << ret;
+}
+
+DelayedControls::DelayedControl *DelayedControls::find(unsigned int id)
+{
+	for (DelayedControl &ctrl : controls_) {
+		if (ctrl.id->id() == id)
+			return &ctrl;
+	}
+
+	return nullptr;
+}
+
+} /* namespace libcamera */
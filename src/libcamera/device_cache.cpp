@@ -0,0 +1,256 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * device_cache.cpp - Persistent cache of device information
+ */
+
+#include "libcamera/internal/device_cache.h"
+
+#include <errno.h>
+#include <iomanip>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include "libcamera/internal/file.h"
+#include "libcamera/internal/log.h"
+#include "libcamera/internal/utils.h"
+
+/**
+ * \file device_cache.h
+ * \brief Persistent cache of device information
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(DeviceCache)
+
+namespace {
+
+struct CacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t keySize;
+	uint64_t dataSize;
+};
+
+constexpr char cacheMagic[8] = { 'l', 'i', 'b', 'c', 'a', 'm', 'd', 'c' };
+constexpr uint32_t cacheVersion = 1;
+
+} /* namespace */
+
+/**
+ * \class DeviceCache
+ * \brief Store information retrieved from devices across libcamera instances
+ *
+ * Querying devices for static information, such as the formats supported by
+ * a camera sensor, takes a large number of ioctls, which are repeated every
+ * time a process starts using libcamera. The DeviceCache stores the result of
+ * such queries on disk, as opaque blobs of data identified by a key, to let
+ * the next libcamera instance skip them.
+ *
+ * The cache is opt-in. The global instance, returned by instance(), stores its
+ * files in the directory named by the LIBCAMERA_DEVICE_CACHE environment
+ * variable, and is disabled when the variable isn't set.
+ *
+ * Keys shall uniquely identify the device and the information being cached,
+ * and shall include anything whose change could invalidate the data. Keys of
+ * media devices are available through MediaDevice::cacheKey(), and include the
+ * systemKey(), so that updating the kernel invalidates the cache. Each key is
+ * stored with its data and checked when loading, entries can thus not be
+ * mixed up.
+ *
+ * The cache is safe to share between processes, as entries are replaced
+ * atomically.
+ */
+
+/**
+ * \brief Construct a DeviceCache storing its files in \a directory
+ * \param[in] directory The cache directory, or an empty string to disable the
+ * cache
+ *
+ * The \a directory is created if it doesn't exist.
+ */
+DeviceCache::DeviceCache(const std::string &directory)
+	: directory_(directory)
+{
+	if (!directory_.empty())
+		mkdir(directory_.c_str(), 0755);
+}
+
+/**
+ * \brief Retrieve the global DeviceCache instance
+ *
+ * The global instance stores its files in the directory specified by the
+ * LIBCAMERA_DEVICE_CACHE environment variable, and is disabled if the
+ * variable isn't set.
+ *
+ * \return The global DeviceCache instance
+ */
+DeviceCache *DeviceCache::instance()
+{
+	static DeviceCache cache([]() {
+		const char *directory = utils::secure_getenv("LIBCAMERA_DEVICE_CACHE");
+		return std::string(directory ? directory : "");
+	}());
+
+	return &cache;
+}
+
+/**
+ * \brief Retrieve a string identifying the running kernel
+ *
+ * The string includes the kernel release and build version, and should be
+ * part of all cache keys for information provided by kernel drivers.
+ *
+ * \return A string identifying the running kernel
+ */
+const std::string &DeviceCache::systemKey()
+{
+	static const std::string key = []() {
+		struct utsname name;
+		if (uname(&name))
+			return std::string();
+
+		return std::string(name.release) + " " + name.version;
+	}();
+
+	return key;
+}
+
+/**
+ * \fn DeviceCache::isEnabled()
+ * \brief Check if the cache is enabled
+ * \return True if the cache is enabled, false otherwise
+ */
+
+/**
+ * \brief Load cached data
+ * \param[in] key The key identifying the data
+ * \return The data stored for \a key, or an empty vector if the cache is
+ * disabled or holds no valid data for \a key
+ */
+std::vector<uint8_t> DeviceCache::load(const std::string &key) const
+{
+	if (!isEnabled())
+		return {};
+
+	File file(fileName(key));
+	if (!file.open(File::ReadOnly))
+		return {};
+
+	Span<uint8_t> data = file.map();
+	if (data.size() < sizeof(CacheHeader))
+		return {};
+
+	CacheHeader header;
+	memcpy(&header, data.data(), sizeof(header));
+
+	if (memcmp(header.magic, cacheMagic, sizeof(header.magic)) ||
+	    header.version != cacheVersion || header.keySize != key.size() ||
+	    header.dataSize != data.size() - sizeof(header) - header.keySize ||
+	    memcmp(data.data() + sizeof(header), key.data(), key.size())) {
+		LOG(DeviceCache, Debug)
+			<< "Ignoring stale cache file " << file.fileName();
+		return {};
+	}
+
+	const uint8_t *begin = data.data() + sizeof(header) + header.keySize;
+	return { begin, begin + header.dataSize };
+}
+
+/**
+ * \brief Store data in the cache
+ * \param[in] key The key identifying the data
+ * \param[in] data The data
+ *
+ * Any data previously stored for \a key is replaced.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENODEV The cache is disabled
+ */
+int DeviceCache::store(const std::string &key, Span<const uint8_t> data) const
+{
+	if (!isEnabled())
+		return -ENODEV;
+
+	CacheHeader header = {};
+	memcpy(header.magic, cacheMagic, sizeof(header.magic));
+	header.version = cacheVersion;
+	header.keySize = key.size();
+	header.dataSize = data.size();
+
+	std::vector<uint8_t> contents(sizeof(header) + key.size() + data.size());
+	memcpy(contents.data(), &header, sizeof(header));
+	memcpy(contents.data() + sizeof(header), key.data(), key.size());
+	memcpy(contents.data() + sizeof(header) + key.size(), data.data(),
+	       data.size());
+
+	/*
+	 * Write to a temporary file and rename it, to avoid other processes
+	 * seeing partially written data.
+	 */
+	std::string name = fileName(key);
+	std::string tmpName = name + ".XXXXXX";
+
+	int fd = mkstemp(&tmpName[0]);
+	if (fd < 0) {
+		int ret = -errno;
+		LOG(DeviceCache, Debug)
+			<< "Failed to create " << tmpName << ": "
+			<< strerror(-ret);
+		return ret;
+	}
+
+	int ret = 0;
+	size_t written = 0;
+	while (written < contents.size()) {
+		ssize_t size = write(fd, contents.data() + written,
+				     contents.size() - written);
+		if (size < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = -errno;
+			break;
+		}
+
+		written += size;
+	}
+
+	if (close(fd) && !ret)
+		ret = -errno;
+
+	if (!ret && (chmod(tmpName.c_str(), 0644) ||
+		     rename(tmpName.c_str(), name.c_str())))
+		ret = -errno;
+
+	if (ret) {
+		LOG(DeviceCache, Debug)
+			<< "Failed to write " << name << ": " << strerror(-ret);
+		unlink(tmpName.c_str());
+	}
+
+	return ret;
+}
+
+std::string DeviceCache::fileName(const std::string &key) const
+{
+	/* 64-bit FNV-1a hash of the key. */
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (unsigned char c : key) {
+		hash ^= c;
+		hash *= 0x100000001b3ULL;
+	}
+
+	std::stringstream name;
+	name << directory_ << "/" << std::hex << std::setw(16)
+	     << std::setfill('0') << hash << ".bin";
+
+	return name.str();
+}
+
+} /* namespace libcamera */
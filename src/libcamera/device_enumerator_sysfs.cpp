@@ -46,10 +46,14 @@ int DeviceEnumeratorSysfs::enumerate()
 			break;
 	}
 
+	/*
+	 * The directories don't exist when no media device driver is loaded.
+	 * This isn't an error, as virtual cameras may still be available.
+	 */
 	if (!dir) {
-		LOG(DeviceEnumerator, Error)
+		LOG(DeviceEnumerator, Debug)
 			<< "No valid sysfs media device directory";
-		return -ENODEV;
+		return 0;
 	}
 
 	while ((ent = readdir(dir)) != nullptr) {
@@ -255,11 +255,32 @@ unsigned int IPAManager::addDir(const char *libDir, unsigned int maxDepth)
 std::unique_ptr<IPAProxy> IPAManager::createIPA(PipelineHandler *pipe,
 						uint32_t maxVersion,
 						uint32_t minVersion)
+{
+	return createIPA(pipe->name(), maxVersion, minVersion);
+}
+
+/**
+ * \brief Create an IPA proxy that matches a pipeline handler name
+ * \param[in] pipelineName The name of the pipeline handler to match
+ * \param[in] minVersion Minimum acceptable version of IPA module
+ * \param[in] maxVersion Maximum acceptable version of IPA module
+ *
+ * This function is similar to createIPA(PipelineHandler *pipe, uint32_t,
+ * uint32_t), but matches IPA modules by pipeline handler name. It allows a
+ * pipeline handler to load the IPA module of another pipeline handler, for
+ * instance to replay captured data offline.
+ *
+ * \return A newly created IPA proxy, or nullptr if no matching IPA module is
+ * found or if the IPA proxy fails to initialize
+ */
+std::unique_ptr<IPAProxy> IPAManager::createIPA(const char *pipelineName,
+						uint32_t maxVersion,
+						uint32_t minVersion)
 {
 	IPAModule *m = nullptr;
 
 	for (IPAModule *module : modules_) {
-		if (module->match(pipe, minVersion, maxVersion)) {
+		if (module->match(pipelineName, minVersion, maxVersion)) {
 			m = module;
 			break;
 		}
@@ -465,10 +465,27 @@ struct ipa_context *IPAModule::createContext()
  */
 bool IPAModule::match(PipelineHandler *pipe,
 		      uint32_t minVersion, uint32_t maxVersion) const
+{
+	return match(pipe->name(), minVersion, maxVersion);
+}
+
+/**
+ * \brief Verify if the IPA module maches a given pipeline handler name
+ * \param[in] pipelineName Name of the pipeline handler to match with
+ * \param[in] minVersion Minimum acceptable version of IPA module
+ * \param[in] maxVersion Maximum acceptable version of IPA module
+ *
+ * This method checks if this IPA module matches the pipeline handler named
+ * \a pipelineName, and the input version range.
+ *
+ * \return True if the pipeline handler matches the IPA module, or false otherwise
+ */
+bool IPAModule::match(const char *pipelineName,
+		      uint32_t minVersion, uint32_t maxVersion) const
 {
 	return info_.pipelineVersion >= minVersion &&
 	       info_.pipelineVersion <= maxVersion &&
-	       !strcmp(info_.pipelineName, pipe->name());
+	       !strcmp(info_.pipelineName, pipelineName);
 }
 
 std::string IPAModule::logPrefix() const
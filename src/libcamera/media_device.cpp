@@ -18,6 +18,7 @@
 
 #include <linux/media.h>
 
+#include "libcamera/internal/device_cache.h"
 #include "libcamera/internal/log.h"
 
 /**
@@ -232,6 +233,12 @@ int MediaDevice::populate()
 	model_ = info.model;
 	version_ = info.media_version;
 
+	cacheKey_ = std::string(info.driver) + "\n" + info.model + "\n" +
+		    info.serial + "\n" + info.bus_info + "\n" +
+		    std::to_string(info.hw_revision) + "\n" +
+		    std::to_string(info.driver_version) + "\n" +
+		    DeviceCache::systemKey();
+
 	/*
 	 * Keep calling G_TOPOLOGY until the version number stays stable.
 	 */
@@ -323,6 +330,18 @@ done:
  * \return The MediaDevice API version
  */
 
+/**
+ * \fn MediaDevice::cacheKey()
+ * \brief Retrieve a key identifying the media device in the DeviceCache
+ *
+ * The key identifies the media device by its driver, model, serial number and
+ * bus information, and includes the driver and kernel versions. It is meant to
+ * be used as a prefix for the keys of cached information related to the media
+ * device.
+ *
+ * \return The media device cache key
+ */
+
 /**
  * \fn MediaDevice::entities()
  * \brief Retrieve the list of entities in the media graph
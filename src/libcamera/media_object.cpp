@@ -71,6 +71,11 @@ LOG_DECLARE_CATEGORY(MediaDevice)
  * \return The MediaDevice
  */
 
+/**
+ * \fn MediaObject::device() const
+ * \copydoc MediaObject::device()
+ */
+
 /**
  * \fn MediaObject::id()
  * \brief Retrieve the media object id
@@ -22,6 +22,7 @@
 #include <linux/videodev2.h>
 
 #include "libcamera/internal/camera_sensor.h"
+#include "libcamera/internal/delayed_controls.h"
 #include "libcamera/internal/device_enumerator.h"
 #include "libcamera/internal/ipa_manager.h"
 #include "libcamera/internal/media_device.h"
@@ -30,7 +31,6 @@
 #include "libcamera/internal/v4l2_controls.h"
 #include "libcamera/internal/v4l2_videodevice.h"
 
-#include "staggered_ctrl.h"
 #include "vcsm.h"
 
 namespace libcamera {
@@ -335,8 +335,7 @@ public:
 	::RPi::Vcsm vcsm_;
 	void *lsTable_;
 
-	RPi::StaggeredCtrl staggeredCtrl_;
-	uint32_t expectedSequence_;
+	std::unique_ptr<DelayedControls> delayedCtrls_;
 	bool sensorMetadata_;
 
 	/*
@@ -784,14 +783,12 @@ int PipelineHandlerRPi::start(Camera *camera)
 	data->unicam_[Unicam::Image].dev()->setFrameStartEnabled(true);
 
 	/*
-	 * Write the last set of gain and exposure values to the camera before
-	 * starting. First check that the staggered ctrl has been initialised
-	 * by the IPA action.
+	 * Reset the delayed controls to the gain and exposure values last
+	 * written to the sensor. First check that they have been set up by the
+	 * IPA action.
 	 */
-	ASSERT(data->staggeredCtrl_);
-	data->staggeredCtrl_.reset();
-	data->staggeredCtrl_.write();
-	data->expectedSequence_ = 0;
+	ASSERT(data->delayedCtrls_);
+	data->delayedCtrls_->reset();
 
 	data->state_ = RPiCameraData::State::Idle;
 
@@ -1113,7 +1110,7 @@ void RPiCameraData::frameStarted(uint32_t sequence)
 	LOG(RPI, Debug) << "frame start " << sequence;
 
 	/* Write any controls for the next frame as soon as we can. */
-	staggeredCtrl_.write();
+	delayedCtrls_->applyControls(sequence);
 }
 
 int RPiCameraData::loadIPA()
@@ -1148,20 +1145,31 @@ void RPiCameraData::queueFrameAction(unsigned int frame, const IPAOperationData
 	switch (action.operation) {
 	case RPI_IPA_ACTION_V4L2_SET_STAGGERED: {
 		ControlList controls = action.controls[0];
-		if (!staggeredCtrl_.set(controls))
-			LOG(RPI, Error) << "V4L2 staggered set failed";
+
+		/*
+		 * Without frames to count the delays against, the controls
+		 * are written straight to the sensor, and will be picked up
+		 * by the delayed controls when they are reset on start.
+		 */
+		if (state_ == State::Stopped)
+			unicam_[Unicam::Image].dev()->setControls(&controls);
+		else if (!delayedCtrls_->push(controls))
+			LOG(RPI, Error) << "V4L2 delayed controls push failed";
 		goto done;
 	}
 
 	case RPI_IPA_ACTION_SET_SENSOR_CONFIG: {
 		/*
-		 * Setup our staggered control writer with the sensor default
+		 * Setup our delayed control writer with the sensor default
 		 * gain and exposure delays.
 		 */
-		if (!staggeredCtrl_) {
-			staggeredCtrl_.init(unicam_[Unicam::Image].dev(),
-					    { { V4L2_CID_ANALOGUE_GAIN, action.data[0] },
-					      { V4L2_CID_EXPOSURE, action.data[1] } });
+		if (!delayedCtrls_) {
+			std::unordered_map<uint32_t, unsigned int> delays = {
+				{ V4L2_CID_ANALOGUE_GAIN, action.data[0] },
+				{ V4L2_CID_EXPOSURE, action.data[1] }
+			};
+			delayedCtrls_ = std::make_unique<DelayedControls>(unicam_[Unicam::Image].dev(),
+									  delays);
 			sensorMetadata_ = action.data[2];
 		}
 
@@ -1253,15 +1261,9 @@ void RPiCameraData::unicamBufferDequeue(FrameBuffer *buffer)
 	} else {
 		embeddedQueue_.push(buffer);
 
-		std::unordered_map<uint32_t, int32_t> ctrl;
-		int offset = buffer->metadata().sequence - expectedSequence_;
-		staggeredCtrl_.get(ctrl, offset);
-
-		expectedSequence_ = buffer->metadata().sequence + 1;
-
 		/*
 		 * Sensor metadata is unavailable, so put the expected ctrl
-		 * values (accounting for the staggered delays) into the empty
+		 * values (accounting for the sensor delays) into the empty
 		 * metadata buffer.
 		 */
 		if (!sensorMetadata_) {
@@ -1270,8 +1272,9 @@ void RPiCameraData::unicamBufferDequeue(FrameBuffer *buffer)
 								       PROT_READ | PROT_WRITE,
 								       MAP_SHARED,
 								       fb.planes()[0].fd.fd(), 0));
-			mem[0] = ctrl[V4L2_CID_EXPOSURE];
-			mem[1] = ctrl[V4L2_CID_ANALOGUE_GAIN];
+			ControlList ctrl = delayedCtrls_->get(buffer->metadata().sequence);
+			mem[0] = ctrl.get(V4L2_CID_EXPOSURE).get<int32_t>();
+			mem[1] = ctrl.get(V4L2_CID_ANALOGUE_GAIN).get<int32_t>();
 			munmap(mem, fb.planes()[0].length);
 		}
 	}
@@ -0,0 +1,851 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * replay.cpp - Pipeline handler replaying recorded frames through an IPA
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <queue>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/drm_fourcc.h>
+#include <linux/rkisp1-config.h>
+#include <linux/videodev2.h>
+
+#include <libcamera/buffer.h>
+#include <libcamera/camera.h>
+#include <libcamera/camera_manager.h>
+#include <libcamera/capture_file.h>
+#include <libcamera/control_ids.h>
+#include <libcamera/ipa/ipa_interface.h>
+#include <libcamera/ipa/rkisp1.h>
+#include <libcamera/request.h>
+#include <libcamera/stream.h>
+
+#include "libcamera/internal/camera_sensor.h"
+#include "libcamera/internal/ipa_manager.h"
+#include "libcamera/internal/log.h"
+#include "libcamera/internal/pipeline_handler.h"
+#include "libcamera/internal/utils.h"
+#include "libcamera/internal/v4l2_controls.h"
+
+/*
+ * The replay pipeline handler creates one virtual camera for each entry of the
+ * LIBCAMERA_REPLAY_FILES environment variable (colon-separated). An entry is a
+ * comma-separated list of capture files recorded during the same capture
+ * session, whose frames are merged. Image frames are read from stream 0, as
+ * recorded by 'cam --record', and the RkISP1 statistics buffers from stream 1,
+ * as recorded by the RkISP1 pipeline handler when LIBCAMERA_RKISP1_STATS_FILE
+ * is set. For instance
+ *
+ *   LIBCAMERA_REPLAY_FILES=images.lccf,stats.lccf
+ *
+ * creates a single camera named "Replay images.lccf". Both streams can also be
+ * stored in a single file.
+ *
+ * For every request, the recorded statistics are fed to the RkISP1 IPA module
+ * through the IPAInterface exactly as the RkISP1 pipeline handler does, and the
+ * recorded image is copied to the request buffer. Requests complete as soon as
+ * the IPA has processed the statistics, without any pacing to the recorded
+ * frame rate. Recordings are looped over when more requests are queued than
+ * frames have been recorded.
+ *
+ * Only the RkISP1 statistics are recorded and replayed. The Raspberry Pi
+ * pipeline handler doesn't record its statistics nor the sensor embedded data,
+ * and its IPA can't be exercised offline.
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(Replay)
+
+class PipelineHandlerReplay;
+
+namespace {
+
+constexpr unsigned int ReplayImageStream = 0;
+constexpr unsigned int ReplayStatsStream = 1;
+constexpr unsigned int ReplayBufferCount = 4;
+
+/* Default output format used for recordings without image frames. */
+constexpr unsigned int ReplayDefaultWidth = 640;
+constexpr unsigned int ReplayDefaultHeight = 480;
+
+/*
+ * Sensor exposure and gain ranges reported to the IPA module. The real ranges
+ * are not recorded, use values wide enough to let the algorithms converge.
+ */
+constexpr int32_t ReplayMinExposure = 1;
+constexpr int32_t ReplayMaxExposure = 65535;
+constexpr int32_t ReplayMinGain = 1;
+constexpr int32_t ReplayMaxGain = 1023;
+
+} /* namespace */
+
+struct ReplayFrameInfo {
+	unsigned int frame;
+	Request *request;
+	FrameBuffer *buffer;
+	FrameBuffer *paramBuffer;
+	FrameBuffer *statBuffer;
+	utils::time_point start;
+};
+
+class ReplayCameraData : public CameraData
+{
+public:
+	ReplayCameraData(PipelineHandler *pipe,
+			 const std::vector<std::string> &fileNames)
+		: CameraData(pipe), fileNames_(fileNames), frame_(0),
+		  startTime_(0), processedFrames_(0)
+	{
+	}
+
+	int init();
+	int loadIPA();
+
+	ReplayFrameInfo *findFrame(unsigned int frame);
+	const CaptureFileFrame *image(unsigned int frame) const;
+	const CaptureFileFrame *stats(unsigned int frame) const;
+	uint64_t timestamp(unsigned int frame) const;
+
+	std::vector<std::string> fileNames_;
+	std::vector<std::unique_ptr<CaptureFileReader>> readers_;
+	std::vector<const CaptureFileFrame *> images_;
+	std::vector<const CaptureFileFrame *> stats_;
+
+	Stream stream_;
+	PixelFormat pixelFormat_;
+	Size size_;
+	unsigned int stride_;
+	size_t frameSize_;
+
+	std::vector<std::unique_ptr<V4L2ControlId>> sensorControlIds_;
+	ControlInfoMap sensorControls_;
+
+	std::vector<std::unique_ptr<FrameBuffer>> paramBuffers_;
+	std::vector<std::unique_ptr<FrameBuffer>> statBuffers_;
+	std::queue<FrameBuffer *> availableParamBuffers_;
+	std::queue<FrameBuffer *> availableStatBuffers_;
+	std::vector<IPABuffer> ipaBuffers_;
+
+	std::map<unsigned int, ReplayFrameInfo> frameInfo_;
+	unsigned int frame_;
+	uint64_t startTime_;
+
+	unsigned int processedFrames_;
+	utils::duration processingTime_;
+
+private:
+	void queueFrameAction(unsigned int frame,
+			      const IPAOperationData &action);
+};
+
+class ReplayCameraConfiguration : public CameraConfiguration
+{
+public:
+	ReplayCameraConfiguration(ReplayCameraData *data);
+
+	Status validate() override;
+
+private:
+	const ReplayCameraData *data_;
+};
+
+class PipelineHandlerReplay : public PipelineHandler
+{
+public:
+	PipelineHandlerReplay(CameraManager *manager);
+	~PipelineHandlerReplay();
+
+	CameraConfiguration *generateConfiguration(Camera *camera,
+		const StreamRoles &roles) override;
+	int configure(Camera *camera, CameraConfiguration *config) override;
+
+	int exportFrameBuffers(Camera *camera, Stream *stream,
+			       std::vector<std::unique_ptr<FrameBuffer>> *buffers) override;
+
+	int start(Camera *camera) override;
+	void stop(Camera *camera) override;
+
+	int queueRequestDevice(Camera *camera, Request *request) override;
+
+	bool match(DeviceEnumerator *enumerator) override;
+
+private:
+	ReplayCameraData *cameraData(const Camera *camera)
+	{
+		return static_cast<ReplayCameraData *>(
+			PipelineHandler::cameraData(camera));
+	}
+
+	friend ReplayCameraData;
+
+	std::unique_ptr<FrameBuffer> createBuffer(size_t size);
+	Span<uint8_t> mapPlane(const FrameBuffer *buffer, unsigned int plane);
+	void unmapBuffers(const FrameBuffer *buffer);
+
+	void allocateBuffers(ReplayCameraData *data);
+	void freeBuffers(ReplayCameraData *data);
+
+	void captureFrame(ReplayCameraData *data, ReplayFrameInfo *info);
+	void completeFrame(ReplayCameraData *data, ReplayFrameInfo *info,
+			   FrameMetadata::Status status);
+
+	std::map<const FrameBuffer *, std::vector<Span<uint8_t>>> mappings_;
+};
+
+/* -----------------------------------------------------------------------------
+ * Camera Data
+ */
+
+int ReplayCameraData::init()
+{
+	for (const std::string &fileName : fileNames_) {
+		std::unique_ptr<CaptureFileReader> reader =
+			std::make_unique<CaptureFileReader>();
+		int ret = reader->open(fileName);
+		if (ret < 0)
+			return ret;
+
+		for (const CaptureFileFrame &frame : reader->frames()) {
+			if (frame.stream == ReplayImageStream)
+				images_.push_back(&frame);
+			else if (frame.stream == ReplayStatsStream)
+				stats_.push_back(&frame);
+		}
+
+		readers_.push_back(std::move(reader));
+	}
+
+	if (images_.empty() && stats_.empty()) {
+		LOG(Replay, Error) << "No frame found in " << fileNames_[0];
+		return -EINVAL;
+	}
+
+	/*
+	 * Frames of each stream may come from different files, order them by
+	 * capture time. Images and statistics are then paired by their rank.
+	 */
+	auto earlier = [](const CaptureFileFrame *a, const CaptureFileFrame *b) {
+		return a->timestamp < b->timestamp;
+	};
+	std::stable_sort(images_.begin(), images_.end(), earlier);
+	std::stable_sort(stats_.begin(), stats_.end(), earlier);
+
+	if (!images_.empty()) {
+		const CaptureFileFrame *first = images_.front();
+
+		pixelFormat_ = first->pixelFormat;
+		size_ = first->size;
+		stride_ = first->stride;
+		frameSize_ = 0;
+		for (const Span<const uint8_t> &plane : first->planes)
+			frameSize_ += plane.size();
+	} else {
+		pixelFormat_ = PixelFormat(DRM_FORMAT_NV12);
+		size_ = Size(ReplayDefaultWidth, ReplayDefaultHeight);
+		stride_ = ReplayDefaultWidth;
+		frameSize_ = stride_ * size_.height * 3 / 2;
+	}
+
+	/* Create the sensor controls exposed to the IPA module. */
+	const struct {
+		uint32_t id;
+		const char *name;
+		int32_t min;
+		int32_t max;
+	} sensorControls[] = {
+		{ V4L2_CID_EXPOSURE, "Exposure", ReplayMinExposure, ReplayMaxExposure },
+		{ V4L2_CID_ANALOGUE_GAIN, "Analogue Gain", ReplayMinGain, ReplayMaxGain },
+	};
+
+	ControlInfoMap::Map ctrls;
+
+	for (const auto &control : sensorControls) {
+		struct v4l2_query_ext_ctrl ctrl = {};
+		ctrl.id = control.id;
+		ctrl.type = V4L2_CTRL_TYPE_INTEGER;
+		utils::strlcpy(ctrl.name, control.name, sizeof(ctrl.name));
+		ctrl.minimum = control.min;
+		ctrl.maximum = control.max;
+		ctrl.default_value = control.min;
+		ctrl.step = 1;
+
+		sensorControlIds_.emplace_back(std::make_unique<V4L2ControlId>(ctrl));
+		ctrls.emplace(sensorControlIds_.back().get(), V4L2ControlInfo(ctrl));
+	}
+
+	sensorControls_ = std::move(ctrls);
+
+	controlInfo_ = {
+		{ &controls::AeEnable, ControlInfo(false, true) },
+	};
+
+	return 0;
+}
+
+int ReplayCameraData::loadIPA()
+{
+	ipa_ = IPAManager::instance()->createIPA("PipelineHandlerRkISP1", 1, 1);
+	if (!ipa_)
+		return -ENOENT;
+
+	ipa_->queueFrameAction.connect(this,
+				       &ReplayCameraData::queueFrameAction);
+
+	return ipa_->init(IPASettings{});
+}
+
+ReplayFrameInfo *ReplayCameraData::findFrame(unsigned int frame)
+{
+	auto it = frameInfo_.find(frame);
+	if (it == frameInfo_.end())
+		return nullptr;
+
+	return &it->second;
+}
+
+const CaptureFileFrame *ReplayCameraData::image(unsigned int frame) const
+{
+	if (images_.empty())
+		return nullptr;
+
+	return images_[frame % images_.size()];
+}
+
+const CaptureFileFrame *ReplayCameraData::stats(unsigned int frame) const
+{
+	if (stats_.empty())
+		return nullptr;
+
+	return stats_[frame % stats_.size()];
+}
+
+/*
+ * Compute the timestamp of a frame. The recorded timestamps come from the
+ * monotonic clock of the recording session, rebase them to the time the camera
+ * has been started, and offset them by the duration of the recording each time
+ * playback loops. As frames are not paced, timestamps reflect the recorded
+ * frame intervals and not the replay time.
+ */
+uint64_t ReplayCameraData::timestamp(unsigned int frame) const
+{
+	const std::vector<const CaptureFileFrame *> &frames =
+		images_.empty() ? stats_ : images_;
+
+	uint64_t first = frames.front()->timestamp;
+	uint64_t last = frames.back()->timestamp;
+	uint64_t interval = frames.size() > 1
+			  ? (last - first) / (frames.size() - 1) : 0;
+	unsigned int loop = frame / frames.size();
+
+	return startTime_ + frames[frame % frames.size()]->timestamp - first +
+	       loop * (last - first + interval);
+}
+
+void ReplayCameraData::queueFrameAction(unsigned int frame,
+					const IPAOperationData &action)
+{
+	PipelineHandlerReplay *pipe = static_cast<PipelineHandlerReplay *>(pipe_);
+	ReplayFrameInfo *info;
+
+	switch (action.operation) {
+	case RKISP1_IPA_ACTION_V4L2_SET:
+		for (const auto &ctrl : action.controls[0])
+			LOG(Replay, Debug)
+				<< "Frame " << frame << ": sensor control "
+				<< utils::hex(ctrl.first) << " set to "
+				<< ctrl.second.toString();
+		break;
+
+	case RKISP1_IPA_ACTION_PARAM_FILLED:
+		info = findFrame(frame);
+		if (info)
+			pipe->captureFrame(this, info);
+		break;
+
+	case RKISP1_IPA_ACTION_METADATA:
+		info = findFrame(frame);
+		if (!info)
+			break;
+
+		info->request->metadata() = action.controls[0];
+
+		processingTime_ += utils::clock::now() - info->start;
+		processedFrames_++;
+
+		pipe->completeFrame(this, info, FrameMetadata::FrameSuccess);
+		break;
+
+	default:
+		LOG(Replay, Error) << "Unknown action " << action.operation;
+		break;
+	}
+}
+
+/* -----------------------------------------------------------------------------
+ * Camera Configuration
+ */
+
+ReplayCameraConfiguration::ReplayCameraConfiguration(ReplayCameraData *data)
+	: CameraConfiguration(), data_(data)
+{
+}
+
+CameraConfiguration::Status ReplayCameraConfiguration::validate()
+{
+	Status status = Valid;
+
+	if (config_.empty())
+		return Invalid;
+
+	/* Cap the number of entries to the available streams. */
+	if (config_.size() > 1) {
+		config_.resize(1);
+		status = Adjusted;
+	}
+
+	/* The format is fixed by the recording. */
+	StreamConfiguration &cfg = config_[0];
+
+	if (cfg.pixelFormat != data_->pixelFormat_ || cfg.size != data_->size_) {
+		LOG(Replay, Debug)
+			<< "Adjusting format to " << data_->size_.toString()
+			<< "-" << data_->pixelFormat_.toString();
+		cfg.pixelFormat = data_->pixelFormat_;
+		cfg.size = data_->size_;
+		status = Adjusted;
+	}
+
+	cfg.stride = data_->stride_;
+	cfg.bufferCount = ReplayBufferCount;
+
+	return status;
+}
+
+/* -----------------------------------------------------------------------------
+ * Pipeline Operations
+ */
+
+PipelineHandlerReplay::PipelineHandlerReplay(CameraManager *manager)
+	: PipelineHandler(manager)
+{
+}
+
+PipelineHandlerReplay::~PipelineHandlerReplay()
+{
+	while (!mappings_.empty())
+		unmapBuffers(mappings_.begin()->first);
+}
+
+CameraConfiguration *PipelineHandlerReplay::generateConfiguration(Camera *camera,
+	const StreamRoles &roles)
+{
+	ReplayCameraData *data = cameraData(camera);
+	CameraConfiguration *config = new ReplayCameraConfiguration(data);
+
+	if (roles.empty())
+		return config;
+
+	std::map<PixelFormat, std::vector<SizeRange>> formats;
+	formats[data->pixelFormat_] = { SizeRange{ data->size_, data->size_ } };
+
+	StreamConfiguration cfg(formats);
+	cfg.pixelFormat = data->pixelFormat_;
+	cfg.size = data->size_;
+	cfg.bufferCount = ReplayBufferCount;
+
+	config->addConfiguration(cfg);
+
+	config->validate();
+
+	return config;
+}
+
+int PipelineHandlerReplay::configure(Camera *camera, CameraConfiguration *c)
+{
+	ReplayCameraData *data = cameraData(camera);
+	StreamConfiguration &cfg = c->at(0);
+
+	cfg.setStream(&data->stream_);
+
+	CameraSensorInfo sensorInfo = {};
+	sensorInfo.model = camera->name();
+	sensorInfo.outputSize = data->size_;
+
+	std::map<unsigned int, IPAStream> streamConfig;
+	streamConfig[0] = {
+		.pixelFormat = cfg.pixelFormat,
+		.size = cfg.size,
+	};
+
+	std::map<unsigned int, const ControlInfoMap &> entityControls;
+	entityControls.emplace(0, data->sensorControls_);
+
+	data->ipa_->configure(sensorInfo, streamConfig, entityControls);
+
+	return 0;
+}
+
+int PipelineHandlerReplay::exportFrameBuffers(Camera *camera, Stream *stream,
+					      std::vector<std::unique_ptr<FrameBuffer>> *buffers)
+{
+	ReplayCameraData *data = cameraData(camera);
+	unsigned int count = stream->configuration().bufferCount;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		std::unique_ptr<FrameBuffer> buffer = createBuffer(data->frameSize_);
+		if (!buffer) {
+			buffers->clear();
+			return -ENOMEM;
+		}
+
+		buffers->push_back(std::move(buffer));
+	}
+
+	return count;
+}
+
+int PipelineHandlerReplay::start(Camera *camera)
+{
+	ReplayCameraData *data = cameraData(camera);
+
+	allocateBuffers(data);
+
+	int ret = data->ipa_->start();
+	if (ret) {
+		freeBuffers(data);
+		return ret;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	data->frame_ = 0;
+	data->startTime_ = now.tv_sec * 1000000000ULL + now.tv_nsec;
+	data->processedFrames_ = 0;
+	data->processingTime_ = utils::duration::zero();
+
+	return 0;
+}
+
+void PipelineHandlerReplay::stop(Camera *camera)
+{
+	ReplayCameraData *data = cameraData(camera);
+
+	while (!data->frameInfo_.empty())
+		completeFrame(data, &data->frameInfo_.begin()->second,
+			      FrameMetadata::FrameCancelled);
+
+	data->ipa_->stop();
+
+	freeBuffers(data);
+
+	if (data->processedFrames_) {
+		auto average = std::chrono::duration_cast<std::chrono::microseconds>(
+			data->processingTime_ / data->processedFrames_);
+		LOG(Replay, Info)
+			<< "Replayed " << data->processedFrames_
+			<< " frames, average IPA processing time "
+			<< average.count() << "us";
+	}
+}
+
+int PipelineHandlerReplay::queueRequestDevice(Camera *camera, Request *request)
+{
+	ReplayCameraData *data = cameraData(camera);
+	FrameBuffer *buffer = request->findBuffer(&data->stream_);
+	if (!buffer) {
+		LOG(Replay, Error)
+			<< "Attempt to queue request with invalid stream";
+		return -ENOENT;
+	}
+
+	if (data->availableParamBuffers_.empty() ||
+	    data->availableStatBuffers_.empty()) {
+		LOG(Replay, Error) << "IPA buffers underrun";
+		return -ENOBUFS;
+	}
+
+	unsigned int frame = data->frame_++;
+
+	ReplayFrameInfo &info = data->frameInfo_[frame];
+	info.frame = frame;
+	info.request = request;
+	info.buffer = buffer;
+	info.paramBuffer = data->availableParamBuffers_.front();
+	info.statBuffer = data->availableStatBuffers_.front();
+
+	data->availableParamBuffers_.pop();
+	data->availableStatBuffers_.pop();
+
+	IPAOperationData op;
+	op.operation = RKISP1_IPA_EVENT_QUEUE_REQUEST;
+	op.data = { frame, info.paramBuffer->cookie() };
+	op.controls = { request->controls() };
+	data->ipa_->processEvent(op);
+
+	return 0;
+}
+
+bool PipelineHandlerReplay::match(DeviceEnumerator *enumerator)
+{
+	const char *files = utils::secure_getenv("LIBCAMERA_REPLAY_FILES");
+	if (!files)
+		return false;
+
+	/*
+	 * The pipeline handler is matched repeatedly until it fails. Create
+	 * all the cameras on the first call, and use the presence of cameras
+	 * in the camera manager to stop the subsequent attempts.
+	 */
+	bool registered = false;
+
+	for (const std::string &entry : utils::split(files, ":")) {
+		std::vector<std::string> fileNames;
+		for (const std::string &fileName : utils::split(entry, ","))
+			if (!fileName.empty())
+				fileNames.push_back(fileName);
+
+		if (fileNames.empty())
+			continue;
+
+		std::string name = std::string("Replay ") +
+				   utils::basename(fileNames[0].c_str());
+		if (manager_->get(name))
+			continue;
+
+		std::unique_ptr<ReplayCameraData> data =
+			std::make_unique<ReplayCameraData>(this, fileNames);
+
+		if (data->init() < 0)
+			continue;
+
+		if (data->loadIPA() < 0) {
+			LOG(Replay, Error)
+				<< "No RkISP1 IPA module found for " << entry;
+			continue;
+		}
+
+		std::set<Stream *> streams{ &data->stream_ };
+		std::shared_ptr<Camera> camera = Camera::create(this, name, streams);
+		registerCamera(std::move(camera), std::move(data));
+		registered = true;
+	}
+
+	return registered;
+}
+
+/* -----------------------------------------------------------------------------
+ * Buffer Handling
+ */
+
+std::unique_ptr<FrameBuffer> PipelineHandlerReplay::createBuffer(size_t size)
+{
+	int fd = memfd_create("libcamera-replay", MFD_CLOEXEC);
+	if (fd < 0) {
+		LOG(Replay, Error)
+			<< "Failed to create buffer: " << strerror(errno);
+		return nullptr;
+	}
+
+	if (ftruncate(fd, size) < 0) {
+		LOG(Replay, Error)
+			<< "Failed to size buffer: " << strerror(errno);
+		close(fd);
+		return nullptr;
+	}
+
+	FrameBuffer::Plane plane;
+	plane.fd = FileDescriptor(std::move(fd));
+	plane.length = size;
+
+	return std::make_unique<FrameBuffer>(std::vector<FrameBuffer::Plane>{ plane });
+}
+
+Span<uint8_t> PipelineHandlerReplay::mapPlane(const FrameBuffer *buffer,
+					      unsigned int plane)
+{
+	auto it = mappings_.find(buffer);
+	if (it == mappings_.end()) {
+		std::vector<Span<uint8_t>> planes;
+
+		for (const FrameBuffer::Plane &p : buffer->planes()) {
+			void *memory = mmap(NULL, p.length, PROT_READ | PROT_WRITE,
+					    MAP_SHARED, p.fd.fd(), 0);
+			if (memory == MAP_FAILED) {
+				LOG(Replay, Error)
+					<< "Failed to map buffer: "
+					<< strerror(errno);
+				planes.emplace_back();
+				continue;
+			}
+
+			planes.emplace_back(static_cast<uint8_t *>(memory),
+					    p.length);
+		}
+
+		it = mappings_.emplace(buffer, std::move(planes)).first;
+	}
+
+	return it->second[plane];
+}
+
+void PipelineHandlerReplay::unmapBuffers(const FrameBuffer *buffer)
+{
+	auto it = mappings_.find(buffer);
+	if (it == mappings_.end())
+		return;
+
+	for (const Span<uint8_t> &plane : it->second) {
+		if (plane.data())
+			munmap(plane.data(), plane.size());
+	}
+
+	mappings_.erase(it);
+}
+
+void PipelineHandlerReplay::allocateBuffers(ReplayCameraData *data)
+{
+	unsigned int count = data->stream_.configuration().bufferCount;
+	unsigned int ipaBufferId = 1;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		std::unique_ptr<FrameBuffer> param =
+			createBuffer(sizeof(struct rkisp1_isp_params_cfg));
+		std::unique_ptr<FrameBuffer> stat =
+			createBuffer(sizeof(struct rkisp1_stat_buffer));
+		if (!param || !stat)
+			continue;
+
+		param->setCookie(ipaBufferId++);
+		stat->setCookie(ipaBufferId++);
+
+		data->ipaBuffers_.push_back({ .id = param->cookie(),
+					      .planes = param->planes() });
+		data->ipaBuffers_.push_back({ .id = stat->cookie(),
+					      .planes = stat->planes() });
+
+		data->availableParamBuffers_.push(param.get());
+		data->availableStatBuffers_.push(stat.get());
+
+		data->paramBuffers_.push_back(std::move(param));
+		data->statBuffers_.push_back(std::move(stat));
+	}
+
+	data->ipa_->mapBuffers(data->ipaBuffers_);
+}
+
+void PipelineHandlerReplay::freeBuffers(ReplayCameraData *data)
+{
+	std::vector<unsigned int> ids;
+	for (IPABuffer &ipabuf : data->ipaBuffers_)
+		ids.push_back(ipabuf.id);
+
+	data->ipa_->unmapBuffers(ids);
+	data->ipaBuffers_.clear();
+
+	data->availableParamBuffers_ = {};
+	data->availableStatBuffers_ = {};
+
+	for (std::unique_ptr<FrameBuffer> &buffer : data->statBuffers_)
+		unmapBuffers(buffer.get());
+
+	data->paramBuffers_.clear();
+	data->statBuffers_.clear();
+
+	/*
+	 * Drop the mappings of the application buffers, they may be freed
+	 * once the camera is stopped.
+	 */
+	while (!mappings_.empty())
+		unmapBuffers(mappings_.begin()->first);
+}
+
+/*
+ * Emulate the capture of a frame: copy the recorded statistics to the IPA
+ * statistics buffer and the recorded image to the request buffer, and hand the
+ * statistics to the IPA module.
+ */
+void PipelineHandlerReplay::captureFrame(ReplayCameraData *data,
+					 ReplayFrameInfo *info)
+{
+	const CaptureFileFrame *image = data->image(info->frame);
+	FrameBuffer *buffer = info->buffer;
+	FrameMetadata &metadata = bufferMetadata(buffer);
+
+	metadata.status = FrameMetadata::FrameSuccess;
+	metadata.sequence = info->frame;
+	metadata.timestamp = data->timestamp(info->frame);
+	metadata.planes.clear();
+
+	for (unsigned int i = 0; i < buffer->planes().size(); ++i) {
+		Span<uint8_t> plane = mapPlane(buffer, i);
+		size_t size = 0;
+
+		if (image && i < image->planes.size()) {
+			size = std::min(plane.size(), image->planes[i].size());
+			memcpy(plane.data(), image->planes[i].data(), size);
+		}
+
+		metadata.planes.push_back({ static_cast<unsigned int>(size) });
+	}
+
+	const CaptureFileFrame *stats = data->stats(info->frame);
+	if (!stats) {
+		/* Without statistics there's nothing for the IPA to process. */
+		completeFrame(data, info, FrameMetadata::FrameSuccess);
+		return;
+	}
+
+	if (stats->planes.empty()) {
+		LOG(Replay, Error)
+			<< "No statistics data recorded for frame " << info->frame;
+		completeFrame(data, info, FrameMetadata::FrameError);
+		return;
+	}
+
+	Span<uint8_t> statBuffer = mapPlane(info->statBuffer, 0);
+	size_t size = std::min(statBuffer.size(), stats->planes[0].size());
+	memcpy(statBuffer.data(), stats->planes[0].data(), size);
+
+	info->start = utils::clock::now();
+
+	IPAOperationData op;
+	op.operation = RKISP1_IPA_EVENT_SIGNAL_STAT_BUFFER;
+	op.data = { info->frame, info->statBuffer->cookie() };
+	data->ipa_->processEvent(op);
+}
+
+void PipelineHandlerReplay::completeFrame(ReplayCameraData *data,
+					  ReplayFrameInfo *info,
+					  FrameMetadata::Status status)
+{
+	Request *request = info->request;
+	FrameBuffer *buffer = info->buffer;
+
+	if (status != FrameMetadata::FrameSuccess) {
+		FrameMetadata &metadata = bufferMetadata(buffer);
+		metadata.status = status;
+		metadata.planes.clear();
+	}
+
+	data->availableParamBuffers_.push(info->paramBuffer);
+	data->availableStatBuffers_.push(info->statBuffer);
+	data->frameInfo_.erase(info->frame);
+
+	completeBuffer(data->camera_, request, buffer);
+	completeRequest(data->camera_, request);
+}
+
+REGISTER_PIPELINE_HANDLER(PipelineHandlerReplay);
+
+} /* namespace libcamera */
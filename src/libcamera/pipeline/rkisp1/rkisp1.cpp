@@ -10,17 +10,20 @@
 #include <iomanip>
 #include <memory>
 #include <queue>
+#include <sys/mman.h>
 
 #include <linux/media-bus-format.h>
 
 #include <libcamera/buffer.h>
 #include <libcamera/camera.h>
+#include <libcamera/capture_file.h>
 #include <libcamera/control_ids.h>
 #include <libcamera/ipa/rkisp1.h>
 #include <libcamera/request.h>
 #include <libcamera/stream.h>
 
 #include "libcamera/internal/camera_sensor.h"
+#include "libcamera/internal/delayed_controls.h"
 #include "libcamera/internal/device_enumerator.h"
 #include "libcamera/internal/ipa_manager.h"
 #include "libcamera/internal/log.h"
@@ -40,7 +43,6 @@ class PipelineHandlerRkISP1;
 class RkISP1ActionQueueBuffers;
 
 enum RkISP1ActionType {
-	SetSensor,
 	SOE,
 	QueueBuffers,
 };
@@ -82,7 +84,6 @@ public:
 	RkISP1Timeline()
 		: Timeline()
 	{
-		setDelay(SetSensor, -1, 5);
 		setDelay(SOE, 0, -1);
 		setDelay(QueueBuffers, -1, 10);
 	}
@@ -134,6 +135,8 @@ public:
 	RkISP1Frames frameInfo_;
 	RkISP1Timeline timeline_;
 
+	std::unique_ptr<DelayedControls> delayedCtrls_;
+
 private:
 	void queueFrameAction(unsigned int frame,
 			      const IPAOperationData &action);
@@ -201,10 +204,15 @@ private:
 	void bufferReady(FrameBuffer *buffer);
 	void paramReady(FrameBuffer *buffer);
 	void statReady(FrameBuffer *buffer);
+	void frameStart(uint32_t sequence);
 
 	int allocateBuffers(Camera *camera);
 	int freeBuffers(Camera *camera);
 
+	void startStatsRecording();
+	void stopStatsRecording();
+	void recordStats(unsigned int frame, FrameBuffer *buffer);
+
 	MediaDevice *media_;
 	V4L2Subdevice *isp_;
 	V4L2Subdevice *resizer_;
@@ -217,6 +225,9 @@ private:
 	std::queue<FrameBuffer *> availableParamBuffers_;
 	std::queue<FrameBuffer *> availableStatBuffers_;
 
+	CaptureFileWriter statsRecorder_;
+	std::map<FrameBuffer *, Span<uint8_t>> statsMemory_;
+
 	Camera *activeCamera_;
 };
 
@@ -334,23 +345,6 @@ RkISP1FrameInfo *RkISP1Frames::find(Request *request)
 	return nullptr;
 }
 
-class RkISP1ActionSetSensor : public FrameAction
-{
-public:
-	RkISP1ActionSetSensor(unsigned int frame, CameraSensor *sensor, const ControlList &controls)
-		: FrameAction(frame, SetSensor), sensor_(sensor), controls_(controls) {}
-
-protected:
-	void run() override
-	{
-		sensor_->setControls(&controls_);
-	}
-
-private:
-	CameraSensor *sensor_;
-	ControlList controls_;
-};
-
 class RkISP1ActionQueueBuffers : public FrameAction
 {
 public:
@@ -413,9 +407,8 @@ void RkISP1CameraData::queueFrameAction(unsigned int frame,
 	switch (action.operation) {
 	case RKISP1_IPA_ACTION_V4L2_SET: {
 		const ControlList &controls = action.controls[0];
-		timeline_.scheduleAction(std::make_unique<RkISP1ActionSetSensor>(frame,
-										 sensor_,
-										 controls));
+		if (!delayedCtrls_->push(controls))
+			LOG(RkISP1, Error) << "Failed to queue sensor controls";
 		break;
 	}
 	case RKISP1_IPA_ACTION_PARAM_FILLED: {
@@ -791,8 +784,22 @@ int PipelineHandlerRkISP1::start(Camera *camera)
 
 	data->frame_ = 0;
 
+	/*
+	 * Sensor controls are applied at the start of each frame, as signalled
+	 * by the ISP.
+	 */
+	data->delayedCtrls_->reset();
+	ret = isp_->setFrameStartEnabled(true);
+	if (ret)
+		LOG(RkISP1, Warning)
+			<< "Frame start events unavailable, sensor controls won't be applied";
+
+	startStatsRecording();
+
 	ret = param_->streamOn();
 	if (ret) {
+		stopStatsRecording();
+		isp_->setFrameStartEnabled(false);
 		data->ipa_->stop();
 		freeBuffers(camera);
 		LOG(RkISP1, Error)
@@ -803,6 +810,8 @@ int PipelineHandlerRkISP1::start(Camera *camera)
 	ret = stat_->streamOn();
 	if (ret) {
 		param_->streamOff();
+		stopStatsRecording();
+		isp_->setFrameStartEnabled(false);
 		data->ipa_->stop();
 		freeBuffers(camera);
 		LOG(RkISP1, Error)
@@ -814,11 +823,14 @@ int PipelineHandlerRkISP1::start(Camera *camera)
 	if (ret) {
 		param_->streamOff();
 		stat_->streamOff();
+		stopStatsRecording();
+		isp_->setFrameStartEnabled(false);
 		data->ipa_->stop();
 		freeBuffers(camera);
 
 		LOG(RkISP1, Error)
 			<< "Failed to start camera " << camera->name();
+		return ret;
 	}
 
 	activeCamera_ = camera;
@@ -869,10 +881,12 @@ void PipelineHandlerRkISP1::stop(Camera *camera)
 
 	data->ipa_->stop();
 
+	isp_->setFrameStartEnabled(false);
 	data->timeline_.reset();
 
 	data->frameInfo_.clear();
 
+	stopStatsRecording();
 	freeBuffers(camera);
 
 	activeCamera_ = nullptr;
@@ -947,6 +961,18 @@ int PipelineHandlerRkISP1::createCamera(MediaEntity *sensor)
 	if (ret)
 		return ret;
 
+	/*
+	 * \todo Read the delays from the sensor instead of hardcoding values
+	 * matching the common sensors used with this platform.
+	 */
+	std::unordered_map<uint32_t, unsigned int> delays = {
+		{ V4L2_CID_ANALOGUE_GAIN, 1 },
+		{ V4L2_CID_EXPOSURE, 2 },
+	};
+	data->delayedCtrls_ =
+		std::make_unique<DelayedControls>(data->sensor_->device(),
+						  delays);
+
 	/* Initialize the camera properties. */
 	data->properties_ = data->sensor_->properties();
 
@@ -1004,6 +1030,7 @@ bool PipelineHandlerRkISP1::match(DeviceEnumerator *enumerator)
 	video_->bufferReady.connect(this, &PipelineHandlerRkISP1::bufferReady);
 	stat_->bufferReady.connect(this, &PipelineHandlerRkISP1::statReady);
 	param_->bufferReady.connect(this, &PipelineHandlerRkISP1::paramReady);
+	isp_->frameStart.connect(this, &PipelineHandlerRkISP1::frameStart);
 
 	/* Configure default links. */
 	if (initLinks() < 0) {
@@ -1097,12 +1124,91 @@ void PipelineHandlerRkISP1::statReady(FrameBuffer *buffer)
 	if (!info)
 		return;
 
+	if (statsRecorder_.isOpen())
+		recordStats(info->frame, buffer);
+
 	IPAOperationData op;
 	op.operation = RKISP1_IPA_EVENT_SIGNAL_STAT_BUFFER;
 	op.data = { info->frame, info->statBuffer->cookie() };
 	data->ipa_->processEvent(op);
 }
 
+/*
+ * The ISP is shared by all cameras, only the sensor of the active camera is
+ * streaming, and only its controls must be applied.
+ */
+void PipelineHandlerRkISP1::frameStart(uint32_t sequence)
+{
+	if (!activeCamera_)
+		return;
+
+	RkISP1CameraData *data = cameraData(activeCamera_);
+	data->delayedCtrls_->applyControls(sequence);
+}
+
+/* -----------------------------------------------------------------------------
+ * Statistics Recording
+ */
+
+/*
+ * When the LIBCAMERA_RKISP1_STATS_FILE environment variable is set, the
+ * statistics buffers are recorded to a capture file as stream 1, in the format
+ * expected by the replay pipeline handler.
+ */
+void PipelineHandlerRkISP1::startStatsRecording()
+{
+	const char *fileName = utils::secure_getenv("LIBCAMERA_RKISP1_STATS_FILE");
+	if (!fileName)
+		return;
+
+	if (statsRecorder_.open(fileName) < 0) {
+		LOG(RkISP1, Warning)
+			<< "Failed to open statistics file " << fileName;
+		return;
+	}
+
+	for (std::unique_ptr<FrameBuffer> &buffer : statBuffers_) {
+		const FrameBuffer::Plane &plane = buffer->planes()[0];
+		void *memory = mmap(NULL, plane.length, PROT_READ, MAP_SHARED,
+				    plane.fd.fd(), 0);
+		if (memory == MAP_FAILED) {
+			LOG(RkISP1, Warning) << "Failed to map statistics buffer";
+			stopStatsRecording();
+			return;
+		}
+
+		statsMemory_[buffer.get()] = { static_cast<uint8_t *>(memory),
+					       plane.length };
+	}
+}
+
+void PipelineHandlerRkISP1::stopStatsRecording()
+{
+	statsRecorder_.close();
+
+	for (auto &memory : statsMemory_)
+		munmap(memory.second.data(), memory.second.size());
+	statsMemory_.clear();
+}
+
+void PipelineHandlerRkISP1::recordStats(unsigned int frame, FrameBuffer *buffer)
+{
+	StreamConfiguration config;
+	config.pixelFormat = PixelFormat(V4L2_META_FMT_RK_ISP1_STAT_3A);
+
+	FrameMetadata metadata = buffer->metadata();
+	metadata.sequence = frame;
+
+	const Span<uint8_t> &memory = statsMemory_[buffer];
+	size_t size = memory.size();
+	if (!metadata.planes.empty() && metadata.planes[0].bytesused)
+		size = std::min<size_t>(size, metadata.planes[0].bytesused);
+	std::vector<Span<const uint8_t>> planes{ { memory.data(), size } };
+
+	statsRecorder_.write(1, config, metadata, planes,
+			     ControlList(controls::controls));
+}
+
 REGISTER_PIPELINE_HANDLER(PipelineHandlerRkISP1);
 
 } /* namespace libcamera */
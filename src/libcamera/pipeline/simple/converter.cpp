@@ -9,6 +9,8 @@
 
 #include <algorithm>
 #include <limits.h>
+#include <utility>
+#include <vector>
 
 #include <libcamera/buffer.h>
 #include <libcamera/geometry.h>
@@ -17,14 +19,195 @@
 
 #include "libcamera/internal/log.h"
 #include "libcamera/internal/media_device.h"
+#include "libcamera/internal/pipeline_handler.h"
 #include "libcamera/internal/v4l2_videodevice.h"
 
 namespace libcamera {
 
 LOG_DECLARE_CATEGORY(SimplePipeline);
 
+/* -----------------------------------------------------------------------------
+ * SimpleConverter::Stream
+ */
+
+SimpleConverter::Stream::Stream(SimpleConverter *converter)
+	: converter_(converter), inputBufferCount_(0), outputBufferCount_(0),
+	  reclaimed_(nullptr)
+{
+}
+
+int SimpleConverter::Stream::open(const std::string &deviceNode)
+{
+	/*
+	 * Each stream opens its own instance of the mem2mem device, to get an
+	 * independent conversion context.
+	 */
+	m2m_ = std::make_unique<V4L2M2MDevice>(deviceNode);
+
+	int ret = m2m_->open();
+	if (ret < 0) {
+		m2m_.reset();
+		return ret;
+	}
+
+	m2m_->output()->bufferReady.connect(this, &Stream::outputBufferReady);
+	m2m_->capture()->bufferReady.connect(this, &Stream::captureBufferReady);
+
+	return 0;
+}
+
+int SimpleConverter::Stream::configure(const StreamConfiguration &inputCfg,
+				       StreamConfiguration *outputCfg)
+{
+	V4L2DeviceFormat format;
+	int ret;
+
+	V4L2PixelFormat videoFormat = m2m_->output()->toV4L2PixelFormat(inputCfg.pixelFormat);
+	format.fourcc = videoFormat;
+	format.size = inputCfg.size;
+
+	ret = m2m_->output()->setFormat(&format);
+	if (ret < 0) {
+		LOG(SimplePipeline, Error)
+			<< "Failed to set input format: " << strerror(-ret);
+		return ret;
+	}
+
+	if (format.fourcc != videoFormat || format.size != inputCfg.size) {
+		LOG(SimplePipeline, Error)
+			<< "Input format not supported";
+		return -EINVAL;
+	}
+
+	/* Set the pixel format and size on the output. */
+	videoFormat = m2m_->capture()->toV4L2PixelFormat(outputCfg->pixelFormat);
+	format.fourcc = videoFormat;
+	format.size = outputCfg->size;
+
+	ret = m2m_->capture()->setFormat(&format);
+	if (ret < 0) {
+		LOG(SimplePipeline, Error)
+			<< "Failed to set output format: " << strerror(-ret);
+		return ret;
+	}
+
+	if (format.fourcc != videoFormat || format.size != outputCfg->size) {
+		LOG(SimplePipeline, Error)
+			<< "Output format not supported";
+		return -EINVAL;
+	}
+
+	outputCfg->stride = format.planes[0].bpl;
+
+	inputBufferCount_ = inputCfg.bufferCount;
+	outputBufferCount_ = outputCfg->bufferCount;
+
+	return 0;
+}
+
+int SimpleConverter::Stream::exportBuffers(unsigned int count,
+					   std::vector<std::unique_ptr<FrameBuffer>> *buffers)
+{
+	return m2m_->capture()->exportBuffers(count, buffers);
+}
+
+int SimpleConverter::Stream::start()
+{
+	int ret = m2m_->output()->importBuffers(inputBufferCount_);
+	if (ret < 0)
+		return ret;
+
+	ret = m2m_->capture()->importBuffers(outputBufferCount_);
+	if (ret < 0) {
+		stop();
+		return ret;
+	}
+
+	ret = m2m_->output()->streamOn();
+	if (ret < 0) {
+		stop();
+		return ret;
+	}
+
+	ret = m2m_->capture()->streamOn();
+	if (ret < 0) {
+		stop();
+		return ret;
+	}
+
+	return 0;
+}
+
+void SimpleConverter::Stream::stop()
+{
+	m2m_->capture()->streamOff();
+	m2m_->output()->streamOff();
+	m2m_->capture()->releaseBuffers();
+	m2m_->output()->releaseBuffers();
+}
+
+int SimpleConverter::Stream::queueBuffers(FrameBuffer *input,
+					  FrameBuffer *output)
+{
+	/*
+	 * The mem2mem device pairs input and output buffers in queueing order.
+	 * Queue the output buffer first, as it can be reclaimed if the input
+	 * buffer can't be queued.
+	 */
+	int ret = m2m_->capture()->queueBuffer(output);
+	if (ret < 0)
+		return ret;
+
+	ret = m2m_->output()->queueBuffer(input);
+	if (ret < 0) {
+		reclaim(output);
+		return ret;
+	}
+
+	/* The input buffer is handed back when dequeued. */
+	converter_->queue_[input]++;
+
+	return 0;
+}
+
+/*
+ * Reclaim an output buffer queued without a matching input buffer, which
+ * would otherwise receive the result of the next conversion and shift all the
+ * following ones. Buffers can't be dequeued individually, restart the device,
+ * which cancels all the conversions in flight. The reclaimed buffer is left to
+ * the caller.
+ */
+void SimpleConverter::Stream::reclaim(FrameBuffer *output)
+{
+	reclaimed_ = output;
+
+	m2m_->capture()->streamOff();
+	m2m_->output()->streamOff();
+
+	reclaimed_ = nullptr;
+
+	if (m2m_->output()->streamOn() < 0 || m2m_->capture()->streamOn() < 0)
+		LOG(SimplePipeline, Error) << "Failed to restart converter";
+}
+
+void SimpleConverter::Stream::captureBufferReady(FrameBuffer *buffer)
+{
+	if (buffer == reclaimed_)
+		return;
+
+	converter_->outputBufferReady.emit(buffer);
+}
+
+void SimpleConverter::Stream::outputBufferReady(FrameBuffer *buffer)
+{
+	converter_->inputProcessed(buffer);
+}
+
+/* -----------------------------------------------------------------------------
+ * SimpleConverter
+ */
+
 SimpleConverter::SimpleConverter(MediaDevice *media)
-	: m2m_(nullptr)
 {
 	/*
 	 * Locate the video node. There's no need to validate the pipeline
@@ -38,15 +221,12 @@ SimpleConverter::SimpleConverter(MediaDevice *media)
 	if (it == entities.end())
 		return;
 
-	m2m_ = new V4L2M2MDevice((*it)->deviceNode());
-
-	m2m_->output()->bufferReady.connect(this, &SimpleConverter::outputBufferReady);
-	m2m_->capture()->bufferReady.connect(this, &SimpleConverter::captureBufferReady);
+	deviceNode_ = (*it)->deviceNode();
+	m2m_ = std::make_unique<V4L2M2MDevice>(deviceNode_);
 }
 
 SimpleConverter::~SimpleConverter()
 {
-	delete m2m_;
 }
 
 int SimpleConverter::open()
@@ -59,6 +239,8 @@ int SimpleConverter::open()
 
 void SimpleConverter::close()
 {
+	streams_.clear();
+
 	if (m2m_)
 		m2m_->close();
 }
@@ -139,80 +321,57 @@ SizeRange SimpleConverter::sizes(const Size &input)
 	return sizes;
 }
 
-int SimpleConverter::configure(PixelFormat inputFormat, const Size &inputSize,
-			       StreamConfiguration *cfg)
+int SimpleConverter::configure(const StreamConfiguration &inputCfg,
+			       const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs)
 {
-	V4L2DeviceFormat format;
-	int ret;
+	int ret = 0;
 
-	V4L2PixelFormat videoFormat = m2m_->output()->toV4L2PixelFormat(inputFormat);
-	format.fourcc = videoFormat;
-	format.size = inputSize;
+	streams_.clear();
+	streams_.reserve(outputCfgs.size());
 
-	ret = m2m_->output()->setFormat(&format);
-	if (ret < 0) {
-		LOG(SimplePipeline, Error)
-			<< "Failed to set input format: " << strerror(-ret);
-		return ret;
-	}
+	for (unsigned int i = 0; i < outputCfgs.size(); ++i) {
+		std::unique_ptr<Stream> stream = std::make_unique<Stream>(this);
 
-	if (format.fourcc != videoFormat || format.size != inputSize) {
-		LOG(SimplePipeline, Error)
-			<< "Input format not supported";
-		return -EINVAL;
-	}
+		ret = stream->open(deviceNode_);
+		if (ret < 0) {
+			LOG(SimplePipeline, Error)
+				<< "Failed to open converter for stream " << i
+				<< ": " << strerror(-ret);
+			break;
+		}
 
-	/* Set the pixel format and size on the output. */
-	videoFormat = m2m_->capture()->toV4L2PixelFormat(cfg->pixelFormat);
-	format.fourcc = videoFormat;
-	format.size = cfg->size;
+		ret = stream->configure(inputCfg, &outputCfgs[i].get());
+		if (ret < 0)
+			break;
 
-	ret = m2m_->capture()->setFormat(&format);
-	if (ret < 0) {
-		LOG(SimplePipeline, Error)
-			<< "Failed to set output format: " << strerror(-ret);
-		return ret;
+		streams_.push_back(std::move(stream));
 	}
 
-	if (format.fourcc != videoFormat || format.size != cfg->size) {
-		LOG(SimplePipeline, Error)
-			<< "Output format not supported";
-		return -EINVAL;
+	if (ret < 0) {
+		streams_.clear();
+		return ret;
 	}
 
-	cfg->stride = format.planes[0].bpl;
-
 	return 0;
 }
 
-int SimpleConverter::exportBuffers(unsigned int count,
+int SimpleConverter::exportBuffers(unsigned int output, unsigned int count,
 				   std::vector<std::unique_ptr<FrameBuffer>> *buffers)
 {
-	return m2m_->capture()->exportBuffers(count, buffers);
+	if (output >= streams_.size())
+		return -EINVAL;
+
+	return streams_[output]->exportBuffers(count, buffers);
 }
 
-int SimpleConverter::start(unsigned int count)
+int SimpleConverter::start()
 {
-	int ret = m2m_->output()->importBuffers(count);
-	if (ret < 0)
-		return ret;
-
-	ret = m2m_->capture()->importBuffers(count);
-	if (ret < 0) {
-		stop();
-		return ret;
-	}
-
-	ret = m2m_->output()->streamOn();
-	if (ret < 0) {
-		stop();
-		return ret;
-	}
-
-	ret = m2m_->capture()->streamOn();
-	if (ret < 0) {
-		stop();
-		return ret;
+	for (std::unique_ptr<Stream> &stream : streams_) {
+		int ret = stream->start();
+		if (ret < 0) {
+			stop();
+			return ret;
+		}
 	}
 
 	return 0;
@@ -220,45 +379,69 @@ int SimpleConverter::start(unsigned int count)
 
 void SimpleConverter::stop()
 {
-	m2m_->capture()->streamOff();
-	m2m_->output()->streamOff();
-	m2m_->capture()->releaseBuffers();
-	m2m_->output()->releaseBuffers();
+	for (std::unique_ptr<Stream> &stream : streams_)
+		stream->stop();
+
+	queue_.clear();
 }
 
-int SimpleConverter::queueBuffers(FrameBuffer *input, FrameBuffer *output)
+int SimpleConverter::queueBuffers(FrameBuffer *input,
+				  const std::map<unsigned int, FrameBuffer *> &outputs)
 {
-	int ret = m2m_->output()->queueBuffer(input);
-	if (ret < 0)
-		return ret;
+	if (outputs.empty())
+		return -EINVAL;
 
-	ret = m2m_->capture()->queueBuffer(output);
-	if (ret < 0)
+	for (const auto &output : outputs) {
+		if (output.first >= streams_.size())
+			return -EINVAL;
+	}
+
+	/*
+	 * Queue the input buffer to all the streams that have an output
+	 * buffer. Several input buffers can be in flight in each stream, the
+	 * input buffer is handed back when all streams are done with it.
+	 */
+	std::vector<FrameBuffer *> failed;
+	int ret = 0;
+
+	for (const auto &output : outputs) {
+		int err = streams_[output.first]->queueBuffers(input, output.second);
+		if (err < 0) {
+			failed.push_back(output.second);
+			ret = err;
+		}
+	}
+
+	/*
+	 * If the input buffer hasn't been queued to any stream, the caller
+	 * keeps ownership of all buffers. Otherwise complete the output
+	 * buffers that couldn't be queued with an error.
+	 */
+	if (queue_.find(input) == queue_.end())
 		return ret;
 
-	return 0;
-}
+	for (FrameBuffer *buffer : failed) {
+		FrameMetadata &metadata = PipelineHandler::bufferMetadata(buffer);
+		metadata.status = FrameMetadata::FrameError;
+		metadata.planes.clear();
 
-void SimpleConverter::captureBufferReady(FrameBuffer *buffer)
-{
-	if (!outputDoneQueue_.empty()) {
-		FrameBuffer *other = outputDoneQueue_.front();
-		outputDoneQueue_.pop();
-		bufferReady.emit(other, buffer);
-	} else {
-		captureDoneQueue_.push(buffer);
+		outputBufferReady.emit(buffer);
 	}
+
+	return 0;
 }
 
-void SimpleConverter::outputBufferReady(FrameBuffer *buffer)
+void SimpleConverter::inputProcessed(FrameBuffer *buffer)
 {
-	if (!captureDoneQueue_.empty()) {
-		FrameBuffer *other = captureDoneQueue_.front();
-		captureDoneQueue_.pop();
-		bufferReady.emit(buffer, other);
-	} else {
-		outputDoneQueue_.push(buffer);
-	}
+	auto it = queue_.find(buffer);
+	if (it == queue_.end())
+		return;
+
+	if (--it->second)
+		return;
+
+	queue_.erase(it);
+	inputBufferReady.emit(buffer);
 }
 
 } /* namespace libcamera */
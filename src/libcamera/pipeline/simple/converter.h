@@ -8,8 +8,10 @@
 #ifndef __LIBCAMERA_PIPELINE_SIMPLE_CONVERTER_H__
 #define __LIBCAMERA_PIPELINE_SIMPLE_CONVERTER_H__
 
+#include <functional>
+#include <map>
 #include <memory>
-#include <queue>
+#include <string>
 #include <vector>
 
 #include <libcamera/pixelformats.h>
@@ -36,26 +38,58 @@ public:
 	std::vector<PixelFormat> formats(PixelFormat input);
 	SizeRange sizes(const Size &input);
 
-	int configure(PixelFormat inputFormat, const Size &inputSize,
-		      StreamConfiguration *cfg);
-	int exportBuffers(unsigned int count,
+	int configure(const StreamConfiguration &inputCfg,
+		      const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs);
+	int exportBuffers(unsigned int output, unsigned int count,
 			  std::vector<std::unique_ptr<FrameBuffer>> *buffers);
 
-	int start(unsigned int count);
+	int start();
 	void stop();
 
-	int queueBuffers(FrameBuffer *input, FrameBuffer *output);
+	int queueBuffers(FrameBuffer *input,
+			 const std::map<unsigned int, FrameBuffer *> &outputs);
 
-	Signal<FrameBuffer *, FrameBuffer *> bufferReady;
+	Signal<FrameBuffer *> inputBufferReady;
+	Signal<FrameBuffer *> outputBufferReady;
 
 private:
-	void captureBufferReady(FrameBuffer *buffer);
-	void outputBufferReady(FrameBuffer *buffer);
+	class Stream
+	{
+	public:
+		Stream(SimpleConverter *converter);
 
-	V4L2M2MDevice *m2m_;
+		int open(const std::string &deviceNode);
 
-	std::queue<FrameBuffer *> captureDoneQueue_;
-	std::queue<FrameBuffer *> outputDoneQueue_;
+		int configure(const StreamConfiguration &inputCfg,
+			      StreamConfiguration *outputCfg);
+		int exportBuffers(unsigned int count,
+				  std::vector<std::unique_ptr<FrameBuffer>> *buffers);
+
+		int start();
+		void stop();
+
+		int queueBuffers(FrameBuffer *input, FrameBuffer *output);
+
+	private:
+		void reclaim(FrameBuffer *output);
+		void captureBufferReady(FrameBuffer *buffer);
+		void outputBufferReady(FrameBuffer *buffer);
+
+		SimpleConverter *converter_;
+		std::unique_ptr<V4L2M2MDevice> m2m_;
+
+		unsigned int inputBufferCount_;
+		unsigned int outputBufferCount_;
+		FrameBuffer *reclaimed_;
+	};
+
+	void inputProcessed(FrameBuffer *buffer);
+
+	std::string deviceNode_;
+	std::unique_ptr<V4L2M2MDevice> m2m_;
+
+	std::vector<std::unique_ptr<Stream>> streams_;
+	std::map<FrameBuffer *, unsigned int> queue_;
 };
 
 } /* namespace libcamera */
@@ -19,6 +19,7 @@
 #include <vector>
 
 #include <linux/media-bus-format.h>
+#include <linux/v4l2-controls.h>
 
 #include <libcamera/camera.h>
 #include <libcamera/request.h>
@@ -33,6 +34,7 @@
 #include "libcamera/internal/v4l2_videodevice.h"
 
 #include "converter.h"
+#include "software_isp.h"
 
 namespace libcamera {
 
@@ -52,21 +54,44 @@ static const SimplePipelineInfo supportedDevices[] = {
 	{ "sun6i-csi", nullptr },
 };
 
+/* Mean luminance targeted by the software ISP exposure control. */
+constexpr double ExposureTarget = 0.18;
+
+/* Number of frames to skip for exposure changes to take effect. */
+constexpr unsigned int ExposureDelay = 2;
+
+/* Maximum number of streams produced by a format converter. */
+constexpr unsigned int MaxConverterStreams = 3;
+
+/*
+ * Number of capture buffers when using a converter. Use enough buffers to
+ * keep the capture device busy while frames are being converted.
+ */
+constexpr unsigned int InternalBufferCount = 4;
+
 } /* namespace */
 
 class SimpleCameraData : public CameraData
 {
 public:
-	SimpleCameraData(SimplePipelineHandler *pipe, MediaEntity *sensor);
+	SimpleCameraData(SimplePipelineHandler *pipe, unsigned int numStreams,
+			 MediaEntity *sensor);
 
 	bool isValid() const { return sensor_ != nullptr; }
-	std::set<Stream *> streams() { return { &stream_ }; }
+	std::set<Stream *> streams();
+	unsigned int streamIndex(const Stream *stream) const
+	{
+		return stream - &streams_.front();
+	}
 
 	int init();
 	int setupLinks();
 	int setupFormats(V4L2SubdeviceFormat *format,
 			 V4L2Subdevice::Whence whence);
 
+	void initExposure();
+	void updateExposure(const SoftwareIspStats &stats);
+
 	struct Entity {
 		MediaEntity *entity;
 		MediaLink *link;
@@ -79,13 +104,19 @@ public:
 		SizeRange outputSizes;
 	};
 
-	Stream stream_;
+	std::vector<Stream> streams_;
 	std::unique_ptr<CameraSensor> sensor_;
 	std::list<Entity> entities_;
 	V4L2VideoDevice *video_;
 
 	std::vector<Configuration> configs_;
 	std::map<PixelFormat, Configuration> formats_;
+
+	/* Exposure control for the software ISP. */
+	bool exposureControl_;
+	int32_t exposure_;
+	int32_t gain_;
+	unsigned int exposureDelay_;
 };
 
 class SimpleCameraConfiguration : public CameraConfiguration
@@ -96,6 +127,10 @@ public:
 	Status validate() override;
 
 	const V4L2SubdeviceFormat &sensorFormat() { return sensorFormat_; }
+	const SimpleCameraData::Configuration *pipeConfig() const
+	{
+		return pipeConfig_;
+	}
 
 	bool needConversion() const { return needConversion_; }
 
@@ -109,6 +144,7 @@ private:
 	const SimpleCameraData *data_;
 
 	V4L2SubdeviceFormat sensorFormat_;
+	const SimpleCameraData::Configuration *pipeConfig_;
 	bool needConversion_;
 };
 
@@ -133,9 +169,11 @@ public:
 	V4L2VideoDevice *video(const MediaEntity *entity);
 	V4L2Subdevice *subdev(const MediaEntity *entity);
 	SimpleConverter *converter() { return converter_; }
+	SoftwareIsp *softwareIsp() { return softwareIsp_.get(); }
 
 protected:
 	int queueRequestDevice(Camera *camera, Request *request) override;
+	int pauseDevice(Camera *camera) override;
 
 private:
 	SimpleCameraData *cameraData(const Camera *camera)
@@ -149,16 +187,19 @@ private:
 	int createCamera(MediaEntity *sensor);
 
 	void bufferReady(FrameBuffer *buffer);
-	void converterDone(FrameBuffer *input, FrameBuffer *output);
+	void converterInputDone(FrameBuffer *buffer);
+	void converterOutputDone(FrameBuffer *buffer);
+	void ispStatsReady(const SoftwareIspStats &stats);
 
 	MediaDevice *media_;
 	std::map<const MediaEntity *, std::unique_ptr<V4L2VideoDevice>> videos_;
 	std::map<const MediaEntity *, V4L2Subdevice> subdevs_;
 
 	SimpleConverter *converter_;
+	std::unique_ptr<SoftwareIsp> softwareIsp_;
 	bool useConverter_;
 	std::vector<std::unique_ptr<FrameBuffer>> converterBuffers_;
-	std::queue<FrameBuffer *> converterQueue_;
+	std::queue<std::map<unsigned int, FrameBuffer *>> converterQueue_;
 
 	Camera *activeCamera_;
 };
@@ -168,8 +209,10 @@ private:
  */
 
 SimpleCameraData::SimpleCameraData(SimplePipelineHandler *pipe,
+				   unsigned int numStreams,
 				   MediaEntity *sensor)
-	: CameraData(pipe)
+	: CameraData(pipe), streams_(numStreams), exposureControl_(false),
+	  exposure_(0), gain_(0), exposureDelay_(0)
 {
 	int ret;
 
@@ -244,10 +287,20 @@ SimpleCameraData::SimpleCameraData(SimplePipelineHandler *pipe,
 	}
 }
 
+std::set<Stream *> SimpleCameraData::streams()
+{
+	std::set<Stream *> streams;
+	for (Stream &stream : streams_)
+		streams.insert(&stream);
+
+	return streams;
+}
+
 int SimpleCameraData::init()
 {
 	SimplePipelineHandler *pipe = static_cast<SimplePipelineHandler *>(pipe_);
 	SimpleConverter *converter = pipe->converter();
+	SoftwareIsp *softwareIsp = pipe->softwareIsp();
 	int ret;
 
 	/*
@@ -304,6 +357,21 @@ int SimpleCameraData::init()
 			config.pixelFormat = pixelFormat;
 			config.captureSize = format.size;
 
+			if (softwareIsp) {
+				/*
+				 * The software ISP can only process raw
+				 * formats, always expose the native format.
+				 */
+				config.outputSizes = config.captureSize;
+				formats_[pixelFormat] = config;
+
+				config.outputSizes = softwareIsp->sizes(format.size);
+
+				for (PixelFormat format : softwareIsp->formats(pixelFormat))
+					formats_[format] = config;
+				continue;
+			}
+
 			if (!converter) {
 				config.outputSizes = config.captureSize;
 				formats_[pixelFormat] = config;
@@ -405,6 +473,98 @@ int SimpleCameraData::setupFormats(V4L2SubdeviceFormat *format,
 	return 0;
 }
 
+void SimpleCameraData::initExposure()
+{
+	const ControlInfoMap &controls = sensor_->controls();
+
+	exposureControl_ = false;
+
+	if (controls.find(V4L2_CID_EXPOSURE) == controls.end() ||
+	    controls.find(V4L2_CID_ANALOGUE_GAIN) == controls.end()) {
+		LOG(SimplePipeline, Debug)
+			<< "Sensor doesn't support exposure control";
+		return;
+	}
+
+	ControlList ctrls = sensor_->getControls({ V4L2_CID_EXPOSURE,
+						   V4L2_CID_ANALOGUE_GAIN });
+	if (ctrls.empty())
+		return;
+
+	exposure_ = ctrls.get(V4L2_CID_EXPOSURE).get<int32_t>();
+	gain_ = ctrls.get(V4L2_CID_ANALOGUE_GAIN).get<int32_t>();
+	exposureDelay_ = 0;
+	exposureControl_ = true;
+}
+
+void SimpleCameraData::updateExposure(const SoftwareIspStats &stats)
+{
+	if (!exposureControl_)
+		return;
+
+	/* Wait for the previous exposure change to take effect. */
+	if (exposureDelay_) {
+		exposureDelay_--;
+		return;
+	}
+
+	/* Compute the mean luminance, normalized to [0, 1]. */
+	uint64_t count = 0;
+	uint64_t sum = 0;
+
+	for (unsigned int i = 0; i < SoftwareIspStats::HistogramBins; ++i) {
+		count += stats.histogram[i];
+		sum += static_cast<uint64_t>(stats.histogram[i]) * i;
+	}
+
+	if (!count)
+		return;
+
+	double mean = (static_cast<double>(sum) / count + 0.5)
+		    / SoftwareIspStats::HistogramBins;
+
+	/* Limit the change per step to avoid oscillations. */
+	double ratio = std::min(std::max(ExposureTarget / mean, 0.5), 2.0);
+	if (std::abs(ratio - 1.0) < 0.1)
+		return;
+
+	const ControlInfo &exposureInfo = sensor_->controls().at(V4L2_CID_EXPOSURE);
+	const ControlInfo &gainInfo = sensor_->controls().at(V4L2_CID_ANALOGUE_GAIN);
+	int32_t minExposure = std::max(exposureInfo.min().get<int32_t>(), 1);
+	int32_t maxExposure = exposureInfo.max().get<int32_t>();
+	int32_t minGain = std::max(gainInfo.min().get<int32_t>(), 1);
+	int32_t maxGain = gainInfo.max().get<int32_t>();
+
+	/*
+	 * Favour the exposure time over the gain to minimize noise. The gain
+	 * is assumed to be linear, which is only a rough approximation for
+	 * most sensors.
+	 */
+	double target = static_cast<double>(std::max(exposure_, 1))
+		      * std::max(gain_, 1) * ratio;
+	int32_t exposure = std::min(std::max<int32_t>(target / minGain, minExposure),
+				    maxExposure);
+	int32_t gain = std::min(std::max<int32_t>(target / exposure, minGain),
+				maxGain);
+
+	if (exposure == exposure_ && gain == gain_)
+		return;
+
+	ControlList ctrls(sensor_->controls());
+	ctrls.set(V4L2_CID_EXPOSURE, exposure);
+	ctrls.set(V4L2_CID_ANALOGUE_GAIN, gain);
+	if (sensor_->setControls(&ctrls) < 0)
+		return;
+
+	LOG(SimplePipeline, Debug)
+		<< "Mean luminance " << mean << ", setting exposure "
+		<< exposure << " and gain " << gain;
+
+	exposure_ = exposure;
+	gain_ = gain;
+	exposureDelay_ = ExposureDelay;
+}
+
 /* -----------------------------------------------------------------------------
  * Camera Configuration
  */
@@ -412,7 +572,7 @@ int SimpleCameraData::setupFormats(V4L2SubdeviceFormat *format,
 SimpleCameraConfiguration::SimpleCameraConfiguration(Camera *camera,
 						     SimpleCameraData *data)
 	: CameraConfiguration(), camera_(camera->shared_from_this()),
-	  data_(data)
+	  data_(data), pipeConfig_(nullptr), needConversion_(false)
 {
 }
 
@@ -424,38 +584,79 @@ CameraConfiguration::Status SimpleCameraConfiguration::validate()
 		return Invalid;
 
 	/* Cap the number of entries to the available streams. */
-	if (config_.size() > 1) {
-		config_.resize(1);
+	if (config_.size() > data_->streams_.size()) {
+		config_.resize(data_->streams_.size());
 		status = Adjusted;
 	}
 
-	StreamConfiguration &cfg = config_[0];
-
-	/* Adjust the pixel format. */
-	auto it = data_->formats_.find(cfg.pixelFormat);
+	/*
+	 * Select the pipeline configuration from the pixel format of the first
+	 * stream. All streams are produced from the same captured frames, the
+	 * pixel formats of the other streams must thus be achievable with the
+	 * same pipeline configuration.
+	 */
+	auto it = data_->formats_.find(config_[0].pixelFormat);
 	if (it == data_->formats_.end())
 		it = data_->formats_.begin();
 
-	PixelFormat pixelFormat = it->first;
-	if (cfg.pixelFormat != pixelFormat) {
-		LOG(SimplePipeline, Debug) << "Adjusting pixel format";
-		cfg.pixelFormat = pixelFormat;
-		status = Adjusted;
-	}
+	pipeConfig_ = &it->second;
 
-	const SimpleCameraData::Configuration &pipeConfig = it->second;
-	if (!pipeConfig.outputSizes.contains(cfg.size)) {
-		LOG(SimplePipeline, Debug)
-			<< "Adjusting size from " << cfg.size.toString()
-			<< " to " << pipeConfig.captureSize.toString();
-		cfg.size = pipeConfig.captureSize;
-		status = Adjusted;
-	}
+	auto compatible = [&](const SimpleCameraData::Configuration &config) {
+		return config.code == pipeConfig_->code &&
+		       config.pixelFormat == pipeConfig_->pixelFormat &&
+		       config.captureSize == pipeConfig_->captureSize;
+	};
+
+	/* Multiple streams can only be produced by the converter. */
+	needConversion_ = config_.size() > 1;
 
-	needConversion_ = cfg.pixelFormat != pipeConfig.pixelFormat
-			|| cfg.size != pipeConfig.captureSize;
+	for (StreamConfiguration &cfg : config_) {
+		/* Adjust the pixel format. */
+		auto format = data_->formats_.find(cfg.pixelFormat);
+		if (format == data_->formats_.end() || !compatible(format->second))
+			format = it;
 
-	cfg.bufferCount = 3;
+		/*
+		 * The converter can't pass the captured format through. When
+		 * all streams go through the converter, pick a converted format
+		 * for streams that request the captured format.
+		 */
+		if (needConversion_ && format->first == format->second.pixelFormat) {
+			format = std::find_if(data_->formats_.begin(),
+					      data_->formats_.end(),
+					      [&](const auto &f) {
+						      return f.first != f.second.pixelFormat &&
+							     compatible(f.second);
+					      });
+			if (format == data_->formats_.end()) {
+				LOG(SimplePipeline, Error)
+					<< "No converted format available for "
+					<< config_.size() << " streams";
+				return Invalid;
+			}
+		}
+
+		PixelFormat pixelFormat = format->first;
+		if (cfg.pixelFormat != pixelFormat) {
+			LOG(SimplePipeline, Debug) << "Adjusting pixel format";
+			cfg.pixelFormat = pixelFormat;
+			status = Adjusted;
+		}
+
+		const SimpleCameraData::Configuration &pipeConfig = format->second;
+		if (!pipeConfig.outputSizes.contains(cfg.size)) {
+			LOG(SimplePipeline, Debug)
+				<< "Adjusting size from " << cfg.size.toString()
+				<< " to " << pipeConfig.captureSize.toString();
+			cfg.size = pipeConfig.captureSize;
+			status = Adjusted;
+		}
+
+		needConversion_ |= cfg.pixelFormat != pipeConfig.pixelFormat
+				|| cfg.size != pipeConfig.captureSize;
+
+		cfg.bufferCount = 3;
+	}
 
 	return status;
 }
@@ -504,7 +705,8 @@ CameraConfiguration *SimplePipelineHandler::generateConfiguration(Camera *camera
 	cfg.pixelFormat = formats.begin()->first;
 	cfg.size = formats.begin()->second[0].max;
 
-	config->addConfiguration(cfg);
+	for (unsigned int i = 0; i < roles.size(); ++i)
+		config->addConfiguration(cfg);
 
 	config->validate();
 
@@ -517,7 +719,6 @@ int SimplePipelineHandler::configure(Camera *camera, CameraConfiguration *c)
 		static_cast<SimpleCameraConfiguration *>(c);
 	SimpleCameraData *data = cameraData(camera);
 	V4L2VideoDevice *video = data->video_;
-	StreamConfiguration &cfg = config->at(0);
 	int ret;
 
 	/*
@@ -528,8 +729,7 @@ int SimplePipelineHandler::configure(Camera *camera, CameraConfiguration *c)
 	if (ret < 0)
 		return ret;
 
-	const SimpleCameraData::Configuration &pipeConfig =
-		data->formats_[cfg.pixelFormat];
+	const SimpleCameraData::Configuration &pipeConfig = *config->pipeConfig();
 
 	V4L2SubdeviceFormat format{ pipeConfig.code, data->sensor_->resolution() };
 
@@ -557,25 +757,52 @@ int SimplePipelineHandler::configure(Camera *camera, CameraConfiguration *c)
 		return -EINVAL;
 	}
 
-	cfg.stride = captureFormat.planes[0].bpl;
-
 	/* Configure the converter if required. */
 	useConverter_ = config->needConversion();
 
-	if (useConverter_) {
-		int ret = converter_->configure(pipeConfig.pixelFormat,
-						pipeConfig.captureSize, &cfg);
+	std::vector<std::reference_wrapper<StreamConfiguration>> outputCfgs;
+
+	for (unsigned int i = 0; i < config->size(); ++i) {
+		StreamConfiguration &cfg = config->at(i);
+
+		cfg.setStream(&data->streams_[i]);
+		cfg.stride = captureFormat.planes[0].bpl;
+
+		outputCfgs.push_back(cfg);
+	}
+
+	if (!useConverter_)
+		return 0;
+
+	StreamConfiguration inputCfg;
+	inputCfg.pixelFormat = pipeConfig.pixelFormat;
+	inputCfg.size = pipeConfig.captureSize;
+	inputCfg.stride = captureFormat.planes[0].bpl;
+	inputCfg.bufferCount = InternalBufferCount;
+
+	if (softwareIsp_) {
+		ret = softwareIsp_->configure(inputCfg.pixelFormat, inputCfg.size,
+					      inputCfg.stride, &config->at(0));
+		if (ret < 0) {
+			LOG(SimplePipeline, Error)
+				<< "Unable to configure software ISP";
+			return ret;
+		}
+
+		LOG(SimplePipeline, Debug) << "Using software ISP";
+	} else {
+		ret = converter_->configure(inputCfg, outputCfgs);
 		if (ret < 0) {
 			LOG(SimplePipeline, Error)
 				<< "Unable to configure converter";
 			return ret;
 		}
 
-		LOG(SimplePipeline, Debug) << "Using format converter";
+		LOG(SimplePipeline, Debug)
+			<< "Using format converter for " << outputCfgs.size()
+			<< " stream(s)";
 	}
 
-	cfg.setStream(&data->stream_);
-
 	return 0;
 }
 
@@ -586,11 +813,14 @@ int SimplePipelineHandler::exportFrameBuffers(Camera *camera, Stream *stream,
 	unsigned int count = stream->configuration().bufferCount;
 
 	/*
-	 * Export buffers on the converter or capture video node, depending on
-	 * whether the converter is used or not.
+	 * Export buffers on the software ISP, converter or capture video node,
+	 * depending on whether conversion is needed or not.
 	 */
-	if (useConverter_)
-		return converter_->exportBuffers(count, buffers);
+	if (useConverter_ && softwareIsp_)
+		return softwareIsp_->exportBuffers(count, buffers);
+	else if (useConverter_)
+		return converter_->exportBuffers(data->streamIndex(stream),
+						 count, buffers);
 	else
 		return data->video_->exportBuffers(count, buffers);
 }
@@ -599,13 +829,20 @@ int SimplePipelineHandler::start(Camera *camera)
 {
 	SimpleCameraData *data = cameraData(camera);
 	V4L2VideoDevice *video = data->video_;
-	unsigned int count = data->stream_.configuration().bufferCount;
 	int ret;
 
-	if (useConverter_)
-		ret = video->allocateBuffers(count, &converterBuffers_);
-	else
+	/*
+	 * When using the converter, capture to internal buffers, independently
+	 * of the number of buffers of the streams to allow several frames to
+	 * be converted while the next ones are being captured.
+	 */
+	if (useConverter_) {
+		ret = video->allocateBuffers(InternalBufferCount,
+					     &converterBuffers_);
+	} else {
+		unsigned int count = data->streams_[0].configuration().bufferCount;
 		ret = video->importBuffers(count);
+	}
 	if (ret < 0)
 		return ret;
 
@@ -616,7 +853,12 @@ int SimplePipelineHandler::start(Camera *camera)
 	}
 
 	if (useConverter_) {
-		ret = converter_->start(count);
+		if (softwareIsp_) {
+			data->initExposure();
+			ret = softwareIsp_->start();
+		} else {
+			ret = converter_->start();
+		}
 		if (ret < 0) {
 			stop(camera);
 			return ret;
@@ -637,38 +879,57 @@ void SimplePipelineHandler::stop(Camera *camera)
 	SimpleCameraData *data = cameraData(camera);
 	V4L2VideoDevice *video = data->video_;
 
-	if (useConverter_)
+	if (useConverter_ && softwareIsp_)
+		softwareIsp_->stop();
+	else if (useConverter_)
 		converter_->stop();
 
 	video->streamOff();
 	video->releaseBuffers();
 
 	converterBuffers_.clear();
+	converterQueue_ = {};
 	activeCamera_ = nullptr;
 }
 
 int SimplePipelineHandler::queueRequestDevice(Camera *camera, Request *request)
 {
 	SimpleCameraData *data = cameraData(camera);
-	Stream *stream = &data->stream_;
+	std::map<unsigned int, FrameBuffer *> buffers;
 
-	FrameBuffer *buffer = request->findBuffer(stream);
-	if (!buffer) {
-		LOG(SimplePipeline, Error)
-			<< "Attempt to queue request with invalid stream";
-		return -ENOENT;
+	for (const auto &entry : request->buffers()) {
+		Stream *stream = entry.first;
+		FrameBuffer *buffer = entry.second;
+
+		/*
+		 * If conversion is needed, gather the buffers of all streams,
+		 * they will be handed to the converter in the capture
+		 * completion handler. Otherwise queue the buffer directly.
+		 */
+		if (useConverter_) {
+			buffers.emplace(data->streamIndex(stream), buffer);
+			continue;
+		}
+
+		int ret = data->video_->queueBuffer(buffer);
+		if (ret < 0)
+			return ret;
 	}
 
+	if (useConverter_)
+		converterQueue_.push(std::move(buffers));
+
+	return 0;
+}
+
+int SimplePipelineHandler::pauseDevice(Camera *camera)
+{
 	/*
-	 * If conversion is needed, push the buffer to the converter queue, it
-	 * will be handed to the converter in the capture completion handler.
+	 * Without requests, capture buffers are either not queued to the
+	 * device, or recycled without conversion by bufferReady(), there's
+	 * nothing to do.
 	 */
-	if (useConverter_) {
-		converterQueue_.push(buffer);
-		return 0;
-	}
-
-	return data->video_->queueBuffer(buffer);
+	return 0;
 }
 
 /* -----------------------------------------------------------------------------
@@ -723,11 +984,26 @@ bool SimplePipelineHandler::match(DeviceEnumerator *enumerator)
 				<< "Failed to open converter, disabling format conversion";
 			delete converter_;
 			converter_ = nullptr;
+		} else {
+			converter_->inputBufferReady.connect(this, &SimplePipelineHandler::converterInputDone);
+			converter_->outputBufferReady.connect(this, &SimplePipelineHandler::converterOutputDone);
 		}
+	}
 
-		converter_->bufferReady.connect(this, &SimplePipelineHandler::converterDone);
+	/*
+	 * Without a hardware converter, process raw frames on the CPU to
+	 * provide applications with RGB output.
+	 */
+	if (!converter_) {
+		softwareIsp_ = std::make_unique<SoftwareIsp>();
+		softwareIsp_->inputBufferReady.connect(this, &SimplePipelineHandler::converterInputDone);
+		softwareIsp_->outputBufferReady.connect(this, &SimplePipelineHandler::converterOutputDone);
+		softwareIsp_->statsReady.connect(this, &SimplePipelineHandler::ispStatsReady);
 	}
 
+	/* Only the hardware converter can produce multiple streams. */
+	unsigned int numStreams = converter_ ? MaxConverterStreams : 1;
+
 	/*
 	 * Create one camera data instance for each sensor and gather all
 	 * entities in all pipelines.
@@ -739,7 +1015,7 @@ bool SimplePipelineHandler::match(DeviceEnumerator *enumerator)
 
 	for (MediaEntity *sensor : sensors) {
 		std::unique_ptr<SimpleCameraData> data =
-			std::make_unique<SimpleCameraData>(this, sensor);
+			std::make_unique<SimpleCameraData>(this, numStreams, sensor);
 		if (!data->isValid()) {
 			LOG(SimplePipeline, Error)
 				<< "No valid pipeline for sensor '"
@@ -844,14 +1120,21 @@ void SimplePipelineHandler::bufferReady(FrameBuffer *buffer)
 			data->video_->queueBuffer(buffer);
 
 			/*
-			 * Get the next user-facing buffer to complete the
+			 * Get the next user-facing buffers to complete the
 			 * request.
 			 */
 			if (converterQueue_.empty())
 				return;
 
-			buffer = converterQueue_.front();
+			std::map<unsigned int, FrameBuffer *> outputs =
+				std::move(converterQueue_.front());
 			converterQueue_.pop();
+
+			Request *request = outputs.begin()->second->request();
+			for (const auto &output : outputs)
+				completeBuffer(activeCamera_, request, output.second);
+			completeRequest(activeCamera_, request);
+			return;
 		}
 
 		Request *request = buffer->request();
@@ -861,7 +1144,7 @@ void SimplePipelineHandler::bufferReady(FrameBuffer *buffer)
 	}
 
 	/*
-	 * Queue the captured and the request buffer to the converter if format
+	 * Queue the captured and the request buffers to the converter if format
 	 * conversion is needed. If there's no queued request, just requeue the
 	 * captured buffer for capture.
 	 */
@@ -871,10 +1154,34 @@ void SimplePipelineHandler::bufferReady(FrameBuffer *buffer)
 			return;
 		}
 
-		FrameBuffer *output = converterQueue_.front();
+		std::map<unsigned int, FrameBuffer *> outputs =
+			std::move(converterQueue_.front());
 		converterQueue_.pop();
 
-		converter_->queueBuffers(buffer, output);
+		int ret = softwareIsp_ ? softwareIsp_->queueBuffers(buffer, outputs)
+				       : converter_->queueBuffers(buffer, outputs);
+		if (ret < 0) {
+			/*
+			 * No buffer has been queued for conversion. Requeue
+			 * the captured buffer for capture and complete the
+			 * request with an error.
+			 */
+			LOG(SimplePipeline, Error)
+				<< "Failed to queue buffers for conversion: "
+				<< strerror(-ret);
+
+			data->video_->queueBuffer(buffer);
+
+			Request *request = outputs.begin()->second->request();
+			for (const auto &output : outputs) {
+				FrameMetadata &metadata = bufferMetadata(output.second);
+				metadata.status = FrameMetadata::FrameError;
+				metadata.planes.clear();
+				completeBuffer(activeCamera_, request, output.second);
+			}
+			completeRequest(activeCamera_, request);
+		}
+
 		return;
 	}
 
@@ -884,19 +1191,31 @@ void SimplePipelineHandler::bufferReady(FrameBuffer *buffer)
 	completeRequest(activeCamera_, request);
 }
 
-void SimplePipelineHandler::converterDone(FrameBuffer *input,
-					  FrameBuffer *output)
+void SimplePipelineHandler::converterInputDone(FrameBuffer *buffer)
 {
 	ASSERT(activeCamera_);
 	SimpleCameraData *data = cameraData(activeCamera_);
 
-	/* Complete the request. */
-	Request *request = output->request();
-	completeBuffer(activeCamera_, request, output);
-	completeRequest(activeCamera_, request);
-
 	/* Queue the input buffer back for capture. */
-	data->video_->queueBuffer(input);
+	data->video_->queueBuffer(buffer);
+}
+
+void SimplePipelineHandler::converterOutputDone(FrameBuffer *buffer)
+{
+	ASSERT(activeCamera_);
+
+	/* Complete the request when all its buffers have been converted. */
+	Request *request = buffer->request();
+	if (completeBuffer(activeCamera_, request, buffer))
+		completeRequest(activeCamera_, request);
+}
+
+void SimplePipelineHandler::ispStatsReady(const SoftwareIspStats &stats)
+{
+	ASSERT(activeCamera_);
+	SimpleCameraData *data = cameraData(activeCamera_);
+
+	data->updateExposure(stats);
 }
 
 REGISTER_PIPELINE_HANDLER(SimplePipelineHandler);
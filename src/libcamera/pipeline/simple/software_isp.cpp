@@ -0,0 +1,676 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * software_isp.cpp - CPU-based image processing for simple pipeline handler
+ */
+
+#include "software_isp.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <map>
+#include <string.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+#include <linux/drm_fourcc.h>
+
+#include <libcamera/buffer.h>
+#include <libcamera/file_descriptor.h>
+#include <libcamera/geometry.h>
+#include <libcamera/span.h>
+#include <libcamera/stream.h>
+
+#include "libcamera/internal/log.h"
+#include "libcamera/internal/pipeline_handler.h"
+
+#include "software_isp_kernels.h"
+
+/*
+ * The software ISP converts raw Bayer frames to RGB on the CPU. Processing
+ * runs in a dedicated thread to avoid blocking the pipeline handler, and each
+ * frame is split in horizontal bands processed concurrently by a pool of
+ * helper threads.
+ *
+ * Every line goes through the following stages:
+ *
+ * - Unpacking of the raw samples to 16-bit values
+ * - Bilinear demosaicing to 16-bit RGB
+ * - Statistics gathering, on a subsampled grid
+ * - Black level correction, white balance gains and gamma
+ *
+ * The black level, white balance gains and gamma are combined into per-colour
+ * lookup tables producing 8-bit output, rebuilt whenever the gains change.
+ *
+ * Neither the sensor nor the simple pipeline handler provide tuning data. The
+ * black level is thus fixed to 64 at 10 bits, scaled to the sample size, which
+ * matches most raw sensors, and no colour correction is applied.
+ *
+ * The line processing kernels are implemented in software_isp_kernels.cpp.
+ *
+ * White balance gains are computed by a grey world algorithm from the
+ * statistics of the previous frame. The statistics are also reported to the
+ * pipeline handler through the statsReady signal to control the exposure.
+ */
+
+namespace libcamera {
+
+LOG_DECLARE_CATEGORY(SimplePipeline);
+
+using namespace softisp;
+
+namespace {
+
+/* Cap the number of threads to the number of cores on typical embedded SoCs. */
+constexpr unsigned int MaxThreads = 4;
+
+/* Limits and speed of the white balance gains. */
+constexpr double AwbMinGain = 0.25;
+constexpr double AwbMaxGain = 4.0;
+constexpr double AwbSpeed = 0.2;
+
+#define CSI2P(fourcc) PixelFormat(fourcc, MIPI_FORMAT_MOD_CSI2_PACKED)
+
+const std::map<PixelFormat, InputFormat> inputFormats{
+	{ PixelFormat(DRM_FORMAT_SBGGR8), { 8, Packing::None8, false, false } },
+	{ PixelFormat(DRM_FORMAT_SGBRG8), { 8, Packing::None8, true, false } },
+	{ PixelFormat(DRM_FORMAT_SGRBG8), { 8, Packing::None8, true, true } },
+	{ PixelFormat(DRM_FORMAT_SRGGB8), { 8, Packing::None8, false, true } },
+	{ PixelFormat(DRM_FORMAT_SBGGR10), { 10, Packing::None16, false, false } },
+	{ PixelFormat(DRM_FORMAT_SGBRG10), { 10, Packing::None16, true, false } },
+	{ PixelFormat(DRM_FORMAT_SGRBG10), { 10, Packing::None16, true, true } },
+	{ PixelFormat(DRM_FORMAT_SRGGB10), { 10, Packing::None16, false, true } },
+	{ CSI2P(DRM_FORMAT_SBGGR10), { 10, Packing::CSI2P10, false, false } },
+	{ CSI2P(DRM_FORMAT_SGBRG10), { 10, Packing::CSI2P10, true, false } },
+	{ CSI2P(DRM_FORMAT_SGRBG10), { 10, Packing::CSI2P10, true, true } },
+	{ CSI2P(DRM_FORMAT_SRGGB10), { 10, Packing::CSI2P10, false, true } },
+	{ PixelFormat(DRM_FORMAT_SBGGR12), { 12, Packing::None16, false, false } },
+	{ PixelFormat(DRM_FORMAT_SGBRG12), { 12, Packing::None16, true, false } },
+	{ PixelFormat(DRM_FORMAT_SGRBG12), { 12, Packing::None16, true, true } },
+	{ PixelFormat(DRM_FORMAT_SRGGB12), { 12, Packing::None16, false, true } },
+	{ CSI2P(DRM_FORMAT_SBGGR12), { 12, Packing::CSI2P12, false, false } },
+	{ CSI2P(DRM_FORMAT_SGBRG12), { 12, Packing::CSI2P12, true, false } },
+	{ CSI2P(DRM_FORMAT_SGRBG12), { 12, Packing::CSI2P12, true, true } },
+	{ CSI2P(DRM_FORMAT_SRGGB12), { 12, Packing::CSI2P12, false, true } },
+};
+
+#undef CSI2P
+
+/* DRM formats are defined in little-endian order. */
+const std::map<PixelFormat, OutputFormat> outputFormats{
+	{ PixelFormat(DRM_FORMAT_RGB888), { 3, 2, 1, 0, -1 } },
+	{ PixelFormat(DRM_FORMAT_BGR888), { 3, 0, 1, 2, -1 } },
+	{ PixelFormat(DRM_FORMAT_ARGB8888), { 4, 2, 1, 0, 3 } },
+	{ PixelFormat(DRM_FORMAT_ABGR8888), { 4, 0, 1, 2, 3 } },
+};
+
+} /* namespace */
+
+/* -----------------------------------------------------------------------------
+ * Worker
+ */
+
+class SoftwareIspHelper;
+
+class SoftwareIspWorker : public Object
+{
+public:
+	SoftwareIspWorker();
+	~SoftwareIspWorker();
+
+	int configure(const InputFormat &input, const OutputFormat &output,
+		      const Size &size, unsigned int inputStride,
+		      unsigned int outputStride, unsigned int bands);
+
+	void setHelpers(std::vector<std::unique_ptr<SoftwareIspHelper>> helpers)
+	{
+		helpers_ = std::move(helpers);
+	}
+
+	void process(FrameBuffer *input, FrameBuffer *output);
+	void sync() {}
+	void unmapBuffers();
+
+	void processBand(unsigned int index);
+	void bandDone();
+
+	std::atomic<bool> running_;
+
+	Signal<FrameBuffer *, FrameBuffer *, bool> processed;
+	Signal<const SoftwareIspStats &> statsReady;
+
+private:
+	struct Band {
+		unsigned int start;
+		unsigned int end;
+		std::vector<uint16_t> lines;
+		std::vector<uint16_t> rgb;
+		SoftwareIspStats stats;
+	};
+
+	uint8_t *map(const FrameBuffer *buffer, size_t size);
+	void unpackLine(unsigned int y, uint16_t *dst);
+	void updateLuts();
+	void updateGains(const SoftwareIspStats &stats);
+
+	InputFormat input_;
+	OutputFormat output_;
+	unsigned int width_;
+	unsigned int height_;
+	unsigned int inputStride_;
+	unsigned int outputStride_;
+	unsigned int blackLevel_;
+
+	std::vector<std::unique_ptr<SoftwareIspHelper>> helpers_;
+	std::vector<Band> bands_;
+
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	unsigned int pending_;
+
+	const uint8_t *src_;
+	uint8_t *dst_;
+	std::map<const FrameBuffer *, Span<uint8_t>> mappings_;
+
+	std::array<double, 3> gains_;
+
+	std::array<std::vector<uint8_t>, 3> lut_;
+	std::vector<uint8_t> gamma_;
+};
+
+class SoftwareIspHelper : public Object
+{
+public:
+	SoftwareIspHelper(SoftwareIspWorker *worker)
+		: worker_(worker)
+	{
+	}
+
+	void process(unsigned int band)
+	{
+		worker_->processBand(band);
+		worker_->bandDone();
+	}
+
+private:
+	SoftwareIspWorker *worker_;
+};
+
+SoftwareIspWorker::SoftwareIspWorker()
+	: running_(false), pending_(0), src_(nullptr), dst_(nullptr),
+	  gains_({ 1.0, 1.0, 1.0 })
+{
+	gamma_ = gammaCurve();
+}
+
+SoftwareIspWorker::~SoftwareIspWorker()
+{
+	unmapBuffers();
+}
+
+int SoftwareIspWorker::configure(const InputFormat &input,
+				 const OutputFormat &output, const Size &size,
+				 unsigned int inputStride,
+				 unsigned int outputStride, unsigned int bands)
+{
+	input_ = input;
+	output_ = output;
+	width_ = size.width;
+	height_ = size.height;
+	inputStride_ = inputStride;
+	outputStride_ = outputStride;
+
+	/* Use the fixed black level of 64 at 10 bits, scaled to the input. */
+	blackLevel_ = 16 << (input_.bits - 8);
+
+	/*
+	 * Split the frame in bands of even height to keep the Bayer phase
+	 * identical at the start of all bands.
+	 */
+	unsigned int bandHeight = ((height_ + bands - 1) / bands + 1) & ~1;
+
+	bands_.clear();
+	bands_.resize(bands);
+
+	for (unsigned int i = 0; i < bands; ++i) {
+		Band &band = bands_[i];
+		band.start = std::min(i * bandHeight, height_);
+		band.end = std::min(band.start + bandHeight, height_);
+		band.lines.resize(3 * (width_ + 2));
+		band.rgb.resize(3 * width_);
+	}
+
+	gains_ = { 1.0, 1.0, 1.0 };
+	updateLuts();
+
+	return 0;
+}
+
+uint8_t *SoftwareIspWorker::map(const FrameBuffer *buffer, size_t size)
+{
+	auto it = mappings_.find(buffer);
+	if (it != mappings_.end())
+		return it->second.data();
+
+	const FrameBuffer::Plane &plane = buffer->planes()[0];
+	if (plane.length < size) {
+		LOG(SimplePipeline, Error)
+			<< "Buffer too small (" << plane.length << " < "
+			<< size << ")";
+		return nullptr;
+	}
+
+	void *mem = mmap(NULL, plane.length, PROT_READ | PROT_WRITE,
+			 MAP_SHARED, plane.fd.fd(), 0);
+	if (mem == MAP_FAILED) {
+		LOG(SimplePipeline, Error)
+			<< "Failed to map buffer: " << strerror(errno);
+		return nullptr;
+	}
+
+	Span<uint8_t> data{ static_cast<uint8_t *>(mem), plane.length };
+	mappings_.emplace(buffer, data);
+
+	return data.data();
+}
+
+void SoftwareIspWorker::unmapBuffers()
+{
+	for (const auto &mapping : mappings_)
+		munmap(mapping.second.data(), mapping.second.size());
+
+	mappings_.clear();
+}
+
+void SoftwareIspWorker::process(FrameBuffer *input, FrameBuffer *output)
+{
+	if (!running_)
+		return;
+
+	src_ = map(input, inputStride_ * height_);
+	dst_ = map(output, outputStride_ * height_);
+	if (!src_ || !dst_) {
+		processed.emit(input, output, false);
+		return;
+	}
+
+	/* Process the first band locally and the other ones in the helpers. */
+	{
+		MutexLocker locker(mutex_);
+		pending_ = bands_.size() - 1;
+	}
+
+	for (unsigned int i = 1; i < bands_.size(); ++i)
+		helpers_[i - 1]->invokeMethod(&SoftwareIspHelper::process,
+					      ConnectionTypeQueued, i);
+
+	processBand(0);
+
+	{
+		MutexLocker locker(mutex_);
+		cv_.wait(locker, [&] { return pending_ == 0; });
+	}
+
+	/* Merge the statistics of all bands. */
+	SoftwareIspStats stats = bands_[0].stats;
+
+	for (unsigned int i = 1; i < bands_.size(); ++i) {
+		const SoftwareIspStats &band = bands_[i].stats;
+
+		for (unsigned int c = 0; c < 3; ++c)
+			stats.sum[c] += band.sum[c];
+		stats.samples += band.samples;
+		for (unsigned int j = 0; j < SoftwareIspStats::HistogramBins; ++j)
+			stats.histogram[j] += band.histogram[j];
+	}
+
+	updateGains(stats);
+
+	statsReady.emit(stats);
+	processed.emit(input, output, true);
+}
+
+void SoftwareIspWorker::bandDone()
+{
+	MutexLocker locker(mutex_);
+	if (--pending_ == 0)
+		cv_.notify_one();
+}
+
+void SoftwareIspWorker::unpackLine(unsigned int y, uint16_t *dst)
+{
+	const uint8_t *src = src_ + y * inputStride_;
+
+	/* Leave room for one sample of padding on each side. */
+	switch (input_.packing) {
+	case Packing::None8:
+		unpack8(src, dst + 1, width_);
+		break;
+	case Packing::None16:
+		unpack16(src, dst + 1, width_);
+		break;
+	case Packing::CSI2P10:
+		unpackCSI2P10(src, dst + 1, width_);
+		break;
+	case Packing::CSI2P12:
+		unpackCSI2P12(src, dst + 1, width_);
+		break;
+	}
+
+	/* Mirror the edges, preserving the Bayer phase. */
+	dst[0] = dst[2];
+	dst[width_ + 1] = dst[width_ - 1];
+}
+
+void SoftwareIspWorker::processBand(unsigned int index)
+{
+	Band &band = bands_[index];
+	SoftwareIspStats &stats = band.stats;
+	unsigned int lineSize = width_ + 2;
+
+	stats = {};
+
+	if (band.start == band.end)
+		return;
+
+	/* Lines are mirrored at the top and bottom, preserving the phase. */
+	auto mirror = [&](int y) -> unsigned int {
+		if (y < 0)
+			return 1;
+		if (y >= static_cast<int>(height_))
+			return height_ - 2;
+		return y;
+	};
+
+	/* Keep three unpacked lines in a ring buffer. */
+	uint16_t *lines[3] = {
+		&band.lines[0],
+		&band.lines[lineSize],
+		&band.lines[2 * lineSize],
+	};
+
+	unpackLine(mirror(band.start - 1), lines[0]);
+	unpackLine(band.start, lines[1]);
+
+	uint16_t *rgb = band.rgb.data();
+
+	for (unsigned int y = band.start; y < band.end; ++y) {
+		unpackLine(mirror(y + 1), lines[2]);
+
+		bool odd = y & 1;
+		bool greenFirst = input_.greenFirst ^ odd;
+		bool redLine = input_.redFirst ^ odd;
+
+		debayerFuncs[greenFirst][redLine](lines[0] + 1, lines[1] + 1,
+						  lines[2] + 1, rgb, width_);
+
+		/* Gather statistics on a subsampled grid. */
+		if (y % StatsStep == 0)
+			gatherStats(rgb, width_, input_.bits, blackLevel_, &stats);
+
+		uint8_t *dst = dst_ + y * outputStride_;
+
+		if (output_.bpp == 4)
+			colourLine<4>(rgb, dst, width_, output_, lut_);
+		else
+			colourLine<3>(rgb, dst, width_, output_, lut_);
+
+		std::rotate(lines, lines + 1, lines + 3);
+	}
+}
+
+void SoftwareIspWorker::updateLuts()
+{
+	buildLuts(input_.bits, blackLevel_, gains_, gamma_, &lut_);
+}
+
+void SoftwareIspWorker::updateGains(const SoftwareIspStats &stats)
+{
+	if (!stats.sum[0] || !stats.sum[1] || !stats.sum[2])
+		return;
+
+	/* Grey world: equalize the averages of the three colours. */
+	double green = stats.sum[1];
+	std::array<double, 3> gains;
+	gains[0] = std::min(std::max(green / stats.sum[0], AwbMinGain), AwbMaxGain);
+	gains[1] = 1.0;
+	gains[2] = std::min(std::max(green / stats.sum[2], AwbMinGain), AwbMaxGain);
+
+	/* Smooth the changes, and skip LUT updates when they're negligible. */
+	bool changed = false;
+
+	for (unsigned int c = 0; c < 3; c += 2) {
+		double gain = gains_[c] + (gains[c] - gains_[c]) * AwbSpeed;
+		if (std::abs(gain - gains_[c]) < 0.005)
+			continue;
+
+		gains_[c] = gain;
+		changed = true;
+	}
+
+	if (changed)
+		updateLuts();
+}
+
+/* -----------------------------------------------------------------------------
+ * Software ISP
+ */
+
+SoftwareIsp::SoftwareIsp()
+	: worker_(std::make_unique<SoftwareIspWorker>()), frameSize_(0),
+	  running_(false)
+{
+	unsigned int count = std::thread::hardware_concurrency();
+	count = std::min(std::max(count, 1U), MaxThreads);
+
+	/*
+	 * The worker runs in the first thread, and processes the first band
+	 * of each frame. The other threads run helpers for the other bands.
+	 */
+	std::vector<std::unique_ptr<SoftwareIspHelper>> helpers;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		threads_.push_back(std::make_unique<Thread>());
+
+		if (i == 0) {
+			worker_->moveToThread(threads_[i].get());
+			continue;
+		}
+
+		helpers.push_back(std::make_unique<SoftwareIspHelper>(worker_.get()));
+		helpers.back()->moveToThread(threads_[i].get());
+	}
+
+	worker_->setHelpers(std::move(helpers));
+
+	worker_->processed.connect(this, &SoftwareIsp::processed);
+	worker_->statsReady.connect(this, &SoftwareIsp::statsProcessed);
+}
+
+SoftwareIsp::~SoftwareIsp()
+{
+	stop();
+}
+
+std::vector<PixelFormat> SoftwareIsp::formats(PixelFormat input)
+{
+	if (inputFormats.find(input) == inputFormats.end())
+		return {};
+
+	std::vector<PixelFormat> formats;
+	for (const auto &format : outputFormats)
+		formats.push_back(format.first);
+
+	return formats;
+}
+
+SizeRange SoftwareIsp::sizes(const Size &input)
+{
+	/* Scaling isn't supported. */
+	return SizeRange(input);
+}
+
+int SoftwareIsp::configure(PixelFormat inputFormat, const Size &inputSize,
+			   unsigned int inputStride, StreamConfiguration *cfg)
+{
+	auto input = inputFormats.find(inputFormat);
+	if (input == inputFormats.end()) {
+		LOG(SimplePipeline, Error)
+			<< "Input format " << inputFormat.toString()
+			<< " not supported";
+		return -EINVAL;
+	}
+
+	auto output = outputFormats.find(cfg->pixelFormat);
+	if (output == outputFormats.end() || cfg->size != inputSize) {
+		LOG(SimplePipeline, Error)
+			<< "Output format not supported";
+		return -EINVAL;
+	}
+
+	if (inputSize.width < 2 || inputSize.height < 2 ||
+	    inputSize.width % 4 || inputSize.height % 2) {
+		LOG(SimplePipeline, Error)
+			<< "Input size " << inputSize.toString()
+			<< " not supported";
+		return -EINVAL;
+	}
+
+	cfg->stride = inputSize.width * output->second.bpp;
+	frameSize_ = cfg->stride * inputSize.height;
+
+	LOG(SimplePipeline, Debug)
+		<< "Configuring software ISP with " << threads_.size()
+		<< " threads";
+
+	return worker_->configure(input->second, output->second, inputSize,
+				  inputStride, cfg->stride, threads_.size());
+}
+
+int SoftwareIsp::exportBuffers(unsigned int count,
+			       std::vector<std::unique_ptr<FrameBuffer>> *buffers)
+{
+	for (unsigned int i = 0; i < count; ++i) {
+		int fd = memfd_create("libcamera-softisp", MFD_CLOEXEC);
+		if (fd < 0 || ftruncate(fd, frameSize_) < 0) {
+			int ret = -errno;
+			LOG(SimplePipeline, Error)
+				<< "Failed to allocate buffer: "
+				<< strerror(-ret);
+			if (fd >= 0)
+				::close(fd);
+			buffers->clear();
+			return ret;
+		}
+
+		FrameBuffer::Plane plane;
+		plane.fd = FileDescriptor(std::move(fd));
+		plane.length = frameSize_;
+
+		buffers->push_back(std::make_unique<FrameBuffer>(
+			std::vector<FrameBuffer::Plane>{ plane }));
+	}
+
+	return count;
+}
+
+int SoftwareIsp::start()
+{
+	for (std::unique_ptr<Thread> &thread : threads_)
+		thread->start();
+
+	worker_->running_ = true;
+	running_ = true;
+
+	return 0;
+}
+
+void SoftwareIsp::stop()
+{
+	if (!running_)
+		return;
+
+	/*
+	 * Skip processing of the queued frames and wait for the frame being
+	 * processed, if any, to complete.
+	 */
+	worker_->running_ = false;
+	worker_->invokeMethod(&SoftwareIspWorker::sync, ConnectionTypeBlocking);
+
+	for (std::unique_ptr<Thread> &thread : threads_) {
+		thread->exit();
+		thread->wait();
+	}
+
+	running_ = false;
+
+	worker_->unmapBuffers();
+
+	/* Cancel all the pending frames. */
+	while (!queue_.empty()) {
+		FrameBuffer *input = queue_.front().first;
+		FrameBuffer *output = queue_.front().second;
+		queue_.pop();
+
+		FrameMetadata &metadata = PipelineHandler::bufferMetadata(output);
+		metadata.status = FrameMetadata::FrameCancelled;
+		metadata.planes.clear();
+
+		outputBufferReady.emit(output);
+		inputBufferReady.emit(input);
+	}
+}
+
+int SoftwareIsp::queueBuffers(FrameBuffer *input,
+			      const std::map<unsigned int, FrameBuffer *> &outputs)
+{
+	if (!running_)
+		return -EINVAL;
+
+	/* Only a single output is supported. */
+	auto it = outputs.find(0);
+	if (outputs.size() != 1 || it == outputs.end())
+		return -EINVAL;
+
+	FrameBuffer *output = it->second;
+
+	queue_.push({ input, output });
+
+	worker_->invokeMethod(&SoftwareIspWorker::process,
+			      ConnectionTypeQueued, input, output);
+
+	return 0;
+}
+
+void SoftwareIsp::processed(FrameBuffer *input, FrameBuffer *output,
+			    bool success)
+{
+	/* Ignore frames that were cancelled when stopping. */
+	if (!running_ || queue_.empty() || queue_.front().second != output)
+		return;
+
+	queue_.pop();
+
+	FrameMetadata &metadata = PipelineHandler::bufferMetadata(output);
+	metadata.status = success ? FrameMetadata::FrameSuccess
+				  : FrameMetadata::FrameError;
+	metadata.sequence = input->metadata().sequence;
+	metadata.timestamp = input->metadata().timestamp;
+	metadata.planes.clear();
+	metadata.planes.push_back({ static_cast<unsigned int>(frameSize_) });
+
+	outputBufferReady.emit(output);
+	inputBufferReady.emit(input);
+}
+
+void SoftwareIsp::statsProcessed(const SoftwareIspStats &stats)
+{
+	if (running_)
+		statsReady.emit(stats);
+}
+
+} /* namespace libcamera */
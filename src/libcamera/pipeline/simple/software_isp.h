@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * software_isp.h - CPU-based image processing for simple pipeline handler
+ */
+
+#ifndef __LIBCAMERA_PIPELINE_SIMPLE_SOFTWARE_ISP_H__
+#define __LIBCAMERA_PIPELINE_SIMPLE_SOFTWARE_ISP_H__
+
+#include <array>
+#include <map>
+#include <memory>
+#include <queue>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include <libcamera/object.h>
+#include <libcamera/pixelformats.h>
+#include <libcamera/signal.h>
+
+#include "libcamera/internal/thread.h"
+
+namespace libcamera {
+
+class FrameBuffer;
+struct Size;
+class SizeRange;
+struct StreamConfiguration;
+class SoftwareIspWorker;
+
+struct SoftwareIspStats {
+	static constexpr unsigned int HistogramBins = 64;
+
+	/* Sums of the black level corrected R, G and B samples. */
+	std::array<uint64_t, 3> sum;
+	unsigned int samples;
+
+	/* Histogram of the black level corrected luminance. */
+	std::array<uint32_t, HistogramBins> histogram;
+};
+
+class SoftwareIsp : public Object
+{
+public:
+	SoftwareIsp();
+	~SoftwareIsp();
+
+	std::vector<PixelFormat> formats(PixelFormat input);
+	SizeRange sizes(const Size &input);
+
+	int configure(PixelFormat inputFormat, const Size &inputSize,
+		      unsigned int inputStride, StreamConfiguration *cfg);
+	int exportBuffers(unsigned int count,
+			  std::vector<std::unique_ptr<FrameBuffer>> *buffers);
+
+	int start();
+	void stop();
+
+	int queueBuffers(FrameBuffer *input,
+			 const std::map<unsigned int, FrameBuffer *> &outputs);
+
+	Signal<FrameBuffer *> inputBufferReady;
+	Signal<FrameBuffer *> outputBufferReady;
+	Signal<const SoftwareIspStats &> statsReady;
+
+private:
+	void processed(FrameBuffer *input, FrameBuffer *output, bool success);
+	void statsProcessed(const SoftwareIspStats &stats);
+
+	std::vector<std::unique_ptr<Thread>> threads_;
+	std::unique_ptr<SoftwareIspWorker> worker_;
+
+	size_t frameSize_;
+	bool running_;
+
+	std::queue<std::pair<FrameBuffer *, FrameBuffer *>> queue_;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_PIPELINE_SIMPLE_SOFTWARE_ISP_H__ */
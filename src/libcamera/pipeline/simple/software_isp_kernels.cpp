@@ -0,0 +1,130 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * software_isp_kernels.cpp - Line processing kernels of the software ISP
+ */
+
+#include "software_isp_kernels.h"
+
+#include <cmath>
+#include <string.h>
+
+/*
+ * The kernels are written as branchless loops over contiguous lines, with the
+ * Bayer phase resolved through template parameters, to let the compiler
+ * vectorize them for the target architecture.
+ */
+
+namespace libcamera {
+
+namespace softisp {
+
+void unpack8(const uint8_t *src, uint16_t *dst, unsigned int width)
+{
+	for (unsigned int x = 0; x < width; ++x)
+		dst[x] = src[x];
+}
+
+void unpack16(const uint8_t *src, uint16_t *dst, unsigned int width)
+{
+	memcpy(dst, src, width * sizeof(*dst));
+}
+
+void unpackCSI2P10(const uint8_t *src, uint16_t *dst, unsigned int width)
+{
+	/* Four samples are stored in five bytes, the last one holding LSBs. */
+	for (unsigned int x = 0; x < width; x += 4, src += 5) {
+		dst[x + 0] = (src[0] << 2) | ((src[4] >> 0) & 3);
+		dst[x + 1] = (src[1] << 2) | ((src[4] >> 2) & 3);
+		dst[x + 2] = (src[2] << 2) | ((src[4] >> 4) & 3);
+		dst[x + 3] = (src[3] << 2) | ((src[4] >> 6) & 3);
+	}
+}
+
+void unpackCSI2P12(const uint8_t *src, uint16_t *dst, unsigned int width)
+{
+	/* Two samples are stored in three bytes, the last one holding LSBs. */
+	for (unsigned int x = 0; x < width; x += 2, src += 3) {
+		dst[x + 0] = (src[0] << 4) | ((src[2] >> 0) & 15);
+		dst[x + 1] = (src[1] << 4) | ((src[2] >> 4) & 15);
+	}
+}
+
+const DebayerFunc debayerFuncs[2][2] = {
+	{ debayerLine<false, false>, debayerLine<false, true> },
+	{ debayerLine<true, false>, debayerLine<true, true> },
+};
+
+/*
+ * Accumulate the statistics of one line of \a rgb samples with \a bits of
+ * precision, subsampled horizontally by StatsStep. The luminance histogram
+ * covers the full range of the black level corrected samples.
+ */
+void gatherStats(const uint16_t *rgb, unsigned int width, unsigned int bits,
+		 unsigned int blackLevel, SoftwareIspStats *stats)
+{
+	unsigned int shift = bits - 6;
+
+	for (unsigned int x = 0; x < width; x += StatsStep) {
+		const uint16_t *p = &rgb[x * 3];
+		unsigned int r = std::max<int>(p[0] - blackLevel, 0);
+		unsigned int g = std::max<int>(p[1] - blackLevel, 0);
+		unsigned int b = std::max<int>(p[2] - blackLevel, 0);
+
+		stats->sum[0] += r;
+		stats->sum[1] += g;
+		stats->sum[2] += b;
+		stats->histogram[(r + 2 * g + b) >> (shift + 2)]++;
+	}
+
+	stats->samples += (width + StatsStep - 1) / StatsStep;
+}
+
+/*
+ * Build the sRGB gamma curve, mapping linear values with LinearBits of
+ * precision to 8-bit output.
+ */
+std::vector<uint8_t> gammaCurve()
+{
+	std::vector<uint8_t> gamma(LinearMax + 1);
+
+	for (unsigned int i = 0; i <= LinearMax; ++i) {
+		double v = static_cast<double>(i) / LinearMax;
+		v = v <= 0.0031308 ? v * 12.92 : 1.055 * std::pow(v, 1.0 / 2.4) - 0.055;
+		gamma[i] = std::lround(v * 255.0);
+	}
+
+	return gamma;
+}
+
+/*
+ * Build the per-colour lookup tables for samples with \a bits of precision,
+ * combining black level correction, white balance \a gains and the \a gamma
+ * curve to produce 8-bit output.
+ */
+void buildLuts(unsigned int bits, unsigned int blackLevel,
+	       const std::array<double, 3> &gains,
+	       const std::vector<uint8_t> &gamma,
+	       std::array<std::vector<uint8_t>, 3> *lut)
+{
+	unsigned int size = 1 << bits;
+	double range = size - 1 - blackLevel;
+
+	for (unsigned int c = 0; c < 3; ++c) {
+		std::vector<uint8_t> &output = (*lut)[c];
+
+		output.resize(size);
+
+		for (unsigned int i = 0; i < size; ++i) {
+			double v = (static_cast<double>(i) - blackLevel) / range;
+			v = std::min(std::max(v * gains[c], 0.0), 1.0);
+
+			output[i] = gamma[std::lround(v * LinearMax)];
+		}
+	}
+}
+
+} /* namespace softisp */
+
+} /* namespace libcamera */
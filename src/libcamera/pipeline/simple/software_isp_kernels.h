@@ -0,0 +1,134 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * software_isp_kernels.h - Line processing kernels of the software ISP
+ */
+
+#ifndef __LIBCAMERA_PIPELINE_SIMPLE_SOFTWARE_ISP_KERNELS_H__
+#define __LIBCAMERA_PIPELINE_SIMPLE_SOFTWARE_ISP_KERNELS_H__
+
+#include <algorithm>
+#include <array>
+#include <stdint.h>
+#include <vector>
+
+#include "software_isp.h"
+
+namespace libcamera {
+
+namespace softisp {
+
+/* Subsampling factor of the statistics, in both directions. */
+constexpr unsigned int StatsStep = 4;
+
+/* Precision of the linear values fed to the gamma curve. */
+constexpr unsigned int LinearBits = 12;
+constexpr unsigned int LinearMax = (1 << LinearBits) - 1;
+
+enum class Packing {
+	None8,
+	None16,
+	CSI2P10,
+	CSI2P12,
+};
+
+struct InputFormat {
+	unsigned int bits;
+	Packing packing;
+	/* Whether the first line starts with a green sample. */
+	bool greenFirst;
+	/* Whether the non-green samples of the first line are red. */
+	bool redFirst;
+};
+
+struct OutputFormat {
+	unsigned int bpp;
+	/* Byte offsets of the R, G and B components, and of alpha if any. */
+	unsigned int r;
+	unsigned int g;
+	unsigned int b;
+	int a;
+};
+
+void unpack8(const uint8_t *src, uint16_t *dst, unsigned int width);
+void unpack16(const uint8_t *src, uint16_t *dst, unsigned int width);
+void unpackCSI2P10(const uint8_t *src, uint16_t *dst, unsigned int width);
+void unpackCSI2P12(const uint8_t *src, uint16_t *dst, unsigned int width);
+
+/*
+ * Interpolate one line of Bayer samples to RGB. The \a prev, \a curr and \a next
+ * lines must be padded with one sample on each side. GreenFirst tells whether
+ * the line starts with a green sample, and RedLine whether the non-green
+ * samples of the line are red.
+ */
+template<bool GreenFirst, bool RedLine>
+void debayerLine(const uint16_t *prev, const uint16_t *curr,
+		 const uint16_t *next, uint16_t *rgb, unsigned int width)
+{
+	/* Index of the line colour and of the other non-green colour. */
+	constexpr unsigned int C = RedLine ? 0 : 2;
+	constexpr unsigned int O = RedLine ? 2 : 0;
+
+	auto green = [&](int x, uint16_t *out) {
+		out[C] = (curr[x - 1] + curr[x + 1]) >> 1;
+		out[1] = curr[x];
+		out[O] = (prev[x] + next[x]) >> 1;
+	};
+
+	auto other = [&](int x, uint16_t *out) {
+		out[C] = curr[x];
+		out[1] = (curr[x - 1] + curr[x + 1] + prev[x] + next[x]) >> 2;
+		out[O] = (prev[x - 1] + prev[x + 1] +
+			  next[x - 1] + next[x + 1]) >> 2;
+	};
+
+	for (int x = 0; x < static_cast<int>(width); x += 2, rgb += 6) {
+		if (GreenFirst) {
+			green(x, rgb);
+			other(x + 1, rgb + 3);
+		} else {
+			other(x, rgb);
+			green(x + 1, rgb + 3);
+		}
+	}
+}
+
+using DebayerFunc = void (*)(const uint16_t *, const uint16_t *,
+			     const uint16_t *, uint16_t *, unsigned int);
+
+/* Indexed by [greenFirst][redLine]. */
+extern const DebayerFunc debayerFuncs[2][2];
+
+template<unsigned int Bpp>
+void colourLine(const uint16_t *rgb, uint8_t *dst, unsigned int width,
+		const OutputFormat &format,
+		const std::array<std::vector<uint8_t>, 3> &lut)
+{
+	const uint8_t *lutR = lut[0].data();
+	const uint8_t *lutG = lut[1].data();
+	const uint8_t *lutB = lut[2].data();
+
+	for (unsigned int x = 0; x < width; ++x, rgb += 3, dst += Bpp) {
+		dst[format.r] = lutR[rgb[0]];
+		dst[format.g] = lutG[rgb[1]];
+		dst[format.b] = lutB[rgb[2]];
+		if (Bpp == 4)
+			dst[format.a] = 0xff;
+	}
+}
+
+void gatherStats(const uint16_t *rgb, unsigned int width, unsigned int bits,
+		 unsigned int blackLevel, SoftwareIspStats *stats);
+
+std::vector<uint8_t> gammaCurve();
+void buildLuts(unsigned int bits, unsigned int blackLevel,
+	       const std::array<double, 3> &gains,
+	       const std::vector<uint8_t> &gamma,
+	       std::array<std::vector<uint8_t>, 3> *lut);
+
+} /* namespace softisp */
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_PIPELINE_SIMPLE_SOFTWARE_ISP_KERNELS_H__ */
@@ -75,6 +75,7 @@ public:
 	void stop(Camera *camera) override;
 
 	int queueRequestDevice(Camera *camera, Request *request) override;
+	int pauseDevice(Camera *camera) override;
 
 	bool match(DeviceEnumerator *enumerator) override;
 
@@ -371,6 +372,15 @@ int PipelineHandlerUVC::queueRequestDevice(Camera *camera, Request *request)
 	return 0;
 }
 
+int PipelineHandlerUVC::pauseDevice(Camera *camera)
+{
+	/*
+	 * Buffers are only queued to the device with requests, and the driver
+	 * drops frames while it has no buffer, there's nothing to do.
+	 */
+	return 0;
+}
+
 bool PipelineHandlerUVC::match(DeviceEnumerator *enumerator)
 {
 	MediaDevice *media;
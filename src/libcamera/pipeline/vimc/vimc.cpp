@@ -92,6 +92,7 @@ public:
 	void stop(Camera *camera) override;
 
 	int queueRequestDevice(Camera *camera, Request *request) override;
+	int pauseDevice(Camera *camera) override;
 
 	bool match(DeviceEnumerator *enumerator) override;
 
@@ -377,6 +378,15 @@ int PipelineHandlerVimc::queueRequestDevice(Camera *camera, Request *request)
 	return 0;
 }
 
+int PipelineHandlerVimc::pauseDevice(Camera *camera)
+{
+	/*
+	 * Buffers are only queued to the device with requests, and the driver
+	 * drops frames while it has no buffer. Keep the IPA running.
+	 */
+	return 0;
+}
+
 bool PipelineHandlerVimc::match(DeviceEnumerator *enumerator)
 {
 	DeviceMatch dm("vimc");
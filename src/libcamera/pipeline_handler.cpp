@@ -90,6 +90,21 @@ LOG_DEFINE_CATEGORY(Pipeline)
  * PipelineHandler::completeRequest()
  */
 
+/**
+ * \var CameraData::heldRequests_
+ * \brief The list of requests queued while the camera is paused
+ *
+ * Requests queued while the camera is paused are held in this list, in
+ * addition to the queuedRequests_ list, until the camera is resumed.
+ *
+ * \sa PipelineHandler::pause(), PipelineHandler::resume()
+ */
+
+/**
+ * \var CameraData::paused_
+ * \brief True if the camera is paused, false otherwise
+ */
+
 /**
  * \var CameraData::controlInfo_
  * \brief The set of controls supported by the camera
@@ -387,6 +402,9 @@ const ControlList &PipelineHandler::properties(Camera *camera)
  * when the pipeline handler is stopped with stop(). Request completion shall be
  * signalled by the pipeline handler using the completeRequest() method.
  *
+ * If the camera is paused, the request is held and only passed to
+ * queueRequestDevice() when the camera is resumed.
+ *
  * \context This function is called from the CameraManager thread.
  *
  * \return 0 on success or a negative error code otherwise
@@ -396,6 +414,11 @@ int PipelineHandler::queueRequest(Camera *camera, Request *request)
 	CameraData *data = cameraData(camera);
 	data->queuedRequests_.push_back(request);
 
+	if (data->paused_) {
+		data->heldRequests_.push_back(request);
+		return 0;
+	}
+
 	int ret = queueRequestDevice(camera, request);
 	if (ret)
 		data->queuedRequests_.remove(request);
@@ -420,6 +443,122 @@ int PipelineHandler::queueRequest(Camera *camera, Request *request)
  * \return 0 on success or a negative error code otherwise
  */
 
+/**
+ * \brief Pause a running camera
+ * \param[in] camera The camera to pause
+ *
+ * This method pauses the \a camera without stopping it. The requests already
+ * passed to queueRequestDevice() complete normally, while requests queued
+ * from now on are held until the camera is resumed with resume(). The
+ * pipeline handler is notified through pauseDevice(), which shall succeed
+ * for the camera to be paused.
+ *
+ * \context This function is called from the CameraManager thread.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int PipelineHandler::pause(Camera *camera)
+{
+	CameraData *data = cameraData(camera);
+
+	int ret = pauseDevice(camera);
+	if (ret)
+		return ret;
+
+	data->paused_ = true;
+
+	return 0;
+}
+
+/**
+ * \brief Resume a paused camera
+ * \param[in] camera The camera to resume
+ *
+ * This method notifies the pipeline handler through resumeDevice(), and then
+ * queues the requests held while the camera was paused to the device in order.
+ * Requests that fail to be queued are cancelled.
+ *
+ * \context This function is called from the CameraManager thread.
+ */
+void PipelineHandler::resume(Camera *camera)
+{
+	CameraData *data = cameraData(camera);
+
+	data->paused_ = false;
+	resumeDevice(camera);
+
+	while (!data->heldRequests_.empty()) {
+		Request *request = data->heldRequests_.front();
+		data->heldRequests_.pop_front();
+
+		int ret = queueRequestDevice(camera, request);
+		if (ret) {
+			LOG(Pipeline, Error)
+				<< "Failed to queue held request: " << ret;
+			cancelRequest(camera, request);
+		}
+	}
+}
+
+/**
+ * \brief Cancel the requests held while the camera was paused
+ * \param[in] camera The camera
+ *
+ * This method is called when a paused camera is stopped, after stop(), or
+ * disconnected, to cancel the requests that have been held and never passed
+ * to the device.
+ *
+ * \context This function is called from the CameraManager thread.
+ */
+void PipelineHandler::cancelHeldRequests(Camera *camera)
+{
+	CameraData *data = cameraData(camera);
+
+	data->paused_ = false;
+
+	while (!data->heldRequests_.empty()) {
+		Request *request = data->heldRequests_.front();
+		data->heldRequests_.pop_front();
+		cancelRequest(camera, request);
+	}
+}
+
+/**
+ * \brief Prepare the device for the camera to be paused
+ * \param[in] camera The camera to pause
+ *
+ * Pipeline handlers that support pausing shall reimplement this method. The
+ * device shall keep streaming and the buffers shall stay allocated, as the
+ * device will be starved from buffers for as long as the camera is paused.
+ * Pipeline handlers shall ensure that running without buffers, and stop() being
+ * called while paused, are handled gracefully.
+ *
+ * The default implementation doesn't support pausing.
+ *
+ * \context This function is called from the CameraManager thread.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENOTSUP The pipeline handler doesn't support pausing
+ */
+int PipelineHandler::pauseDevice(Camera *camera)
+{
+	return -ENOTSUP;
+}
+
+/**
+ * \brief Prepare the device for the camera to be resumed
+ * \param[in] camera The camera to resume
+ *
+ * This method is called when a paused camera is resumed, before the requests
+ * held while paused are queued with queueRequestDevice(). The default
+ * implementation does nothing.
+ *
+ * \context This function is called from the CameraManager thread.
+ */
+void PipelineHandler::resumeDevice(Camera *camera)
+{
+}
+
 /**
  * \brief Complete a buffer for a request
  * \param[in] camera The camera the request belongs to
@@ -477,6 +616,36 @@ void PipelineHandler::completeRequest(Camera *camera, Request *request)
 	}
 }
 
+/**
+ * \brief Retrieve the metadata of a frame buffer for update
+ * \param[in] buffer The frame buffer
+ *
+ * The FrameBuffer metadata is read-only for applications. Pipeline handlers,
+ * and the components they use to process frames, call this function to fill
+ * the metadata of buffers that are not captured through a V4L2VideoDevice.
+ *
+ * \return A reference to the \a buffer metadata
+ */
+FrameMetadata &PipelineHandler::bufferMetadata(FrameBuffer *buffer)
+{
+	return buffer->metadata_;
+}
+
+/**
+ * \brief Cancel a request that hasn't been queued to the device
+ * \param[in] camera The camera the request belongs to
+ * \param[in] request The request to cancel
+ */
+void PipelineHandler::cancelRequest(Camera *camera, Request *request)
+{
+	request->cancel();
+
+	for (auto const &it : request->buffers())
+		completeBuffer(camera, request, it.second);
+
+	completeRequest(camera, request);
+}
+
 /**
  * \brief Register a camera to the camera manager and pipeline handler
  * \param[in] camera The camera to be added
@@ -539,9 +708,10 @@ void PipelineHandler::mediaDeviceDisconnected(MediaDevice *media)
  * \brief Device disconnection handler
  *
  * This virtual function is called to notify the pipeline handler that the
- * device it handles has been disconnected. It notifies all cameras created by
- * the pipeline handler that they have been disconnected, and unregisters them
- * from the camera manager.
+ * device it handles has been disconnected. It cancels the requests held for
+ * paused cameras, as the cameras can't be resumed or stopped anymore, notifies
+ * all cameras created by the pipeline handler that they have been
+ * disconnected, and unregisters them from the camera manager.
  *
  * The function can be overloaded by pipeline handlers to perform custom
  * operations at disconnection time. Any overloaded version shall call the
@@ -554,6 +724,7 @@ void PipelineHandler::disconnect()
 		if (!camera)
 			continue;
 
+		cancelHeldRequests(camera.get());
 		camera->disconnect();
 		manager_->removeCamera(camera.get());
 	}
@@ -214,6 +214,18 @@ void Request::complete()
 	status_ = cancelled_ ? RequestCancelled : RequestComplete;
 }
 
+/**
+ * \brief Cancel a request that hasn't been processed
+ *
+ * Mark all the pending buffers of the request as cancelled. The buffers shall
+ * then be completed with completeBuffer(), and the request with complete().
+ */
+void Request::cancel()
+{
+	for (FrameBuffer *buffer : pending_)
+		buffer->metadata_.status = FrameMetadata::FrameCancelled;
+}
+
 /**
  * \brief Complete a buffer for the request
  * \param[in] buffer The buffer that has completed
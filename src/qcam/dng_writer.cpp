@@ -8,8 +8,11 @@
 #include "dng_writer.h"
 
 #include <algorithm>
+#include <future>
 #include <iostream>
 #include <map>
+#include <thread>
+#include <vector>
 
 #include <tiffio.h>
 
@@ -152,11 +155,39 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 	}
 
 	/*
-	 * Scanline buffer, has to be large enough to store both a RAW scanline
-	 * or a thumbnail scanline. The latter will always be much smaller than
-	 * the former as we downscale by 16 in both directions.
+	 * Unpack the RAW image in horizontal bands, one per CPU, and store each
+	 * band as a separate TIFF strip. The bands are unpacked concurrently
+	 * while the thumbnail is generated, and are written to the file in
+	 * order as soon as they become available.
 	 */
-	uint8_t scanline[(config.size.width * info->bitsPerSample + 7) / 8];
+	const unsigned int width = config.size.width;
+	const unsigned int height = config.size.height;
+	const unsigned int lineLength = (width * info->bitsPerSample + 7) / 8;
+	const unsigned int numBands =
+		std::max(1U, std::min(std::thread::hardware_concurrency(),
+				      height / 16));
+	/* Round the band height up to an even number of lines. */
+	const unsigned int bandHeight = ((height + numBands - 1) / numBands + 1) & ~1U;
+
+	std::vector<uint8_t> image(lineLength * height);
+	std::vector<std::future<void>> bands;
+
+	for (unsigned int top = 0; top < height; top += bandHeight) {
+		unsigned int bottom = std::min(top + bandHeight, height);
+
+		bands.push_back(std::async(std::launch::async,
+			[=, &config, &image]() {
+				const uint8_t *row = static_cast<const uint8_t *>(data)
+						   + top * config.stride;
+				uint8_t *out = image.data() + top * lineLength;
+
+				for (unsigned int y = top; y < bottom; y++) {
+					info->packScanline(out, row, width);
+					row += config.stride;
+					out += lineLength;
+				}
+			}));
+	}
 
 	toff_t rawIFDOffset = 0;
 	toff_t exifIFDOffset = 0;
@@ -201,12 +232,13 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 	TIFFSetField(tif, TIFFTAG_EXIFIFD, exifIFDOffset);
 
 	/* Write the thumbnail. */
+	std::vector<uint8_t> scanline(width / 16 * 3);
 	const uint8_t *row = static_cast<const uint8_t *>(data);
-	for (unsigned int y = 0; y < config.size.height / 16; y++) {
-		info->thumbScanline(*info, &scanline, row,
-				    config.size.width / 16, config.stride);
+	for (unsigned int y = 0; y < height / 16; y++) {
+		info->thumbScanline(*info, scanline.data(), row, width / 16,
+				    config.stride);
 
-		if (TIFFWriteScanline(tif, &scanline, y, 0) != 1) {
+		if (TIFFWriteScanline(tif, scanline.data(), y, 0) != 1) {
 			std::cerr << "Failed to write thumbnail scanline"
 				  << std::endl;
 			TIFFClose(tif);
@@ -235,6 +267,7 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 	TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
 	TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
 	TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
+	TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, bandHeight);
 	TIFFSetField(tif, TIFFTAG_CFAREPEATPATTERNDIM, cfaRepeatPatternDim);
 	TIFFSetField(tif, TIFFTAG_CFAPATTERN, info->pattern);
 	TIFFSetField(tif, TIFFTAG_CFAPLANECOLOR, 3, cfaPlaneColor);
@@ -282,19 +315,19 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 	TIFFSetField(tif, TIFFTAG_BLACKLEVEL, 4, &blackLevel);
 	TIFFSetField(tif, TIFFTAG_WHITELEVEL, 1, &whiteLevel);
 
-	/* Write RAW content. */
-	row = static_cast<const uint8_t *>(data);
-	for (unsigned int y = 0; y < config.size.height; y++) {
-		info->packScanline(&scanline, row, config.size.width);
+	/* Write RAW content, one strip per band. */
+	for (unsigned int strip = 0; strip < bands.size(); strip++) {
+		unsigned int top = strip * bandHeight;
+		unsigned int lines = std::min(bandHeight, height - top);
 
-		if (TIFFWriteScanline(tif, &scanline, y, 0) != 1) {
-			std::cerr << "Failed to write RAW scanline"
-				  << std::endl;
+		bands[strip].wait();
+
+		if (TIFFWriteEncodedStrip(tif, strip, image.data() + top * lineLength,
+					  lines * lineLength) < 0) {
+			std::cerr << "Failed to write RAW strip" << std::endl;
 			TIFFClose(tif);
 			return -EINVAL;
 		}
-
-		row += config.stride;
 	}
 
 	/* Checkpoint the IFD to retrieve its offset, and write it out. */
@@ -7,6 +7,7 @@
 
 #include "main_window.h"
 
+#include <chrono>
 #include <iomanip>
 #include <string>
 #include <sys/mman.h>
@@ -501,6 +502,11 @@ void MainWindow::stopCapture()
 
 	camera_->requestCompleted.disconnect(this, &MainWindow::requestComplete);
 
+	/* Wait for pending DNG writes before unmapping the buffers. */
+	for (std::future<void> &write : rawWrites_)
+		write.wait();
+	rawWrites_.clear();
+
 	for (auto &iter : mappedBuffers_) {
 		const MappedBuffer &buffer = iter.second;
 		munmap(buffer.memory, buffer.size);
@@ -556,11 +562,33 @@ void MainWindow::processRaw(FrameBuffer *buffer, const ControlList &metadata)
 	QString filename = QFileDialog::getSaveFileName(this, "Save DNG", defaultPath,
 							"DNG Files (*.dng)");
 
+	/* Drop the writes that have completed. */
+	rawWrites_.remove_if([](const std::future<void> &write) {
+		return write.wait_for(std::chrono::seconds(0)) ==
+		       std::future_status::ready;
+	});
+
 	if (!filename.isEmpty()) {
+		/*
+		 * Write the DNG file in the background to avoid stalling the
+		 * UI. The buffer is returned to the free queue once the write
+		 * completes.
+		 */
 		const MappedBuffer &mapped = mappedBuffers_[buffer];
-		DNGWriter::write(filename.toStdString().c_str(), camera_.get(),
-				 rawStream_->configuration(), metadata, buffer,
-				 mapped.memory);
+		std::shared_ptr<Camera> camera = camera_;
+		const StreamConfiguration &config = rawStream_->configuration();
+		Stream *stream = rawStream_;
+
+		rawWrites_.push_back(std::async(std::launch::async,
+			[this, filename, camera, config, metadata, buffer, stream, mapped]() {
+				DNGWriter::write(filename.toStdString().c_str(),
+						 camera.get(), config, metadata,
+						 buffer, mapped.memory);
+
+				QMutexLocker locker(&mutex_);
+				freeBuffers_[stream].enqueue(buffer);
+			}));
+		return;
 	}
 #endif
 
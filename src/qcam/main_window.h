@@ -7,6 +7,8 @@
 #ifndef __QCAM_MAIN_WINDOW_H__
 #define __QCAM_MAIN_WINDOW_H__
 
+#include <future>
+#include <list>
 #include <memory>
 
 #include <QElapsedTimer>
@@ -123,6 +125,7 @@ private:
 	std::map<Stream *, QQueue<FrameBuffer *>> freeBuffers_;
 	QQueue<CaptureRequest> doneQueue_;
 	QMutex mutex_; /* Protects freeBuffers_ and doneQueue_ */
+	std::list<std::future<void>> rawWrites_;
 
 	uint64_t lastBufferTime_;
 	QElapsedTimer frameRateInterval_;
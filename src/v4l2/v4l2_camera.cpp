@@ -8,6 +8,9 @@
 #include "v4l2_camera.h"
 
 #include <errno.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "libcamera/internal/log.h"
 
@@ -16,7 +19,8 @@ using namespace libcamera;
 LOG_DECLARE_CATEGORY(V4L2Compat);
 
 V4L2Camera::V4L2Camera(std::shared_ptr<Camera> camera)
-	: camera_(camera), isRunning_(false), bufferAllocator_(nullptr)
+	: camera_(camera), isRunning_(false), efd_(-1),
+	  bufferAllocator_(nullptr), completedHead_(0), completedTail_(0)
 {
 	camera_->requestCompleted.connect(this, &V4L2Camera::requestComplete);
 }
@@ -53,22 +57,44 @@ void V4L2Camera::close()
 	camera_->release();
 }
 
+/*
+ * The event fd is signalled every time a buffer completes, and is read from
+ * when the buffer is dequeued. It backs the file descriptor handed to the
+ * application, which can thus poll() it for buffer availability.
+ */
+void V4L2Camera::bind(int efd)
+{
+	efd_ = efd;
+}
+
+void V4L2Camera::unbind()
+{
+	efd_ = -1;
+}
+
 void V4L2Camera::getStreamConfig(StreamConfiguration *streamConfig)
 {
 	*streamConfig = config_->at(0);
 }
 
-std::vector<V4L2Camera::Buffer> V4L2Camera::completedBuffers()
+/*
+ * Retrieve the oldest completed buffer, or nullptr if no buffer has completed.
+ * The buffer stays valid until releaseCompletedBuffer() is called. Only the
+ * application thread may call this.
+ */
+const V4L2Camera::Buffer *V4L2Camera::completedBuffer()
 {
-	std::vector<Buffer> v;
+	unsigned int tail = completedTail_.load(std::memory_order_relaxed);
+	if (tail == completedHead_.load(std::memory_order_acquire))
+		return nullptr;
 
-	bufferLock_.lock();
-	for (std::unique_ptr<Buffer> &metadata : completedBuffers_)
-		v.push_back(*metadata.get());
-	completedBuffers_.clear();
-	bufferLock_.unlock();
+	return &completedBuffers_[tail % MAX_BUFFERS];
+}
 
-	return v;
+void V4L2Camera::releaseCompletedBuffer()
+{
+	unsigned int tail = completedTail_.load(std::memory_order_relaxed);
+	completedTail_.store(tail + 1, std::memory_order_release);
 }
 
 void V4L2Camera::requestComplete(Request *request)
@@ -76,13 +102,32 @@ void V4L2Camera::requestComplete(Request *request)
 	if (request->status() == Request::RequestCancelled)
 		return;
 
-	/* We only have one stream at the moment. */
-	bufferLock_.lock();
+	/*
+	 * The ring can't overflow, as it's as large as the maximum number of
+	 * buffers, and buffers can't be queued again before being dequeued.
+	 */
+	unsigned int head = completedHead_.load(std::memory_order_relaxed);
+	if (head - completedTail_.load(std::memory_order_acquire) == MAX_BUFFERS) {
+		LOG(V4L2Compat, Error) << "Completed buffers ring overflow";
+		return;
+	}
+
+	/*
+	 * We only have one stream at the moment. Assigning the metadata
+	 * reuses the memory of the ring entry, avoiding allocations once all
+	 * entries have been used.
+	 */
 	FrameBuffer *buffer = request->buffers().begin()->second;
-	std::unique_ptr<Buffer> metadata =
-		std::make_unique<Buffer>(request->cookie(), buffer->metadata());
-	completedBuffers_.push_back(std::move(metadata));
-	bufferLock_.unlock();
+	Buffer &completed = completedBuffers_[head % MAX_BUFFERS];
+	completed.index = request->cookie();
+	completed.data = buffer->metadata();
+	completedHead_.store(head + 1, std::memory_order_release);
+
+	if (efd_ >= 0) {
+		uint64_t data = 1;
+		if (::write(efd_, &data, sizeof(data)) != sizeof(data))
+			LOG(V4L2Compat, Error) << "Failed to signal eventfd POLLIN";
+	}
 
 	bufferSema_.release();
 }
@@ -125,10 +170,57 @@ int V4L2Camera::allocBuffers(unsigned int count)
 	return bufferAllocator_->allocate(stream);
 }
 
+/*
+ * Import the dmabuf \a fd as the buffer at \a index. The FrameBuffer created
+ * for the dmabuf is cached, and reused when the same dmabuf is imported again
+ * at the same index, which keeps the dmabuf to V4L2 buffer mapping stable in
+ * the pipeline handler.
+ */
+int V4L2Camera::importBuffer(unsigned int index, int fd, unsigned int length)
+{
+	struct stat statbuf;
+	if (fstat(fd, &statbuf) < 0)
+		return -EBADF;
+
+	if (index >= importedBuffers_.size())
+		importedBuffers_.resize(index + 1);
+
+	ImportedBuffer &imported = importedBuffers_[index];
+	if (imported.buffer && imported.dev == statbuf.st_dev &&
+	    imported.ino == statbuf.st_ino &&
+	    imported.buffer->planes()[0].length == length)
+		return 0;
+
+	FrameBuffer::Plane plane;
+	plane.fd = FileDescriptor(fd);
+	plane.length = length;
+
+	imported.buffer = std::make_unique<FrameBuffer>(std::vector<FrameBuffer::Plane>{ plane });
+	imported.dev = statbuf.st_dev;
+	imported.ino = statbuf.st_ino;
+
+	return 0;
+}
+
 void V4L2Camera::freeBuffers()
 {
 	Stream *stream = *camera_->streams().begin();
 	bufferAllocator_->free(stream);
+	importedBuffers_.clear();
+}
+
+FrameBuffer *V4L2Camera::buffer(unsigned int index)
+{
+	if (index < importedBuffers_.size() && importedBuffers_[index].buffer)
+		return importedBuffers_[index].buffer.get();
+
+	Stream *stream = config_->at(0).stream();
+	const std::vector<std::unique_ptr<FrameBuffer>> &buffers =
+		bufferAllocator_->buffers(stream);
+	if (index >= buffers.size())
+		return nullptr;
+
+	return buffers[index].get();
 }
 
 FileDescriptor V4L2Camera::getBufferFd(unsigned int index)
@@ -190,9 +282,14 @@ int V4L2Camera::qbuf(unsigned int index)
 		return -ENOMEM;
 	}
 
+	FrameBuffer *frameBuffer = buffer(index);
+	if (!frameBuffer) {
+		LOG(V4L2Compat, Error) << "No buffer at index " << index;
+		return -EINVAL;
+	}
+
 	Stream *stream = config_->at(0).stream();
-	FrameBuffer *buffer = bufferAllocator_->buffers(stream)[index].get();
-	int ret = request->addBuffer(stream, buffer);
+	int ret = request->addBuffer(stream, frameBuffer);
 	if (ret < 0) {
 		LOG(V4L2Compat, Error) << "Can't set buffer for request";
 		return -ENOMEM;
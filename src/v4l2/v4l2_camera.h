@@ -8,9 +8,13 @@
 #ifndef __V4L2_CAMERA_H__
 #define __V4L2_CAMERA_H__
 
+#include <array>
+#include <atomic>
 #include <deque>
-#include <mutex>
+#include <linux/videodev2.h>
+#include <sys/types.h>
 #include <utility>
+#include <vector>
 
 #include <libcamera/buffer.h>
 #include <libcamera/camera.h>
@@ -25,28 +29,29 @@ class V4L2Camera
 {
 public:
 	struct Buffer {
-		Buffer(unsigned int index, const FrameMetadata &data)
-			: index(index), data(data)
-		{
-		}
-
 		unsigned int index;
 		FrameMetadata data;
 	};
 
+	static constexpr unsigned int MAX_BUFFERS = VIDEO_MAX_FRAME;
+
 	V4L2Camera(std::shared_ptr<Camera> camera);
 	~V4L2Camera();
 
 	int open();
 	void close();
+	void bind(int efd);
+	void unbind();
 	void getStreamConfig(StreamConfiguration *streamConfig);
-	std::vector<Buffer> completedBuffers();
+	const Buffer *completedBuffer();
+	void releaseCompletedBuffer();
 
 	int configure(StreamConfiguration *streamConfigOut,
 		      const Size &size, const PixelFormat &pixelformat,
 		      unsigned int bufferCount);
 
 	int allocBuffers(unsigned int count);
+	int importBuffer(unsigned int index, int fd, unsigned int length);
 	void freeBuffers();
 	FileDescriptor getBufferFd(unsigned int index);
 
@@ -58,18 +63,35 @@ public:
 	Semaphore bufferSema_;
 
 private:
+	struct ImportedBuffer {
+		dev_t dev;
+		ino_t ino;
+		std::unique_ptr<FrameBuffer> buffer;
+	};
+
 	void requestComplete(Request *request);
+	FrameBuffer *buffer(unsigned int index);
 
 	std::shared_ptr<Camera> camera_;
 	std::unique_ptr<CameraConfiguration> config_;
 
 	bool isRunning_;
 
-	std::mutex bufferLock_;
+	int efd_;
+
 	FrameBufferAllocator *bufferAllocator_;
+	std::vector<ImportedBuffer> importedBuffers_;
 
 	std::deque<std::unique_ptr<Request>> pendingRequests_;
-	std::deque<std::unique_ptr<Buffer>> completedBuffers_;
+
+	/*
+	 * Completed buffers, in a single producer single consumer ring
+	 * written by the camera manager thread and read by the application
+	 * thread.
+	 */
+	std::array<Buffer, MAX_BUFFERS> completedBuffers_;
+	std::atomic<unsigned int> completedHead_;
+	std::atomic<unsigned int> completedTail_;
 };
 
 #endif /* __V4L2_CAMERA_H__ */
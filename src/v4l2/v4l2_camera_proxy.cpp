@@ -10,9 +10,11 @@
 #include <algorithm>
 #include <array>
 #include <errno.h>
+#include <fcntl.h>
 #include <linux/videodev2.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <unistd.h>
 
 #include <libcamera/camera.h>
 #include <libcamera/object.h>
@@ -31,7 +33,8 @@ LOG_DECLARE_CATEGORY(V4L2Compat);
 
 V4L2CameraProxy::V4L2CameraProxy(unsigned int index,
 				 std::shared_ptr<Camera> camera)
-	: refcount_(0), index_(index), bufferCount_(0), currentBuf_(0),
+	: refcount_(0), index_(index), efd_(-1), bufferCount_(0),
+	  memory_(V4L2_MEMORY_MMAP), currentBuf_(0),
 	  vcam_(std::make_unique<V4L2Camera>(camera))
 {
 	querycap(camera);
@@ -58,6 +61,17 @@ int V4L2CameraProxy::open(bool nonBlocking)
 	return 0;
 }
 
+/*
+ * Bind the proxy to the eventfd returned to the application by open(). A
+ * private duplicate of \a fd is kept, to stay valid regardless of how the
+ * application duplicates and closes its file descriptors.
+ */
+void V4L2CameraProxy::bind(int fd)
+{
+	efd_ = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	vcam_->bind(efd_);
+}
+
 void V4L2CameraProxy::dup()
 {
 	refcount_++;
@@ -70,7 +84,13 @@ void V4L2CameraProxy::close()
 	if (--refcount_ > 0)
 		return;
 
+	vcam_->unbind();
 	vcam_->close();
+
+	if (efd_ >= 0) {
+		V4L2CompatManager::instance()->fops().close(efd_);
+		efd_ = -1;
+	}
 }
 
 void *V4L2CameraProxy::mmap(void *addr, size_t length, int prot, int flags,
@@ -135,7 +155,7 @@ bool V4L2CameraProxy::validateBufferType(uint32_t type)
 
 bool V4L2CameraProxy::validateMemoryType(uint32_t memory)
 {
-	return memory == V4L2_MEMORY_MMAP;
+	return memory == V4L2_MEMORY_MMAP || memory == V4L2_MEMORY_DMABUF;
 }
 
 void V4L2CameraProxy::setFmtFromConfig(StreamConfiguration &streamConfig)
@@ -186,10 +206,10 @@ void V4L2CameraProxy::querycap(std::shared_ptr<Camera> camera)
 
 void V4L2CameraProxy::updateBuffers()
 {
-	std::vector<V4L2Camera::Buffer> completedBuffers = vcam_->completedBuffers();
-	for (const V4L2Camera::Buffer &buffer : completedBuffers) {
-		const FrameMetadata &fmd = buffer.data;
-		struct v4l2_buffer &buf = buffers_[buffer.index];
+	const V4L2Camera::Buffer *buffer;
+	while ((buffer = vcam_->completedBuffer())) {
+		const FrameMetadata &fmd = buffer->data;
+		struct v4l2_buffer &buf = buffers_[buffer->index];
 
 		switch (fmd.status) {
 		case FrameMetadata::FrameSuccess:
@@ -207,6 +227,8 @@ void V4L2CameraProxy::updateBuffers()
 		default:
 			break;
 		}
+
+		vcam_->releaseCompletedBuffer();
 	}
 }
 
@@ -339,7 +361,11 @@ int V4L2CameraProxy::vidioc_reqbufs(struct v4l2_requestbuffers *arg)
 
 	LOG(V4L2Compat, Debug) << arg->count << " buffers requested ";
 
-	arg->capabilities = V4L2_BUF_CAP_SUPPORTS_MMAP;
+	if (arg->count > V4L2Camera::MAX_BUFFERS)
+		arg->count = V4L2Camera::MAX_BUFFERS;
+
+	arg->capabilities = V4L2_BUF_CAP_SUPPORTS_MMAP
+			  | V4L2_BUF_CAP_SUPPORTS_DMABUF;
 
 	if (arg->count == 0)
 		return freeBuffers();
@@ -359,11 +385,15 @@ int V4L2CameraProxy::vidioc_reqbufs(struct v4l2_requestbuffers *arg)
 
 	arg->count = streamConfig_.bufferCount;
 	bufferCount_ = arg->count;
-
-	ret = vcam_->allocBuffers(arg->count);
-	if (ret < 0) {
-		arg->count = 0;
-		return ret;
+	memory_ = arg->memory;
+
+	/* Imported buffers are provided by the application at qbuf time. */
+	if (memory_ == V4L2_MEMORY_MMAP) {
+		ret = vcam_->allocBuffers(arg->count);
+		if (ret < 0) {
+			arg->count = 0;
+			return ret;
+		}
 	}
 
 	buffers_.resize(arg->count);
@@ -371,8 +401,11 @@ int V4L2CameraProxy::vidioc_reqbufs(struct v4l2_requestbuffers *arg)
 		struct v4l2_buffer buf = {};
 		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 		buf.length = curV4L2Format_.fmt.pix.sizeimage;
-		buf.memory = V4L2_MEMORY_MMAP;
-		buf.m.offset = i * curV4L2Format_.fmt.pix.sizeimage;
+		buf.memory = memory_;
+		if (memory_ == V4L2_MEMORY_MMAP)
+			buf.m.offset = i * curV4L2Format_.fmt.pix.sizeimage;
+		else
+			buf.m.fd = -1;
 		buf.index = i;
 
 		buffers_[i] = buf;
@@ -404,10 +437,30 @@ int V4L2CameraProxy::vidioc_qbuf(struct v4l2_buffer *arg)
 			       << arg->index;
 
 	if (!validateBufferType(arg->type) ||
-	    !validateMemoryType(arg->memory) ||
+	    arg->memory != memory_ ||
 	    arg->index >= bufferCount_)
 		return -EINVAL;
 
+	if (memory_ == V4L2_MEMORY_DMABUF) {
+		unsigned int length = arg->length;
+		if (!length) {
+			off_t size = lseek(arg->m.fd, 0, SEEK_END);
+			if (size < 0)
+				return -EINVAL;
+			length = size;
+		}
+
+		if (length < sizeimage_)
+			return -EINVAL;
+
+		int ret = vcam_->importBuffer(arg->index, arg->m.fd, length);
+		if (ret < 0)
+			return -EINVAL;
+
+		buffers_[arg->index].m.fd = arg->m.fd;
+		buffers_[arg->index].length = length;
+	}
+
 	int ret = vcam_->qbuf(arg->index);
 	if (ret < 0)
 		return ret;
@@ -423,20 +476,28 @@ int V4L2CameraProxy::vidioc_dqbuf(struct v4l2_buffer *arg)
 	LOG(V4L2Compat, Debug) << "Servicing vidioc_dqbuf";
 
 	if (!validateBufferType(arg->type) ||
-	    !validateMemoryType(arg->memory))
+	    arg->memory != memory_)
 		return -EINVAL;
 
-	if (nonBlocking_ && !vcam_->bufferSema_.tryAcquire())
-		return -EAGAIN;
-	else
+	if (nonBlocking_) {
+		if (!vcam_->bufferSema_.tryAcquire())
+			return -EAGAIN;
+	} else {
 		vcam_->bufferSema_.acquire();
+	}
+
+	/* Consume the buffer completion event, to clear POLLIN when empty. */
+	uint64_t data;
+	if (efd_ >= 0 && ::read(efd_, &data, sizeof(data)) != sizeof(data))
+		LOG(V4L2Compat, Error) << "Failed to clear eventfd POLLIN";
 
 	updateBuffers();
 
 	struct v4l2_buffer &buf = buffers_[currentBuf_];
 
 	buf.flags &= ~V4L2_BUF_FLAG_QUEUED;
-	buf.length = sizeimage_;
+	if (memory_ == V4L2_MEMORY_MMAP)
+		buf.length = sizeimage_;
 	*arg = buf;
 
 	currentBuf_ = (currentBuf_ + 1) % bufferCount_;
@@ -444,6 +505,30 @@ int V4L2CameraProxy::vidioc_dqbuf(struct v4l2_buffer *arg)
 	return 0;
 }
 
+int V4L2CameraProxy::vidioc_expbuf(struct v4l2_exportbuffer *arg)
+{
+	LOG(V4L2Compat, Debug) << "Servicing vidioc_expbuf";
+
+	if (!validateBufferType(arg->type) ||
+	    memory_ != V4L2_MEMORY_MMAP ||
+	    arg->index >= bufferCount_ || arg->plane ||
+	    arg->flags & ~(O_CLOEXEC | O_ACCMODE))
+		return -EINVAL;
+
+	FileDescriptor fd = vcam_->getBufferFd(arg->index);
+	if (!fd.isValid())
+		return -EINVAL;
+
+	/* The access mode of a duplicated file descriptor can't be changed. */
+	int ret = ::fcntl(fd.fd(), arg->flags & O_CLOEXEC ? F_DUPFD_CLOEXEC : F_DUPFD, 0);
+	if (ret < 0)
+		return -errno;
+
+	arg->fd = ret;
+
+	return 0;
+}
+
 int V4L2CameraProxy::vidioc_streamon(int *arg)
 {
 	LOG(V4L2Compat, Debug) << "Servicing vidioc_streamon";
@@ -463,6 +548,15 @@ int V4L2CameraProxy::vidioc_streamoff(int *arg)
 
 	int ret = vcam_->streamOff();
 
+	/* Drop the completed buffers that haven't been dequeued. */
+	uint64_t data;
+	while (vcam_->bufferSema_.tryAcquire()) {
+		if (efd_ >= 0 && ::read(efd_, &data, sizeof(data)) != sizeof(data))
+			LOG(V4L2Compat, Error) << "Failed to clear eventfd POLLIN";
+	}
+	while (vcam_->completedBuffer())
+		vcam_->releaseCompletedBuffer();
+
 	for (struct v4l2_buffer &buf : buffers_)
 		buf.flags &= ~(V4L2_BUF_FLAG_QUEUED | V4L2_BUF_FLAG_DONE);
 
@@ -500,6 +594,9 @@ int V4L2CameraProxy::ioctl(unsigned long request, void *arg)
 	case VIDIOC_DQBUF:
 		ret = vidioc_dqbuf(static_cast<struct v4l2_buffer *>(arg));
 		break;
+	case VIDIOC_EXPBUF:
+		ret = vidioc_expbuf(static_cast<struct v4l2_exportbuffer *>(arg));
+		break;
 	case VIDIOC_STREAMON:
 		ret = vidioc_streamon(static_cast<int *>(arg));
 		break;
@@ -26,6 +26,7 @@ public:
 	V4L2CameraProxy(unsigned int index, std::shared_ptr<Camera> camera);
 
 	int open(bool nonBlocking);
+	void bind(int fd);
 	void dup();
 	void close();
 	void *mmap(void *addr, size_t length, int prot, int flags, off_t offset);
@@ -52,6 +53,7 @@ private:
 	int vidioc_querybuf(struct v4l2_buffer *arg);
 	int vidioc_qbuf(struct v4l2_buffer *arg);
 	int vidioc_dqbuf(struct v4l2_buffer *arg);
+	int vidioc_expbuf(struct v4l2_exportbuffer *arg);
 	int vidioc_streamon(int *arg);
 	int vidioc_streamoff(int *arg);
 
@@ -65,11 +67,13 @@ private:
 	unsigned int refcount_;
 	unsigned int index_;
 	bool nonBlocking_;
+	int efd_;
 
 	struct v4l2_format curV4L2Format_;
 	StreamConfiguration streamConfig_;
 	struct v4l2_capability capabilities_;
 	unsigned int bufferCount_;
+	uint32_t memory_;
 	unsigned int currentBuf_;
 	unsigned int sizeimage_;
 
@@ -155,12 +155,18 @@ int V4L2CompatManager::openat(int dirfd, const char *path, int oflag, mode_t mod
 	if (ret < 0)
 		return ret;
 
-	int efd = eventfd(0, oflag & (O_CLOEXEC | O_NONBLOCK));
+	/*
+	 * The file descriptor returned to the application is an eventfd that
+	 * is signalled when buffers complete, with one count per buffer, to
+	 * support poll(), select() and epoll natively.
+	 */
+	int efd = eventfd(0, EFD_SEMAPHORE | (oflag & (O_CLOEXEC | O_NONBLOCK)));
 	if (efd < 0) {
 		proxy->close();
 		return efd;
 	}
 
+	proxy->bind(efd);
 	devices_.emplace(efd, proxy);
 
 	return efd;
@@ -188,7 +194,6 @@ int V4L2CompatManager::close(int fd)
 	if (proxy) {
 		proxy->close();
 		devices_.erase(fd);
-		return 0;
 	}
 
 	return fops_.close(fd);
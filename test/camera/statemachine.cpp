@@ -42,6 +42,12 @@ protected:
 		if (camera_->stop() != -EACCES)
 			return TestFail;
 
+		if (camera_->pause() != -EACCES)
+			return TestFail;
+
+		if (camera_->resume() != -EACCES)
+			return TestFail;
+
 		/* Test operations which should pass. */
 		if (camera_->release())
 			return TestFail;
@@ -72,6 +78,12 @@ protected:
 		if (camera_->stop() != -EACCES)
 			return TestFail;
 
+		if (camera_->pause() != -EACCES)
+			return TestFail;
+
+		if (camera_->resume() != -EACCES)
+			return TestFail;
+
 		/* Test valid state transitions, end in Configured state. */
 		if (camera_->release())
 			return TestFail;
@@ -98,6 +110,12 @@ protected:
 		if (camera_->stop() != -EACCES)
 			return TestFail;
 
+		if (camera_->pause() != -EACCES)
+			return TestFail;
+
+		if (camera_->resume() != -EACCES)
+			return TestFail;
+
 		/* Test operations which should pass. */
 		Request *request2 = camera_->createRequest();
 		if (!request2)
@@ -143,6 +161,9 @@ protected:
 		if (camera_->start() != -EACCES)
 			return TestFail;
 
+		if (camera_->resume() != -EACCES)
+			return TestFail;
+
 		/* Test operations which should pass. */
 		Request *request = camera_->createRequest();
 		if (!request)
@@ -155,6 +176,57 @@ protected:
 		if (camera_->queueRequest(request))
 			return TestFail;
 
+		/* Test valid state transitions, end in Paused state. */
+		if (camera_->stop())
+			return TestFail;
+
+		if (camera_->start())
+			return TestFail;
+
+		if (camera_->pause())
+			return TestFail;
+
+		return TestPass;
+	}
+
+	int testPaused()
+	{
+		/* Test operations which should fail. */
+		if (camera_->acquire() != -EBUSY)
+			return TestFail;
+
+		if (camera_->release() != -EBUSY)
+			return TestFail;
+
+		if (camera_->configure(defconf_.get()) != -EACCES)
+			return TestFail;
+
+		if (camera_->start() != -EACCES)
+			return TestFail;
+
+		if (camera_->pause() != -EACCES)
+			return TestFail;
+
+		/* Test operations which should pass. */
+		Stream *stream = *camera_->streams().begin();
+		for (unsigned int i = 0; i < 2; ++i) {
+			Request *request = camera_->createRequest();
+			if (!request)
+				return TestFail;
+
+			if (request->addBuffer(stream, allocator_->buffers(stream)[i].get()))
+				return TestFail;
+
+			if (camera_->queueRequest(request))
+				return TestFail;
+
+			/* Resume once, to queue the held request. */
+			if (i == 0) {
+				if (camera_->resume() || camera_->pause())
+					return TestFail;
+			}
+		}
+
 		/* Test valid state transitions, end in Available state. */
 		if (camera_->stop())
 			return TestFail;
@@ -203,6 +275,11 @@ protected:
 			return TestFail;
 		}
 
+		if (testPaused() != TestPass) {
+			cout << "State machine in Paused state failed" << endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 
@@ -0,0 +1,169 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * capture-file.cpp - Capture file writer and reader tests
+ */
+
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#include <libcamera/capture_file.h>
+#include <libcamera/control_ids.h>
+
+#include "libcamera/internal/capture_file_format.h"
+#include "libcamera/internal/file.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+class CaptureFileTest : public Test
+{
+protected:
+	int init()
+	{
+		fileName_ = "/tmp/libcamera.test.XXXXXX";
+		int fd = mkstemp(&fileName_.front());
+		if (fd == -1)
+			return TestFail;
+
+		close(fd);
+
+		return TestPass;
+	}
+
+	int write()
+	{
+		CaptureFileWriter writer;
+
+		if (writer.open(fileName_) < 0) {
+			cerr << "Failed to create capture file" << endl;
+			return TestFail;
+		}
+
+		StreamConfiguration config;
+		config.pixelFormat = PixelFormat(0x30314742); /* BG10 */
+		config.size = Size(64, 16);
+		config.stride = 128;
+
+		for (unsigned int i = 0; i < numFrames_; ++i) {
+			FrameMetadata metadata;
+			metadata.sequence = i;
+			metadata.timestamp = 1000000ULL * i;
+
+			ControlList controls(controls::controls);
+			controls.set(controls::ExposureTime, 1000 + i);
+
+			std::vector<uint8_t> data(config.stride * config.size.height, i);
+			std::vector<Span<const uint8_t>> planes{ { data.data(), data.size() } };
+
+			if (writer.write(i % 2, config, metadata, planes, controls) < 0) {
+				cerr << "Failed to write frame " << i << endl;
+				return TestFail;
+			}
+		}
+
+		if (writer.close() < 0) {
+			cerr << "Failed to close capture file" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int read()
+	{
+		CaptureFileReader reader;
+
+		if (reader.open(fileName_) < 0) {
+			cerr << "Failed to open capture file" << endl;
+			return TestFail;
+		}
+
+		const std::vector<CaptureFileFrame> &frames = reader.frames();
+		if (frames.size() != numFrames_) {
+			cerr << "Invalid number of frames " << frames.size()
+			     << endl;
+			return TestFail;
+		}
+
+		for (unsigned int i = 0; i < numFrames_; ++i) {
+			const CaptureFileFrame &frame = frames[i];
+
+			if (frame.stream != i % 2 || frame.sequence != i ||
+			    frame.timestamp != 1000000ULL * i ||
+			    frame.pixelFormat != PixelFormat(0x30314742) ||
+			    frame.size != Size(64, 16) || frame.stride != 128) {
+				cerr << "Invalid frame " << i << " information"
+				     << endl;
+				return TestFail;
+			}
+
+			if (frame.planes.size() != 1 ||
+			    frame.planes[0].size() != 128 * 16 ||
+			    frame.planes[0][0] != i ||
+			    frame.planes[0][128 * 16 - 1] != i) {
+				cerr << "Invalid frame " << i << " data" << endl;
+				return TestFail;
+			}
+
+			ControlList controls = reader.metadata(frame);
+			if (!controls.contains(controls::ExposureTime) ||
+			    controls.get(controls::ExposureTime) !=
+			    static_cast<int32_t>(1000 + i)) {
+				cerr << "Invalid frame " << i << " metadata" << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		int ret = write();
+		if (ret != TestPass)
+			return ret;
+
+		ret = read();
+		if (ret != TestPass)
+			return ret;
+
+		/*
+		 * Drop the index from the header to simulate an interrupted
+		 * capture, and verify that the frames are recovered.
+		 */
+		File file(fileName_);
+		if (!file.open(File::ReadWrite)) {
+			cerr << "Failed to reopen capture file" << endl;
+			return TestFail;
+		}
+
+		Span<uint8_t> data = file.map();
+		struct capture_file_header *header =
+			reinterpret_cast<struct capture_file_header *>(data.data());
+		header->index_offset = 0;
+		header->num_frames = 0;
+		file.unmap(data.data());
+		file.close();
+
+		return read();
+	}
+
+	void cleanup()
+	{
+		unlink(fileName_.c_str());
+	}
+
+private:
+	static constexpr unsigned int numFrames_ = 5;
+
+	std::string fileName_;
+};
+
+TEST_REGISTER(CaptureFileTest)
@@ -0,0 +1,296 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * delayed-controls-emulated.cpp - Delayed controls tests on an emulated device
+ */
+
+#include <algorithm>
+#include <errno.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <iostream>
+#include <map>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+#include <vector>
+
+#include <linux/videodev2.h>
+
+#include "libcamera/internal/delayed_controls.h"
+#include "libcamera/internal/v4l2_device.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+/*
+ * A V4L2 device exposing integer controls, emulated without any kernel driver.
+ * The device node is /dev/null, and the ioctls issued on it are handled by the
+ * ioctl() function below instead of reaching the kernel. The values written to
+ * the device are recorded along with the frame they have been written in.
+ */
+class EmulatedDevice : public V4L2Device
+{
+public:
+	struct Write {
+		unsigned int frame;
+		uint32_t id;
+		int32_t value;
+	};
+
+	EmulatedDevice(const vector<uint32_t> &ids)
+		: V4L2Device("/dev/null"), frame_(0)
+	{
+		for (uint32_t id : ids)
+			values_[id] = 0;
+
+		current = this;
+	}
+
+	~EmulatedDevice()
+	{
+		current = nullptr;
+	}
+
+	int open()
+	{
+		return V4L2Device::open(O_RDWR);
+	}
+
+	void setFrame(unsigned int frame) { frame_ = frame; }
+	int32_t value(uint32_t id) { return values_[id]; }
+
+	vector<Write> writes;
+
+	static EmulatedDevice *current;
+
+	int handleIoctl(unsigned long request, void *argp)
+	{
+		switch (request) {
+		case VIDIOC_QUERY_EXT_CTRL:
+			return queryControl(static_cast<v4l2_query_ext_ctrl *>(argp));
+
+		case VIDIOC_G_EXT_CTRLS: {
+			v4l2_ext_controls *ctrls = static_cast<v4l2_ext_controls *>(argp);
+			for (unsigned int i = 0; i < ctrls->count; ++i)
+				ctrls->controls[i].value = values_[ctrls->controls[i].id];
+			return 0;
+		}
+
+		case VIDIOC_S_EXT_CTRLS: {
+			v4l2_ext_controls *ctrls = static_cast<v4l2_ext_controls *>(argp);
+			for (unsigned int i = 0; i < ctrls->count; ++i) {
+				const v4l2_ext_control &ctrl = ctrls->controls[i];
+				values_[ctrl.id] = ctrl.value;
+				writes.push_back({ frame_, ctrl.id, ctrl.value });
+			}
+			return 0;
+		}
+
+		default:
+			return -ENOTTY;
+		}
+	}
+
+protected:
+	std::string logPrefix() const override { return "Emulated"; }
+
+private:
+	int queryControl(v4l2_query_ext_ctrl *ctrl)
+	{
+		uint32_t id = ctrl->id & ~(V4L2_CTRL_FLAG_NEXT_CTRL |
+					   V4L2_CTRL_FLAG_NEXT_COMPOUND);
+		auto it = values_.upper_bound(id);
+		if (it == values_.end())
+			return -EINVAL;
+
+		memset(ctrl, 0, sizeof(*ctrl));
+		ctrl->id = it->first;
+		ctrl->type = V4L2_CTRL_TYPE_INTEGER;
+		snprintf(ctrl->name, sizeof(ctrl->name), "Control %u", it->first);
+		ctrl->minimum = 0;
+		ctrl->maximum = 1000;
+		ctrl->step = 1;
+		ctrl->elem_size = sizeof(int32_t);
+		ctrl->elems = 1;
+
+		return 0;
+	}
+
+	map<uint32_t, int32_t> values_;
+	unsigned int frame_;
+};
+
+EmulatedDevice *EmulatedDevice::current = nullptr;
+
+/*
+ * Interpose the C library ioctl() to route the ioctls issued on /dev/null to
+ * the emulated device, and forward all others to the kernel.
+ */
+int ioctl(int fd, unsigned long request, ...) __THROW
+{
+	va_list ap;
+	va_start(ap, request);
+	void *argp = va_arg(ap, void *);
+	va_end(ap);
+
+	struct stat st;
+	if (EmulatedDevice::current && !fstat(fd, &st) && S_ISCHR(st.st_mode) &&
+	    st.st_rdev == makedev(1, 3)) {
+		int ret = EmulatedDevice::current->handleIoctl(request, argp);
+		if (ret < 0) {
+			errno = -ret;
+			return -1;
+		}
+
+		return 0;
+	}
+
+	return syscall(SYS_ioctl, fd, request, argp);
+}
+
+class DelayedControlsEmulatedTest : public Test
+{
+protected:
+	/*
+	 * Controls with different delays pushed for the same frame must be
+	 * written early enough to all take effect on that frame.
+	 */
+	int mixedDelays()
+	{
+		EmulatedDevice device({ V4L2_CID_EXPOSURE, V4L2_CID_ANALOGUE_GAIN });
+		if (device.open()) {
+			cerr << "Failed to open emulated device" << endl;
+			return TestFail;
+		}
+
+		DelayedControls delayed(&device, { { V4L2_CID_EXPOSURE, 2 },
+						   { V4L2_CID_ANALOGUE_GAIN, 1 } });
+		delayed.reset();
+
+		constexpr unsigned int numFrames = 10;
+
+		for (unsigned int frame = 0; frame < numFrames; ++frame) {
+			ControlList ctrls(device.controls());
+			ctrls.set(V4L2_CID_EXPOSURE, static_cast<int32_t>(100 + frame));
+			ctrls.set(V4L2_CID_ANALOGUE_GAIN, static_cast<int32_t>(200 + frame));
+			if (!delayed.push(ctrls)) {
+				cerr << "Failed to push controls for frame "
+				     << frame << endl;
+				return TestFail;
+			}
+
+			device.setFrame(frame);
+			delayed.applyControls(frame);
+		}
+
+		/* Keep frames coming after the queue has run dry. */
+		for (unsigned int frame = numFrames; frame < numFrames + 4; ++frame) {
+			device.setFrame(frame);
+			delayed.applyControls(frame);
+		}
+
+		/*
+		 * The exposure, with the largest delay, is written in the frame
+		 * it has been pushed for, and the gain one frame later.
+		 */
+		for (const EmulatedDevice::Write &write : device.writes) {
+			unsigned int frame = write.id == V4L2_CID_EXPOSURE
+					   ? write.value - 100
+					   : write.value - 200 + 1;
+			if (write.frame != frame) {
+				cerr << "Control " << write.id << " set to "
+				     << write.value << " in frame " << write.frame
+				     << ", expected " << frame << endl;
+				return TestFail;
+			}
+		}
+
+		if (device.writes.size() != numFrames * 2) {
+			cerr << "Invalid number of writes " << device.writes.size()
+			     << endl;
+			return TestFail;
+		}
+
+		/*
+		 * All controls pushed for frame N take effect in frame N + 2,
+		 * the initial values before, and the last ones after the queue
+		 * has run dry.
+		 */
+		for (unsigned int frame = 0; frame < numFrames + 4; ++frame) {
+			ControlList ctrls = delayed.get(frame);
+			int32_t exposure = 0;
+			int32_t gain = 0;
+
+			if (frame >= 2) {
+				unsigned int pushed = std::min(frame - 2, numFrames - 1);
+				exposure = 100 + pushed;
+				gain = 200 + pushed;
+			}
+
+			if (ctrls.get(V4L2_CID_EXPOSURE).get<int32_t>() != exposure ||
+			    ctrls.get(V4L2_CID_ANALOGUE_GAIN).get<int32_t>() != gain) {
+				cerr << "Invalid controls in effect for frame "
+				     << frame << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+	/*
+	 * Delays that don't fit in the history must not prevent the queue from
+	 * being filled when it runs dry.
+	 */
+	int largeDelay()
+	{
+		EmulatedDevice device({ V4L2_CID_BRIGHTNESS, V4L2_CID_CONTRAST });
+		if (device.open()) {
+			cerr << "Failed to open emulated device" << endl;
+			return TestFail;
+		}
+
+		DelayedControls delayed(&device, { { V4L2_CID_BRIGHTNESS, 20 },
+						   { V4L2_CID_CONTRAST, 0 } });
+		delayed.reset();
+
+		ControlList ctrls(device.controls());
+		ctrls.set(V4L2_CID_BRIGHTNESS, 42);
+		if (!delayed.push(ctrls)) {
+			cerr << "Failed to push controls with a large delay" << endl;
+			return TestFail;
+		}
+
+		for (unsigned int frame = 0; frame < 40; ++frame) {
+			device.setFrame(frame);
+			delayed.applyControls(frame);
+		}
+
+		if (device.value(V4L2_CID_BRIGHTNESS) != 42) {
+			cerr << "Control with a large delay not applied" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		int ret = mixedDelays();
+		if (ret != TestPass)
+			return ret;
+
+		return largeDelay();
+	}
+};
+
+TEST_REGISTER(DelayedControlsEmulatedTest);
@@ -0,0 +1,280 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Raspberry Pi (Trading) Ltd.
+ *
+ * delayed-controls.cpp - Delayed controls tests
+ */
+
+#include <iostream>
+
+#include <linux/videodev2.h>
+
+#include "libcamera/internal/camera_sensor.h"
+#include "libcamera/internal/delayed_controls.h"
+#include "libcamera/internal/device_enumerator.h"
+#include "libcamera/internal/media_device.h"
+#include "libcamera/internal/v4l2_subdevice.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+class DelayedControlsTest : public Test
+{
+protected:
+	int init() override
+	{
+		enumerator_ = DeviceEnumerator::create();
+		if (!enumerator_) {
+			cerr << "Failed to create device enumerator" << endl;
+			return TestFail;
+		}
+
+		if (enumerator_->enumerate()) {
+			cerr << "Failed to enumerate media devices" << endl;
+			return TestFail;
+		}
+
+		DeviceMatch dm("vimc");
+		media_ = enumerator_->search(dm);
+		if (!media_) {
+			cerr << "Unable to find \'vimc\' media device node" << endl;
+			return TestSkip;
+		}
+
+		MediaEntity *entity = media_->getEntityByName("Sensor A");
+		if (!entity) {
+			cerr << "Unable to find media entity 'Sensor A'" << endl;
+			return TestFail;
+		}
+
+		sensor_ = make_unique<CameraSensor>(entity);
+		if (sensor_->init() < 0) {
+			cerr << "Unable to initialise camera sensor" << endl;
+			return TestFail;
+		}
+
+		const ControlInfoMap &infoMap = sensor_->controls();
+		if (infoMap.find(V4L2_CID_BRIGHTNESS) == infoMap.end() ||
+		    infoMap.find(V4L2_CID_CONTRAST) == infoMap.end()) {
+			cerr << "Sensor doesn't expose brightness and contrast"
+			     << endl;
+			return TestSkip;
+		}
+
+		return TestPass;
+	}
+
+	/* Set the initial values on the device, before reset(). */
+	int setInitial(int32_t value)
+	{
+		ControlList ctrls(sensor_->controls());
+		ctrls.set(V4L2_CID_BRIGHTNESS, value);
+		ctrls.set(V4L2_CID_CONTRAST, value);
+		return sensor_->setControls(&ctrls);
+	}
+
+	int32_t deviceValue(uint32_t id)
+	{
+		ControlList ctrls = sensor_->getControls({ id });
+		return ctrls.get(id).get<int32_t>();
+	}
+
+	int singleControlNoDelay()
+	{
+		std::unordered_map<uint32_t, unsigned int> delays = {
+			{ V4L2_CID_BRIGHTNESS, 0 },
+		};
+		DelayedControls delayed(sensor_->device(), delays);
+
+		if (setInitial(100))
+			return TestFail;
+		delayed.reset();
+
+		for (uint32_t frame = 0; frame < 10; frame++) {
+			int32_t value = 110 + frame;
+
+			ControlList ctrls(sensor_->controls());
+			ctrls.set(V4L2_CID_BRIGHTNESS, value);
+			if (!delayed.push(ctrls)) {
+				cerr << "Failed to push controls" << endl;
+				return TestFail;
+			}
+
+			delayed.applyControls(frame);
+
+			ControlList result = delayed.get(frame);
+			int32_t brightness = result.get(V4L2_CID_BRIGHTNESS).get<int32_t>();
+			if (brightness != value || deviceValue(V4L2_CID_BRIGHTNESS) != value) {
+				cerr << "Failed single control without delay"
+				     << " frame " << frame
+				     << " expected " << value
+				     << " got " << brightness << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+	int singleControlWithDelay()
+	{
+		std::unordered_map<uint32_t, unsigned int> delays = {
+			{ V4L2_CID_BRIGHTNESS, 1 },
+		};
+		DelayedControls delayed(sensor_->device(), delays);
+
+		if (setInitial(100))
+			return TestFail;
+		delayed.reset();
+
+		/* Sequence numbers don't have to start from 0. */
+		for (uint32_t frame = 5; frame < 15; frame++) {
+			int32_t value = 110 + frame;
+
+			ControlList ctrls(sensor_->controls());
+			ctrls.set(V4L2_CID_BRIGHTNESS, value);
+			delayed.push(ctrls);
+
+			delayed.applyControls(frame);
+
+			/* The value written in a frame takes effect in the next. */
+			int32_t expected = frame == 5 ? 100 : value - 1;
+			ControlList result = delayed.get(frame);
+			int32_t brightness = result.get(V4L2_CID_BRIGHTNESS).get<int32_t>();
+			if (brightness != expected) {
+				cerr << "Failed single control with delay"
+				     << " frame " << frame
+				     << " expected " << expected
+				     << " got " << brightness << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+	int dualControlsWithDelay()
+	{
+		std::unordered_map<uint32_t, unsigned int> delays = {
+			{ V4L2_CID_BRIGHTNESS, 1 },
+			{ V4L2_CID_CONTRAST, 2 },
+		};
+		DelayedControls delayed(sensor_->device(), delays);
+
+		if (setInitial(100))
+			return TestFail;
+		delayed.reset();
+
+		for (uint32_t frame = 0; frame < 10; frame++) {
+			int32_t value = 110 + frame;
+
+			ControlList ctrls(sensor_->controls());
+			ctrls.set(V4L2_CID_BRIGHTNESS, value);
+			ctrls.set(V4L2_CID_CONTRAST, value);
+			delayed.push(ctrls);
+
+			delayed.applyControls(frame);
+
+			/*
+			 * The control with the largest delay is written
+			 * straight away, the other one a frame later, so that
+			 * both take effect on the same frame.
+			 */
+			int32_t expectedBrightness = frame < 1 ? 100 : value - 1;
+			if (deviceValue(V4L2_CID_BRIGHTNESS) != expectedBrightness ||
+			    deviceValue(V4L2_CID_CONTRAST) != value) {
+				cerr << "Failed dual controls write"
+				     << " frame " << frame << endl;
+				return TestFail;
+			}
+
+			int32_t expected = frame < 2 ? 100 : value - 2;
+			ControlList result = delayed.get(frame);
+			int32_t brightness = result.get(V4L2_CID_BRIGHTNESS).get<int32_t>();
+			int32_t contrast = result.get(V4L2_CID_CONTRAST).get<int32_t>();
+			if (brightness != expected || contrast != expected) {
+				cerr << "Failed dual controls"
+				     << " frame " << frame
+				     << " expected " << expected
+				     << " got " << brightness << " and " << contrast
+				     << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+	int dualControlsMultiQueue()
+	{
+		std::unordered_map<uint32_t, unsigned int> delays = {
+			{ V4L2_CID_BRIGHTNESS, 1 },
+			{ V4L2_CID_CONTRAST, 2 },
+		};
+		DelayedControls delayed(sensor_->device(), delays);
+
+		if (setInitial(100))
+			return TestFail;
+		delayed.reset();
+
+		/* Queue several frames ahead, then let the frames catch up. */
+		for (unsigned int i = 1; i <= 4; i++) {
+			ControlList ctrls(sensor_->controls());
+			ctrls.set(V4L2_CID_BRIGHTNESS, static_cast<int32_t>(100 + i));
+			ctrls.set(V4L2_CID_CONTRAST, static_cast<int32_t>(100 + i));
+			delayed.push(ctrls);
+		}
+
+		for (uint32_t frame = 0; frame < 10; frame++) {
+			delayed.applyControls(frame);
+
+			/* The last queued values stay in effect. */
+			int32_t expected = 100 + std::min<int32_t>(4, std::max<int32_t>(0, frame - 1));
+			ControlList result = delayed.get(frame);
+			int32_t brightness = result.get(V4L2_CID_BRIGHTNESS).get<int32_t>();
+			int32_t contrast = result.get(V4L2_CID_CONTRAST).get<int32_t>();
+			if (brightness != expected || contrast != expected) {
+				cerr << "Failed multi queue"
+				     << " frame " << frame
+				     << " expected " << expected
+				     << " got " << brightness << " and " << contrast
+				     << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		int ret;
+
+		ret = singleControlNoDelay();
+		if (ret)
+			return ret;
+
+		ret = singleControlWithDelay();
+		if (ret)
+			return ret;
+
+		ret = dualControlsWithDelay();
+		if (ret)
+			return ret;
+
+		ret = dualControlsMultiQueue();
+		if (ret)
+			return ret;
+
+		return TestPass;
+	}
+
+private:
+	std::unique_ptr<DeviceEnumerator> enumerator_;
+	std::shared_ptr<MediaDevice> media_;
+	std::unique_ptr<CameraSensor> sensor_;
+};
+
+TEST_REGISTER(DelayedControlsTest)
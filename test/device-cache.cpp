@@ -0,0 +1,121 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * device-cache.cpp - DeviceCache tests
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#include "libcamera/internal/device_cache.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+class DeviceCacheTest : public Test
+{
+protected:
+	int init()
+	{
+		char name[] = "/tmp/libcamera.test.XXXXXX";
+		if (!mkdtemp(name))
+			return TestFail;
+
+		directory_ = name;
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		const vector<uint8_t> data = { 1, 2, 3, 4, 5, 6, 7, 8 };
+		const vector<uint8_t> other = { 42 };
+
+		/* A cache without a directory is disabled. */
+		DeviceCache disabled("");
+		if (disabled.isEnabled() || disabled.store("key", data) != -ENODEV ||
+		    !disabled.load("key").empty()) {
+			cerr << "Disabled cache isn't disabled" << endl;
+			return TestFail;
+		}
+
+		DeviceCache cache(directory_);
+		if (!cache.isEnabled()) {
+			cerr << "Cache isn't enabled" << endl;
+			return TestFail;
+		}
+
+		if (!cache.load("key").empty()) {
+			cerr << "Empty cache returned data" << endl;
+			return TestFail;
+		}
+
+		/* Store and load back. */
+		if (cache.store("key", data) || cache.store("other key", other)) {
+			cerr << "Failed to store data" << endl;
+			return TestFail;
+		}
+
+		if (cache.load("key") != data || cache.load("other key") != other) {
+			cerr << "Loaded data doesn't match stored data" << endl;
+			return TestFail;
+		}
+
+		/* A new instance shares the same storage. */
+		DeviceCache cache2(directory_);
+		if (cache2.load("key") != data) {
+			cerr << "Data not persisted across instances" << endl;
+			return TestFail;
+		}
+
+		/* Replace data. */
+		if (cache.store("key", other) || cache.load("key") != other) {
+			cerr << "Failed to replace data" << endl;
+			return TestFail;
+		}
+
+		/* Empty data is valid. */
+		if (cache.store("empty", {}) || !cache.load("empty").empty()) {
+			cerr << "Failed to store empty data" << endl;
+			return TestFail;
+		}
+
+		/* The system key identifies the running kernel. */
+		if (DeviceCache::systemKey().empty()) {
+			cerr << "System key is empty" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	void cleanup()
+	{
+		DIR *dir = opendir(directory_.c_str());
+		if (dir) {
+			struct dirent *ent;
+			while ((ent = readdir(dir))) {
+				if (ent->d_name[0] == '.')
+					continue;
+				unlink((directory_ + "/" + ent->d_name).c_str());
+			}
+			closedir(dir);
+		}
+
+		rmdir(directory_.c_str());
+	}
+
+private:
+	string directory_;
+};
+
+TEST_REGISTER(DeviceCacheTest)
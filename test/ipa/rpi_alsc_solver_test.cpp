@@ -0,0 +1,207 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * rpi_alsc_solver_test.cpp - Raspberry Pi ALSC solver regression test
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdint.h>
+
+#include "rpi/alsc_solver.hpp"
+
+#include "test.h"
+
+using namespace std;
+using namespace RPi;
+
+namespace {
+
+constexpr int X = ALSC_CELLS_X;
+constexpr int Y = ALSC_CELLS_Y;
+constexpr int XY = X * Y;
+
+/* ALSC tuning of the IMX219 sensor. */
+constexpr double sigma = 0.00381;
+constexpr double omega = 1.3;
+constexpr int nIter = 100;
+constexpr double threshold = 1e-3;
+
+/*
+ * Maximum relative difference between the lambdas computed by the red-black
+ * single precision solver and by the reference solver. Both stop before full
+ * convergence, at about 11% of the converged solution, but from different
+ * directions, and were measured to differ by up to 2.2%.
+ */
+constexpr double tolerance = 0.025;
+
+/*
+ * Reference solver: symmetric Gauss-Seidel sweeps with over-relaxation in
+ * double precision, as used by the ALSC algorithm before the red-black solver.
+ */
+void constructM(const double C[XY], const double W[XY][4], double M[XY][4])
+{
+	const double epsilon = 0.001;
+
+	for (int i = 0; i < XY; i++) {
+		int m = !!(i >= X) + !!(i % X < X - 1) + !!(i < XY - X) + !!(i % X);
+		double diagonal = (epsilon + W[i][0] + W[i][1] + W[i][2] + W[i][3]) * C[i];
+
+		M[i][0] = i >= X ? (W[i][0] * C[i - X] + epsilon / m * C[i]) / diagonal : 0;
+		M[i][1] = i % X < X - 1 ? (W[i][1] * C[i + 1] + epsilon / m * C[i]) / diagonal : 0;
+		M[i][2] = i < XY - X ? (W[i][2] * C[i + X] + epsilon / m * C[i]) / diagonal : 0;
+		M[i][3] = i % X ? (W[i][3] * C[i - 1] + epsilon / m * C[i]) / diagonal : 0;
+	}
+}
+
+double computeLambda(int i, const double M[XY][4], const double lambda[XY])
+{
+	double l = 0;
+
+	if (i >= X)
+		l += M[i][0] * lambda[i - X];
+	if (i % X < X - 1)
+		l += M[i][1] * lambda[i + 1];
+	if (i < XY - X)
+		l += M[i][2] * lambda[i + X];
+	if (i % X)
+		l += M[i][3] * lambda[i - 1];
+
+	return l;
+}
+
+double gaussSeidel2SOR(const double M[XY][4], double lambda[XY])
+{
+	double oldLambda[XY];
+	std::copy(lambda, lambda + XY, oldLambda);
+
+	for (int i = 0; i < XY; i++)
+		lambda[i] = computeLambda(i, M, lambda);
+	for (int i = XY - 1; i >= 0; i--)
+		lambda[i] = computeLambda(i, M, lambda);
+
+	double maxDiff = 0;
+	for (int i = 0; i < XY; i++) {
+		lambda[i] = oldLambda[i] + (lambda[i] - oldLambda[i]) * omega;
+		maxDiff = std::max(maxDiff, std::abs(lambda[i] - oldLambda[i]));
+	}
+
+	return maxDiff;
+}
+
+void referenceIterations(const double C[XY], double lambda[XY],
+			 const double W[XY][4])
+{
+	double M[XY][4];
+	constructM(C, W, M);
+
+	for (int i = 0; i < nIter; i++) {
+		if (gaussSeidel2SOR(M, lambda) < threshold)
+			break;
+	}
+}
+
+void normalise(double lambda[XY])
+{
+	double minval = *std::min_element(lambda, lambda + XY);
+	for (int i = 0; i < XY; i++)
+		lambda[i] /= minval;
+}
+
+} /* namespace */
+
+/*
+ * Compare the ALSC solver with the reference solver it replaced, on colour
+ * statistics modelled on those of the bcm2835 ISP for a lens with radial
+ * colour shading: a per-field colour cast and radial falloff, an offset
+ * optical centre, zone noise, and a few zones without enough pixels to be
+ * used.
+ */
+class RPiAlscSolverTest : public Test
+{
+protected:
+	/* Deterministic pseudo-random numbers in [0, 1). */
+	double random()
+	{
+		seed_ = seed_ * 6364136223846793005ULL + 1442695040888963407ULL;
+		return (seed_ >> 11) * (1.0 / (1ULL << 53));
+	}
+
+	void generateStatistics(double C[XY])
+	{
+		double cast = 0.5 + random();
+		double falloff = 0.1 + 0.3 * random();
+		double cx = (X - 1) / 2.0 + (random() - 0.5) * 3;
+		double cy = (Y - 1) / 2.0 + (random() - 0.5) * 3;
+
+		for (int y = 0; y < Y; y++) {
+			for (int x = 0; x < X; x++) {
+				double dx = (x - cx) / X;
+				double dy = (y - cy) / X;
+				double r2 = 4 * (dx * dx + dy * dy);
+				double noise = 1 + (random() - 0.5) * 0.01;
+
+				C[y * X + x] = cast * (1 - falloff * r2) * noise;
+			}
+		}
+
+		unsigned int invalid = random() * 6;
+		for (unsigned int i = 0; i < invalid; i++)
+			C[static_cast<int>(random() * XY)] = ALSC_INSUFFICIENT_DATA;
+	}
+
+	int run()
+	{
+		constexpr unsigned int numFields = 200;
+		double worst = 0;
+
+		seed_ = 1;
+
+		for (unsigned int field = 0; field < numFields; field++) {
+			double C[XY], W[XY][4];
+			double lambda[XY], reference[XY];
+
+			generateStatistics(C);
+			alsc_compute_W(C, sigma, W);
+
+			std::fill(lambda, lambda + XY, 1.0);
+			std::fill(reference, reference + XY, 1.0);
+
+			alsc_run_matrix_iterations(C, lambda, W, omega, nIter,
+						   threshold);
+			referenceIterations(C, reference, W);
+
+			normalise(lambda);
+			normalise(reference);
+
+			for (int i = 0; i < XY; i++) {
+				if (!std::isfinite(lambda[i])) {
+					cerr << "Invalid lambda in field " << field
+					     << " zone " << i << endl;
+					return TestFail;
+				}
+
+				double diff = std::abs(lambda[i] / reference[i] - 1);
+				worst = std::max(worst, diff);
+			}
+		}
+
+		cout << "Largest difference with the reference solver: "
+		     << worst * 100 << "%" << endl;
+
+		if (worst > tolerance) {
+			cerr << "Solver differs from the reference by more than "
+			     << tolerance * 100 << "%" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+private:
+	uint64_t seed_;
+};
+
+TEST_REGISTER(RPiAlscSolverTest);
@@ -0,0 +1,168 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * rpi_tuning_file_test.cpp - Raspberry Pi binary tuning file test
+ */
+
+#include <iostream>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/property_tree/ptree.hpp>
+
+#include "tuning_file.hpp"
+
+#include "test.h"
+
+using namespace std;
+using namespace RPi;
+
+class RPiTuningFileTest : public Test
+{
+protected:
+	int init()
+	{
+		char dir[] = "/tmp/libcamera.tuning.XXXXXX";
+		if (!mkdtemp(dir)) {
+			cerr << "Failed to create temporary directory" << endl;
+			return TestFail;
+		}
+
+		dir_ = dir;
+		return TestPass;
+	}
+
+	/* Convert a JSON file to binary and check that it loads back the same. */
+	int testConvert(const string &name)
+	{
+		string json = string(RPI_TUNING_DATA_DIR) + "/" + name;
+		string binary = dir_ + "/" + name + ".bin";
+		boost::property_tree::ptree root;
+		boost::property_tree::ptree converted;
+		uint64_t hash;
+
+		ReadJsonTuningFile(json.c_str(), root, &hash);
+		if (root.empty()) {
+			cerr << "Failed to parse " << json << endl;
+			return TestFail;
+		}
+
+		if (!WriteBinaryTuningFile(binary.c_str(), root, hash)) {
+			cerr << "Failed to convert " << name << endl;
+			return TestFail;
+		}
+
+		if (!ReadBinaryTuningFile(binary.c_str(), converted, &hash) ||
+		    converted != root) {
+			cerr << "Converted " << name << " doesn't match" << endl;
+			return TestFail;
+		}
+
+		/* Binary files are also accepted by the generic loader. */
+		converted.clear();
+		ReadTuningFile(binary.c_str(), converted);
+		if (converted != root) {
+			cerr << "Converted " << name << " doesn't load" << endl;
+			return TestFail;
+		}
+
+		/* Binary files made from a different JSON file are stale. */
+		uint64_t other = hash + 1;
+		if (ReadBinaryTuningFile(binary.c_str(), converted, &other)) {
+			cerr << "Stale " << name << " accepted" << endl;
+			return TestFail;
+		}
+
+		unlink(binary.c_str());
+
+		return TestPass;
+	}
+
+	int testCache()
+	{
+		string json = string(RPI_TUNING_DATA_DIR) + "/imx219.json";
+		string cacheDir = dir_ + "/cache";
+		string cache = cacheDir + "/imx219.json.bin";
+		boost::property_tree::ptree root;
+		boost::property_tree::ptree cached;
+		struct stat st;
+
+		ReadJsonTuningFile(json.c_str(), root);
+
+		/* The cache is disabled by default. */
+		unsetenv("LIBCAMERA_RPI_TUNING_CACHE");
+		unsetenv("XDG_CACHE_HOME");
+		setenv("HOME", dir_.c_str(), 1);
+
+		ReadTuningFile(json.c_str(), cached);
+		if (cached != root) {
+			cerr << "Tuning file doesn't load" << endl;
+			return TestFail;
+		}
+
+		if (!stat((dir_ + "/.cache").c_str(), &st)) {
+			cerr << "Cache written while disabled" << endl;
+			return TestFail;
+		}
+
+		/* The first load fills the cache, the next one uses it. */
+		setenv("LIBCAMERA_RPI_TUNING_CACHE", cacheDir.c_str(), 1);
+
+		cached.clear();
+		ReadTuningFile(json.c_str(), cached);
+		if (cached != root || stat(cache.c_str(), &st)) {
+			cerr << "Tuning file not cached" << endl;
+			return TestFail;
+		}
+
+		cached.clear();
+		ReadTuningFile(json.c_str(), cached);
+		if (cached != root) {
+			cerr << "Cached tuning file doesn't match" << endl;
+			return TestFail;
+		}
+
+		unsetenv("LIBCAMERA_RPI_TUNING_CACHE");
+		unlink(cache.c_str());
+		rmdir(cacheDir.c_str());
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		const char *names[] = {
+			"imx219.json",
+			"imx477.json",
+			"ov5647.json",
+			"uncalibrated.json",
+		};
+
+		try {
+			for (const char *name : names) {
+				int ret = testConvert(name);
+				if (ret != TestPass)
+					return ret;
+			}
+
+			return testCache();
+		} catch (std::exception &e) {
+			cerr << e.what() << endl;
+			return TestFail;
+		}
+	}
+
+	void cleanup()
+	{
+		rmdir(dir_.c_str());
+	}
+
+private:
+	string dir_;
+};
+
+TEST_REGISTER(RPiTuningFileTest);
@@ -0,0 +1,316 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * replay_pipeline_test.cpp - Replay pipeline handler test
+ */
+
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include <linux/drm_fourcc.h>
+#include <linux/rkisp1-config.h>
+
+#include <libcamera/camera.h>
+#include <libcamera/camera_manager.h>
+#include <libcamera/capture_file.h>
+#include <libcamera/control_ids.h>
+#include <libcamera/event_dispatcher.h>
+#include <libcamera/framebuffer_allocator.h>
+#include <libcamera/request.h>
+#include <libcamera/timer.h>
+
+#include "libcamera/internal/utils.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+/*
+ * Record image frames and RkISP1 statistics to two separate capture files, as
+ * 'cam --record' and the RkISP1 pipeline handler do, replay them through the
+ * replay pipeline handler, and verify that the recorded images, the recorded
+ * frame intervals and the IPA metadata computed from the recorded statistics
+ * are delivered to the application.
+ */
+class ReplayPipelineTest : public Test
+{
+protected:
+	int init() override;
+	int run() override;
+	void cleanup() override;
+
+private:
+	static constexpr unsigned int numFrames = 3;
+	static constexpr uint64_t recordedStart = 1000000000000ULL;
+	static constexpr uint64_t frameInterval = 33333333;
+
+	int createFile(string *fileName);
+	int record();
+	uint64_t now() const;
+
+	void requestComplete(Request *request);
+
+	string imagesFile_;
+	string statsFile_;
+
+	CameraManager *cm_;
+	std::shared_ptr<Camera> camera_;
+
+	StreamConfiguration config_;
+	std::vector<FrameMetadata> completed_;
+	std::vector<uint8_t> contents_;
+	unsigned int errors_;
+};
+
+int ReplayPipelineTest::createFile(string *fileName)
+{
+	*fileName = "/tmp/libcamera.replay.XXXXXX";
+	int fd = mkstemp(&fileName->front());
+	if (fd == -1)
+		return -errno;
+
+	close(fd);
+
+	return 0;
+}
+
+uint64_t ReplayPipelineTest::now() const
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int ReplayPipelineTest::record()
+{
+	CaptureFileWriter images;
+	CaptureFileWriter stats;
+
+	if (images.open(imagesFile_) < 0 || stats.open(statsFile_) < 0) {
+		cerr << "Failed to create capture files" << endl;
+		return TestFail;
+	}
+
+	config_.pixelFormat = PixelFormat(DRM_FORMAT_NV12);
+	config_.size = Size(64, 32);
+	config_.stride = 64;
+
+	StreamConfiguration statsConfig;
+
+	/* Statistics that make the IPA report the exposure as locked. */
+	struct rkisp1_stat_buffer statsBuffer = {};
+	statsBuffer.meas_type = CIFISP_STAT_AUTOEXP;
+	for (unsigned int i = 0; i < CIFISP_AE_MEAN_MAX; ++i)
+		statsBuffer.params.ae.exp_mean[i] = 60;
+
+	for (unsigned int i = 0; i < numFrames; ++i) {
+		FrameMetadata metadata;
+		metadata.sequence = i;
+		metadata.timestamp = recordedStart + i * frameInterval;
+
+		std::vector<uint8_t> image(config_.stride * config_.size.height * 3 / 2,
+					   0x10 + i);
+		std::vector<Span<const uint8_t>> planes{ { image.data(), image.size() } };
+
+		if (images.write(0, config_, metadata, planes,
+				 ControlList(controls::controls)) < 0) {
+			cerr << "Failed to record image " << i << endl;
+			return TestFail;
+		}
+
+		const uint8_t *data = reinterpret_cast<const uint8_t *>(&statsBuffer);
+		planes = { { data, sizeof(statsBuffer) } };
+
+		if (stats.write(1, statsConfig, metadata, planes,
+				ControlList(controls::controls)) < 0) {
+			cerr << "Failed to record statistics " << i << endl;
+			return TestFail;
+		}
+	}
+
+	if (images.close() < 0 || stats.close() < 0) {
+		cerr << "Failed to close capture files" << endl;
+		return TestFail;
+	}
+
+	return TestPass;
+}
+
+int ReplayPipelineTest::init()
+{
+	cm_ = nullptr;
+
+	if (createFile(&imagesFile_) < 0 || createFile(&statsFile_) < 0)
+		return TestFail;
+
+	int ret = record();
+	if (ret != TestPass)
+		return ret;
+
+	string files = imagesFile_ + "," + statsFile_;
+	setenv("LIBCAMERA_REPLAY_FILES", files.c_str(), 1);
+
+	cm_ = new CameraManager();
+	if (cm_->start()) {
+		cerr << "Failed to start camera manager" << endl;
+		return TestFail;
+	}
+
+	string name = string("Replay ") + utils::basename(imagesFile_.c_str());
+	camera_ = cm_->get(name);
+	if (!camera_) {
+		/* The RkISP1 IPA module may not have been built. */
+		cerr << "Replay camera not found" << endl;
+		return TestSkip;
+	}
+
+	return TestPass;
+}
+
+void ReplayPipelineTest::requestComplete(Request *request)
+{
+	if (request->status() != Request::RequestComplete)
+		return;
+
+	FrameBuffer *buffer = request->buffers().begin()->second;
+	completed_.push_back(buffer->metadata());
+
+	if (!request->metadata().contains(controls::AeLocked) ||
+	    !request->metadata().get(controls::AeLocked))
+		errors_++;
+
+	const FrameBuffer::Plane &plane = buffer->planes()[0];
+	uint8_t value;
+	if (pread(plane.fd.fd(), &value, 1, 0) != 1)
+		value = 0;
+	contents_.push_back(value);
+
+	/* Replay the recording three times. */
+	if (completed_.size() >= numFrames * 3)
+		return;
+
+	Stream *stream = request->buffers().begin()->first;
+	request = camera_->createRequest();
+	request->addBuffer(stream, buffer);
+	camera_->queueRequest(request);
+}
+
+int ReplayPipelineTest::run()
+{
+	std::unique_ptr<CameraConfiguration> config =
+		camera_->generateConfiguration({ StreamRole::VideoRecording });
+	if (!config || config->size() != 1) {
+		cerr << "Failed to generate configuration" << endl;
+		return TestFail;
+	}
+
+	StreamConfiguration &cfg = config->at(0);
+	if (cfg.pixelFormat != config_.pixelFormat || cfg.size != config_.size) {
+		cerr << "Configuration doesn't match the recording" << endl;
+		return TestFail;
+	}
+
+	if (camera_->acquire() || camera_->configure(config.get())) {
+		cerr << "Failed to configure camera" << endl;
+		return TestFail;
+	}
+
+	Stream *stream = cfg.stream();
+	FrameBufferAllocator allocator(camera_);
+	if (allocator.allocate(stream) < 0) {
+		cerr << "Failed to allocate buffers" << endl;
+		return TestFail;
+	}
+
+	errors_ = 0;
+	camera_->requestCompleted.connect(this, &ReplayPipelineTest::requestComplete);
+
+	uint64_t startTime = now();
+
+	if (camera_->start()) {
+		cerr << "Failed to start camera" << endl;
+		return TestFail;
+	}
+
+	for (const std::unique_ptr<FrameBuffer> &buffer : allocator.buffers(stream)) {
+		Request *request = camera_->createRequest();
+		request->addBuffer(stream, buffer.get());
+		if (camera_->queueRequest(request)) {
+			cerr << "Failed to queue request" << endl;
+			return TestFail;
+		}
+	}
+
+	EventDispatcher *dispatcher = cm_->eventDispatcher();
+
+	Timer timer;
+	timer.start(1000);
+	while (timer.isRunning())
+		dispatcher->processEvents();
+
+	camera_->stop();
+	camera_->release();
+
+	if (completed_.size() < numFrames * 3) {
+		cerr << "Failed to replay enough frames (got "
+		     << completed_.size() << ")" << endl;
+		return TestFail;
+	}
+
+	if (errors_) {
+		cerr << "Recorded statistics not processed by the IPA" << endl;
+		return TestFail;
+	}
+
+	/* Recordings are looped over. */
+	for (unsigned int i = 0; i < completed_.size(); ++i) {
+		if (contents_[i] != 0x10 + i % numFrames) {
+			cerr << "Frame " << i << " doesn't match the recording"
+			     << endl;
+			return TestFail;
+		}
+	}
+
+	/*
+	 * Timestamps are rebased to the monotonic clock at start time, and
+	 * keep the recorded frame interval, including across loops.
+	 */
+	if (completed_[0].timestamp < startTime ||
+	    completed_[0].timestamp > now()) {
+		cerr << "Timestamp not rebased to the monotonic clock" << endl;
+		return TestFail;
+	}
+
+	for (unsigned int i = 1; i < completed_.size(); ++i) {
+		if (completed_[i].timestamp - completed_[i - 1].timestamp !=
+		    frameInterval) {
+			cerr << "Invalid frame interval for frame " << i << endl;
+			return TestFail;
+		}
+	}
+
+	return TestPass;
+}
+
+void ReplayPipelineTest::cleanup()
+{
+	camera_.reset();
+
+	if (cm_) {
+		cm_->stop();
+		delete cm_;
+	}
+
+	unsetenv("LIBCAMERA_REPLAY_FILES");
+	unlink(imagesFile_.c_str());
+	unlink(statsFile_.c_str());
+}
+
+TEST_REGISTER(ReplayPipelineTest);
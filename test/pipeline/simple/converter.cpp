@@ -0,0 +1,216 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * converter.cpp - Simple pipeline handler format converter test
+ */
+
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+#include <vector>
+
+#include <libcamera/buffer.h>
+#include <libcamera/event_dispatcher.h>
+#include <libcamera/stream.h>
+#include <libcamera/timer.h>
+
+#include "libcamera/internal/device_enumerator.h"
+#include "libcamera/internal/media_device.h"
+#include "libcamera/internal/thread.h"
+#include "libcamera/internal/v4l2_videodevice.h"
+
+#include "converter.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+/*
+ * Check that the converter keeps input and output buffers paired when an input
+ * buffer fails to be queued: the output buffer queued with it must not receive
+ * the result of the next conversion.
+ */
+class ConverterTest : public Test
+{
+protected:
+	void inputBufferReady(FrameBuffer *buffer)
+	{
+		inputs_.push_back(buffer);
+	}
+
+	void outputBufferReady(FrameBuffer *buffer)
+	{
+		outputs_.push_back(buffer);
+	}
+
+	bool waitForOutput(unsigned int count)
+	{
+		EventDispatcher *dispatcher = Thread::current()->eventDispatcher();
+
+		Timer timeout;
+		timeout.start(1000);
+		while (timeout.isRunning() && outputs_.size() < count)
+			dispatcher->processEvents();
+
+		return outputs_.size() >= count;
+	}
+
+	int init()
+	{
+		enumerator_ = DeviceEnumerator::create();
+		if (!enumerator_) {
+			cerr << "Failed to create device enumerator" << endl;
+			return TestFail;
+		}
+
+		if (enumerator_->enumerate()) {
+			cerr << "Failed to enumerate media devices" << endl;
+			return TestFail;
+		}
+
+		DeviceMatch dm("vim2m");
+		dm.add("vim2m-source");
+		dm.add("vim2m-sink");
+
+		media_ = enumerator_->search(dm);
+		if (!media_) {
+			cerr << "No vim2m device found" << endl;
+			return TestSkip;
+		}
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		constexpr unsigned int bufferCount = 4;
+
+		/* Use a second instance of the device to allocate input buffers. */
+		MediaEntity *entity = media_->getEntityByName("vim2m-source");
+		V4L2M2MDevice source(entity->deviceNode());
+		if (source.open()) {
+			cerr << "Failed to open vim2m device" << endl;
+			return TestFail;
+		}
+
+		V4L2DeviceFormat format = {};
+		if (source.capture()->getFormat(&format)) {
+			cerr << "Failed to get format" << endl;
+			return TestFail;
+		}
+
+		format.size = { 640, 480 };
+		if (source.capture()->setFormat(&format)) {
+			cerr << "Failed to set format" << endl;
+			return TestFail;
+		}
+
+		std::vector<std::unique_ptr<FrameBuffer>> inputBuffers;
+		if (source.capture()->exportBuffers(bufferCount, &inputBuffers) < 0) {
+			cerr << "Failed to allocate input buffers" << endl;
+			return TestFail;
+		}
+
+		StreamConfiguration inputCfg;
+		inputCfg.pixelFormat = format.fourcc.toPixelFormat();
+		inputCfg.size = format.size;
+		inputCfg.bufferCount = bufferCount;
+
+		StreamConfiguration outputCfg = inputCfg;
+
+		SimpleConverter converter(media_.get());
+		if (converter.open()) {
+			cerr << "Failed to open converter" << endl;
+			return TestFail;
+		}
+
+		if (converter.configure(inputCfg, { outputCfg })) {
+			cerr << "Failed to configure converter" << endl;
+			return TestFail;
+		}
+
+		std::vector<std::unique_ptr<FrameBuffer>> outputBuffers;
+		if (converter.exportBuffers(0, bufferCount, &outputBuffers) < 0) {
+			cerr << "Failed to allocate output buffers" << endl;
+			return TestFail;
+		}
+
+		converter.inputBufferReady.connect(this, &ConverterTest::inputBufferReady);
+		converter.outputBufferReady.connect(this, &ConverterTest::outputBufferReady);
+
+		if (converter.start()) {
+			cerr << "Failed to start converter" << endl;
+			return TestFail;
+		}
+
+		/* A regular conversion. */
+		FrameBuffer *output = outputBuffers[0].get();
+		if (converter.queueBuffers(inputBuffers[0].get(), { { 0, output } }) ||
+		    !waitForOutput(1) || outputs_[0] != output ||
+		    output->metadata().status != FrameMetadata::FrameSuccess) {
+			cerr << "Failed to convert frame" << endl;
+			return TestFail;
+		}
+
+		/* An input buffer that can't be queued, as it's not a dmabuf. */
+		int fd = open("/dev/null", O_RDWR);
+		FrameBuffer::Plane plane;
+		plane.fd = FileDescriptor(fd);
+		plane.length = inputBuffers[0]->planes()[0].length;
+		close(fd);
+
+		FrameBuffer invalid({ plane });
+		FrameBuffer *failed = outputBuffers[1].get();
+
+		if (!converter.queueBuffers(&invalid, { { 0, failed } })) {
+			cerr << "Invalid input buffer queued" << endl;
+			converter.stop();
+			return TestFail;
+		}
+
+		/*
+		 * The next conversion must be written to its own output buffer,
+		 * and the failed output buffer must not be completed.
+		 */
+		output = outputBuffers[2].get();
+		if (converter.queueBuffers(inputBuffers[1].get(), { { 0, output } }) ||
+		    !waitForOutput(2)) {
+			cerr << "Failed to convert frame after an error" << endl;
+			converter.stop();
+			return TestFail;
+		}
+
+		converter.stop();
+
+		if (outputs_[1] != output) {
+			cerr << "Input and output buffers out of sync" << endl;
+			return TestFail;
+		}
+
+		for (FrameBuffer *buffer : outputs_) {
+			if (buffer == failed) {
+				cerr << "Failed output buffer completed" << endl;
+				return TestFail;
+			}
+		}
+
+		if (inputs_.size() != 2 || inputs_[0] != inputBuffers[0].get() ||
+		    inputs_[1] != inputBuffers[1].get()) {
+			cerr << "Input buffers not handed back" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+private:
+	std::unique_ptr<DeviceEnumerator> enumerator_;
+	std::shared_ptr<MediaDevice> media_;
+
+	std::vector<FrameBuffer *> inputs_;
+	std::vector<FrameBuffer *> outputs_;
+};
+
+TEST_REGISTER(ConverterTest);
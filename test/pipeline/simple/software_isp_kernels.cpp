@@ -0,0 +1,286 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * software_isp_kernels.cpp - Software ISP line processing kernels test
+ */
+
+#include <iostream>
+#include <stdint.h>
+#include <vector>
+
+#include "software_isp_kernels.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+using namespace libcamera::softisp;
+
+class SoftwareIspKernelsTest : public Test
+{
+protected:
+	int testUnpack()
+	{
+		uint16_t dst[4];
+
+		/* 8-bit samples. */
+		const uint8_t raw8[] = { 0x00, 0x01, 0x80, 0xff };
+		unpack8(raw8, dst, 4);
+		if (dst[0] != 0x00 || dst[1] != 0x01 || dst[2] != 0x80 ||
+		    dst[3] != 0xff) {
+			cerr << "Invalid 8-bit unpacking" << endl;
+			return TestFail;
+		}
+
+		/* 16-bit little-endian samples. */
+		const uint8_t raw16[] = { 0xff, 0x03, 0x00, 0x00,
+					  0x55, 0x01, 0xaa, 0x02 };
+		unpack16(raw16, dst, 4);
+		if (dst[0] != 0x3ff || dst[1] != 0x000 || dst[2] != 0x155 ||
+		    dst[3] != 0x2aa) {
+			cerr << "Invalid 16-bit unpacking" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * 0x3ff, 0x000, 0x155 and 0x2aa packed as CSI-2 10-bit: four
+		 * MSB bytes followed by the 2-bit LSBs of the four samples.
+		 */
+		const uint8_t raw10[] = { 0xff, 0x00, 0x55, 0xaa, 0x93 };
+		unpackCSI2P10(raw10, dst, 4);
+		if (dst[0] != 0x3ff || dst[1] != 0x000 || dst[2] != 0x155 ||
+		    dst[3] != 0x2aa) {
+			cerr << "Invalid CSI-2 10-bit unpacking" << endl;
+			return TestFail;
+		}
+
+		/* 0xfff, 0x123, 0x000 and 0x80f packed as CSI-2 12-bit. */
+		const uint8_t raw12[] = { 0xff, 0x12, 0x3f, 0x00, 0x80, 0xf0 };
+		unpackCSI2P12(raw12, dst, 4);
+		if (dst[0] != 0xfff || dst[1] != 0x123 || dst[2] != 0x000 ||
+		    dst[3] != 0x80f) {
+			cerr << "Invalid CSI-2 12-bit unpacking" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	/*
+	 * Create a padded line of Bayer samples for a flat field of colour
+	 * \a rgb, with the given phase.
+	 */
+	vector<uint16_t> bayerLine(const uint16_t rgb[3], bool greenFirst,
+				   bool redLine, unsigned int width)
+	{
+		vector<uint16_t> line(width + 2);
+		uint16_t colour = redLine ? rgb[0] : rgb[2];
+
+		for (unsigned int x = 0; x < width; ++x) {
+			bool green = (x & 1) != greenFirst;
+			line[x + 1] = green ? rgb[1] : colour;
+		}
+
+		/* Mirror the edges, preserving the Bayer phase. */
+		line[0] = line[2];
+		line[width + 1] = line[width - 1];
+
+		return line;
+	}
+
+	int testDebayer()
+	{
+		constexpr unsigned int width = 8;
+		const uint16_t rgb[3] = { 100, 200, 300 };
+
+		/*
+		 * A flat field must be reconstructed exactly for all four
+		 * Bayer phases. Lines above and below have the opposite phase.
+		 */
+		for (unsigned int phase = 0; phase < 4; ++phase) {
+			bool greenFirst = phase & 1;
+			bool redLine = phase & 2;
+
+			vector<uint16_t> curr = bayerLine(rgb, greenFirst, redLine, width);
+			vector<uint16_t> other = bayerLine(rgb, !greenFirst, !redLine, width);
+			vector<uint16_t> out(width * 3);
+
+			debayerFuncs[greenFirst][redLine](other.data() + 1,
+							  curr.data() + 1,
+							  other.data() + 1,
+							  out.data(), width);
+
+			for (unsigned int x = 0; x < width; ++x) {
+				if (out[x * 3] != rgb[0] || out[x * 3 + 1] != rgb[1] ||
+				    out[x * 3 + 2] != rgb[2]) {
+					cerr << "Invalid demosaicing for phase "
+					     << phase << " at " << x << ": "
+					     << out[x * 3] << "/" << out[x * 3 + 1]
+					     << "/" << out[x * 3 + 2] << endl;
+					return TestFail;
+				}
+			}
+		}
+
+		/*
+		 * A single red sample on a black RGGB field is interpolated
+		 * to half its value on the neighbouring green samples of the
+		 * same line.
+		 */
+		vector<uint16_t> curr(width + 2, 0);
+		vector<uint16_t> other(width + 2, 0);
+		vector<uint16_t> out(width * 3);
+
+		curr[1 + 2] = 400;
+		debayerFuncs[false][true](other.data() + 1, curr.data() + 1,
+					  other.data() + 1, out.data(), width);
+
+		if (out[2 * 3] != 400 || out[1 * 3] != 200 || out[3 * 3] != 200 ||
+		    out[0 * 3] != 0 || out[4 * 3] != 0) {
+			cerr << "Invalid red interpolation" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int testLuts()
+	{
+		constexpr unsigned int bits = 10;
+		constexpr unsigned int blackLevel = 64;
+
+		vector<uint8_t> gamma = gammaCurve();
+		if (gamma.size() != LinearMax + 1 || gamma[0] != 0 ||
+		    gamma[LinearMax] != 255) {
+			cerr << "Invalid gamma curve range" << endl;
+			return TestFail;
+		}
+
+		/* sRGB encodes 25% linear as 53.7%. */
+		if (gamma[(LinearMax + 1) / 4] != 137) {
+			cerr << "Invalid gamma curve value "
+			     << static_cast<unsigned int>(gamma[(LinearMax + 1) / 4])
+			     << endl;
+			return TestFail;
+		}
+
+		std::array<std::vector<uint8_t>, 3> lut;
+		buildLuts(bits, blackLevel, { 2.0, 1.0, 1.0 }, gamma, &lut);
+
+		for (unsigned int c = 0; c < 3; ++c) {
+			if (lut[c].size() != 1 << bits) {
+				cerr << "Invalid LUT size" << endl;
+				return TestFail;
+			}
+
+			/* Black level is clipped to 0, white to the maximum. */
+			if (lut[c][0] != 0 || lut[c][blackLevel] != 0 ||
+			    lut[c][(1 << bits) - 1] != 255) {
+				cerr << "Invalid LUT range for colour " << c << endl;
+				return TestFail;
+			}
+
+			for (unsigned int i = 1; i < 1 << bits; ++i) {
+				if (lut[c][i] < lut[c][i - 1]) {
+					cerr << "Invalid LUT value for colour "
+					     << c << " at " << i << endl;
+					return TestFail;
+				}
+			}
+		}
+
+		/*
+		 * Samples above mid-range saturate with a 2x gain, and map to
+		 * half of the linear range without gain.
+		 */
+		unsigned int mid = blackLevel + ((1 << bits) - 1 - blackLevel) / 2;
+		if (lut[0][mid + 1] != 255 ||
+		    lut[1][mid] < gamma[LinearMax / 2 - 2] ||
+		    lut[1][mid] > gamma[LinearMax / 2 + 2]) {
+			cerr << "Invalid white balance gain" << endl;
+			return TestFail;
+		}
+
+		/* Output components are stored at the format offsets. */
+		const OutputFormat argb8888{ 4, 2, 1, 0, 3 };
+		const uint16_t rgb[3] = { 1023, 64, 576 };
+		uint8_t dst[4] = {};
+
+		colourLine<4>(rgb, dst, 1, argb8888, lut);
+		if (dst[2] != 255 || dst[1] != 0 || dst[0] != lut[2][576] ||
+		    dst[3] != 0xff) {
+			cerr << "Invalid colour conversion" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int testStats()
+	{
+		constexpr unsigned int width = 16;
+		constexpr unsigned int bits = 10;
+		constexpr unsigned int blackLevel = 64;
+
+		/* A flat line of black level corrected colour 100/200/300. */
+		vector<uint16_t> rgb(width * 3);
+		for (unsigned int x = 0; x < width; ++x) {
+			rgb[x * 3 + 0] = 164;
+			rgb[x * 3 + 1] = 264;
+			rgb[x * 3 + 2] = 364;
+		}
+
+		/* Samples below the black level are clipped. */
+		rgb[0] = 0;
+
+		SoftwareIspStats stats = {};
+		gatherStats(rgb.data(), width, bits, blackLevel, &stats);
+
+		/* One sample every StatsStep pixels. */
+		unsigned int samples = width / StatsStep;
+		if (stats.samples != samples ||
+		    stats.sum[0] != 100 * (samples - 1) ||
+		    stats.sum[1] != 200 * samples ||
+		    stats.sum[2] != 300 * samples) {
+			cerr << "Invalid statistics sums" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * The luminance (R + 2G + B) / 4 is binned over the 10-bit
+		 * range in 64 bins of 16 values.
+		 */
+		unsigned int total = 0;
+		for (unsigned int i = 0; i < SoftwareIspStats::HistogramBins; ++i)
+			total += stats.histogram[i];
+
+		if (total != samples ||
+		    stats.histogram[(100 + 400 + 300) / 4 / 16] != samples - 1 ||
+		    stats.histogram[(0 + 400 + 300) / 4 / 16] != 1) {
+			cerr << "Invalid statistics histogram" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		int ret = testUnpack();
+		if (ret != TestPass)
+			return ret;
+
+		ret = testDebayer();
+		if (ret != TestPass)
+			return ret;
+
+		ret = testLuts();
+		if (ret != TestPass)
+			return ret;
+
+		return testStats();
+	}
+};
+
+TEST_REGISTER(SoftwareIspKernelsTest);
@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2020, Raspberry Pi (Trading) Limited
+ *
+ * rpi-tuning-convert.cpp - convert tuning files between JSON and binary form
+ */
+
+#include <stdint.h>
+
+#include <iostream>
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include "tuning_file.hpp"
+
+using namespace RPi;
+
+// A binary input is converted back to JSON (handy for checking what's in
+// it), anything else is taken to be JSON and converted to binary.
+int main(int argc, char *argv[])
+{
+	if (argc != 3) {
+		std::cerr << "Usage: " << argv[0] << " <input> <output>"
+			  << std::endl;
+		return 1;
+	}
+
+	boost::property_tree::ptree root;
+	try {
+		if (ReadBinaryTuningFile(argv[1], root)) {
+			boost::property_tree::write_json(argv[2], root);
+			return 0;
+		}
+		uint64_t hash;
+		ReadJsonTuningFile(argv[1], root, &hash);
+		if (!WriteBinaryTuningFile(argv[2], root, hash)) {
+			std::cerr << "Failed to write " << argv[2] << std::endl;
+			return 1;
+		}
+	} catch (std::exception &e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}